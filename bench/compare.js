@@ -0,0 +1,180 @@
+#!/usr/bin/env node
+// neoshell/bench/compare.js
+// Compares two benchmark result files (as written by `--out`) metric by metric.
+//
+// For every metric present in both files:
+//   delta  Hodges-Lehmann estimate of the shift (median of all pairwise
+//          head - base differences), absolute and relative to the base median
+//   CI     distribution-free confidence interval for that shift, from the
+//          same pairwise differences (the interval that inverts the test below)
+//   p      two-sided Mann-Whitney U test (normal approximation, tie-corrected)
+//
+// Lower is better for every metric (they are all times). A metric regresses
+// when the shift is significant (p < alpha) and larger than --threshold
+// percent of the base median; the exit status is 1 if any gated metric
+// regressed, so this can gate changes like a test run.
+//
+// Usage: node bench/compare.js <base.json> <head.json> [--threshold 5]
+//                              [--alpha 0.05] [--metric total ...]
+const fs = require('fs');
+
+const USAGE = 'Usage: compare.js <base.json> <head.json> [--threshold pct] [--alpha p] [--metric name ...]';
+
+// Unlike parseFloat, NaN for trailing junk ("5x") and for nothing at all.
+function toNumber(value) {
+    return value.trim() === '' ? NaN : Number(value);
+}
+
+function parseArgs(argv) {
+    const opts = { files: [], threshold: 5, alpha: 0.05, metrics: [] };
+    for (let i = 0; i < argv.length; i++) {
+        const a = argv[i];
+        if (!a.startsWith('--')) { opts.files.push(a); continue; }
+        const value = argv[++i];
+        if (value === undefined) throw new Error(`Missing value for ${a}\n${USAGE}`);
+        switch (a) {
+            case '--threshold': opts.threshold = toNumber(value); break;
+            case '--alpha': opts.alpha = toNumber(value); break;
+            case '--metric': opts.metrics.push(value); break;
+            default: throw new Error(`Unknown option: ${a}\n${USAGE}`);
+        }
+    }
+    if (opts.files.length !== 2) throw new Error(USAGE);
+    // A NaN would fail every comparison, and so pass every metric
+    if (!(Number.isFinite(opts.threshold) && opts.threshold >= 0)) throw new Error(`--threshold must be a percentage >= 0\n${USAGE}`);
+    if (!(opts.alpha > 0 && opts.alpha < 1)) throw new Error(`--alpha must be between 0 and 1\n${USAGE}`);
+    return opts;
+}
+
+// { metric: [values...] } from a results file.
+function loadSamples(file) {
+    const data = JSON.parse(fs.readFileSync(file, 'utf8'));
+    if (!Array.isArray(data.samples)) throw new Error(`${file}: no "samples" array`);
+    const byMetric = {};
+    for (const sample of data.samples) {
+        for (const [metric, value] of Object.entries(sample)) {
+            if (typeof value !== 'number' || !Number.isFinite(value)) continue;
+            (byMetric[metric] = byMetric[metric] || []).push(value);
+        }
+    }
+    return { name: data.benchmark || file, byMetric };
+}
+
+// --- Statistics ---
+
+function median(sorted) {
+    const n = sorted.length;
+    return n % 2 ? sorted[(n - 1) / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+// Standard normal CDF (Abramowitz & Stegun 26.2.17, |error| < 7.5e-8).
+function normCdf(z) {
+    const t = 1 / (1 + 0.2316419 * Math.abs(z));
+    const poly = t * (0.319381530 + t * (-0.356563782 + t * (1.781477937 + t * (-1.821255978 + t * 1.330274429))));
+    const tail = Math.exp(-z * z / 2) / Math.sqrt(2 * Math.PI) * poly;
+    return z >= 0 ? 1 - tail : tail;
+}
+
+// Inverse of normCdf by bisection; plenty fast for a handful of calls.
+function normQuantile(p) {
+    let lo = -10;
+    let hi = 10;
+    for (let i = 0; i < 100; i++) {
+        const mid = (lo + hi) / 2;
+        if (normCdf(mid) < p) lo = mid; else hi = mid;
+    }
+    return (lo + hi) / 2;
+}
+
+// Two-sided Mann-Whitney U test. Returns { u, p }.
+function mannWhitney(a, b) {
+    const all = a.map((v) => ({ v, g: 0 })).concat(b.map((v) => ({ v, g: 1 })));
+    all.sort((x, y) => x.v - y.v);
+    const n = all.length;
+    let rankSumA = 0;
+    let tieTerm = 0;
+    for (let i = 0; i < n;) {
+        let j = i;
+        while (j + 1 < n && all[j + 1].v === all[i].v) j++;
+        const rank = (i + j) / 2 + 1; // Average rank of the tie group
+        for (let k = i; k <= j; k++) if (all[k].g === 0) rankSumA += rank;
+        const t = j - i + 1;
+        tieTerm += t * t * t - t;
+        i = j + 1;
+    }
+    const n1 = a.length;
+    const n2 = b.length;
+    const u = rankSumA - (n1 * (n1 + 1)) / 2;
+    const mean = (n1 * n2) / 2;
+    const variance = ((n1 * n2) / 12) * (n + 1 - tieTerm / (n * (n - 1)));
+    if (variance <= 0) return { u, p: 1 }; // All values identical
+    const z = (Math.abs(u - mean) - 0.5) / Math.sqrt(variance); // Continuity correction
+    return { u, p: Math.min(1, 2 * (1 - normCdf(Math.max(0, z)))) };
+}
+
+// Hodges-Lehmann shift (head - base) with its distribution-free CI.
+function shiftEstimate(a, b, confidence) {
+    const diffs = [];
+    for (const x of a) for (const y of b) diffs.push(y - x);
+    diffs.sort((x, y) => x - y);
+    const n1 = a.length;
+    const n2 = b.length;
+    const m = diffs.length;
+    const z = normQuantile(1 - (1 - confidence) / 2);
+    let k = Math.floor((n1 * n2) / 2 - z * Math.sqrt((n1 * n2 * (n1 + n2 + 1)) / 12));
+    k = Math.max(1, Math.min(k, Math.ceil(m / 2)));
+    return { shift: median(diffs), lo: diffs[k - 1], hi: diffs[m - k] };
+}
+
+// --- Report ---
+
+function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    const base = loadSamples(opts.files[0]);
+    const head = loadSamples(opts.files[1]);
+    const metrics = opts.metrics.length ? opts.metrics : Object.keys(base.byMetric).filter((m) => head.byMetric[m]);
+    const confidence = 1 - opts.alpha;
+    const width = Math.max(12, ...metrics.map((m) => m.length + 2));
+
+    const pct = (v) => `${v >= 0 ? '+' : ''}${v.toFixed(1)}%`;
+    console.log(`base: ${opts.files[0]}\nhead: ${opts.files[1]}\n`);
+    console.log(`${'metric'.padEnd(width)}${'n'.padStart(9)}${'base p50'.padStart(11)}${'head p50'.padStart(11)}${'delta'.padStart(10)}  ${`${(confidence * 100).toFixed(0)}% CI`.padEnd(20)}${'p'.padStart(8)}  verdict`);
+    let regressions = 0;
+    for (const metric of metrics) {
+        const a = (base.byMetric[metric] || []).slice().sort((x, y) => x - y);
+        const b = (head.byMetric[metric] || []).slice().sort((x, y) => x - y);
+        if (a.length < 2 || b.length < 2) {
+            console.log(`${metric.padEnd(width)}  (not enough samples in both files)`);
+            continue;
+        }
+        const baseMedian = median(a);
+        const { shift, lo, hi } = shiftEstimate(a, b, confidence);
+        const { p } = mannWhitney(a, b);
+        const rel = (v) => (baseMedian !== 0 ? (v / baseMedian) * 100 : 0);
+        let verdict = 'no change';
+        if (p < opts.alpha) {
+            if (rel(shift) > opts.threshold) {
+                verdict = 'REGRESSION';
+                regressions++;
+            } else if (rel(shift) < -opts.threshold) {
+                verdict = 'improvement';
+            } else {
+                verdict = 'within threshold';
+            }
+        }
+        console.log(`${metric.padEnd(width)}${`${a.length}/${b.length}`.padStart(9)}${baseMedian.toFixed(2).padStart(11)}${median(b).toFixed(2).padStart(11)}` +
+            `${pct(rel(shift)).padStart(10)}  ${`[${pct(rel(lo))}, ${pct(rel(hi))}]`.padEnd(20)}${p.toFixed(4).padStart(8)}  ${verdict}`);
+    }
+    console.log(`\nRegression: slower by more than ${opts.threshold}% with p < ${opts.alpha}.`);
+    if (regressions > 0) {
+        console.log(`${regressions} metric(s) regressed.`);
+        process.exitCode = 1;
+    }
+}
+
+try {
+    main();
+} catch (err) {
+    console.error(err.message);
+    process.exitCode = 2;
+}
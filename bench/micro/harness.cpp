@@ -0,0 +1,146 @@
+// neoshell/bench/micro/harness.cpp
+#include "harness.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+// --- Counting Allocator ---
+// Replaces the global operator new/delete for the whole benchmark binary.
+static size_t g_allocs = 0;
+static size_t g_alloc_bytes = 0;
+
+static void* counted_alloc(size_t n) {
+    ++g_allocs;
+    g_alloc_bytes += n;
+    void* p = malloc(n ? n : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t n) { return counted_alloc(n); }
+void* operator new[](size_t n) { return counted_alloc(n); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+// --- Runner ---
+
+namespace microbench {
+
+struct Benchmark {
+    const char* name;
+    std::function<void()> fn;
+};
+
+static std::vector<Benchmark>& registry() {
+    static std::vector<Benchmark> benchmarks; // Filled by static Registrars
+    return benchmarks;
+}
+
+void add(const char* name, std::function<void()> fn) {
+    registry().push_back({name, std::move(fn)});
+}
+
+} // namespace microbench
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsed_ns(Clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+struct Result {
+    std::string name;
+    std::vector<double> ns_per_op; // One entry per rep
+    double allocs_per_op;
+    double bytes_per_op;
+};
+
+static Result run(const microbench::Benchmark& b, int reps, double batch_ns) {
+    // 1. Warm up (caches, branch predictors, lazy init) and estimate the cost
+    size_t warm_iters = 0;
+    Clock::time_point start = Clock::now();
+    do {
+        b.fn();
+        ++warm_iters;
+    } while (elapsed_ns(start) < batch_ns);
+    double est = elapsed_ns(start) / warm_iters;
+    size_t iters = std::max<size_t>(1, (size_t)(batch_ns / est));
+
+    // 2. Timed batches, counting allocations across all of them
+    Result r{b.name, {}, 0, 0};
+    size_t allocs0 = g_allocs, bytes0 = g_alloc_bytes;
+    for (int rep = 0; rep < reps; ++rep) {
+        start = Clock::now();
+        for (size_t i = 0; i < iters; ++i) b.fn();
+        r.ns_per_op.push_back(elapsed_ns(start) / iters);
+    }
+    double ops = (double)iters * reps;
+    r.allocs_per_op = (g_allocs - allocs0) / ops;
+    r.bytes_per_op = (g_alloc_bytes - bytes0) / ops;
+    return r;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [--filter <substring>] [--reps N] [--batch-ms N] [--json <file>]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char* argv[]) {
+    const char* filter = nullptr;
+    const char* json_path = nullptr;
+    int reps = 10;
+    double batch_ms = 20;
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc) usage(argv[0]);
+        if (strcmp(argv[i], "--filter") == 0) filter = argv[++i];
+        else if (strcmp(argv[i], "--reps") == 0) reps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--batch-ms") == 0) batch_ms = atof(argv[++i]);
+        else if (strcmp(argv[i], "--json") == 0) json_path = argv[++i];
+        else usage(argv[0]);
+    }
+    if (reps < 1 || batch_ms <= 0) usage(argv[0]);
+
+    std::vector<Result> results;
+    printf("%-24s %12s %12s %12s %12s\n", "benchmark", "ns/op (p50)", "ns/op (min)", "allocs/op", "bytes/op");
+    for (const auto& b : microbench::registry()) {
+        if (filter && !strstr(b.name, filter)) continue;
+        Result r = run(b, reps, batch_ms * 1e6);
+        std::vector<double> sorted = r.ns_per_op;
+        std::sort(sorted.begin(), sorted.end());
+        printf("%-24s %12.1f %12.1f %12.2f %12.1f\n", r.name.c_str(), sorted[sorted.size() / 2], sorted[0],
+               r.allocs_per_op, r.bytes_per_op);
+        results.push_back(std::move(r));
+    }
+
+    // Same layout as bench/startup.js --out, so bench/compare.js can diff two runs
+    if (json_path) {
+        FILE* f = fopen(json_path, "w");
+        if (!f) {
+            perror("fopen");
+            return EXIT_FAILURE;
+        }
+        fprintf(f, "{\"benchmark\":\"micro\",\"unit\":\"ns/op\",\"samples\":[");
+        for (int rep = 0; rep < reps; ++rep) {
+            fprintf(f, "%s{", rep ? "," : "");
+            for (size_t i = 0; i < results.size(); ++i) {
+                fprintf(f, "%s\"%s\":%.3f", i ? "," : "", results[i].name.c_str(), results[i].ns_per_op[rep]);
+            }
+            fprintf(f, "}");
+        }
+        fprintf(f, "],\"allocs_per_op\":{");
+        for (size_t i = 0; i < results.size(); ++i) {
+            fprintf(f, "%s\"%s\":%.3f", i ? "," : "", results[i].name.c_str(), results[i].allocs_per_op);
+        }
+        fprintf(f, "}}\n");
+        fclose(f);
+    }
+    return EXIT_SUCCESS;
+}
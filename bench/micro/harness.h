@@ -0,0 +1,37 @@
+// neoshell/bench/micro/harness.h
+// Minimal microbenchmark harness for sandbox internals.
+//
+// A benchmark is a function run in a timed loop. The runner warms it up,
+// picks an iteration count so one batch takes about --batch-ms, then times
+// --reps batches. Every operator new in the binary goes through a counting
+// allocator, so besides ns/op each benchmark reports allocations/op and
+// bytes/op.
+#ifndef NSI_BENCH_MICRO_HARNESS_H
+#define NSI_BENCH_MICRO_HARNESS_H
+
+#include <cstddef>
+#include <functional>
+
+namespace microbench {
+
+void add(const char* name, std::function<void()> fn);
+
+struct Registrar {
+    Registrar(const char* name, std::function<void()> fn) { add(name, std::move(fn)); }
+};
+
+// Keeps the compiler from optimizing away a result or the work producing it.
+template <class T>
+inline void keep(T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+} // namespace microbench
+
+// NSI_BENCH(name) { ...one operation... }
+#define NSI_BENCH(name)                                                   \
+    static void nsi_bench_##name();                                       \
+    static microbench::Registrar nsi_bench_reg_##name(#name, nsi_bench_##name); \
+    static void nsi_bench_##name()
+
+#endif // NSI_BENCH_MICRO_HARNESS_H
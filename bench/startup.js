@@ -0,0 +1,238 @@
+#!/usr/bin/env node
+// neoshell/bench/startup.js
+// End-to-end launch benchmark: time from "nsi run" to the first successful
+// HTTP response of examples/simple-node-app, split into phases.
+//
+// Every phase boundary is a line that `nsi run` already prints; the driver
+// timestamps each line as it arrives:
+//
+//   cli        spawn of `nsi run`            -> "Image Name: ..."   (node + CLI startup)
+//   extract    "Image Name: ..."             -> "Spawning nsi-sandbox..."
+//   sandbox    "Spawning nsi-sandbox..."     -> "[nsi-sandbox] Entering Stage 3"
+//   node_boot  "Entering Stage 3" (execve)   -> "[SimpleApp] Started at"
+//   listen     "[SimpleApp] Started at"      -> "[SimpleApp] Server listening"
+//   response   "Server listening"            -> first HTTP 200 on PORT
+//
+// Without --image the app is built into an image that carries the node
+// running this driver (see buildImage), so extract includes unpacking it.
+//
+// Usage: node bench/startup.js [--runs 20] [--warmup 2] [--port 3100]
+//                              [--timeout 15000] [--image <file.nsi>]
+//                              [--out results.json] [-- <extra nsi run args>]
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const http = require('http');
+const { spawn, execFileSync } = require('child_process');
+
+const ROOT = path.resolve(__dirname, '..');
+const CLI = path.join(ROOT, 'src', 'cli', 'index.js');
+const APP_DIR = path.join(ROOT, 'examples', 'simple-node-app');
+
+const PHASES = ['cli', 'extract', 'sandbox', 'node_boot', 'listen', 'response'];
+const MARKERS = [
+    ['image', /Image Name: /],
+    ['spawn', /Spawning nsi-sandbox\.\.\./],
+    ['exec', /\[nsi-sandbox\] Entering Stage 3/],
+    ['started', /\[SimpleApp\] Started at/],
+    ['listening', /\[SimpleApp\] Server listening/],
+];
+const POLL_MS = 5;
+
+function parseArgs(argv) {
+    const opts = { runs: 20, warmup: 2, port: 3100, timeout: 15000, image: null, out: null, extra: [] };
+    for (let i = 0; i < argv.length; i++) {
+        const a = argv[i];
+        if (a === '--') { opts.extra = argv.slice(i + 1); break; }
+        const value = argv[++i];
+        if (value === undefined) throw new Error(`Missing value for ${a}`);
+        switch (a) {
+            case '--runs': opts.runs = parseInt(value, 10); break;
+            case '--warmup': opts.warmup = parseInt(value, 10); break;
+            case '--port': opts.port = parseInt(value, 10); break;
+            case '--timeout': opts.timeout = parseInt(value, 10); break;
+            case '--image': opts.image = path.resolve(value); break;
+            case '--out': opts.out = path.resolve(value); break;
+            default: throw new Error(`Unknown option: ${a}`);
+        }
+    }
+    return opts;
+}
+
+// Shared libraries a binary loads, as host paths ([] for a static one).
+function sharedLibraries(binary) {
+    let out;
+    try {
+        out = execFileSync('ldd', [binary], { encoding: 'utf8', stdio: ['ignore', 'pipe', 'ignore'] });
+    } catch (e) {
+        return []; // "not a dynamic executable"
+    }
+    return out.split('\n').map((line) => (line.match(/(\/\S+) \(0x/) || [])[1]).filter(Boolean);
+}
+
+// The example's image has no node of its own (its cmd is a bare "node"), so
+// the bench image is a rootfs around it: the app in /app, and this node
+// binary with the libraries it loads at their host paths, run by absolute path.
+function buildImage() {
+    const dir = fs.mkdtempSync(path.join(os.tmpdir(), 'neoshell-bench-'));
+    const image = path.join(dir, 'simple-node-app-bench.nsi');
+    const context = path.join(dir, 'rootfs');
+    console.log(`Building ${APP_DIR} with ${process.execPath} -> ${image}`);
+    if (!fs.existsSync(path.join(APP_DIR, 'node_modules'))) {
+        execFileSync('npm', ['ci', '--omit=dev'], { cwd: APP_DIR, stdio: 'ignore' });
+    }
+    for (const name of ['app.js', 'package.json', 'node_modules']) {
+        fs.cpSync(path.join(APP_DIR, name), path.join(context, 'app', name), { recursive: true, verbatimSymlinks: true });
+    }
+    for (const file of [process.execPath, ...sharedLibraries(process.execPath)]) {
+        fs.mkdirSync(path.join(context, path.dirname(file)), { recursive: true });
+        fs.copyFileSync(fs.realpathSync(file), path.join(context, file)); // Keeps the mode
+    }
+    for (const mountPoint of ['proc', 'sys', 'dev', 'tmp']) fs.mkdirSync(path.join(context, mountPoint), { recursive: true });
+    const yamlPath = path.join(context, '.nsi.yaml');
+    fs.writeFileSync(yamlPath, [
+        'name: simple-node-app-bench',
+        'version: 1.0.0',
+        'runtime:',
+        `  cmd: [${JSON.stringify(process.execPath)}, "app.js"]`,
+        '  workDir: /app',
+        '  env:',
+        '    NODE_ENV: production',
+        '',
+    ].join('\n'));
+    execFileSync(process.execPath, [CLI, 'build', yamlPath, image], { cwd: context, stdio: 'ignore' });
+    fs.rmSync(context, { recursive: true, force: true });
+    return image;
+}
+
+// Resolves true once GET / answers 200, false if the run ends first.
+function pollHttp(port, isDone) {
+    return new Promise((resolve) => {
+        const attempt = () => {
+            if (isDone()) return resolve(false);
+            const req = http.get({ host: '127.0.0.1', port, path: '/', agent: false }, (res) => {
+                res.resume();
+                if (res.statusCode === 200) return resolve(true);
+                setTimeout(attempt, POLL_MS);
+            });
+            req.on('error', () => setTimeout(attempt, POLL_MS));
+        };
+        attempt();
+    });
+}
+
+// One launch. Returns { ok, marks: {name: ms since spawn}, error }.
+async function runOnce(image, port, opts) {
+    const t0 = process.hrtime.bigint();
+    const now = () => Number(process.hrtime.bigint() - t0) / 1e6;
+    const marks = {};
+    const child = spawn(process.execPath, [CLI, 'run', image, '-e', `PORT=${port}`, ...opts.extra], {
+        stdio: ['ignore', 'pipe', 'pipe'],
+        detached: true, // Own process group, so the whole tree can be stopped
+    });
+    let exited = false;
+    let output = '';
+    const closed = new Promise((resolve) => child.on('close', () => { exited = true; resolve(); }));
+
+    // Markers are matched on whole lines; a line is timed when it completes
+    const scanner = () => {
+        let partial = '';
+        return (chunk) => {
+            const at = now();
+            const text = chunk.toString('utf8');
+            output = (output + text).slice(-4096);
+            const lines = (partial + text).split('\n');
+            partial = lines.pop();
+            for (const line of lines) {
+                for (const [name, re] of MARKERS) {
+                    if (marks[name] === undefined && re.test(line)) marks[name] = at;
+                }
+            }
+        };
+    };
+    child.stdout.on('data', scanner());
+    child.stderr.on('data', scanner());
+
+    let timedOut = false;
+    const timer = setTimeout(() => { timedOut = true; }, opts.timeout);
+    const ok = await pollHttp(port, () => exited || timedOut);
+    if (ok) marks.response = now();
+    clearTimeout(timer);
+
+    try {
+        process.kill(-child.pid, 'SIGTERM');
+    } catch (e) {
+        // Already gone
+    }
+    await closed; // nsi run removes its rootfs on the way out
+
+    if (ok) return { ok, marks };
+    const error = timedOut ? `no response within ${opts.timeout}ms` : 'nsi run exited before answering';
+    return { ok, marks, error, output };
+}
+
+function phasesOf(marks) {
+    const bounds = [0, marks.image, marks.spawn, marks.exec, marks.started, marks.listening, marks.response];
+    const out = { total: marks.response };
+    PHASES.forEach((phase, i) => {
+        const a = bounds[i];
+        const b = bounds[i + 1];
+        out[phase] = a !== undefined && b !== undefined ? b - a : null;
+    });
+    return out;
+}
+
+// Nearest-rank percentile of a sorted array.
+function percentile(sorted, p) {
+    const rank = Math.ceil((p / 100) * sorted.length);
+    return sorted[Math.min(sorted.length, Math.max(1, rank)) - 1];
+}
+
+function report(samples) {
+    const fmt = (v) => v.toFixed(1).padStart(8);
+    const totalP50 = percentile(samples.map((s) => s.total).sort((a, b) => a - b), 50);
+    console.log(`\n${samples.length} runs, milliseconds:`);
+    console.log(`${'phase'.padEnd(10)}${'p50'.padStart(8)}${'p90'.padStart(8)}${'p99'.padStart(8)}${'mean'.padStart(8)}${'min'.padStart(8)}${'max'.padStart(8)}  share`);
+    for (const phase of [...PHASES, 'total']) {
+        const values = samples.map((s) => s[phase]).filter((v) => v !== null).sort((a, b) => a - b);
+        if (values.length === 0) {
+            console.log(`${phase.padEnd(10)}  (no data: marker line not seen)`);
+            continue;
+        }
+        const mean = values.reduce((a, b) => a + b, 0) / values.length;
+        const p50 = percentile(values, 50);
+        const share = phase === 'total' ? '' : `${((p50 / totalP50) * 100).toFixed(0).padStart(4)}%`;
+        console.log(`${phase.padEnd(10)}${fmt(p50)}${fmt(percentile(values, 90))}${fmt(percentile(values, 99))}${fmt(mean)}${fmt(values[0])}${fmt(values[values.length - 1])}  ${share}`);
+    }
+}
+
+async function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    const image = opts.image || buildImage();
+    const samples = [];
+    let failures = 0;
+    for (let i = 0; i < opts.warmup + opts.runs; i++) {
+        const warm = i < opts.warmup;
+        const result = await runOnce(image, opts.port + i, opts); // Fresh port: no TIME_WAIT or stale listener
+        if (!result.ok) {
+            failures++;
+            console.error(`run ${i + 1}: FAILED (${result.error})\n${result.output}`);
+            if (failures > Math.max(2, opts.runs / 4)) throw new Error('Too many failed runs, giving up.');
+            continue;
+        }
+        const phases = phasesOf(result.marks);
+        if (!warm) samples.push(phases);
+        console.log(`run ${i + 1}${warm ? ' (warmup)' : ''}: ${phases.total.toFixed(1)}ms`);
+    }
+    if (samples.length === 0) throw new Error('No successful runs.');
+    report(samples);
+    if (opts.out) {
+        fs.writeFileSync(opts.out, JSON.stringify({ benchmark: 'startup', image, date: new Date().toISOString(), samples }, null, 2));
+        console.log(`\nRaw samples written to ${opts.out}`);
+    }
+}
+
+main().catch((err) => {
+    console.error(err.message);
+    process.exitCode = 1;
+});
@@ -0,0 +1,111 @@
+// neoshell/src/cli/commands/adopt.js
+const fs = require('fs').promises;
+const fsSync = require('fs');
+const os = require('os');
+const path = require('path');
+const { spawn, spawnSync } = require('child_process');
+const logger = require('../utils/logger');
+const { logsDir, LogWriter } = require('../utils/logStore');
+const { findSandboxExecutable } = require('../utils/sandbox');
+
+// Containers the sandbox can adopt: [{ id, status, pid, rootfs }]
+function listContainers(sandboxExecutable) {
+    const result = spawnSync(sandboxExecutable, ['adopt', 'ls'], { encoding: 'utf8' });
+    if (result.status !== 0) throw new Error(`"nsi-sandbox adopt ls" failed: ${(result.stderr || '').trim()}`);
+    return result.stdout.split('\n').filter(Boolean).map((line) => {
+        const [id, status, pid, rootfs] = line.split('\t');
+        return { id, status, pid: pid === '-' ? null : Number(pid), rootfs: rootfs === '-' ? null : rootfs };
+    });
+}
+
+// The temp dir "nsi run" extracted this container's image to (a cached
+// --reuse-rootfs tree is not one, and is kept)
+function isTempRootfs(rootfs, containerId) {
+    return Boolean(rootfs) && path.dirname(rootfs) === os.tmpdir()
+        && path.basename(rootfs).startsWith(`neoshell-${containerId}-rootfs-`);
+}
+
+module.exports = {
+    command: 'adopt [containerId]',
+    describe: 'Re-attach to a container whose "nsi run" has exited: relay its output, report its exit status and clean up (lists containers without an id)',
+    builder: (yargs) => {
+        yargs
+            .positional('containerId', {
+                describe: 'Container ID printed by "nsi run" (omit to list containers and their status)',
+                type: 'string',
+            })
+            .option('force', {
+                describe: 'Adopt even while its launcher is still attached (the output is then split between both)',
+                type: 'boolean',
+                default: false,
+            });
+    },
+    handler: async (argv) => {
+        const containerId = argv.containerId;
+        let sandboxExecutable;
+        let known;
+        try {
+            sandboxExecutable = findSandboxExecutable();
+            if (!containerId) {
+                const containers = listContainers(sandboxExecutable);
+                if (containers.length === 0) logger.log('No containers to adopt.');
+                for (const c of containers) {
+                    logger.log(`${c.id}  ${c.status}  init PID ${c.pid === null ? '-' : c.pid}  rootfs ${c.rootfs || '-'}`);
+                }
+                return;
+            }
+            known = listContainers(sandboxExecutable).find((c) => c.id === containerId);
+        } catch (err) {
+            logger.error(err.message);
+            process.exitCode = 1;
+            return;
+        }
+
+        // Output goes on into the container's log if "nsi run" kept one
+        const logWriter = fsSync.existsSync(path.join(logsDir(), containerId))
+            ? new LogWriter(containerId, { resume: true })
+            : null;
+        const args = ['adopt', containerId, ...(argv.force ? ['--force'] : [])];
+        // The adopter's own lines come on fd 3 (NSI_LOG_FD), apart from the container's
+        const child = spawn(sandboxExecutable, args, {
+            stdio: logWriter ? ['ignore', 'pipe', 'pipe', 'pipe'] : ['ignore', 'inherit', 'inherit'],
+            env: logWriter ? { ...process.env, NSI_LOG_FD: '3' } : process.env,
+        });
+        if (logWriter) {
+            child.stdout.on('data', (chunk) => {
+                process.stdout.write(chunk);
+                logWriter.write('o', chunk);
+            });
+            child.stderr.on('data', (chunk) => {
+                process.stderr.write(chunk);
+                logWriter.write('e', chunk);
+            });
+            child.stdio[3].on('data', (chunk) => process.stderr.write(chunk));
+        }
+
+        // Ctrl+C only detaches: the container keeps running and can be adopted again
+        process.on('SIGINT', () => {
+            logger.log(`\nDetached; container ${containerId} keeps running (re-attach with: nsi adopt ${containerId})`);
+        });
+
+        child.on('error', (err) => {
+            logger.error(`Failed to start sandbox process: ${err.message}`);
+            process.exitCode = 1;
+        });
+
+        child.on('close', async (code) => {
+            if (logWriter) await logWriter.close();
+            process.exitCode = code === null ? 1 : code;
+            // Once the container is gone (and not merely refused), its temp rootfs goes too
+            try {
+                const stillThere = listContainers(sandboxExecutable).some((c) => c.id === containerId);
+                if (known && !stillThere && isTempRootfs(known.rootfs, containerId)) {
+                    logger.log(`Cleaning up rootfs: ${known.rootfs}`);
+                    await fs.rm(known.rootfs, { recursive: true, force: true });
+                }
+            } catch (err) {
+                logger.warn(`Cleanup after container ${containerId} failed: ${err.message}`);
+            }
+        });
+    },
+};
@@ -7,6 +7,7 @@ const tar = require('tar-fs');
 const zlib = require('zlib');
 const crypto = require('crypto');
 const logger = require('../utils/logger');
+const verity = require('../utils/verity');
 const { execSync } = require('child_process'); // For running build commands
 
 const NSI_MAGIC = Buffer.from('NSI!');
@@ -121,6 +122,11 @@ module.exports = {
             const hash = crypto.createHash('sha256').update(tarBuffer).digest('hex');
             logger.info(`Payload SHA256: ${hash}`);
 
+            // 4b. Per-file fs-verity digests, so a reused rootfs can be sealed
+            //     and verified lazily by the kernel instead of re-hashed
+            const verityFiles = await verity.computeVerityDigests(tarBuffer);
+            logger.info(`Computed fs-verity digests for ${Object.keys(verityFiles).length} files`);
+
             // 5. Compress payload (zlib)
             const compressedPayload = await new Promise((resolve, reject) => {
                 zlib.deflate(tarBuffer, (err, buffer) => {
@@ -141,6 +147,7 @@ module.exports = {
                 workDir: config.runtime?.workDir || '/app',
                 cmd: config.runtime?.cmd || null, // Make cmd explicitly null if not set
                 env: config.runtime?.env || {},
+                verity: { algorithm: 'sha256', blockSize: verity.BLOCK_SIZE, files: verityFiles },
             });
             const headerBuffer = Buffer.from(headerJson, 'utf8');
             const headerLengthBuffer = Buffer.alloc(4);
@@ -0,0 +1,180 @@
+// neoshell/src/cli/commands/import.js
+const fsSync = require('fs');
+const fs = require('fs').promises;
+const path = require('path');
+const zlib = require('zlib');
+const crypto = require('crypto');
+const { pipeline, finished } = require('stream/promises');
+const tarStream = require('tar-stream');
+const logger = require('../utils/logger');
+const verity = require('../utils/verity');
+const { loadImage } = require('../utils/oci');
+const { chunkStoreDir, streamDigest, layerView } = require('../utils/layers');
+
+const NSI_MAGIC = Buffer.from('NSI!');
+const NSI_VERSION = Buffer.from([0, 0, 0, 1]); // Binary format version; chunked payloads are header schemaVersion 2
+const MOUNT_POINTS = ['proc', 'dev', 'sys']; // nsi-sandbox mounts onto these
+const DEFAULT_PATH = '/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin';
+
+// A layer with just the given directories. Always the same bytes for the
+// same directories, so its chunk is reused too.
+function dirsLayer(dirs) {
+    const open = () => {
+        const pack = tarStream.pack();
+        for (const name of dirs) pack.entry({ name, type: 'directory', mode: 0o755, mtime: new Date(0) });
+        pack.finalize();
+        return pack;
+    };
+    return { diffId: null, open };
+}
+
+const storePath = (digest) => path.join(chunkStoreDir(), `${digest.split(':')[1]}.zz`);
+
+// True if the store holds an intact chunk for digest.
+async function stored(digest) {
+    const file = storePath(digest);
+    if (!fsSync.existsSync(file)) return false;
+    const inflated = fsSync.createReadStream(file).on('error', () => {}).pipe(zlib.createInflate());
+    return (await streamDigest(inflated).catch(() => null)) === digest; // Damaged: convert again
+}
+
+// Reads a layer once, adding it to view and converting it to a chunk in
+// the store, unless an earlier import converted the same layer. Returns
+// { digest, size, length, file, reused }.
+async function convertLayer(layer, view, what) {
+    await fs.mkdir(chunkStoreDir(), { recursive: true });
+    const reused = layer.diffId !== null && await stored(layer.diffId);
+    const tmp = reused ? null : path.join(chunkStoreDir(), `.tmp-${process.pid}-${crypto.randomBytes(4).toString('hex')}`);
+    const input = layer.open();
+    let size = 0;
+    input.on('data', (c) => { size += c.length; });
+    let digest;
+    try {
+        [digest] = await Promise.all([
+            streamDigest(input),
+            view.add(input),
+            tmp && pipeline(input, zlib.createDeflate(), fsSync.createWriteStream(tmp)),
+        ]);
+        if (layer.diffId && digest !== layer.diffId) throw new Error(`${what} does not match its diff ID ${layer.diffId}`);
+        if (tmp) await fs.rename(tmp, storePath(digest));
+    } finally {
+        if (tmp) await fs.rm(tmp, { force: true });
+    }
+    const file = storePath(digest);
+    return { digest, size, length: (await fs.stat(file)).size, file, reused };
+}
+
+// execve() needs a path: look a bare command up in the image's PATH.
+function resolveCommand(cmd, env, entries) {
+    if (cmd[0].startsWith('/')) return cmd;
+    for (const dir of (env.PATH || DEFAULT_PATH).split(':')) {
+        const candidate = path.posix.join(dir, cmd[0]);
+        if (entries.has(candidate.slice(1))) return [candidate, ...cmd.slice(1)];
+    }
+    logger.warn(`Command "${cmd[0]}" not found in the image's PATH; keeping it as is.`);
+    return cmd;
+}
+
+module.exports = {
+    command: 'import <archivePath> [outputPath]',
+    describe: 'Convert a local OCI image layout or "docker save" archive into a Neoshell (.nsi) image (each .nsi carries all of its layers and `nsi run` applies them all; layers seen in earlier imports are only converted once)',
+    builder: (yargs) => {
+        yargs
+            .positional('archivePath', {
+                describe: 'OCI layout directory, or a tar of one, or a "docker save" tar',
+                type: 'string',
+            })
+            .positional('outputPath', {
+                describe: 'Path to save the .nsi image (default: <name>-<version>.nsi)',
+                type: 'string',
+            })
+            .option('ref', {
+                describe: 'Image to import when the archive holds several (e.g. node:18-alpine)',
+                type: 'string',
+            })
+            .option('name', {
+                describe: 'Image name (default: from the image reference)',
+                type: 'string',
+            })
+            .option('image-version', {
+                describe: 'Image version (default: the image tag)',
+                type: 'string',
+            });
+    },
+    handler: async (argv) => {
+        let image = null;
+        try {
+            // 1. The image and its layers
+            logger.log(`Importing ${argv.archivePath}`);
+            image = await loadImage(path.resolve(argv.archivePath), argv.ref);
+            const config = image.config.config || {};
+            const name = argv.name || image.name || path.basename(argv.archivePath).replace(/\.(tar|oci)$/, '');
+            const version = argv.imageVersion || image.version || 'latest';
+            logger.info(`Image ${image.ref || '(untagged)'}: ${image.layers.length} layers`);
+
+            // 2. One chunk per layer, named by its diff ID, read once for it
+            //    and for the final file view (fs-verity digests, command lookup)
+            const view = layerView();
+            const chunks = [];
+            let reused = 0;
+            let size = 0;
+            const add = async (layer, what) => {
+                const chunk = await convertLayer(layer, view, what);
+                chunks.push(chunk);
+                size += chunk.size;
+                if (chunk.reused) reused++;
+                logger.info(`${chunk.digest.slice(0, 19)}  ${(chunk.size / 1048576).toFixed(1)}MiB -> ${(chunk.length / 1048576).toFixed(1)}MiB${chunk.reused ? '  (reused)' : ''}`);
+            };
+            for (const [i, layer] of image.layers.entries()) await add(layer, `Layer ${i + 1}`);
+            const missing = MOUNT_POINTS.filter((d) => view.entries.get(d) !== 'directory');
+            if (missing.length > 0) await add(dirsLayer(missing), 'Mount point layer');
+            const { files, entries } = view;
+
+            // 3. Runtime configuration
+            const env = Object.fromEntries((config.Env || []).map((e) => {
+                const eq = e.indexOf('=');
+                return eq === -1 ? [e, ''] : [e.slice(0, eq), e.slice(eq + 1)];
+            }));
+            const cmd = [...(config.Entrypoint || []), ...(config.Cmd || [])];
+            if (cmd.length === 0) throw new Error('The image defines no Entrypoint or Cmd.');
+            if (config.User && !/^(0|root)(:(0|root))?$/.test(config.User)) {
+                logger.warn(`Image user "${config.User}" is not supported; the app runs as root in the container's user namespace.`);
+            }
+
+            // 4. Header and image file
+            const header = {
+                imageName: name,
+                version,
+                schemaVersion: 2, // Chunked payload
+                created: new Date().toISOString(),
+                importedFrom: image.ref || path.basename(argv.archivePath),
+                sizeKB: Math.ceil(size / 1024),
+                // Image identity (rootfs cache key): the chunk list
+                hash: crypto.createHash('sha256').update(chunks.map((c) => c.digest).join('\n')).digest('hex'),
+                workDir: config.WorkingDir || '/',
+                cmd: resolveCommand(cmd, env, entries),
+                env,
+                chunks: chunks.map(({ digest, size: chunkSize, length }) => ({ digest, size: chunkSize, length })),
+                verity: { algorithm: 'sha256', blockSize: verity.BLOCK_SIZE, files },
+            };
+            const headerBuffer = Buffer.from(JSON.stringify(header), 'utf8');
+            const headerLengthBuffer = Buffer.alloc(4);
+            headerLengthBuffer.writeUInt32BE(headerBuffer.length, 0);
+
+            const outputFullPath = path.resolve(argv.outputPath || `${name}-${version}.nsi`);
+            const out = fsSync.createWriteStream(outputFullPath);
+            for (const part of [NSI_MAGIC, NSI_VERSION, headerLengthBuffer, headerBuffer]) out.write(part);
+            for (const chunk of chunks) await pipeline(fsSync.createReadStream(chunk.file), out, { end: false });
+            out.end();
+            await finished(out);
+
+            logger.log(`Successfully imported image: ${outputFullPath} (${chunks.length} chunks, ${reused} reused from ${chunkStoreDir()})`);
+        } catch (err) {
+            logger.error('Import failed:');
+            logger.error(err.message);
+            process.exitCode = 1;
+        } finally {
+            if (image) await image.close();
+        }
+    },
+};
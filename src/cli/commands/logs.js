@@ -0,0 +1,61 @@
+// neoshell/src/cli/commands/logs.js
+const logger = require('../utils/logger');
+const { readLogs } = require('../utils/logStore');
+
+// Accepts an ISO date/epoch ms, or a duration relative to now: 30s, 15m, 2h, 1d
+function parseTime(value) {
+    if (value === undefined || value === null) return null;
+    const rel = /^(\d+(?:\.\d+)?)(ms|s|m|h|d)$/.exec(value);
+    if (rel) {
+        const unit = { ms: 1, s: 1000, m: 60000, h: 3600000, d: 86400000 }[rel[2]];
+        return Date.now() - parseFloat(rel[1]) * unit;
+    }
+    const ts = /^\d+$/.test(value) ? parseInt(value, 10) : Date.parse(value);
+    if (Number.isNaN(ts)) throw new Error(`Invalid time: ${value}`);
+    return ts;
+}
+
+module.exports = {
+    command: 'logs <containerId>',
+    describe: 'Show captured output of a container',
+    builder: (yargs) => {
+        yargs
+            .positional('containerId', {
+                describe: 'Container ID printed by "nsi run"',
+                type: 'string',
+            })
+            .option('since', {
+                describe: 'Only records at or after this time (e.g. 10m, 2h, 2024-05-01T12:00:00Z)',
+                type: 'string',
+            })
+            .option('until', {
+                describe: 'Only records at or before this time (same formats as --since)',
+                type: 'string',
+            })
+            .option('stream', {
+                describe: 'Only show one stream',
+                choices: ['stdout', 'stderr'],
+            })
+            .option('timestamps', {
+                alias: 't',
+                describe: 'Prefix each line with its capture time',
+                type: 'boolean',
+                default: false,
+            });
+    },
+    handler: async (argv) => {
+        try {
+            const since = parseTime(argv.since);
+            const until = parseTime(argv.until);
+            const only = argv.stream ? argv.stream[3] : null; // 'o' or 'e'
+            for await (const rec of readLogs(argv.containerId, since, until)) {
+                if (only && rec.stream !== only) continue;
+                const line = argv.timestamps ? `${new Date(rec.ts).toISOString()} ${rec.text}\n` : `${rec.text}\n`;
+                (rec.stream === 'e' ? process.stderr : process.stdout).write(line);
+            }
+        } catch (err) {
+            logger.error(err.code === 'ENOENT' ? `No logs found for container ${argv.containerId}` : err.message);
+            process.exitCode = 1;
+        }
+    },
+};
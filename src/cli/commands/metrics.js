@@ -0,0 +1,50 @@
+// neoshell/src/cli/commands/metrics.js
+const { spawnSync } = require('child_process');
+const logger = require('../utils/logger');
+const { findSandboxExecutable } = require('../utils/sandbox');
+
+module.exports = {
+    command: 'metrics [containerId]',
+    describe: 'Show the resource history recorded for a container run with --metrics (also after it exited)',
+    builder: (yargs) => {
+        yargs
+            .positional('containerId', {
+                describe: 'Container ID printed by "nsi run" (omit to list recordings)',
+                type: 'string',
+            })
+            .option('last', {
+                describe: 'Only the last N minutes of the recording',
+                type: 'number',
+            })
+            .option('json', {
+                describe: 'Print one JSON object per sample (raw cumulative counters)',
+                type: 'boolean',
+                default: false,
+            })
+            .option('rm', {
+                describe: 'Delete the recording instead (recordings untouched for 7 days are deleted anyway)',
+                type: 'boolean',
+                default: false,
+            });
+    },
+    handler: (argv) => {
+        if (argv.rm && !argv.containerId) {
+            logger.error('"nsi metrics --rm" needs a container ID');
+            process.exitCode = 1;
+            return;
+        }
+        let args = ['metrics', 'ls'];
+        if (argv.rm) {
+            args = ['metrics', 'rm', argv.containerId];
+        } else if (argv.containerId) {
+            args = ['metrics', argv.containerId, ...(argv.last ? [`--last=${argv.last}`] : []), ...(argv.json ? ['--json'] : [])];
+        }
+        try {
+            const result = spawnSync(findSandboxExecutable(), args, { stdio: 'inherit' });
+            process.exitCode = result.status === null ? 1 : result.status;
+        } catch (err) {
+            logger.error(err.message);
+            process.exitCode = 1;
+        }
+    },
+};
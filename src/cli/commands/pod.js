@@ -0,0 +1,43 @@
+// neoshell/src/cli/commands/pod.js
+const { spawnSync } = require('child_process');
+const logger = require('../utils/logger');
+const { findSandboxExecutable } = require('../utils/sandbox');
+
+module.exports = {
+    command: 'pod <action> [name]',
+    describe: 'Manage pods: containers run with --pod <name> share its network, IPC and hostname',
+    builder: (yargs) => {
+        yargs
+            .positional('action', {
+                describe: 'create, rm or ls',
+                choices: ['create', 'rm', 'ls'],
+            })
+            .positional('name', {
+                describe: 'Pod name (also its hostname)',
+                type: 'string',
+            })
+            .option('net', {
+                describe: 'create: give the pod outbound networking through a user-mode stack (as run --net user)',
+                type: 'boolean',
+                default: false,
+            });
+    },
+    handler: (argv) => {
+        if (argv.action !== 'ls' && !argv.name) {
+            logger.error(`"nsi pod ${argv.action}" needs a pod name`);
+            process.exitCode = 1;
+            return;
+        }
+        try {
+            const args = ['pod', argv.action, ...(argv.action === 'ls' ? [] : [argv.name])];
+            if (argv.action === 'create' && argv.net) args.push('--net');
+            const result = spawnSync(findSandboxExecutable(), args, {
+                stdio: 'inherit',
+            });
+            process.exitCode = result.status === null ? 1 : result.status;
+        } catch (err) {
+            logger.error(err.message);
+            process.exitCode = 1;
+        }
+    },
+};
@@ -0,0 +1,52 @@
+// neoshell/src/cli/commands/profile.js
+const { spawnSync } = require('child_process');
+const logger = require('../utils/logger');
+const { findSandboxExecutable } = require('../utils/sandbox');
+
+module.exports = {
+    command: 'profile <containerId>',
+    describe: 'Sample the CPU stacks of a running container and print them as folded stacks (for flamegraph.pl, speedscope)',
+    builder: (yargs) => {
+        yargs
+            .positional('containerId', {
+                describe: 'Container ID printed by "nsi run"',
+                type: 'string',
+            })
+            .option('seconds', {
+                describe: 'How long to sample (Ctrl+C stops early)',
+                type: 'number',
+                default: 10,
+            })
+            .option('frequency', {
+                describe: 'Samples per second per CPU',
+                type: 'number',
+                default: 99,
+            })
+            .option('kernel', {
+                describe: 'Include kernel frames (needs kernel.perf_event_paranoid <= 1 or CAP_PERFMON)',
+                type: 'boolean',
+                default: false,
+            })
+            .option('output', {
+                alias: 'o',
+                describe: 'Write the folded stacks to this file instead of stdout',
+                type: 'string',
+            });
+    },
+    handler: (argv) => {
+        const args = ['profile', argv.containerId, `--seconds=${argv.seconds}`, `--frequency=${argv.frequency}`,
+            ...(argv.kernel ? ['--kernel'] : []), ...(argv.output ? [`--output=${argv.output}`] : [])];
+        try {
+            // Ctrl+C reaches nsi-sandbox too; it stops sampling and still writes the profile
+            process.on('SIGINT', () => {});
+            const result = spawnSync(findSandboxExecutable(), args, { stdio: 'inherit' });
+            process.exitCode = result.status === null ? 1 : result.status;
+            if (result.status === 0 && argv.output) {
+                logger.log(`Folded stacks written to ${argv.output} (render with: flamegraph.pl ${argv.output} > profile.svg)`);
+            }
+        } catch (err) {
+            logger.error(err.message);
+            process.exitCode = 1;
+        }
+    },
+};
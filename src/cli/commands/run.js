@@ -1,40 +1,188 @@
 // neoshell/src/cli/commands/run.js
 const fs = require('fs').promises;
 const fsSync = require('fs'); // Need sync version for some cleanup scenarios
+const { StringDecoder } = require('string_decoder');
 const path = require('path');
 const zlib = require('zlib');
 const tar = require('tar-fs');
 const crypto = require('crypto');
-const { spawn } = require('child_process');
+const { spawn, spawnSync } = require('child_process');
+const { once } = require('events');
+const { pipeline } = require('stream/promises');
 const os = require('os');
 const { v4: uuidv4 } = require('uuid');
 const logger = require('../utils/logger');
+const verity = require('../utils/verity');
+const { LogWriter, pruneLogs } = require('../utils/logStore');
+const { STARTED, findSandboxExecutable } = require('../utils/sandbox');
+const { streamDigest, chunkLayers, extractChunks } = require('../utils/layers');
 
 const NSI_MAGIC = Buffer.from('NSI!');
 
-// Helper to find the bundled sandbox executable
-function findSandboxExecutable() {
-    // Inside pkg snapshot, __dirname points to snapshot filesystem
-    const possiblePath = path.join(__dirname, '..', '..', '..', 'build', 'nsi-sandbox');
-    // When running directly via node, it's relative to the script
-    const possiblePathDev = path.resolve(__dirname, '..', '..', '..', 'build', 'nsi-sandbox');
+// Where extracted rootfs trees are kept when --reuse-rootfs is used
+function rootfsCacheDir() {
+    const base = process.env.XDG_CACHE_HOME || path.join(os.homedir(), '.cache');
+    return path.join(base, 'neoshell', 'rootfs');
+}
+
+// Feeds output chunks of one stream; calls onMatch at the first line matching re.
+function lineWatcher(re, onMatch) {
+    const decoder = new StringDecoder('utf8');
+    let partial = '';
+    let matched = false;
+    return (chunk) => {
+        if (matched) return;
+        const lines = (partial + decoder.write(chunk)).split('\n');
+        partial = lines.pop();
+        if (lines.some((line) => re.test(line))) {
+            matched = true;
+            onMatch();
+        }
+    };
+}
+
+// Reads and decompresses a (non-chunked) payload: one tar.
+async function readPayload(fileHandle, payloadOffset) {
+    const stats = await fileHandle.stat();
+    const payloadLength = stats.size - payloadOffset;
+    const compressedPayloadBuffer = Buffer.alloc(payloadLength);
+    await fileHandle.read(compressedPayloadBuffer, 0, payloadLength, payloadOffset);
+
+    return new Promise((resolve, reject) => {
+        zlib.unzip(compressedPayloadBuffer, (err, buffer) => {
+            if (err) return reject(err);
+            resolve(buffer);
+        });
+    });
+}
+
+// Reads, decompresses and extracts the payload into destPath.
+// Returns the uncompressed payload so the caller can hash it if needed;
+// null for chunked (imported) images, whose chunks are verified as they
+// are applied.
+async function extractPayload(fileHandle, payloadOffset, destPath, header) {
+    if (header.chunks) {
+        await extractChunks(fileHandle, payloadOffset, header, destPath);
+        return null;
+    }
+    const payloadBuffer = await readPayload(fileHandle, payloadOffset);
+
+    // Extract tar stream from buffer
+    await new Promise((resolve, reject) => {
+         // Create a readable stream from the buffer
+        const Readable = require('stream').Readable;
+        const stream = new Readable();
+        stream.push(payloadBuffer);
+        stream.push(null); // Signal EOF
 
-    if (fsSync.existsSync(possiblePath)) {
-        return possiblePath;
+        const extract = tar.extract(destPath);
+        stream.pipe(extract);
+        extract.on('finish', resolve);
+        extract.on('error', reject);
+    });
+    return payloadBuffer;
+}
+
+// Writes the payload to nsi-sandbox for --rootfs-tmpfs: the image tar, or
+// the layer tars of a chunked image in order, each checked before it is
+// sent. The sandbox extracts them into the tmpfs as they arrive.
+async function streamPayload(fileHandle, payloadOffset, header, pipe) {
+    if (!header.chunks) {
+        const payloadBuffer = await readPayload(fileHandle, payloadOffset);
+        verifyPayloadHash(payloadBuffer, header);
+        if (!pipe.write(payloadBuffer)) await once(pipe, 'drain');
+        pipe.end();
+        return;
     }
-    if (fsSync.existsSync(possiblePathDev)) {
-        return possiblePathDev;
+    for (const layer of chunkLayers(fileHandle, payloadOffset, header)) {
+        // Read through once to check it, then again to send it
+        if (await streamDigest(layer.open()) !== layer.digest) throw new Error(`Chunk ${layer.digest} is corrupt (digest mismatch)`);
+        await pipeline(layer.open(), pipe, { end: false });
     }
-    // Fallback: Check PATH (if installed system-wide)
-    // You might need more robust logic here
-    try {
-        const pathOutput = require('child_process').execSync('which nsi-sandbox', { encoding: 'utf8' });
-        return pathOutput.trim();
-    } catch (e) {
-        // Not found in PATH
+    pipe.end();
+}
+
+// Verify hash (optional but recommended)
+function verifyPayloadHash(payloadBuffer, header) {
+    const calculatedHash = crypto.createHash('sha256').update(payloadBuffer).digest('hex');
+    if (calculatedHash !== header.hash) {
+        logger.warn(`Payload hash mismatch! Expected ${header.hash}, got ${calculatedHash}`);
+        // Decide whether to continue or fail
+        // throw new Error('Payload integrity check failed!');
+    } else {
+        logger.info('Payload hash verified.');
+    }
+}
+
+// Runs `nsi-sandbox verity <mode>`; returns its exit status.
+function runVerity(sandboxExecutable, mode, rootfsPath, manifestPath) {
+    const result = require('child_process').spawnSync(sandboxExecutable, ['verity', mode, rootfsPath, manifestPath], {
+        stdio: ['ignore', 'inherit', 'inherit'],
+    });
+    return result.status;
+}
+
+// Returns a kept rootfs for this image, extracting it on first use.
+// With fs-verity digests in the header the tree is sealed once; later
+// launches only ask the kernel for each file's digest, and file pages are
+// verified as the app reads them. Without fs-verity, the payload is hashed
+// at extraction time as before.
+async function prepareCachedRootfs(sandboxExecutable, fileHandle, payloadOffset, header) {
+    const cacheDir = rootfsCacheDir();
+    const rootfsPath = path.join(cacheDir, header.hash);
+    // Manifest lives next to (not inside) the rootfs; it only exists once sealed
+    const manifestPath = `${rootfsPath}.verity`;
+    await fs.mkdir(cacheDir, { recursive: true });
+
+    if (fsSync.existsSync(rootfsPath)) {
+        if (!fsSync.existsSync(manifestPath)) {
+            logger.info(`Reusing cached rootfs (not sealed): ${rootfsPath}`);
+            return rootfsPath;
+        }
+        if (runVerity(sandboxExecutable, 'check', rootfsPath, manifestPath) === 0) {
+            logger.info(`Reusing fs-verity sealed rootfs: ${rootfsPath}`);
+            return rootfsPath;
+        }
+        logger.warn('Cached rootfs failed fs-verity check, extracting again.');
+        await fs.rm(rootfsPath, { recursive: true, force: true });
+        await fs.rm(manifestPath, { force: true });
     }
 
-    throw new Error("Could not find the 'nsi-sandbox' executable. Build it first (npm run build:sandbox) or make sure it's in your PATH or bundled correctly.");
+    const stagingPath = await fs.mkdtemp(`${rootfsPath}.tmp-`);
+    try {
+        logger.info(`Extracting payload to cache: ${stagingPath}`);
+        const payloadBuffer = await extractPayload(fileHandle, payloadOffset, stagingPath, header);
+        logger.info('Payload extracted successfully.');
+
+        let sealed = false;
+        if (header.verity && header.verity.files) {
+            const stagingManifest = `${stagingPath}.verity`;
+            await fs.writeFile(stagingManifest, verity.formatManifest(header.verity.files));
+            const status = runVerity(sandboxExecutable, 'seal', stagingPath, stagingManifest);
+            if (status === 0) {
+                // Every file's kernel-measured digest matched the image: no full hash needed
+                await fs.rename(stagingManifest, manifestPath);
+                sealed = true;
+            } else {
+                await fs.rm(stagingManifest, { force: true });
+                if (status !== 2) throw new Error('Extracted files do not match the image fs-verity digests!');
+                logger.info('fs-verity not supported here, falling back to payload hash.');
+            }
+        }
+        if (!sealed && payloadBuffer) verifyPayloadHash(payloadBuffer, header);
+
+        try {
+            await fs.rename(stagingPath, rootfsPath);
+        } catch (err) {
+            // A concurrent run cached it first; use theirs
+            if (err.code !== 'ENOTEMPTY' && err.code !== 'EEXIST') throw err;
+            await fs.rm(stagingPath, { recursive: true, force: true });
+        }
+    } catch (err) {
+        await fs.rm(stagingPath, { recursive: true, force: true });
+        throw err;
+    }
+    return rootfsPath;
 }
 
 module.exports = {
@@ -56,6 +204,89 @@ module.exports = {
                 type: 'number',
                 // default: 1.0 // Default CPU limit (may need complex cgroup setup)
             })
+            .option('reuse-rootfs', {
+                describe: 'Keep the extracted rootfs in the cache and reuse it (sealed with fs-verity where supported). The cached tree is shared and read-only: the app\'s writes go to a private in-memory layer and are gone when it exits',
+                type: 'boolean',
+                default: false
+            })
+            .option('rootfs-tmpfs', {
+                describe: 'Extract the image into a memory-backed rootfs of this size (e.g. 64M; default: the --mem limit) instead of a temp dir; charged to the container, never written to disk',
+                type: 'string'
+            })
+            .option('mem-request', {
+                describe: 'Memory the container is expected to need (e.g., 128M); protected from reclaim and used by nsi-sandbox oomd',
+                type: 'string'
+            })
+            .option('priority', {
+                describe: 'Priority class for nsi-sandbox oomd (critical containers are never killed)',
+                choices: ['critical', 'high', 'normal', 'low']
+            })
+            .option('virtual-proc', {
+                describe: 'Show container limits in /proc/meminfo, cpuinfo, stat and loadavg (needs /dev/fuse)',
+                type: 'boolean',
+                default: false
+            })
+            .option('logs', {
+                describe: 'Capture container output for "nsi logs" (default: unless stdout is a terminal, which the app then keeps; --logs captures anyway, --no-logs never). Logs idle for 14 days are pruned',
+                type: 'boolean'
+            })
+            .option('log-forward', {
+                describe: 'Also ship output lines to a local collector (unix:<path>, tcp:<ip>:<port>, udp:<ip>:<port>)',
+                type: 'string'
+            })
+            .option('log-format', {
+                describe: 'Record format for --log-forward',
+                choices: ['json', 'syslog'],
+                default: 'json'
+            })
+            .option('net', {
+                describe: 'Network: host (shared), none (private, loopback only) or user (private, outbound via a user-mode stack; host services at 10.0.2.2)',
+                choices: ['host', 'none', 'user'],
+                default: 'host'
+            })
+            .option('net-rate', {
+                describe: 'Limit container bandwidth in each direction, tc units (e.g. 10mbit, 500kbit); needs a private network namespace, so not with --pod',
+                type: 'string'
+            })
+            .option('net-burst', {
+                describe: 'Burst size for --net-rate (e.g. 64k); defaults to ~10ms of traffic',
+                type: 'string'
+            })
+            .option('pod', {
+                describe: 'Join a pod created with "nsi pod create": share its network (127.0.0.1), IPC and hostname',
+                type: 'string'
+            })
+            .option('tenant', {
+                describe: 'Run in the user namespace of a tenant created with "nsi tenant create" (cannot be combined with --pod)',
+                type: 'string'
+            })
+            .option('listen', {
+                describe: 'Listen on [addr:]port on the host; the app inherits the sockets as fd 3, 4, ... (LISTEN_FDS). Repeatable',
+                type: 'array',
+                default: []
+            })
+            .option('replace', {
+                describe: 'Take over the --listen sockets of this running container (its ID), then stop it (SIGTERM, SIGKILL after --grace)',
+                type: 'string'
+            })
+            .option('grace', {
+                describe: 'With --replace: seconds the old container has to exit after SIGTERM',
+                type: 'number',
+                default: 30
+            })
+            .option('ready-log', {
+                describe: 'With --replace: ready when an output line matches this regex (default: as soon as the app starts)',
+                type: 'string'
+            })
+            .option('metrics', {
+                describe: 'Record resource usage every <ms> milliseconds for "nsi metrics", kept after the container exits (e.g. 1000)',
+                type: 'number'
+            })
+            .option('metrics-slots', {
+                describe: 'Samples kept by --metrics (oldest are overwritten)',
+                type: 'number',
+                default: 3600
+            })
             .option('env', {
                 alias: 'e',
                 describe: 'Set environment variables (e.g., -e VAR=value)',
@@ -69,8 +300,24 @@ module.exports = {
         const imageFullPath = path.resolve(argv.imagePath);
         const containerId = uuidv4().substring(0, 8); // Short unique ID for this run
         let tempExtractPath = null; // Keep track for cleanup
+        let rootfsPath = null;
+        // --rootfs-tmpfs with no size: as large as the container may grow anyway
+        const tmpfsSize = argv.rootfsTmpfs === undefined ? null : (argv.rootfsTmpfs || argv.mem);
 
         try {
+            if (tmpfsSize && argv.reuseRootfs) {
+                throw new Error('--rootfs-tmpfs and --reuse-rootfs cannot be combined');
+            }
+            if (argv.replace && argv.listen.length === 0) {
+                throw new Error('--replace needs --listen: the sockets to take over');
+            }
+            if (argv.readyLog && !argv.replace) {
+                throw new Error('--ready-log only applies with --replace');
+            }
+            if (!(argv.grace >= 0)) {
+                throw new Error('--grace must be a number of seconds');
+            }
+            const readyRe = argv.readyLog ? new RegExp(argv.readyLog) : STARTED;
             const sandboxExecutable = findSandboxExecutable();
             logger.info(`Using sandbox executable: ${sandboxExecutable}`);
 
@@ -96,59 +343,47 @@ module.exports = {
             logger.info(`Image Name: ${header.imageName}, Version: ${header.version}`);
             logger.info(`Command: ${header.cmd.join(' ')}`);
 
-            // 2. Prepare Extraction Path
-            tempExtractPath = await fs.mkdtemp(path.join(os.tmpdir(), `neoshell-${containerId}-rootfs-`));
-            logger.info(`Extracting payload to: ${tempExtractPath}`);
-
-            // 3. Read, Decompress, and Extract Payload
-            const stats = await fileHandle.stat();
+            // 2. Prepare the rootfs: reuse a kept one, or extract to a temp dir.
+            //    A tmpfs rootfs is filled by the sandbox itself (step 5).
             const payloadOffset = 12 + headerLength;
-            const payloadLength = stats.size - payloadOffset;
-            const compressedPayloadBuffer = Buffer.alloc(payloadLength);
-            await fileHandle.read(compressedPayloadBuffer, 0, payloadLength, payloadOffset);
-            await fileHandle.close(); // Close file handle now
-
-            const payloadBuffer = await new Promise((resolve, reject) => {
-                zlib.unzip(compressedPayloadBuffer, (err, buffer) => {
-                    if (err) return reject(err);
-                    resolve(buffer);
-                });
-            });
-
-            // Verify hash (optional but recommended)
-            const calculatedHash = crypto.createHash('sha256').update(payloadBuffer).digest('hex');
-            if (calculatedHash !== header.hash) {
-                logger.warn(`Payload hash mismatch! Expected ${header.hash}, got ${calculatedHash}`);
-                // Decide whether to continue or fail
-                // throw new Error('Payload integrity check failed!');
+            if (tmpfsSize) {
+                logger.info(`Image will be streamed into a ${tmpfsSize} tmpfs rootfs`);
+            } else if (argv.reuseRootfs) {
+                rootfsPath = await prepareCachedRootfs(sandboxExecutable, fileHandle, payloadOffset, header);
             } else {
-                logger.info('Payload hash verified.');
-            }
+                tempExtractPath = await fs.mkdtemp(path.join(os.tmpdir(), `neoshell-${containerId}-rootfs-`));
+                rootfsPath = tempExtractPath;
+                logger.info(`Extracting payload to: ${tempExtractPath}`);
 
-            // Extract tar stream from buffer
-            await new Promise((resolve, reject) => {
-                 // Create a readable stream from the buffer
-                const Readable = require('stream').Readable;
-                const stream = new Readable();
-                stream.push(payloadBuffer);
-                stream.push(null); // Signal EOF
-
-                const extract = tar.extract(tempExtractPath);
-                stream.pipe(extract);
-                extract.on('finish', resolve);
-                extract.on('error', reject);
-            });
-            logger.info('Payload extracted successfully.');
+                // 3. Read, Decompress, and Extract Payload
+                const payloadBuffer = await extractPayload(fileHandle, payloadOffset, tempExtractPath, header);
+                if (payloadBuffer) verifyPayloadHash(payloadBuffer, header);
+                logger.info('Payload extracted successfully.');
+            }
+            if (!tmpfsSize) await fileHandle.close(); // Close file handle now
 
 
             // 4. Prepare Arguments for nsi-sandbox
             const sandboxArgs = [
-                `--rootfs=${tempExtractPath}`,
+                tmpfsSize ? `--rootfs-tmpfs=${tmpfsSize}` : `--rootfs=${rootfsPath}`,
+                ...(argv.reuseRootfs ? ['--rootfs-overlay'] : []), // Shared by every run of the image
                 `--workdir=${header.workDir}`,
                 ...Object.entries(header.env).map(([key, value]) => `--env=${key}=${value}`),
                 ...argv.env.map(e => `--env=${e}`),
                 `--mem=${argv.mem}`,
+                ...(argv.memRequest ? [`--mem-request=${argv.memRequest}`] : []),
+                ...(argv.priority ? [`--priority=${argv.priority}`] : []),
                 `--cgroup-id=${containerId}`, 
+                ...(argv.virtualProc ? ['--virtual-proc'] : []),
+                ...(argv.logForward ? [`--log-forward=${argv.logForward}`, `--log-format=${argv.logFormat}`] : []),
+                ...(argv.net !== 'host' ? [`--net=${argv.net}`] : []),
+                ...(argv.netRate ? [`--net-rate=${argv.netRate}`] : []),
+                ...(argv.netBurst ? [`--net-burst=${argv.netBurst}`] : []),
+                ...(argv.pod ? [`--pod=${argv.pod}`] : []),
+                ...(argv.tenant ? [`--tenant=${argv.tenant}`] : []),
+                ...argv.listen.map((l) => `--listen=${l}`),
+                ...(argv.replace ? [`--takeover=${argv.replace}`] : []),
+                ...(argv.metrics ? [`--metrics-interval=${argv.metrics}`, `--metrics-slots=${argv.metricsSlots}`] : []),
                 ...header.cmd
             ];
     
@@ -156,11 +391,76 @@ module.exports = {
             logger.info(`> ${sandboxExecutable} ${sandboxArgs.join(' ')}`);
 
             // 5. Spawn nsi-sandbox
+            // Pipe child's stdio directly to this process's stdio, or tee
+            // stdout/stderr into the log store when capturing (and watch
+            // it for readiness when replacing a container)
+            const captureLogs = argv.logs === undefined ? !process.stdout.isTTY : argv.logs;
+            const watchOutput = captureLogs || argv.replace;
+            if (captureLogs) await pruneLogs().catch((err) => logger.warn(`Pruning old logs failed: ${err.message}`));
+            const stdio = watchOutput ? ['inherit', 'pipe', 'pipe'] : ['inherit', 'inherit', 'inherit'];
+            if (tmpfsSize) stdio.push('pipe'); // fd 3: the image tar streams
+            // The sandbox's own lines get a pipe of their own, so that the
+            // app's stderr is recorded as it is
+            const sandboxLogFd = watchOutput ? stdio.push('pipe') - 1 : -1;
             const child = spawn(sandboxExecutable, sandboxArgs, {
-                stdio: 'inherit', // Pipe child's stdio directly to this process's stdio
+                stdio,
+                env: watchOutput ? { ...process.env, NSI_LOG_FD: String(sandboxLogFd) } : process.env,
                 // detached: false, // Set true for detached mode later
             });
 
+            if (tmpfsSize) {
+                // Streamed while the sandbox sets up its namespaces. If it
+                // fails, the sandbox sees a short stream and gives up.
+                const imagePipe = child.stdio[3];
+                imagePipe.on('error', () => {}); // Surfaces in streamPayload
+                child.on('close', () => imagePipe.destroy());
+                streamPayload(fileHandle, payloadOffset, header, imagePipe)
+                    .catch((err) => {
+                        logger.error(`Streaming the image failed: ${err.message}`);
+                        imagePipe.destroy();
+                    })
+                    .finally(() => fileHandle.close());
+            }
+
+            if (argv.listen.length > 0) {
+                logger.log(`Listeners of container ${containerId} can be taken over by a later run with --replace ${containerId}`);
+            }
+
+            // The old container drains once this one is ready; both serve the same sockets until then
+            let drained = false;
+            const drainReplaced = () => {
+                if (drained) return;
+                drained = true;
+                logger.log(`Replacement ready, draining container ${argv.replace}`);
+                const result = spawnSync(sandboxExecutable, ['handover', 'drain', argv.replace, `--grace=${Math.floor(argv.grace)}`], { stdio: 'inherit' });
+                if (result.status !== 0) logger.warn(`Could not drain container ${argv.replace}; stop it yourself`);
+            };
+
+            let logWriter = null;
+            if (captureLogs) {
+                logWriter = new LogWriter(containerId);
+                logger.info(`Container ID: ${containerId} (view output with: nsi logs ${containerId})`);
+            }
+            if (watchOutput) {
+                const readyOut = argv.replace ? lineWatcher(readyRe, drainReplaced) : null;
+                const readyErr = argv.replace ? lineWatcher(readyRe, drainReplaced) : null;
+                const readySandbox = argv.replace ? lineWatcher(readyRe, drainReplaced) : null;
+                child.stdout.on('data', (chunk) => {
+                    process.stdout.write(chunk);
+                    if (logWriter) logWriter.write('o', chunk);
+                    if (readyOut) readyOut(chunk);
+                });
+                child.stderr.on('data', (chunk) => {
+                    process.stderr.write(chunk);
+                    if (logWriter) logWriter.write('e', chunk);
+                    if (readyErr) readyErr(chunk);
+                });
+                child.stdio[sandboxLogFd].on('data', (chunk) => {
+                    process.stderr.write(chunk); // Shown, not recorded
+                    if (readySandbox) readySandbox(chunk);
+                });
+            }
+
             // 6. Wait for exit and handle cleanup (simplified)
             child.on('error', (err) => {
                 logger.error(`Failed to start sandbox process: ${err.message}`);
@@ -168,15 +468,17 @@ module.exports = {
                 process.exitCode = 1;
             });
 
-            child.on('close', (code) => {
+            child.on('close', async (code) => {
                 logger.log(`Container process exited with code ${code}`);
+                if (logWriter) await logWriter.close(); // Compacts the last segment
                 cleanup(); // Attempt cleanup
                 process.exitCode = code; // Propagate exit code
             });
 
-            // Handle Ctrl+C interrupting the Node.js script
-            process.on('SIGINT', () => {
-                logger.log('\nSIGINT received, attempting to stop container...');
+            // Handle Ctrl+C interrupting the Node.js script, and SIGTERM
+            // (e.g. from "nsi up" stopping a stack) the same way
+            const stopOnSignal = (signal, exitCode) => {
+                logger.log(`\n${signal} received, attempting to stop container...`);
                 if (child.pid) {
                     // Send SIGTERM to the child process group (more robust for cleanup)
                     try {
@@ -193,10 +495,12 @@ module.exports = {
                 // Cleanup is handled by the 'close' event handler
                 // Give cleanup a moment before forceful exit
                 setTimeout(() => {
-                    logger.warn('Exiting after SIGINT timeout.');
-                    process.exit(130); // Exit code for Ctrl+C
+                    logger.warn(`Exiting after ${signal} timeout.`);
+                    process.exit(exitCode); // 128 + signal number
                 }, 2000); // Wait 2s for cleanup
-            });
+            };
+            process.on('SIGINT', () => stopOnSignal('SIGINT', 130));
+            process.on('SIGTERM', () => stopOnSignal('SIGTERM', 143));
 
 
         } catch (err) {
@@ -0,0 +1,43 @@
+// neoshell/src/cli/commands/runq.js
+const { spawnSync } = require('child_process');
+const logger = require('../utils/logger');
+const { findSandboxExecutable } = require('../utils/sandbox');
+
+module.exports = {
+    command: 'runq [containerIds..]',
+    describe: 'Measure how long containers wait for a CPU, and whether to add cores, raise a quota or move them',
+    builder: (yargs) => {
+        yargs
+            .positional('containerIds', {
+                describe: 'Container IDs printed by "nsi run" (omit for all running containers)',
+                type: 'string',
+                array: true,
+            })
+            .option('interval', {
+                describe: 'Sampling interval in milliseconds',
+                type: 'number',
+                default: 1000,
+            })
+            .option('duration', {
+                describe: 'Seconds to measure for',
+                type: 'number',
+                default: 10,
+            })
+            .option('json', {
+                describe: 'Print the report as JSON',
+                type: 'boolean',
+                default: false,
+            });
+    },
+    handler: (argv) => {
+        const args = ['runq', ...(argv.containerIds || []),
+            `--interval=${argv.interval}`, `--duration=${argv.duration}`, ...(argv.json ? ['--json'] : [])];
+        try {
+            const result = spawnSync(findSandboxExecutable(), args, { stdio: 'inherit' });
+            process.exitCode = result.status === null ? 1 : result.status;
+        } catch (err) {
+            logger.error(err.message);
+            process.exitCode = 1;
+        }
+    },
+};
@@ -0,0 +1,62 @@
+// neoshell/src/cli/commands/stats.js
+const { execFileSync } = require('child_process');
+const logger = require('../utils/logger');
+const { findSandboxExecutable } = require('../utils/sandbox');
+
+const fmt = (v, unit = '') => (v === null || v === undefined ? '-' : `${v}${unit}`);
+const mib = (v) => (v === null ? '-' : `${(v / 1048576).toFixed(1)}MiB`);
+
+function printSummary(s) {
+    const cg = s.cgroup;
+    console.log(`Container ${s.id}`);
+    console.log(`  memory     ${mib(cg.memory_current)} / ${cg.memory_max === null ? 'max' : mib(cg.memory_max)}  (oom ${fmt(cg.oom)}, oom_kill ${fmt(cg.oom_kill)})`);
+    if (cg.working_set !== null && cg.working_set !== undefined) console.log(`  working    ${mib(cg.working_set)} (estimated by nsi-sandbox reclaim)`);
+    console.log(`  cpu        ${fmt(cg.usage_usec, 'us')} used, throttled ${fmt(cg.nr_throttled)}x / ${fmt(cg.throttled_usec, 'us')}`);
+    console.log(`  pids       ${fmt(cg.pids_current)}`);
+    const tcp = s.tcp;
+    if (!tcp) {
+        console.log('  tcp        unavailable');
+        return;
+    }
+    const states = Object.entries(tcp.states).map(([k, v]) => `${k} ${v}`).join(', ');
+    console.log(`  tcp        ${tcp.sockets} sockets${states ? ` (${states})` : ''}${tcp.private_netns ? '' : ', host network (own sockets only)'}`);
+    console.log(`  rtt        avg ${fmt(tcp.rtt_us_avg, 'us')}, max ${fmt(tcp.rtt_us_max, 'us')}; retransmits ${tcp.retransmits}, lost ${tcp.lost}`);
+    console.log(`  listen     overflows ${fmt(tcp.listen_overflows)}, drops ${fmt(tcp.listen_drops)}`);
+    for (const l of tcp.listeners) {
+        const full = l.backlog >= l.max_backlog ? '  FULL' : '';
+        console.log(`    :${l.port}  accept queue ${l.backlog}/${l.max_backlog}${full}`);
+    }
+}
+
+module.exports = {
+    command: 'stats <containerId>',
+    describe: 'Show resource usage and TCP socket stats of a running container',
+    builder: (yargs) => {
+        yargs
+            .positional('containerId', {
+                describe: 'Container ID printed by "nsi run"',
+                type: 'string',
+            })
+            .option('json', {
+                describe: 'Print the raw JSON object',
+                type: 'boolean',
+                default: false,
+            });
+    },
+    handler: (argv) => {
+        try {
+            const out = execFileSync(findSandboxExecutable(), ['stats', argv.containerId], {
+                encoding: 'utf8',
+                stdio: ['ignore', 'pipe', 'inherit'],
+            });
+            if (argv.json) {
+                process.stdout.write(out);
+            } else {
+                printSummary(JSON.parse(out));
+            }
+        } catch (err) {
+            logger.error(err.status ? `Could not read stats for container ${argv.containerId}` : err.message);
+            process.exitCode = 1;
+        }
+    },
+};
@@ -0,0 +1,37 @@
+// neoshell/src/cli/commands/tenant.js
+const { spawnSync } = require('child_process');
+const logger = require('../utils/logger');
+const { findSandboxExecutable } = require('../utils/sandbox');
+
+module.exports = {
+    command: 'tenant <action> [name]',
+    describe: 'Manage tenants: containers run with --tenant <name> share its user namespace (one identity for shared caches and volumes)',
+    builder: (yargs) => {
+        yargs
+            .positional('action', {
+                describe: 'create, rm or ls',
+                choices: ['create', 'rm', 'ls'],
+            })
+            .positional('name', {
+                describe: 'Tenant name',
+                type: 'string',
+            });
+    },
+    handler: (argv) => {
+        if (argv.action !== 'ls' && !argv.name) {
+            logger.error(`"nsi tenant ${argv.action}" needs a tenant name`);
+            process.exitCode = 1;
+            return;
+        }
+        try {
+            const args = ['tenant', argv.action, ...(argv.action === 'ls' ? [] : [argv.name])];
+            const result = spawnSync(findSandboxExecutable(), args, {
+                stdio: 'inherit',
+            });
+            process.exitCode = result.status === null ? 1 : result.status;
+        } catch (err) {
+            logger.error(err.message);
+            process.exitCode = 1;
+        }
+    },
+};
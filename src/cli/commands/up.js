@@ -0,0 +1,157 @@
+// neoshell/src/cli/commands/up.js
+const net = require('net');
+const { spawn } = require('child_process');
+const logger = require('../utils/logger');
+const { loadStack } = require('../utils/stack');
+const { STARTED } = require('../utils/sandbox');
+
+const TCP_POLL_MS = 50;
+
+// Resolves when something accepts on 127.0.0.1:port, unless cancelled() first.
+function waitTcp(port, cancelled) {
+    return new Promise((resolve) => {
+        const attempt = () => {
+            if (cancelled()) return;
+            const sock = net.connect({ host: '127.0.0.1', port }, () => {
+                sock.destroy();
+                resolve();
+            });
+            sock.on('error', () => setTimeout(attempt, TCP_POLL_MS));
+        };
+        attempt();
+    });
+}
+
+// The chain of dependencies that determined when `name` became ready.
+function criticalPath(services, state, name) {
+    const path = [name];
+    for (;;) {
+        const deps = services[path[0]].dependsOn;
+        if (deps.length === 0) return path;
+        path.unshift(deps.reduce((a, b) => (state[b].readyAt > state[a].readyAt ? b : a)));
+    }
+}
+
+module.exports = {
+    command: 'up <specPath>',
+    describe: 'Start a multi-container stack, each service as soon as its dependencies are ready',
+    builder: (yargs) => {
+        yargs
+            .positional('specPath', {
+                describe: 'Path to the stack spec (YAML, see src/cli/utils/stack.js)',
+                type: 'string',
+            });
+    },
+    handler: (argv) => {
+        let stack;
+        try {
+            stack = loadStack(argv.specPath);
+        } catch (err) {
+            logger.error(`Invalid stack spec: ${err.message}`);
+            process.exitCode = 1;
+            return;
+        }
+        const { services, order } = stack;
+        const t0 = process.hrtime.bigint();
+        const now = () => Number(process.hrtime.bigint() - t0) / 1e6;
+        const width = Math.max(...order.map((n) => n.length));
+        const state = {}; // name -> { child, startedAt, readyAt, exited }
+        let stopping = false;
+
+        const stopAll = (reason) => {
+            if (stopping) return;
+            stopping = true;
+            if (reason) {
+                logger.error(reason);
+                process.exitCode = 1;
+            }
+            for (const s of Object.values(state)) {
+                if (s.exited) continue;
+                try {
+                    process.kill(-s.child.pid, 'SIGTERM'); // Its "nsi run" and the sandbox
+                } catch (e) {
+                    // Already gone
+                }
+            }
+        };
+
+        const report = () => {
+            const total = Math.max(...order.map((n) => state[n].readyAt));
+            const last = order.find((n) => state[n].readyAt === total);
+            const sequential = order.reduce((sum, n) => sum + (state[n].readyAt - state[n].startedAt), 0);
+            logger.log(`Stack "${stack.name}" ready in ${total.toFixed(0)}ms:`);
+            for (const name of order) {
+                const s = state[name];
+                console.log(`  ${name.padEnd(width)}  start ${s.startedAt.toFixed(0).padStart(6)}ms  ready ${s.readyAt.toFixed(0).padStart(6)}ms  (${(s.readyAt - s.startedAt).toFixed(0)}ms)`);
+            }
+            logger.log(`Critical path: ${criticalPath(services, state, last).join(' -> ')}; one at a time would take ~${sequential.toFixed(0)}ms`);
+        };
+
+        const markReady = (name) => {
+            const s = state[name];
+            if (s.readyAt !== undefined || stopping) return;
+            s.readyAt = now();
+            clearTimeout(s.timer);
+            logger.log(`${name} ready (${(s.readyAt - s.startedAt).toFixed(0)}ms after start)`);
+            if (order.every((n) => state[n] && state[n].readyAt !== undefined)) report();
+            schedule();
+        };
+
+        const launch = (name) => {
+            const svc = services[name];
+            const child = spawn(process.execPath, [process.argv[1], 'run', svc.image, ...svc.args], {
+                stdio: ['ignore', 'pipe', 'pipe'],
+                detached: true, // Own process group, so the service can be stopped as a whole
+            });
+            const s = { child, startedAt: now(), exited: false };
+            state[name] = s;
+            logger.log(`Starting ${name}${svc.dependsOn.length ? ` (after ${svc.dependsOn.join(', ')})` : ''}`);
+
+            // Output is prefixed per service; readiness lines are matched as they arrive
+            const prefix = `${name.padEnd(width)} | `;
+            const lineSplitter = (stream) => {
+                let partial = '';
+                return (chunk) => {
+                    const lines = (partial + chunk.toString('utf8')).split('\n');
+                    partial = lines.pop();
+                    for (const line of lines) {
+                        stream.write(prefix + line + '\n');
+                        if (svc.ready.kind === 'started' && STARTED.test(line)) markReady(name);
+                        if (svc.ready.kind === 'log' && svc.ready.re.test(line)) markReady(name);
+                    }
+                };
+            };
+            child.stdout.on('data', lineSplitter(process.stdout));
+            child.stderr.on('data', lineSplitter(process.stderr));
+
+            if (svc.ready.kind === 'tcp') waitTcp(svc.ready.port, () => s.exited || stopping).then(() => markReady(name));
+            s.timer = setTimeout(() => stopAll(`${name} not ready within ${svc.readyTimeout / 1000}s, stopping the stack`), svc.readyTimeout);
+
+            child.on('close', (code, signal) => {
+                s.exited = true;
+                clearTimeout(s.timer);
+                const status = signal ? `signal ${signal}` : `code ${code}`;
+                if (svc.ready.kind === 'exited' && code === 0) {
+                    markReady(name);
+                } else if (s.readyAt === undefined) {
+                    stopAll(`${name} exited with ${status} before it was ready, stopping the stack`);
+                } else {
+                    logger.log(`${name} exited with ${status}`);
+                    if (!stopping && code !== 0) process.exitCode = 1;
+                }
+            });
+        };
+
+        // Starts every service whose dependencies are all ready
+        const schedule = () => {
+            for (const name of order) {
+                if (stopping || state[name]) continue;
+                if (services[name].dependsOn.every((dep) => state[dep] && state[dep].readyAt !== undefined)) launch(name);
+            }
+        };
+
+        process.on('SIGINT', () => stopAll());
+        process.on('SIGTERM', () => stopAll());
+        schedule();
+    },
+};
@@ -5,7 +5,17 @@ const { hideBin } = require('yargs/helpers');
 
 yargs(hideBin(process.argv))
   .command(require('./commands/build'))
+  .command(require('./commands/import'))
   .command(require('./commands/run'))
+  .command(require('./commands/logs'))
+  .command(require('./commands/stats'))
+  .command(require('./commands/metrics'))
+  .command(require('./commands/profile'))
+  .command(require('./commands/runq'))
+  .command(require('./commands/up'))
+  .command(require('./commands/pod'))
+  .command(require('./commands/tenant'))
+  .command(require('./commands/adopt'))
   // Add other commands here (e.g., list, inspect, rm)
   .demandCommand(1, 'You need to specify a command (e.g., build, run).')
   .help()
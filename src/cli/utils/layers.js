@@ -0,0 +1,259 @@
+// neoshell/src/cli/utils/layers.js
+// Chunked image payloads: one chunk per filesystem layer, applied in order.
+//
+// A chunk is a layer tar exactly as in OCI/docker images (whiteouts
+// included), deflated. It is named by the SHA-256 of the uncompressed tar,
+// which is the layer's OCI "diff ID", so a base layer shared by several
+// images is only converted once (see chunkStoreDir). Each .nsi still carries
+// its own copy of every chunk, and `nsi run` applies every layer of the
+// image it runs: images share the conversion, not disk space or extraction.
+//
+// Layers are streamed, never held in memory whole: a layer is a function
+// that opens its uncompressed tar afresh, read once to check it and once to
+// extract it.
+//
+// Whiteouts (OCI image spec, "Representing Changes"):
+//   dir/.wh.name      removes dir/name of the lower layers
+//   dir/.wh..wh..opq  removes everything in dir of the lower layers
+const fsSync = require('fs');
+const fs = require('fs').promises;
+const os = require('os');
+const path = require('path');
+const { pipeline } = require('stream');
+const tar = require('tar-fs');
+const tarStream = require('tar-stream');
+const zlib = require('zlib');
+const crypto = require('crypto');
+const verity = require('./verity');
+
+const WHITEOUT = '.wh.';
+const OPAQUE = '.wh..wh..opq';
+
+// Converted chunks kept for later imports, named <hex digest>.zz
+function chunkStoreDir() {
+    const base = process.env.XDG_CACHE_HOME || path.join(os.homedir(), '.cache');
+    return path.join(base, 'neoshell', 'chunks');
+}
+
+const sha256 = (buf) => `sha256:${crypto.createHash('sha256').update(buf).digest('hex')}`;
+
+// "./usr/bin/" -> "usr/bin"
+function normalizeName(name) {
+    return path.posix.normalize(`/${name}`).slice(1).replace(/\/$/, '');
+}
+
+// Reads a tar stream, calling onEntry({ header, name, data }) per entry in
+// order; data is only kept for regular files, and only when withData.
+function readTar(input, withData, onEntry) {
+    return new Promise((resolve, reject) => {
+        const extract = tarStream.extract();
+        extract.on('entry', (header, stream, next) => {
+            const keep = withData && header.type === 'file';
+            const chunks = [];
+            if (keep) stream.on('data', (c) => chunks.push(c));
+            stream.on('end', () => {
+                onEntry({ header, name: normalizeName(header.name), data: keep ? Buffer.concat(chunks) : null });
+                next();
+            });
+            stream.resume();
+        });
+        extract.on('finish', resolve);
+        extract.on('error', reject);
+        input.on('error', reject);
+        input.pipe(extract);
+    });
+}
+
+// "sha256:<hex>" of everything the stream yields, once it ends.
+function streamDigest(input) {
+    return new Promise((resolve, reject) => {
+        const hash = crypto.createHash('sha256');
+        input.on('data', (c) => hash.update(c));
+        input.on('end', () => resolve(`sha256:${hash.digest('hex')}`));
+        input.on('error', reject);
+    });
+}
+
+// Absolute path of rel inside root, or null if a symlink would lead it out.
+async function insideRoot(root, rel) {
+    const target = path.join(root, rel);
+    let parent;
+    try {
+        parent = await fs.realpath(path.dirname(target));
+    } catch (err) {
+        return null; // Parent does not exist: nothing there to remove
+    }
+    if (parent !== root && !parent.startsWith(`${root}/`)) return null;
+    return path.join(parent, path.basename(target));
+}
+
+// Creates the parent directories of rel inside root, refusing to go through
+// anything that is not a real directory (as tar-fs does). Returns the
+// absolute path of rel, or null.
+async function makeParents(root, rel) {
+    let dir = root;
+    for (const part of path.posix.dirname(rel).split('/').filter((p) => p && p !== '.')) {
+        dir = path.join(dir, part);
+        const st = await fs.lstat(dir).catch(() => null);
+        if (!st) await fs.mkdir(dir, { mode: 0o755 });
+        else if (!st.isDirectory()) return null;
+    }
+    return path.join(dir, path.posix.basename(rel));
+}
+
+// True if nothing on the way to rel is a symlink (or other non-directory);
+// typeOf(path) gives the tar type at a path, undefined if there is none.
+// tar-fs follows symlinks when it creates directories and hard links, so
+// lower layers' symlinks could otherwise take an entry out of the rootfs.
+function realPath(rel, typeOf) {
+    const parts = rel.split('/').filter((p) => p && p !== '.');
+    for (let i = 0; i < parts.length; i++) {
+        const type = typeOf(parts.slice(0, i + 1).join('/'));
+        if (type === undefined) return true; // Not there yet: created as real directories
+        if (type === 'symlink' || (i < parts.length - 1 && type !== 'directory')) return false;
+    }
+    return true;
+}
+
+// Whether applyLayer extracts a (non-whiteout) entry, given what is there
+function extracted({ header, name }, typeOf) {
+    if (header.type === 'symlink') return realPath(path.posix.dirname(name), typeOf); // See makeParents
+    return realPath(name, typeOf) && (header.type !== 'link' || realPath(normalizeName(header.linkname), typeOf));
+}
+
+// Tar type of what is at rel inside root, undefined if nothing
+function typeAt(root, rel) {
+    let st;
+    try {
+        st = fsSync.lstatSync(path.join(root, rel));
+    } catch (err) {
+        return undefined;
+    }
+    return st.isSymbolicLink() ? 'symlink' : st.isDirectory() ? 'directory' : 'file';
+}
+
+// Applies one layer on top of destPath. layer: { open() -> tar stream,
+// digest } (digest checked before anything is changed; null to skip).
+async function applyLayer(layer, destPath) {
+    const root = await fs.realpath(destPath);
+    const entries = [];
+    const read = layer.open();
+    const [digest] = await Promise.all([streamDigest(read), readTar(read, false, (e) => entries.push(e))]);
+    if (layer.digest && digest !== layer.digest) throw new Error(`Chunk ${layer.digest} is corrupt (digest mismatch)`);
+
+    // 1. Whiteouts and replaced entries, while only the lower layers are there
+    for (const { header, name } of entries) {
+        if (!name) continue;
+        const base = path.posix.basename(name);
+        const dir = path.posix.dirname(name);
+        if (base === OPAQUE) {
+            const target = await fs.realpath(path.join(root, dir)).catch(() => null);
+            const inside = target && (target === root || target.startsWith(`${root}/`));
+            const children = inside ? await fs.readdir(target).catch(() => []) : [];
+            for (const child of children) await fs.rm(path.join(target, child), { recursive: true, force: true });
+        } else if (base.startsWith(WHITEOUT)) {
+            const target = await insideRoot(root, path.posix.join(dir, base.slice(WHITEOUT.length)));
+            if (target) await fs.rm(target, { recursive: true, force: true });
+        } else {
+            const target = await insideRoot(root, name);
+            const st = target && await fs.lstat(target).catch(() => null);
+            // A directory over a directory merges; anything else replaces
+            if (st && !(st.isDirectory() && header.type === 'directory')) await fs.rm(target, { recursive: true, force: true });
+        }
+    }
+
+    // 2. Contents. Symlinks are made below: tar-fs refuses absolute targets,
+    //    which images are full of (/etc/alternatives/...). Entries through a
+    //    lower layer's symlink are dropped, checked as each one is reached.
+    const symlinks = entries.filter((e) => e.header.type === 'symlink' && e.name);
+    await new Promise((resolve, reject) => {
+        const extract = tar.extract(root, {
+            ignore: (name, header) => header.type === 'symlink' || path.basename(name).startsWith(WHITEOUT) ||
+                !extracted({ header, name: path.relative(root, name) }, (rel) => typeAt(root, rel)),
+            dmode: 0o700, // Keep directories writable for later layers and cleanup
+            strict: false, // Device nodes and fifos are skipped
+        });
+        const input = layer.open();
+        extract.on('finish', resolve);
+        extract.on('error', reject);
+        input.on('error', reject);
+        input.pipe(extract);
+    });
+    for (const { header, name } of symlinks) {
+        const target = await makeParents(root, name);
+        if (!target) continue;
+        await fs.rm(target, { recursive: true, force: true });
+        await fs.symlink(header.linkname, target);
+    }
+}
+
+// Final file view of a layer stack, built one layer at a time without
+// extracting it: files maps paths to fs-verity digests (regular files),
+// entries maps paths to types. Entries applyLayer would drop are left out.
+function layerView() {
+    const entries = new Map();
+    const files = {};
+    // Drops name (unless keepSelf) and everything below it; '.' is the root
+    const remove = (name, keepSelf) => {
+        for (const key of [...entries.keys()]) {
+            if ((key === name && !keepSelf) || name === '.' || key.startsWith(`${name}/`)) {
+                entries.delete(key);
+                delete files[key];
+            }
+        }
+    };
+    // Adds the layer tar read from input on top
+    const add = async (input) => {
+        const layer = [];
+        await readTar(input, true, ({ header, name, data }) => {
+            // One file's data at a time: only its digest is kept
+            const digest = header.type === 'file' && !name.includes('\n') ? verity.fsverityDigest(data) : null;
+            layer.push({ header, name, digest });
+        });
+        for (const { header, name } of layer) {
+            if (!name) continue;
+            const base = path.posix.basename(name);
+            const dir = path.posix.dirname(name);
+            if (base === OPAQUE) {
+                remove(dir, true);
+            } else if (base.startsWith(WHITEOUT)) {
+                remove(path.posix.join(dir, base.slice(WHITEOUT.length)), false);
+            } else if (!(header.type === 'directory' && entries.get(name) === 'directory')) {
+                remove(name, false);
+            }
+        }
+        // In extraction order: this layer's symlinks are made last
+        const typeOf = (rel) => entries.get(rel);
+        const kept = layer.filter((e) => e.name && !path.posix.basename(e.name).startsWith(WHITEOUT));
+        for (const e of [...kept.filter((k) => k.header.type !== 'symlink'), ...kept.filter((k) => k.header.type === 'symlink')]) {
+            if (!extracted(e, typeOf)) continue;
+            entries.set(e.name, e.header.type);
+            if (e.digest) files[e.name] = e.digest;
+        }
+    };
+    return { files, entries, add };
+}
+
+// The layers of a chunked payload (header.chunks), in order, as applyLayer
+// takes them: each opens its stretch of the image file and inflates it.
+function chunkLayers(fileHandle, payloadOffset, header) {
+    let offset = payloadOffset;
+    return header.chunks.map((chunk) => {
+        const start = offset;
+        offset += chunk.length;
+        const open = () => pipeline(
+            fileHandle.createReadStream({ start, end: start + chunk.length - 1, autoClose: false }),
+            zlib.createInflate(),
+            () => {}); // Errors reach whoever reads the returned stream
+        return { digest: chunk.digest, open };
+    });
+}
+
+// Extracts a chunked payload (header.chunks) into destPath, verifying each chunk.
+async function extractChunks(fileHandle, payloadOffset, header, destPath) {
+    for (const layer of chunkLayers(fileHandle, payloadOffset, header)) {
+        await applyLayer(layer, destPath);
+    }
+}
+
+module.exports = { chunkStoreDir, sha256, streamDigest, applyLayer, layerView, chunkLayers, extractChunks };
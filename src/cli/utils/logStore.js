@@ -0,0 +1,245 @@
+// neoshell/src/cli/utils/logStore.js
+// On-disk store for captured container output.
+//
+// Layout of <logsDir>/<containerId>/:
+//   <seq>.active     Current segment, plain records, appended as output arrives.
+//   <seq>.seg        Rotated segment: a sequence of independently gzipped frames
+//                    (so the whole file is also valid input for zcat).
+//   <seq>.idx        Sparse index for <seq>.seg: one entry per frame with its byte
+//                    range and first/last timestamp, so time-range reads only
+//                    decompress the frames they need.
+//
+// A record is one line: "<epoch ms> <o|e> <text>\n".
+//
+// Retention: a container keeps its newest MAX_SEGMENTS segments (older ones
+// are deleted as it rotates), and pruneLogs() deletes the logs of
+// containers that have written nothing for RETENTION_DAYS.
+const fs = require('fs');
+const fsPromises = require('fs').promises;
+const { StringDecoder } = require('string_decoder');
+const path = require('path');
+const os = require('os');
+const zlib = require('zlib');
+const { promisify } = require('util');
+const logger = require('./logger');
+
+const gzip = promisify(zlib.gzip);
+const gunzip = promisify(zlib.gunzip);
+
+const SEGMENT_BYTES = 8 * 1024 * 1024; // Rotate the active segment at this size
+const FRAME_BYTES = 256 * 1024;        // Uncompressed bytes per seekable frame
+const MAX_SEGMENTS = 16;               // Per container: at most 128 MiB before compression
+const RETENTION_DAYS = 14;             // Logs of containers idle this long are pruned
+
+function logsDir() {
+    const base = process.env.XDG_STATE_HOME || path.join(os.homedir(), '.local', 'state');
+    return path.join(base, 'neoshell', 'logs');
+}
+
+const seqName = (seq) => String(seq).padStart(6, '0');
+
+// Compresses a finished .active segment into .seg/.idx and removes it.
+async function compactSegment(dir, seq) {
+    const base = path.join(dir, seqName(seq));
+    const raw = await fsPromises.readFile(`${base}.active`);
+    const frames = [];
+    const parts = [];
+    let offset = 0;
+    let start = 0;
+    while (start < raw.length) {
+        // Cut frames on record boundaries
+        let end = Math.min(start + FRAME_BYTES, raw.length);
+        if (end < raw.length) {
+            const nl = raw.indexOf(0x0a, end - 1);
+            end = nl === -1 ? raw.length : nl + 1;
+        }
+        const chunk = raw.subarray(start, end);
+        const compressed = await gzip(chunk);
+        const lines = chunk.toString('utf8').split('\n').filter(Boolean);
+        frames.push({
+            offset,
+            length: compressed.length,
+            firstTs: parseInt(lines[0], 10),
+            lastTs: parseInt(lines[lines.length - 1], 10),
+            records: lines.length,
+        });
+        parts.push(compressed);
+        offset += compressed.length;
+        start = end;
+    }
+    await fsPromises.writeFile(`${base}.seg`, Buffer.concat(parts));
+    // The index is written last: its presence marks the segment as complete
+    await fsPromises.writeFile(`${base}.idx`, JSON.stringify({ version: 1, rawBytes: raw.length, frames }));
+    await fsPromises.unlink(`${base}.active`);
+}
+
+// Segment to continue an existing log at: the last one if it was never
+// compacted (its writer went away mid-segment), else the one after it.
+function resumeSeq(dir) {
+    let names;
+    try {
+        names = fs.readdirSync(dir);
+    } catch (err) {
+        if (err.code === 'ENOENT') return 0;
+        throw err;
+    }
+    const seqs = names.map((n) => parseInt(n, 10)).filter((n) => !Number.isNaN(n));
+    if (seqs.length === 0) return 0;
+    const last = Math.max(...seqs);
+    return names.includes(`${seqName(last)}.idx`) ? last + 1 : last;
+}
+
+// Deletes the segments of a log older than its newest maxSegments.
+async function pruneSegments(dir, newestSeq, maxSegments) {
+    const names = await fsPromises.readdir(dir);
+    for (const name of names) {
+        const seq = parseInt(name, 10);
+        if (!Number.isNaN(seq) && seq <= newestSeq - maxSegments) {
+            await fsPromises.rm(path.join(dir, name), { force: true });
+        }
+    }
+}
+
+// Deletes the logs of containers that have written nothing for maxAgeDays.
+async function pruneLogs(maxAgeDays = RETENTION_DAYS) {
+    const cutoff = Date.now() - maxAgeDays * 24 * 60 * 60 * 1000;
+    let ids;
+    try {
+        ids = await fsPromises.readdir(logsDir());
+    } catch (err) {
+        if (err.code === 'ENOENT') return;
+        throw err;
+    }
+    for (const id of ids) {
+        const dir = path.join(logsDir(), id);
+        const names = await fsPromises.readdir(dir).catch(() => []);
+        const mtimes = await Promise.all(names.map((n) => fsPromises.stat(path.join(dir, n)).then((st) => st.mtimeMs, () => 0)));
+        if (Math.max(0, ...mtimes) < cutoff) {
+            await fsPromises.rm(dir, { recursive: true, force: true });
+        }
+    }
+}
+
+class LogWriter {
+    // options.resume: append to the container's existing log (nsi adopt)
+    constructor(containerId, options = {}) {
+        this.dir = path.join(logsDir(), containerId);
+        this.segmentBytes = options.segmentBytes || SEGMENT_BYTES;
+        this.maxSegments = options.maxSegments || MAX_SEGMENTS;
+        this.seq = options.resume ? resumeSeq(this.dir) : 0;
+        this.partial = { o: '', e: '' }; // Unterminated line per stream
+        // Characters split across chunks are completed by the next one
+        this.decoders = { o: new StringDecoder('utf8'), e: new StringDecoder('utf8') };
+        this.pending = [];               // Compactions in flight
+        fs.mkdirSync(this.dir, { recursive: true });
+        this._openSegment();
+    }
+
+    _openSegment() {
+        const file = path.join(this.dir, `${seqName(this.seq)}.active`);
+        this.bytes = fs.existsSync(file) ? fs.statSync(file).size : 0; // A resumed segment keeps its records
+        this.out = fs.createWriteStream(file, { flags: 'a' });
+    }
+
+    // Closes the active segment and compacts it in the background.
+    _finishSegment() {
+        const seq = this.seq;
+        const finished = new Promise((resolve) => this.out.end(resolve))
+            .then(() => compactSegment(this.dir, seq))
+            .then(() => pruneSegments(this.dir, seq, this.maxSegments))
+            .catch((err) => logger.warn(`Log compaction failed for segment ${seq}: ${err.message}`));
+        this.pending.push(finished);
+    }
+
+    _rotate() {
+        this._finishSegment();
+        this.seq++;
+        this._openSegment();
+    }
+
+    // Appends a chunk of output from stream 'o' (stdout) or 'e' (stderr).
+    write(stream, chunk) {
+        const text = this.partial[stream] + (typeof chunk === 'string' ? chunk : this.decoders[stream].write(chunk));
+        const lines = text.split('\n');
+        this.partial[stream] = lines.pop();
+        const ts = Date.now();
+        let records = '';
+        for (const line of lines) {
+            records += `${ts} ${stream} ${line}\n`;
+        }
+        if (!records) return;
+        this.out.write(records);
+        this.bytes += Buffer.byteLength(records);
+        if (this.bytes >= this.segmentBytes) this._rotate();
+    }
+
+    // Flushes unterminated lines and compacts the final segment; nothing
+    // is appended once the container has exited.
+    async close() {
+        for (const stream of ['o', 'e']) {
+            const rest = this.partial[stream] + this.decoders[stream].end();
+            this.partial[stream] = '';
+            if (rest) this.write(stream, `${rest}\n`);
+        }
+        if (this.bytes > 0) {
+            this._finishSegment();
+        } else {
+            await new Promise((resolve) => this.out.end(resolve));
+            await fsPromises.unlink(path.join(this.dir, `${seqName(this.seq)}.active`));
+        }
+        await Promise.all(this.pending);
+    }
+}
+
+// Yields records in [since, until] (epoch ms, either may be null) in order.
+async function* readLogs(containerId, since = null, until = null) {
+    const dir = path.join(logsDir(), containerId);
+    const names = await fsPromises.readdir(dir);
+    const seqs = [...new Set(names.map((n) => parseInt(n, 10)).filter((n) => !Number.isNaN(n)))].sort((a, b) => a - b);
+    const inRange = (ts) => (since === null || ts >= since) && (until === null || ts <= until);
+
+    function* parse(text) {
+        for (const line of text.split('\n')) {
+            if (!line) continue;
+            const s1 = line.indexOf(' ');
+            const ts = parseInt(line.slice(0, s1), 10);
+            if (!inRange(ts)) continue;
+            yield { ts, stream: line.slice(s1 + 1, s1 + 2), text: line.slice(s1 + 3) };
+        }
+    }
+
+    for (const seq of seqs) {
+        const base = path.join(dir, seqName(seq));
+        let index = null;
+        try {
+            index = JSON.parse(await fsPromises.readFile(`${base}.idx`, 'utf8'));
+        } catch (err) {
+            if (err.code !== 'ENOENT') throw err;
+        }
+
+        if (!index) {
+            // Active (or not yet compacted) segment: plain records, bounded in size
+            try {
+                yield* parse(await fsPromises.readFile(`${base}.active`, 'utf8'));
+            } catch (err) {
+                if (err.code !== 'ENOENT') throw err;
+            }
+            continue;
+        }
+
+        const handle = await fsPromises.open(`${base}.seg`, 'r');
+        try {
+            for (const frame of index.frames) {
+                if (since !== null && frame.lastTs < since) continue;
+                if (until !== null && frame.firstTs > until) break; // Frames are time-ordered
+                const buf = Buffer.alloc(frame.length);
+                await handle.read(buf, 0, frame.length, frame.offset);
+                yield* parse((await gunzip(buf)).toString('utf8'));
+            }
+        } finally {
+            await handle.close();
+        }
+    }
+}
+
+module.exports = { logsDir, LogWriter, readLogs, compactSegment, pruneLogs };
@@ -0,0 +1,180 @@
+// neoshell/src/cli/utils/oci.js
+// Reads container images from local archives for "nsi import":
+//
+//   OCI image layout   a directory, or a tar of one (oci-layout, index.json, blobs/)
+//   docker save        a tar with manifest.json, <config>.json and layer tars
+//
+// Both resolve to the image config plus its layers, uncompressed and checked
+// against their digests. Layers are streamed from disk: a tar archive is
+// unpacked to a temporary directory first rather than read into memory.
+const fsSync = require('fs');
+const fs = require('fs').promises;
+const os = require('os');
+const path = require('path');
+const zlib = require('zlib');
+const crypto = require('crypto');
+const { pipeline, Transform } = require('stream');
+const tar = require('tar-fs');
+const { sha256 } = require('./layers');
+
+const OCI_INDEX = ['application/vnd.oci.image.index.v1+json', 'application/vnd.docker.distribution.manifest.list.v2+json'];
+const ARCH = { x64: 'amd64', arm64: 'arm64', arm: 'arm', ia32: '386', ppc64: 'ppc64le', s390x: 's390x' };
+
+// { has(name), read(name), file(name), close() } over a directory or an
+// (uncompressed) tar archive.
+async function openSource(inputPath) {
+    let dir = inputPath;
+    let temp = null;
+    if (!fsSync.statSync(inputPath).isDirectory()) {
+        temp = await fs.mkdtemp(path.join(os.tmpdir(), 'neoshell-import-'));
+        await new Promise((resolve, reject) => {
+            const extract = tar.extract(temp, { dmode: 0o700, strict: false });
+            extract.on('finish', resolve);
+            extract.on('error', reject);
+            fsSync.createReadStream(inputPath).on('error', reject).pipe(extract);
+        }).catch(async (err) => {
+            await fs.rm(temp, { recursive: true, force: true });
+            throw err;
+        });
+        dir = temp;
+    }
+    const file = (name) => path.join(dir, path.join('/', name));
+    const has = (name) => fsSync.existsSync(file(name));
+    return {
+        has,
+        read: (name) => {
+            if (!has(name)) throw new Error(`${inputPath}: missing ${name}`);
+            return fsSync.readFileSync(file(name));
+        },
+        file: (name) => {
+            if (!has(name)) throw new Error(`${inputPath}: missing ${name}`);
+            return file(name);
+        },
+        close: () => (temp ? fs.rm(temp, { recursive: true, force: true }) : Promise.resolve()),
+    };
+}
+
+// Passes data through, failing at the end unless its SHA-256 is expected.
+function verified(expected, what) {
+    const hash = crypto.createHash('sha256');
+    return new Transform({
+        transform(chunk, encoding, callback) {
+            hash.update(chunk);
+            callback(null, chunk);
+        },
+        flush(callback) {
+            callback(`sha256:${hash.digest('hex')}` === expected ? null : new Error(`${what} is corrupt (digest mismatch)`));
+        },
+    });
+}
+
+// Layer blob file -> stream of the uncompressed tar (layers may be plain or
+// gzip'ed tars), checked against the blob digest when there is one.
+function openLayer(file, blobDigest, what) {
+    const magic = Buffer.alloc(4);
+    const fd = fsSync.openSync(file, 'r');
+    try {
+        fsSync.readSync(fd, magic, 0, 4, 0);
+    } finally {
+        fsSync.closeSync(fd);
+    }
+    if (magic.readUInt32LE(0) === 0xfd2fb528) throw new Error(`${what}: zstd-compressed layers are not supported`);
+    const streams = [fsSync.createReadStream(file)];
+    if (blobDigest) streams.push(verified(blobDigest, `Blob ${blobDigest}`));
+    if (magic[0] === 0x1f && magic[1] === 0x8b) streams.push(zlib.createGunzip());
+    if (streams.length === 1) return streams[0];
+    return pipeline(...streams, () => {}); // Errors reach whoever reads the returned stream
+}
+
+// "docker.io/library/node:18-alpine" -> { name: 'node', version: '18-alpine' }
+function parseRef(ref) {
+    const at = ref.indexOf('@');
+    const base = at === -1 ? ref : ref.slice(0, at);
+    const colon = base.lastIndexOf(':');
+    const hasTag = colon > base.lastIndexOf('/');
+    const repo = hasTag ? base.slice(0, colon) : base;
+    return { name: repo.split('/').pop(), version: hasTag ? base.slice(colon + 1) : 'latest' };
+}
+
+function pick(candidates, ref, refsOf, what) {
+    if (ref) {
+        const match = candidates.find((c) => refsOf(c).some((r) => r === ref || r.endsWith(`/${ref}`)));
+        if (!match) throw new Error(`No image "${ref}" in ${what} (has: ${candidates.flatMap(refsOf).join(', ') || 'untagged images'})`);
+        return match;
+    }
+    if (candidates.length !== 1) {
+        throw new Error(`${what} holds ${candidates.length} images, choose one with --ref (${candidates.flatMap(refsOf).join(', ')})`);
+    }
+    return candidates[0];
+}
+
+function loadOci(source, ref) {
+    const blob = (digest) => {
+        const [alg, hex] = digest.split(':');
+        const data = source.read(`blobs/${alg}/${hex}`);
+        if (alg === 'sha256' && sha256(data) !== digest) throw new Error(`Blob ${digest} is corrupt (digest mismatch)`);
+        return data;
+    };
+    const json = (digest) => JSON.parse(blob(digest).toString('utf8'));
+    const refsOf = (m) => Object.entries(m.annotations || {})
+        .filter(([k]) => k === 'org.opencontainers.image.ref.name' || k === 'io.containerd.image.name')
+        .map(([, v]) => v);
+
+    const index = JSON.parse(source.read('index.json').toString('utf8'));
+    let desc = pick(index.manifests || [], ref, refsOf, 'OCI layout');
+    let imageRef = refsOf(desc).find((r) => r.includes(':')) || ref || null;
+    let manifest = json(desc.digest);
+    // Multi-platform image: the manifest for this machine
+    while (OCI_INDEX.includes(desc.mediaType) || (manifest.manifests && !manifest.layers)) {
+        const arch = ARCH[process.arch] || process.arch;
+        desc = manifest.manifests.find((m) => m.platform && m.platform.os === 'linux' && m.platform.architecture === arch);
+        if (!desc) throw new Error(`No linux/${arch} image in the OCI index`);
+        manifest = json(desc.digest);
+    }
+    return {
+        ref: imageRef,
+        config: json(manifest.config.digest),
+        layerBlobs: manifest.layers.map((l) => ({
+            file: source.file(`blobs/${l.digest.replace(':', '/')}`),
+            digest: l.digest.startsWith('sha256:') ? l.digest : null,
+        })),
+    };
+}
+
+function loadDockerSave(source, ref) {
+    const images = JSON.parse(source.read('manifest.json').toString('utf8'));
+    const image = pick(images, ref, (m) => m.RepoTags || [], 'docker save archive');
+    return {
+        ref: (image.RepoTags || []).find((r) => !ref || r === ref || r.endsWith(`/${ref}`)) || null,
+        config: JSON.parse(source.read(image.Config).toString('utf8')),
+        layerBlobs: image.Layers.map((p) => ({ file: source.file(p), digest: null })),
+    };
+}
+
+// Loads an image: { ref, name, version, config, layers, close() }. A layer
+// is { diffId, open() -> uncompressed tar stream }; the caller checks the
+// diff ID as it reads. close() removes what was unpacked.
+async function loadImage(inputPath, ref) {
+    const source = await openSource(inputPath);
+    try {
+        let image;
+        if (source.has('index.json') && source.has('oci-layout')) {
+            image = loadOci(source, ref);
+        } else if (source.has('manifest.json')) {
+            image = loadDockerSave(source, ref);
+        } else {
+            throw new Error(`${inputPath} is neither an OCI image layout nor a docker save archive`);
+        }
+        const diffIds = (image.config.rootfs && image.config.rootfs.diff_ids) || [];
+        const layers = image.layerBlobs.map(({ file, digest }, i) => ({
+            diffId: diffIds[i] || null,
+            open: () => openLayer(file, digest, `layer ${i + 1}`),
+        }));
+        return { ...image, ...(image.ref ? parseRef(image.ref) : { name: null, version: null }), layers, close: source.close };
+    } catch (err) {
+        await source.close();
+        throw err;
+    }
+}
+
+module.exports = { loadImage, parseRef };
@@ -0,0 +1,33 @@
+// neoshell/src/cli/utils/sandbox.js
+const fsSync = require('fs');
+const path = require('path');
+
+// Printed by nsi-sandbox right before the app is exec'd
+const STARTED = /\[nsi-sandbox\] Entering Stage 3/;
+
+// Helper to find the bundled sandbox executable
+function findSandboxExecutable() {
+    // Inside pkg snapshot, __dirname points to snapshot filesystem
+    const possiblePath = path.join(__dirname, '..', '..', '..', 'build', 'nsi-sandbox');
+    // When running directly via node, it's relative to the script
+    const possiblePathDev = path.resolve(__dirname, '..', '..', '..', 'build', 'nsi-sandbox');
+
+    if (fsSync.existsSync(possiblePath)) {
+        return possiblePath;
+    }
+    if (fsSync.existsSync(possiblePathDev)) {
+        return possiblePathDev;
+    }
+    // Fallback: Check PATH (if installed system-wide)
+    // You might need more robust logic here
+    try {
+        const pathOutput = require('child_process').execSync('which nsi-sandbox', { encoding: 'utf8' });
+        return pathOutput.trim();
+    } catch (e) {
+        // Not found in PATH
+    }
+
+    throw new Error("Could not find the 'nsi-sandbox' executable. Build it first (npm run build:sandbox) or make sure it's in your PATH or bundled correctly.");
+}
+
+module.exports = { STARTED, findSandboxExecutable };
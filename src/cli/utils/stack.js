@@ -0,0 +1,92 @@
+// neoshell/src/cli/utils/stack.js
+// Loads a multi-container stack spec (YAML) for "nsi up":
+//
+//   name: shop
+//   services:
+//     cache:
+//       image: ./cache.nsi          # Relative to the spec file
+//       ready: { tcp: 6379 }
+//     migrate:
+//       image: ./migrate.nsi
+//       ready: exited               # Must exit 0 before dependents start
+//     app:
+//       image: ./app.nsi
+//       depends_on: [cache, migrate]
+//       env: [PORT=3000]
+//       mem: 256M
+//       ready: { log: "listening on" }
+//       ready_timeout: 30           # Seconds (default 60)
+//       args: [--reuse-rootfs]      # Extra "nsi run" options
+//       pod: shop                   # Existing pod to join (nsi pod create shop)
+//       tenant: acme                # Existing tenant's user namespace (nsi tenant create acme)
+//       net: user                   # host (default), none or user (nsi run --net)
+//       metrics: 1000               # Record resource usage every second (nsi metrics)
+//
+// Readiness: "started" (default: the app process has been exec'd),
+// "exited", { tcp: port }, { log: regex }.
+const fs = require('fs');
+const path = require('path');
+const YAML = require('yaml');
+
+const RUN_OPTIONS = { mem: 'mem', mem_request: 'mem-request', priority: 'priority', net: 'net', net_rate: 'net-rate', net_burst: 'net-burst', pod: 'pod', tenant: 'tenant', metrics: 'metrics' };
+
+function parseReady(name, ready) {
+    if (ready === undefined || ready === 'started') return { kind: 'started' };
+    if (ready === 'exited') return { kind: 'exited' };
+    if (ready && typeof ready === 'object') {
+        if (Number.isInteger(ready.tcp)) return { kind: 'tcp', port: ready.tcp };
+        if (typeof ready.log === 'string') return { kind: 'log', re: new RegExp(ready.log) };
+    }
+    throw new Error(`Service "${name}": ready must be started, exited, { tcp: <port> } or { log: <regex> }`);
+}
+
+// Service names in an order where every service comes after its dependencies.
+function startOrder(services) {
+    const order = [];
+    const state = {}; // undefined: new, 1: visiting, 2: done
+    const visit = (name, from) => {
+        if (state[name] === 2) return;
+        if (state[name] === 1) throw new Error(`Dependency cycle: ${[...from, name].join(' -> ')}`);
+        state[name] = 1;
+        for (const dep of services[name].dependsOn) visit(dep, [...from, name]);
+        state[name] = 2;
+        order.push(name);
+    };
+    Object.keys(services).forEach((name) => visit(name, []));
+    return order;
+}
+
+function loadStack(specPath) {
+    const fullPath = path.resolve(specPath);
+    const spec = YAML.parse(fs.readFileSync(fullPath, 'utf8'));
+    if (!spec || typeof spec.services !== 'object' || Object.keys(spec.services).length === 0) {
+        throw new Error(`${specPath}: no services defined`);
+    }
+    const baseDir = path.dirname(fullPath);
+    const services = {};
+    for (const [name, s] of Object.entries(spec.services)) {
+        if (!s || typeof s.image !== 'string') throw new Error(`Service "${name}": image is required`);
+        const dependsOn = s.depends_on || [];
+        if (!Array.isArray(dependsOn)) throw new Error(`Service "${name}": depends_on must be a list`);
+        for (const dep of dependsOn) {
+            if (!spec.services[dep]) throw new Error(`Service "${name}" depends on unknown service "${dep}"`);
+        }
+        const args = [];
+        for (const [key, option] of Object.entries(RUN_OPTIONS)) {
+            if (s[key] !== undefined) args.push(`--${option}=${s[key]}`);
+        }
+        for (const e of s.env || []) args.push('-e', String(e));
+        args.push(...(s.args || []).map(String));
+        services[name] = {
+            name,
+            image: path.resolve(baseDir, s.image),
+            dependsOn,
+            ready: parseReady(name, s.ready),
+            readyTimeout: (s.ready_timeout || 60) * 1000,
+            args,
+        };
+    }
+    return { name: spec.name || path.basename(fullPath).replace(/\.ya?ml$/, ''), services, order: startOrder(services) };
+}
+
+module.exports = { loadStack };
@@ -0,0 +1,86 @@
+// neoshell/src/cli/utils/verity.js
+// fs-verity digests for image files, computed at build time so that a kept
+// (reused) rootfs can be sealed and checked by the kernel instead of hashed
+// up front on every launch. See src/sandbox/verity.cpp for the runtime side.
+const crypto = require('crypto');
+const tarStream = require('tar-stream');
+
+const BLOCK_SIZE = 4096;   // Must match VERITY_BLOCK_SIZE in verity.cpp
+const HASH_ALG_SHA256 = 1; // FS_VERITY_HASH_ALG_SHA256
+const DIGEST_SIZE = 32;
+
+const sha256 = (buf) => crypto.createHash('sha256').update(buf).digest();
+
+// Root of the fs-verity Merkle tree: hash every data block, pack the hashes
+// into blocks, and repeat until a single block is left.
+function merkleRoot(data) {
+    if (data.length === 0) return Buffer.alloc(DIGEST_SIZE); // Empty file: all zeros
+
+    let level = data;
+    for (;;) {
+        const blocks = Math.ceil(level.length / BLOCK_SIZE);
+        if (blocks === 1) {
+            const last = Buffer.alloc(BLOCK_SIZE);
+            level.copy(last, 0, 0, level.length);
+            return sha256(last);
+        }
+        const hashes = Buffer.alloc(blocks * DIGEST_SIZE);
+        const padded = Buffer.alloc(BLOCK_SIZE);
+        for (let i = 0; i < blocks; i++) {
+            const start = i * BLOCK_SIZE;
+            let block = level.subarray(start, start + BLOCK_SIZE);
+            if (block.length < BLOCK_SIZE) {
+                padded.fill(0);
+                block.copy(padded);
+                block = padded;
+            }
+            sha256(block).copy(hashes, i * DIGEST_SIZE);
+        }
+        level = hashes;
+    }
+}
+
+// The file digest the kernel reports via FS_IOC_MEASURE_VERITY: SHA-256 over
+// struct fsverity_descriptor (version 1, no salt, no signature).
+function fsverityDigest(data) {
+    const desc = Buffer.alloc(256);
+    desc.writeUInt8(1, 0);                      // version
+    desc.writeUInt8(HASH_ALG_SHA256, 1);        // hash_algorithm
+    desc.writeUInt8(Math.log2(BLOCK_SIZE), 2);  // log_blocksize
+    desc.writeUInt8(0, 3);                      // salt_size
+    desc.writeBigUInt64LE(BigInt(data.length), 8); // data_size
+    merkleRoot(data).copy(desc, 16);            // root_hash[64]
+    return sha256(desc).toString('hex');
+}
+
+// Walks an uncompressed tar payload and returns { relativePath: digest } for
+// every regular file.
+function computeVerityDigests(tarBuffer) {
+    return new Promise((resolve, reject) => {
+        const files = {};
+        const extract = tarStream.extract();
+        extract.on('entry', (header, stream, next) => {
+            const chunks = [];
+            stream.on('data', (c) => chunks.push(c));
+            stream.on('end', () => {
+                const name = header.name.replace(/^(\.\/|\/)+/, '');
+                // Newlines can't be represented in the line-based manifest
+                if (header.type === 'file' && name && !name.includes('\n')) {
+                    files[name] = fsverityDigest(Buffer.concat(chunks));
+                }
+                next();
+            });
+            stream.resume();
+        });
+        extract.on('finish', () => resolve(files));
+        extract.on('error', reject);
+        extract.end(tarBuffer);
+    });
+}
+
+// Manifest consumed by `nsi-sandbox verity seal|check`.
+function formatManifest(files) {
+    return Object.entries(files).map(([name, digest]) => `${digest} ${name}\n`).join('');
+}
+
+module.exports = { BLOCK_SIZE, fsverityDigest, computeVerityDigests, formatManifest };
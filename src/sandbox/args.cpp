@@ -0,0 +1,217 @@
+// neoshell/src/sandbox/args.cpp
+#include "args.h"
+#include "utils.h"
+#include "netshape.h"
+#include "oomd.h"
+#include "holder.h"
+#include "tenant.h"
+#include "handover.h"
+#include "rootfs.h"
+
+#include <getopt.h>   // For argument parsing
+#include <fcntl.h>    // For fcntl (tar stream check)
+#include <sys/stat.h> // For stat
+
+// --- Argument Parsing Function (Revised) ---
+void parse_args(int argc, char* argv[], Args& args) {
+    struct option long_options[] = {
+        {"rootfs",    required_argument, 0, 'r'},
+        {"workdir",   required_argument, 0, 'w'},
+        {"env",       required_argument, 0, 'e'},
+        {"mem",       required_argument, 0, 'm'},
+        {"cgroup-id", required_argument, 0, 'g'},
+        {"virtual-proc", no_argument,     0, 'P'},
+        {"log-forward", required_argument, 0, 'L'},
+        {"log-format",  required_argument, 0, 'F'},
+        {"net-rate",    required_argument, 0, 'N'},
+        {"net-burst",   required_argument, 0, 'B'},
+        {"mem-request", required_argument, 0, 'R'},
+        {"priority",    required_argument, 0, 'Q'},
+        {"pod",         required_argument, 0, 'O'},
+        {"tenant",      required_argument, 0, 'U'},
+        {"metrics-interval", required_argument, 0, 'M'},
+        {"metrics-slots",    required_argument, 0, 'S'},
+        {"rootfs-tmpfs",     required_argument, 0, 'T'},
+        {"rootfs-overlay",   no_argument,       0, 'o'},
+        {"net",              required_argument, 0, 'n'},
+        {"listen",           required_argument, 0, 'l'},
+        {"takeover",         required_argument, 0, 'k'},
+        {"compile-plan",     required_argument, 0, 'C'},
+        // {"cpu",     required_argument, 0, 'p'}, // Example for future cpu limit
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    // Options string matching short options in long_options
+    const char *optstring = "r:w:e:m:g:PL:F:N:B:R:Q:O:U:M:S:T:on:l:k:C:";
+
+    // Reset getopt's internal index
+    optind = 1;
+
+    // Parse all options first
+    while ((opt = getopt_long(argc, argv, optstring, long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'r': args.rootfs = optarg; break;
+            case 'w': args.workdir = optarg; break;
+            case 'm': args.mem_limit = optarg; break;
+            case 'g': args.cgroup_id = optarg; break;
+            case 'P': args.virtual_proc = true; break;
+            case 'L': args.log_forward = optarg; break;
+            case 'F': args.log_format = optarg; break;
+            case 'N': args.net_rate = optarg; break;
+            case 'B': args.net_burst = optarg; break;
+            case 'R': args.mem_request = optarg; break;
+            case 'Q': args.priority = optarg; break;
+            case 'O': args.pod = optarg; break;
+            case 'U': args.tenant = optarg; break;
+            case 'M': args.metrics_interval_ms = strtoul(optarg, NULL, 10); break;
+            case 'S': args.metrics_slots = strtoul(optarg, NULL, 10); break;
+            case 'T': args.rootfs_tmpfs = optarg; break;
+            case 'o': args.rootfs_overlay = true; break;
+            case 'n': args.net = optarg; break;
+            case 'l': {
+                std::string spec;
+                if (!handover_parse_spec(optarg, spec)) {
+                    die(("Invalid --listen (expected [addr:]port, e.g. 8080, 127.0.0.1:8080, [::]:8080): " + std::string(optarg)).c_str());
+                }
+                args.listen.push_back(spec);
+                break;
+            }
+            case 'k': args.takeover = optarg; break;
+            case 'C': args.compile_plan = optarg; break;
+            // case 'p': args.cpu_limit = optarg; break; // Future cpu limit
+            case 'e': {
+                std::string env_pair = optarg;
+                size_t eq_pos = env_pair.find('=');
+                // Ensure there's an '=' and the key part isn't empty
+                if (eq_pos != std::string::npos && eq_pos > 0) {
+                    args.env_vars[env_pair.substr(0, eq_pos)] = env_pair.substr(eq_pos + 1);
+                } else {
+                    log_msg(("Warning: Ignoring invalid env var format: " + std::string(optarg)).c_str());
+                }
+                break;
+            }
+            case '?': // Unknown option or missing argument detected by getopt
+                // getopt_long usually prints its own error message for '?'
+                fprintf(stderr, "Usage: %s --rootfs <path> [--rootfs-overlay]|--rootfs-tmpfs <size> --cgroup-id <id> [--workdir <path>] [--mem <limit>] [--mem-request <size>] [--priority <class>] [--virtual-proc] [--log-forward <endpoint>] [--log-format json|syslog] [--net host|none|user] [--net-rate <rate>] [--net-burst <size>] [--pod <name>] [--tenant <name>|/dev/fd/<n>] [--listen [addr:]port] ... [--takeover <container-id>] [--metrics-interval <ms>] [--metrics-slots <n>] [--compile-plan <file>] [--env KEY=VAL] ... -- <command> [args...]\n       %s --plan <file> [--cgroup-id <id>]\n", argv[0], argv[0]);
+                exit(EXIT_FAILURE);
+            default:
+                // Should not happen with the current setup, but handle defensively
+                 fprintf(stderr, "Usage: %s --rootfs <path> [--rootfs-overlay]|--rootfs-tmpfs <size> --cgroup-id <id> [--workdir <path>] [--mem <limit>] [--mem-request <size>] [--priority <class>] [--virtual-proc] [--log-forward <endpoint>] [--log-format json|syslog] [--net host|none|user] [--net-rate <rate>] [--net-burst <size>] [--pod <name>] [--tenant <name>|/dev/fd/<n>] [--listen [addr:]port] ... [--takeover <container-id>] [--metrics-interval <ms>] [--metrics-slots <n>] [--compile-plan <file>] [--env KEY=VAL] ... -- <command> [args...]\n       %s --plan <file> [--cgroup-id <id>]\n", argv[0], argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    // After the loop, optind points to the first non-option argument (the command)
+    if (optind >= argc) {
+        die("Missing required command after options (use '--' if command resembles an option)");
+    }
+
+    // Collect the command and its arguments
+    for (int i = optind; i < argc; ++i) {
+        args.cmd.push_back(argv[i]);
+    }
+
+    // ---- Validation of parsed arguments ----
+    if (!args.rootfs_tmpfs.empty()) {
+        // The image arrives as tar streams on a pipe; the tmpfs is mounted
+        // over a directory of the host, in the container's namespace only
+        if (!args.rootfs.empty()) die("--rootfs and --rootfs-tmpfs are mutually exclusive");
+        if (args.rootfs_overlay) die("--rootfs-overlay applies to --rootfs, not --rootfs-tmpfs");
+        if (!rootfs_tmpfs_valid_size(args.rootfs_tmpfs)) {
+            die(("Invalid --rootfs-tmpfs size (expected e.g. 64M, 1G): " + args.rootfs_tmpfs).c_str());
+        }
+        // The stream belongs to a launch, not to a plan compiled for many
+        if (args.compile_plan.empty() && fcntl(NSI_ROOTFS_TAR_FD, F_GETFD) == -1) {
+            die("--rootfs-tmpfs expects the image tar stream on fd 3");
+        }
+        args.rootfs = NSI_ROOTFS_TMPFS_MOUNTPOINT;
+    }
+    if (args.rootfs.empty()) die("Missing required argument: --rootfs");
+    if (args.cmd.empty()) die("Missing required command after options"); // Should be caught above, but double-check
+    if (args.cgroup_id.empty()) die("Missing required argument: --cgroup-id");
+    if (!args.net_rate.empty() && !parse_rate(args.net_rate, args.net_rate_bps)) {
+        die(("Invalid --net-rate (expected e.g. 10mbit, 500kbit, 2mbps): " + args.net_rate).c_str());
+    }
+    if (!args.net_burst.empty()) {
+        if (args.net_rate.empty()) die("--net-burst requires --net-rate");
+        if (!parse_size(args.net_burst, args.net_burst_bytes)) {
+            die(("Invalid --net-burst (expected e.g. 64k, 1m): " + args.net_burst).c_str());
+        }
+    }
+    if (!args.priority.empty() && oomd_priority_rank(args.priority) == -1) {
+        die(("Invalid --priority (expected critical, high, normal or low): " + args.priority).c_str());
+    }
+    if (!args.pod.empty() && !holder_valid_name(args.pod)) {
+        die(("Invalid --pod name: " + args.pod).c_str());
+    }
+    if (!args.tenant.empty() && !holder_valid_name(args.tenant) && tenant_inherited_fd(args.tenant) == -1) {
+        die(("Invalid --tenant (expected a tenant name or /dev/fd/<n>): " + args.tenant).c_str());
+    }
+    if (!args.tenant.empty() && !args.pod.empty()) {
+        die("--tenant conflicts with --pod: pod members use the pod's user namespace");
+    }
+    if (args.net != "host" && args.net != "none" && args.net != "user") {
+        die(("Invalid --net (expected host, none or user): " + args.net).c_str());
+    }
+    if (args.net != "host" && !args.pod.empty()) {
+        die("--net conflicts with --pod: pod members use the pod's network (pod create --net)");
+    }
+    if (!args.net_rate.empty() && !args.pod.empty()) {
+        // Shaping applies to the namespace's interfaces: one member's would replace another's
+        die("--net-rate conflicts with --pod: pod members share the pod's interfaces");
+    }
+    if (args.listen.size() > 16) die("At most 16 --listen sockets");
+    if (!args.takeover.empty() && args.listen.empty()) die("--takeover requires --listen (the sockets to take)");
+    if (args.metrics_interval_ms != 0 && args.metrics_interval_ms < 10) {
+        die("--metrics-interval must be at least 10 (ms)");
+    }
+    if (args.metrics_slots < 2 || args.metrics_slots > 10000000) {
+        die("--metrics-slots must be between 2 and 10000000");
+    }
+    if (args.workdir.empty()) {
+        args.workdir = "/"; // Default workdir if not provided
+        log_msg("Workdir not specified, defaulting to '/'");
+    }
+    // Check if rootfs path exists (basic check)
+    struct stat st;
+    if (stat(args.rootfs.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        die(("Rootfs path specified is not a valid directory: " + args.rootfs).c_str());
+    }
+}
+
+void build_envp(const Args& args, const std::string& hostname,
+                std::vector<std::string>& storage, std::vector<char*>& envp) {
+    storage.clear();
+    storage.reserve(args.env_vars.size() + 5);
+    for (const auto& pair : args.env_vars) {
+        std::string& entry = storage.emplace_back();
+        entry.reserve(pair.first.size() + 1 + pair.second.size());
+        entry += pair.first;
+        entry += '=';
+        entry += pair.second;
+    }
+    // Add minimal required PATH if not set by user? Better to rely on image.
+    if (args.env_vars.find("PATH") == args.env_vars.end()) {
+        storage.push_back("PATH=/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin");
+        log_msg("-> Setting default PATH=/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin");
+    }
+    // Add container indicator
+    storage.push_back("NEOSHELL_CONTAINER=true");
+    // Add hostname
+    storage.push_back("HOSTNAME=" + hostname);
+    // Inherited listening sockets, systemd-style (the app is PID 1)
+    if (!args.listen.empty()) {
+        storage.push_back("LISTEN_FDS=" + std::to_string(args.listen.size()));
+        storage.push_back("LISTEN_PID=1");
+    }
+
+    // Only take pointers once storage is complete: growing the vector
+    // would move (short, inline-stored) strings and invalidate them.
+    envp.clear();
+    envp.reserve(storage.size() + 1);
+    for (std::string& entry : storage) {
+        envp.push_back(const_cast<char*>(entry.c_str()));
+    }
+    envp.push_back(nullptr); // Null-terminate the environment list
+}
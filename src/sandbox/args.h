@@ -0,0 +1,49 @@
+// neoshell/src/sandbox/args.h
+#ifndef NSI_SANDBOX_ARGS_H
+#define NSI_SANDBOX_ARGS_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// --- Argument Parsing Structure ---
+struct Args {
+    std::string rootfs;
+    std::string workdir;
+    std::string cgroup_id;
+    std::string mem_limit;
+    std::string mem_request;   // memory.low: protected from reclaim, and the oomd "request"
+    std::string priority;      // oomd priority class: critical, high, normal or low
+    bool virtual_proc = false; // Serve container-aware /proc/{meminfo,cpuinfo,stat,loadavg}
+    std::string log_forward;   // Collector endpoint: unix:<path>, tcp:<ip>:<port> or udp:<ip>:<port>
+    std::string log_format;    // json (default) or syslog
+    std::string net = "host";  // host (shared), none (loopback only) or user (tap + nsi-net, see netstack.h)
+    std::string net_rate;      // tc-style rate ("10mbit"), shapes egress and polices ingress
+    std::string net_burst;     // tc-style size ("64k"); default derived from the rate
+    uint64_t net_rate_bps = 0; // Parsed net_rate, bytes/s
+    uint32_t net_burst_bytes = 0;
+    std::string pod;           // Join this pod's network, IPC and UTS namespaces (see pod.h)
+    std::string tenant;        // Join this tenant's user namespace instead of creating one (see tenant.h)
+    uint32_t metrics_interval_ms = 0; // Record cgroup samples this often (see metrics.h); 0: off
+    uint32_t metrics_slots = 3600;    // Ring size in samples (an hour at 1s)
+    std::vector<std::string> listen; // Canonical "addr:port" specs, passed to the app as fds 3.. (see handover.h)
+    std::string takeover;      // Take the listening sockets of this running container
+    std::string rootfs_tmpfs;  // Size of a memory-backed rootfs, filled from a tar stream (see rootfs.h)
+    bool rootfs_overlay = false; // rootfs is shared: read-only under a private overlay (see rootfs.h)
+    std::string compile_plan;  // Write a launch plan here instead of launching (see plan.h)
+    // std::string cpu_limit; // TODO: Add later if needed
+    std::vector<std::string> cmd;
+    std::map<std::string, std::string> env_vars;
+};
+
+// Parses and validates the sandbox command line; dies on bad input.
+void parse_args(int argc, char* argv[], Args& args);
+
+// Builds the container's environment for execve: the --env variables plus
+// a default PATH, NEOSHELL_CONTAINER and HOSTNAME. storage owns the strings,
+// envp (nullptr-terminated) points into it.
+void build_envp(const Args& args, const std::string& hostname,
+                std::vector<std::string>& storage, std::vector<char*>& envp);
+
+#endif // NSI_SANDBOX_ARGS_H
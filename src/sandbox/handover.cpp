@@ -0,0 +1,428 @@
+// neoshell/src/sandbox/handover.cpp
+#include "handover.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <csignal>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/prctl.h>    // For PR_SET_NAME
+#include <sys/socket.h>
+#include <sys/stat.h>     // For mkdir
+#include <sys/syscall.h>  // For SYS_pidfd_open
+#include <sys/un.h>
+
+static const size_t MAX_LISTENERS = 16;     // One SCM_RIGHTS message carries them all
+static const int DEFAULT_GRACE_S = 30;
+static const int REQUEST_TIMEOUT_MS = 2000; // A client that connects but never asks
+static const int DRAIN_CHECK_MS = 100;      // How often a draining init's SIGTERM handler is checked
+
+static std::string listeners_dir() {
+    return runtime_dir() + "/listeners";
+}
+
+// Address of a container's handover socket; false if the path does not fit.
+static bool handover_address(const std::string& container_id, struct sockaddr_un& addr) {
+    std::string path = listeners_dir() + "/" + container_id;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (container_id.empty() || container_id.find('/') != std::string::npos || path.size() >= sizeof(addr.sun_path)) return false;
+    memcpy(addr.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+// --- Specs and Sockets ---
+
+static bool spec_address(const std::string& text, struct sockaddr_storage& ss, socklen_t& len) {
+    std::string host = "0.0.0.0", port = text;
+    size_t colon = text.rfind(':');
+    if (colon != std::string::npos) {
+        host = text.substr(0, colon);
+        port = text.substr(colon + 1);
+        if (host.size() >= 2 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+    }
+    char* end;
+    long p = strtol(port.c_str(), &end, 10);
+    if (port.empty() || *end || p < 1 || p > 65535) return false;
+    memset(&ss, 0, sizeof(ss));
+    struct sockaddr_in* in4 = reinterpret_cast<struct sockaddr_in*>(&ss);
+    struct sockaddr_in6* in6 = reinterpret_cast<struct sockaddr_in6*>(&ss);
+    if (inet_pton(AF_INET, host.c_str(), &in4->sin_addr) == 1) {
+        in4->sin_family = AF_INET;
+        in4->sin_port = htons(p);
+        len = sizeof(*in4);
+    } else if (inet_pton(AF_INET6, host.c_str(), &in6->sin6_addr) == 1) {
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(p);
+        len = sizeof(*in6);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool handover_parse_spec(const std::string& text, std::string& spec) {
+    struct sockaddr_storage ss;
+    socklen_t len;
+    if (!spec_address(text, ss, len)) return false;
+    char host[INET6_ADDRSTRLEN];
+    if (ss.ss_family == AF_INET) {
+        const struct sockaddr_in* in4 = reinterpret_cast<const struct sockaddr_in*>(&ss);
+        inet_ntop(AF_INET, &in4->sin_addr, host, sizeof(host));
+        spec = std::string(host) + ":" + std::to_string(ntohs(in4->sin_port));
+    } else {
+        const struct sockaddr_in6* in6 = reinterpret_cast<const struct sockaddr_in6*>(&ss);
+        inet_ntop(AF_INET6, &in6->sin6_addr, host, sizeof(host));
+        spec = "[" + std::string(host) + "]:" + std::to_string(ntohs(in6->sin6_port));
+    }
+    return true;
+}
+
+static int listen_on(const std::string& spec) {
+    struct sockaddr_storage ss;
+    socklen_t len = 0;
+    spec_address(spec, ss, len); // Validated by parse_args
+    errno = 0;
+    int fd = socket(ss.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) die(("--listen " + spec + ": socket failed").c_str());
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&ss), len) == -1) die(("--listen " + spec + ": bind failed").c_str());
+    if (listen(fd, SOMAXCONN) == -1) die(("--listen " + spec + ": listen failed").c_str());
+    return fd;
+}
+
+// --- Takeover (client side) ---
+
+static int handover_connect(const std::string& container_id) {
+    struct sockaddr_un addr;
+    if (!handover_address(container_id, addr)) return -1;
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+    struct timeval tv = {REQUEST_TIMEOUT_MS / 1000, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+// The old container's sockets: "spec\nspec\n..." with the fds in the same order.
+static std::vector<Listener> take_listeners(const std::string& container_id) {
+    errno = 0;
+    int fd = handover_connect(container_id);
+    if (fd == -1) die(("--takeover: container " + container_id + " has no listeners to hand over (not running, or run without --listen)").c_str());
+    if (send(fd, "take", 4, MSG_NOSIGNAL) != 4) die("--takeover: request failed");
+
+    char buf[4096];
+    char cbuf[CMSG_SPACE(sizeof(int) * MAX_LISTENERS)];
+    struct iovec iov = {buf, sizeof(buf)};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    close(fd);
+    if (n <= 0) die(("--takeover: no answer from container " + container_id).c_str());
+
+    std::vector<int> fds;
+    for (struct cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        size_t count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; ++i) {
+            int received;
+            memcpy(&received, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+            fds.push_back(received);
+        }
+    }
+    std::string names(buf, n);
+    std::vector<Listener> taken;
+    size_t pos = 0;
+    for (int received : fds) {
+        size_t end = names.find('\n', pos);
+        if (end == std::string::npos) {
+            close(received); // More sockets than names: not ours to guess
+            continue;
+        }
+        taken.push_back({names.substr(pos, end - pos), received});
+        pos = end + 1;
+    }
+    return taken;
+}
+
+// --- Keeper (nsi-listen) ---
+
+static void keeper_reply_listeners(int client, const std::vector<Listener>& listeners) {
+    std::string names;
+    for (const Listener& l : listeners) names += l.spec + "\n";
+    char cbuf[CMSG_SPACE(sizeof(int) * MAX_LISTENERS)];
+    memset(cbuf, 0, sizeof(cbuf));
+    struct iovec iov = {const_cast<char*>(names.data()), names.size()};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * listeners.size());
+    struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int) * listeners.size());
+    for (size_t i = 0; i < listeners.size(); ++i) memcpy(CMSG_DATA(c) + i * sizeof(int), &listeners[i].fd, sizeof(int));
+    sendmsg(client, &msg, MSG_NOSIGNAL);
+}
+
+// Whether pid has a handler for sig (SigCgt in /proc/<pid>/status). True
+// when that cannot be read, so callers fall back to signalling and waiting.
+static bool catches_signal(pid_t pid, int sig) {
+    std::string status;
+    if (!read_file_at(AT_FDCWD, ("/proc/" + std::to_string(pid) + "/status").c_str(), status)) return true;
+    size_t at = status.find("\nSigCgt:");
+    if (at == std::string::npos) return true;
+    unsigned long long mask = strtoull(status.c_str() + at + 8, NULL, 16);
+    return mask & (1ULL << (sig - 1));
+}
+
+// Waits for the container to exit: true if it did within timeout_ms (-1: forever).
+static bool keeper_wait_exit(int pidfd, pid_t pid, int timeout_ms) {
+    if (pidfd != -1) {
+        struct pollfd p = {pidfd, POLLIN, 0};
+        return poll(&p, 1, timeout_ms) == 1;
+    }
+    // Without pidfds (Linux < 5.3): poll the PID
+    for (int waited = 0; timeout_ms < 0 || waited < timeout_ms; waited += 100) {
+        if (kill(pid, 0) == -1 && errno == ESRCH) return true;
+        usleep(100000);
+    }
+    return false;
+}
+
+// Waits up to grace_ms for a container sent SIGTERM to exit. False if it
+// did not, or if it stopped catching SIGTERM while still running: a one-shot
+// handler that re-raises the signal (node's default one) leaves PID 1
+// ignoring it, so waiting longer would only delay the SIGKILL.
+static bool keeper_wait_drain(int pidfd, pid_t pid, int grace_ms) {
+    for (int waited = 0; waited < grace_ms; waited += DRAIN_CHECK_MS) {
+        if (keeper_wait_exit(pidfd, pid, std::min(DRAIN_CHECK_MS, grace_ms - waited))) return true;
+        if (!catches_signal(pid, SIGTERM)) return false;
+    }
+    return keeper_wait_exit(pidfd, pid, 0);
+}
+
+[[noreturn]] static void keeper_main(const std::string& path, int srv, int ctl, std::vector<Listener> listeners) {
+    prctl(PR_SET_NAME, "nsi-listen", 0, 0, 0);
+    signal(SIGINT, SIG_IGN); // Ctrl+C is for the container; we follow it out
+    signal(SIGHUP, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+    int null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (null_fd != -1) {
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+    }
+    // Hold nothing of the sandbox's but our sockets (other helpers' pipes
+    // would otherwise stay open as long as we do)
+    std::vector<int> keep = {srv, ctl};
+    for (const Listener& l : listeners) keep.push_back(l.fd);
+    std::sort(keep.begin(), keep.end());
+    int next = 3;
+    for (int fd : keep) {
+        if (fd > next) syscall(SYS_close_range, next, fd - 1, 0);
+        next = fd + 1;
+    }
+    syscall(SYS_close_range, next, ~0U, 0);
+
+    // 1. The container whose sockets we hold
+    pid_t pid;
+    if (read(ctl, &pid, sizeof(pid)) != sizeof(pid)) {
+        unlink(path.c_str());
+        _exit(EXIT_SUCCESS);
+    }
+    close(ctl);
+    int pidfd = syscall(SYS_pidfd_open, pid, 0);
+
+    // 2. Serve take/drain until the container exits
+    int grace_s = -1; // Set by a drain request
+    for (;;) {
+        struct pollfd fds[2] = {{srv, POLLIN, 0}, {pidfd, POLLIN, 0}};
+        int n = poll(fds, pidfd == -1 ? 1 : 2, pidfd == -1 ? 1000 : -1);
+        if (n == -1 && errno != EINTR) break;
+        if (pidfd != -1 && (fds[1].revents & POLLIN)) break;
+        if (pidfd == -1 && kill(pid, 0) == -1 && errno == ESRCH) break;
+        if (!(fds[0].revents & POLLIN)) continue;
+
+        int client = accept4(srv, NULL, NULL, SOCK_CLOEXEC);
+        if (client == -1) continue;
+        struct pollfd cp = {client, POLLIN, 0};
+        char req[64] = "";
+        ssize_t len = poll(&cp, 1, REQUEST_TIMEOUT_MS) == 1 ? recv(client, req, sizeof(req) - 1, 0) : -1;
+        if (len > 0) {
+            req[len] = '\0';
+            if (strcmp(req, "take") == 0) {
+                keeper_reply_listeners(client, listeners);
+            } else if (strncmp(req, "drain ", 6) == 0) {
+                grace_s = std::max(atoi(req + 6), 0);
+                // The container's init is PID 1 of its namespace, which the kernel
+                // spares signals it has no handler for. Without one, SIGTERM's
+                // default action would have ended it at once, so SIGKILL now
+                // does what it would have done instead of waiting out the grace
+                if (catches_signal(pid, SIGTERM)) {
+                    kill(pid, SIGTERM);
+                    send(client, "ok", 2, MSG_NOSIGNAL);
+                } else {
+                    kill(pid, SIGKILL);
+                    send(client, "kl", 2, MSG_NOSIGNAL);
+                }
+            } else {
+                send(client, "?", 1, MSG_NOSIGNAL);
+            }
+        }
+        close(client);
+        if (grace_s >= 0) break;
+    }
+
+    // 3. Gone, or draining: nothing more to hand over
+    unlink(path.c_str());
+    close(srv);
+    for (const Listener& l : listeners) close(l.fd);
+    if (grace_s >= 0 && !keeper_wait_drain(pidfd, pid, grace_s * 1000)) {
+        kill(pid, SIGKILL);
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+// --- Sandbox Side ---
+
+void handover_start(Handover& h, const std::string& container_id,
+                    const std::vector<std::string>& specs, const std::string& takeover_id) {
+    // 1. Sockets: the old container's where it has them, else new ones
+    std::vector<Listener> taken;
+    if (!takeover_id.empty()) taken = take_listeners(takeover_id);
+    for (const std::string& spec : specs) {
+        auto it = std::find_if(taken.begin(), taken.end(), [&](const Listener& l) { return l.spec == spec; });
+        if (it != taken.end()) {
+            h.listeners.push_back(*it);
+            taken.erase(it);
+            log_msg(("-> Listening on " + spec + " (taken over from " + takeover_id + ")").c_str());
+        } else {
+            h.listeners.push_back({spec, listen_on(spec)});
+            log_msg(("-> Listening on " + spec).c_str());
+        }
+    }
+    for (const Listener& l : taken) {
+        log_msg(("Warning: " + takeover_id + " also listens on " + l.spec + ", which was not asked for; leaving it").c_str());
+        close(l.fd);
+    }
+
+    // 2. Our own handover socket, bound before the keeper exists so errors end the sandbox
+    struct sockaddr_un addr;
+    errno = 0;
+    if (mkdir(listeners_dir().c_str(), 0700) == -1 && errno != EEXIST) die(("mkdir " + listeners_dir() + " failed").c_str());
+    errno = 0;
+    if (!handover_address(container_id, addr)) die("handover socket path too long (set XDG_RUNTIME_DIR to a shorter directory)");
+    unlink(addr.sun_path); // A crashed keeper's leftover
+    int srv = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (srv == -1 || bind(srv, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1 || listen(srv, 8) == -1) {
+        die(("handover socket " + std::string(addr.sun_path) + " failed").c_str());
+    }
+
+    // 3. The keeper
+    int sv[2];
+    errno = 0;
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) die("socketpair for nsi-listen failed");
+    pid_t pid = fork();
+    if (pid == -1) die("fork of nsi-listen failed");
+    if (pid == 0) {
+        close(sv[0]);
+        keeper_main(addr.sun_path, srv, sv[1], h.listeners);
+    }
+    close(sv[1]);
+    close(srv);
+    h.pid = pid;
+    h.ctl = sv[0];
+    log_msg(("-> Listeners can be handed over via " + std::string(addr.sun_path) + " (nsi-listen PID " + std::to_string(pid) + ")").c_str());
+}
+
+void handover_watch(Handover& h, pid_t pid) {
+    for (Listener& l : h.listeners) {
+        close(l.fd); // The container and the keeper have them
+        l.fd = -1;
+    }
+    if (h.ctl == -1) return;
+    if (write(h.ctl, &pid, sizeof(pid)) != sizeof(pid)) {
+        log_msg(("Warning: nsi-listen did not take the PID to watch: " + std::string(strerror(errno))).c_str());
+    }
+    close(h.ctl);
+    h.ctl = -1;
+}
+
+void handover_attach(const Handover& h) {
+    int n = h.listeners.size();
+    if (n == 0) return;
+    // Out of the way first: a socket may already sit on one of the targets
+    std::vector<int> moved;
+    for (const Listener& l : h.listeners) {
+        int fd = fcntl(l.fd, F_DUPFD_CLOEXEC, 3 + n);
+        if (fd == -1) die("moving listening sockets failed");
+        moved.push_back(fd);
+    }
+    // dup2 clears O_CLOEXEC on the targets; the moved copies close at execve
+    for (int i = 0; i < n; ++i) {
+        if (dup2(moved[i], 3 + i) == -1) die("dup2 of listening sockets failed");
+    }
+}
+
+// --- Host Tool ---
+
+static void usage() {
+    fprintf(stderr, "Usage: nsi-sandbox handover drain <container-id> [--grace <seconds>]\n");
+    exit(EXIT_FAILURE);
+}
+
+int handover_main(int argc, char* argv[]) {
+    int grace_s = DEFAULT_GRACE_S;
+    struct option long_options[] = {
+        {"grace", required_argument, 0, 'g'},
+        {0, 0, 0, 0}
+    };
+    optind = 1;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "g:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'g': grace_s = atoi(optarg); break;
+            default: usage();
+        }
+    }
+    if (optind != argc - 2 || strcmp(argv[optind], "drain") != 0 || grace_s < 0) usage();
+    std::string id = argv[optind + 1];
+
+    int fd = handover_connect(id);
+    if (fd == -1) {
+        fprintf(stderr, "Container %s has no listeners to hand over (not running, run without --listen, or already draining)\n", id.c_str());
+        return EXIT_FAILURE;
+    }
+    std::string req = "drain " + std::to_string(grace_s);
+    char reply[8] = "";
+    if (send(fd, req.c_str(), req.size(), MSG_NOSIGNAL) != (ssize_t)req.size() || recv(fd, reply, sizeof(reply) - 1, 0) != 2 ||
+        (strcmp(reply, "ok") != 0 && strcmp(reply, "kl") != 0)) {
+        fprintf(stderr, "Container %s did not accept the drain request\n", id.c_str());
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    if (strcmp(reply, "kl") == 0) {
+        log_msg(("Container " + id + " has no SIGTERM handler; killed it (SIGKILL)").c_str());
+    } else {
+        log_msg(("Container " + id + " is draining (SIGTERM; SIGKILL after " + std::to_string(grace_s) + "s)").c_str());
+    }
+    return EXIT_SUCCESS;
+}
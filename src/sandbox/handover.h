@@ -0,0 +1,67 @@
+// neoshell/src/sandbox/handover.h
+#ifndef NSI_SANDBOX_HANDOVER_H
+#define NSI_SANDBOX_HANDOVER_H
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// Listening sockets owned by the sandbox (`--listen`), and their handover
+// from a running container to its replacement (`--takeover`).
+//
+// With --listen [addr:]port the sandbox binds the socket itself, on the
+// host and before any namespace exists, and the app inherits it as fd 3,
+// 4, ... in --listen order, with LISTEN_FDS and LISTEN_PID set (systemd's
+// socket activation convention: sd_listen_fds(), node's listen({fd: 3})).
+// The socket lives in the host's network namespace, so this also serves
+// containers run with --net none or --net user.
+//
+// A keeper process (nsi-listen) holds the sockets for the container's
+// lifetime and answers on <runtime_dir>/listeners/<container-id>, a Unix
+// seqpacket socket:
+//
+//   "take"           the specs and the sockets themselves (SCM_RIGHTS)
+//   "drain <secs>"   SIGTERM to the container, SIGKILL after <secs>, or
+//                    as soon as its init does not catch SIGTERM (as PID 1
+//                    of its namespace it ignores signals it has no handler
+//                    for, e.g. after node's default handler re-raised one)
+//
+// A replacement started with --takeover <old-id> gets the old container's
+// sockets instead of binding new ones. Old and new app then accept from
+// the same socket and the same queue, so no connection is refused while
+// the new app starts. Once it is ready, `nsi-sandbox handover drain
+// <old-id>` (what `nsi run --replace` does) stops the old one.
+//
+// Binding a second socket with SO_REUSEPORT would avoid the keeper, but
+// connections still queued on the old app's socket are reset when it
+// closes it; with one shared socket none are lost.
+
+struct Listener {
+    std::string spec; // Canonical: "0.0.0.0:8080", "[::1]:9000"
+    int fd = -1;
+};
+
+struct Handover {
+    pid_t pid = -1; // nsi-listen
+    int ctl = -1;   // Our end of its control socket
+    std::vector<Listener> listeners;
+};
+
+// "8080", "127.0.0.1:8080", "[::]:8080" -> canonical spec. False if invalid.
+bool handover_parse_spec(const std::string& text, std::string& spec);
+
+// Takes the sockets of takeover_id (if not empty), binds the rest of specs
+// and forks the keeper for container_id. Call before any namespace is
+// created, after the other helpers are forked. Dies on error.
+void handover_start(Handover& h, const std::string& container_id,
+                    const std::vector<std::string>& specs, const std::string& takeover_id);
+// In the sandbox parent after forking the container: the keeper watches
+// pid; our control socket and copies of the sockets are closed.
+void handover_watch(Handover& h, pid_t pid);
+// In the container init, right before execve: the sockets become fds 3, 4, ...
+void handover_attach(const Handover& h);
+
+// `nsi-sandbox handover drain <container-id> [--grace <seconds>]`
+int handover_main(int argc, char* argv[]);
+
+#endif // NSI_SANDBOX_HANDOVER_H
@@ -0,0 +1,158 @@
+// neoshell/src/sandbox/holder.cpp
+#include "holder.h"
+#include "utils.h"
+
+#include <cctype>
+#include <csignal>
+#include <unistd.h>
+#include <fcntl.h>        // For open
+#include <dirent.h>       // For listing holders
+#include <sys/file.h>     // For flock
+#include <sys/prctl.h>    // For PR_SET_NAME
+#include <sys/stat.h>     // For mkdir
+#include <sys/wait.h>     // For waitpid
+
+bool holder_valid_name(const std::string& name) {
+    if (name.empty() || name.size() > 63 || name[0] == '.') return false;
+    for (char c : name) {
+        if (!isalnum((unsigned char)c) && c != '_' && c != '.' && c != '-') return false;
+    }
+    return true;
+}
+
+static std::string holders_dir(const HolderKind& kind) {
+    return runtime_dir() + "/" + kind.dir;
+}
+
+// "Pod", "Tenant": for messages that start with the noun
+static std::string capitalized(const char* noun) {
+    std::string s = noun;
+    if (!s.empty()) s[0] = toupper((unsigned char)s[0]);
+    return s;
+}
+
+// The kind's directory, created if needed and locked exclusively; the
+// lock goes with the returned descriptor.
+static int holders_lock(const HolderKind& kind) {
+    std::string dir = holders_dir(kind);
+    errno = 0;
+    if (mkdir(dir.c_str(), 0700) == -1 && errno != EEXIST) die(("mkdir " + dir + " failed").c_str());
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1 || flock(fd, LOCK_EX) == -1) die(("locking " + dir + " failed").c_str());
+    return fd;
+}
+
+bool holder_state(const HolderKind& kind, const std::string& name, int& pid, unsigned long long& started) {
+    std::string state;
+    if (!read_file_at(AT_FDCWD, (holders_dir(kind) + "/" + name).c_str(), state)) return false;
+    return sscanf(state.c_str(), "%d %llu", &pid, &started) == 2 && pid > 0;
+}
+
+int holder_pid(const HolderKind& kind, const std::string& name) {
+    int pid = 0;
+    unsigned long long started = 0, now_started = 0;
+    if (!holder_state(kind, name, pid, started)) return -1;
+    if (!proc_start_ticks(pid, now_started) || now_started != started) return -1;
+    return pid;
+}
+
+// The holder process: runs setup, reports on ready_fd, then holds on.
+[[noreturn]] static void holder_main(const HolderKind& kind, const std::function<void()>& setup, int ready_fd) {
+    setsid(); // Outlives the terminal and the caller's process group
+    prctl(PR_SET_NAME, kind.comm, 0, 0, 0);
+    setup();
+
+    // Ready: detach from the caller's stdio and wait to be removed
+    if (write(ready_fd, "1", 1) != 1) die((std::string(kind.noun) + " ready notification failed").c_str());
+    close(ready_fd);
+    int null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (null_fd != -1) {
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        close(null_fd);
+    }
+    signal(SIGHUP, SIG_IGN);
+    signal(SIGINT, SIG_IGN);
+    for (;;) pause(); // SIGTERM (rm) ends us with the default action
+}
+
+int holder_create(const HolderKind& kind, const std::string& name, const std::function<void()>& setup) {
+    // Checked and created under the lock: a second creator waits, then finds ours
+    int lock_fd = holders_lock(kind);
+    if (holder_pid(kind, name) != -1) {
+        fprintf(stderr, "%s %s already exists\n", capitalized(kind.noun).c_str(), name.c_str());
+        close(lock_fd);
+        return EXIT_FAILURE;
+    }
+
+    int ready[2];
+    errno = 0;
+    if (pipe2(ready, O_CLOEXEC) == -1) die("pipe failed");
+    pid_t pid = fork();
+    if (pid == -1) die("fork failed");
+    if (pid == 0) {
+        close(lock_fd); // The lock is the creator's, not the holder's
+        close(ready[0]);
+        holder_main(kind, setup, ready[1]);
+    }
+    close(ready[1]);
+    char c;
+    ssize_t n = read(ready[0], &c, 1);
+    close(ready[0]);
+    if (n != 1) { // The holder died (and said why) before it was ready
+        waitpid(pid, NULL, 0);
+        errno = 0;
+        die((std::string(kind.noun) + " " + name + ": " + kind.role + " process failed to start").c_str());
+    }
+
+    // State file: "<pid> <start time>", written whole so readers never see half of it
+    unsigned long long started = 0;
+    proc_start_ticks(pid, started);
+    std::string path = holders_dir(kind) + "/" + name;
+    std::string tmp = holders_dir(kind) + "/." + name + ".tmp"; // Not a valid name, so ls skips it
+    std::string state = std::to_string(pid) + " " + std::to_string(started) + "\n";
+    errno = 0;
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1 || write(fd, state.c_str(), state.length()) != (ssize_t)state.length() || rename(tmp.c_str(), path.c_str()) == -1) {
+        kill(pid, SIGTERM);
+        die(("writing " + std::string(kind.noun) + " state " + path + " failed").c_str());
+    }
+    close(fd);
+    close(lock_fd);
+    log_msg((capitalized(kind.noun) + " " + name + " created (" + kind.role + " PID " + std::to_string(pid) + ")").c_str());
+    return EXIT_SUCCESS;
+}
+
+int holder_rm(const HolderKind& kind, const std::string& name) {
+    int lock_fd = holders_lock(kind);
+    int pid = holder_pid(kind, name);
+    unlink((holders_dir(kind) + "/" + name).c_str()); // Stale or not, the name is free again
+    close(lock_fd);
+    if (pid == -1) {
+        fprintf(stderr, "No running %s named %s\n", kind.noun, name.c_str());
+        return EXIT_FAILURE;
+    }
+    errno = 0;
+    if (kill(pid, SIGTERM) == -1) die(("kill " + std::string(kind.noun) + " " + kind.role + " process failed").c_str());
+    // Containers still in its namespaces keep them alive until they exit
+    log_msg((capitalized(kind.noun) + " " + name + " removed").c_str());
+    return EXIT_SUCCESS;
+}
+
+int holder_ls(const HolderKind& kind) {
+    DIR* d = opendir(holders_dir(kind).c_str());
+    if (!d) return EXIT_SUCCESS; // None was ever created
+    while (struct dirent* e = readdir(d)) {
+        std::string name = e->d_name;
+        if (!holder_valid_name(name)) continue; // ".", ".." and temporary files
+        int pid = holder_pid(kind, name);
+        if (pid == -1) {
+            printf("%s\tstale\n", name.c_str());
+        } else {
+            printf("%s\t%d\n", name.c_str(), pid);
+        }
+    }
+    closedir(d);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,47 @@
+// neoshell/src/sandbox/holder.h
+#ifndef NSI_SANDBOX_HOLDER_H
+#define NSI_SANDBOX_HOLDER_H
+
+#include <functional>
+#include <string>
+
+// Named holder processes: what pods (pod.h) and tenants (tenant.h) are
+// built on. A holder is a small process that creates namespaces, reports
+// that it is ready, and then only holds them until it gets SIGTERM.
+//
+// <runtime_dir>/<kind dir>/<name> holds "<pid> <start time>", so a PID
+// reused after the holder died is not mistaken for it. Creating and
+// removing take an exclusive lock on that directory, so two creators of
+// the same name cannot both start a holder.
+
+struct HolderKind {
+    const char* dir;  // Under runtime_dir(): "pods", "tenants"
+    const char* noun; // For messages: "pod", "tenant"
+    const char* role; // For messages: "infra", "holder"
+    const char* comm; // Process name: "nsi-pod", "nsi-tenant"
+};
+
+// True for names usable as a pod or tenant (and hostname): [A-Za-z0-9_.-],
+// 1-63 chars, not starting with '.' (so never a temporary file's).
+bool holder_valid_name(const std::string& name);
+
+// PID and start time the state file names; false if there is none.
+bool holder_state(const HolderKind& kind, const std::string& name, int& pid, unsigned long long& started);
+
+// PID of the running holder, -1 if there is none (or the state file names
+// a PID that has since been reused).
+int holder_pid(const HolderKind& kind, const std::string& name);
+
+// Starts the holder for name unless one is running. setup runs in the new
+// process (in its own session, not yet ready) and creates the namespaces;
+// it dies on error.
+int holder_create(const HolderKind& kind, const std::string& name, const std::function<void()>& setup);
+
+// Ends the holder and frees the name. Containers still in its namespaces
+// keep them alive until they exit.
+int holder_rm(const HolderKind& kind, const std::string& name);
+
+// Prints "<name>\t<pid>" (or "<name>\tstale") per state file.
+int holder_ls(const HolderKind& kind);
+
+#endif // NSI_SANDBOX_HOLDER_H
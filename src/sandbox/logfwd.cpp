@@ -0,0 +1,459 @@
+// neoshell/src/sandbox/logfwd.cpp
+#include "logfwd.h"
+#include "utils.h"
+
+#include <deque>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// --- Tunables ---
+static const size_t QUEUE_MAX_BYTES = 1024 * 1024; // Bounded buffer; beyond this lines are dropped
+static const size_t BATCH_BYTES = 64 * 1024;       // Send as soon as this much is queued...
+static const double BATCH_WINDOW = 0.1;            // ...or this many seconds after the first record
+static const size_t MAX_LINE = 16 * 1024;          // Longer lines are split
+static const double RETRY_INTERVAL = 1.0;          // Reconnect delay after collector errors
+static const double DRAIN_TIMEOUT = 2.0;           // How long to keep sending after the container exits
+static const int MAX_BATCH_RECORDS = 64;
+
+enum Transport { T_UNIX, T_TCP, T_UDP };
+enum Format { F_JSON, F_SYSLOG };
+
+struct Endpoint {
+    Transport transport;
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+};
+
+struct StreamIn {
+    int fd;          // Read end of the container pipe
+    int out_fd;      // Our own stdout/stderr for passthrough
+    const char* name;
+    int severity;    // Syslog severity: info for stdout, err for stderr
+    std::string partial;
+};
+
+struct Forwarder {
+    Endpoint ep;
+    Format format;
+    std::string container_id;
+    std::string hostname;
+    int sock = -1;
+    bool dgram = false;
+    bool connecting = false;
+    double next_retry = 0;
+    std::deque<std::string> queue;
+    size_t queue_bytes = 0;
+    size_t head_off = 0; // Bytes of queue.front() already sent (stream sockets)
+    double batch_deadline = 0;
+    unsigned long long dropped = 0, dropped_reported = 0, sent = 0;
+    unsigned long long oversized = 0; // Of dropped: records larger than a datagram can carry
+};
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void parse_endpoint(const std::string& spec, Endpoint& ep) {
+    memset(&ep.addr, 0, sizeof(ep.addr));
+    if (spec.compare(0, 5, "unix:") == 0) {
+        struct sockaddr_un* un = reinterpret_cast<struct sockaddr_un*>(&ep.addr);
+        std::string path = spec.substr(5);
+        if (path.empty() || path.size() >= sizeof(un->sun_path)) die(("Invalid unix log endpoint: " + spec).c_str());
+        un->sun_family = AF_UNIX;
+        memcpy(un->sun_path, path.c_str(), path.size() + 1);
+        ep.transport = T_UNIX;
+        ep.addr_len = sizeof(*un);
+        return;
+    }
+    bool tcp = spec.compare(0, 4, "tcp:") == 0;
+    if (!tcp && spec.compare(0, 4, "udp:") != 0) {
+        die(("Log endpoint must start with unix:, tcp: or udp: " + spec).c_str());
+    }
+    std::string hostport = spec.substr(4);
+    size_t colon = hostport.rfind(':');
+    if (colon == std::string::npos) die(("Log endpoint is missing a port: " + spec).c_str());
+    std::string host = hostport.substr(0, colon);
+    int port = atoi(hostport.c_str() + colon + 1);
+    if (port <= 0 || port > 65535) die(("Invalid port in log endpoint: " + spec).c_str());
+
+    struct sockaddr_in* in4 = reinterpret_cast<struct sockaddr_in*>(&ep.addr);
+    struct sockaddr_in6* in6 = reinterpret_cast<struct sockaddr_in6*>(&ep.addr);
+    if (inet_pton(AF_INET, host.c_str(), &in4->sin_addr) == 1) {
+        in4->sin_family = AF_INET;
+        in4->sin_port = htons(port);
+        ep.addr_len = sizeof(*in4);
+    } else if (host.size() > 2 && host.front() == '[' && host.back() == ']' &&
+               inet_pton(AF_INET6, host.substr(1, host.size() - 2).c_str(), &in6->sin6_addr) == 1) {
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(port);
+        ep.addr_len = sizeof(*in6);
+    } else {
+        die(("Log endpoint host must be a numeric address: " + spec).c_str());
+    }
+    ep.transport = tcp ? T_TCP : T_UDP;
+}
+
+// --- Record Formatting ---
+
+void append_json_string(std::string& out, const char* p, size_t n) {
+    out += '"';
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char c = p[i];
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char esc[8];
+                    snprintf(esc, sizeof(esc), "\\u%04x", c);
+                    out += esc;
+                } else {
+                    out += (char)c;
+                }
+        }
+    }
+    out += '"';
+}
+
+static std::string build_record(const Forwarder& f, const StreamIn& s, const char* line, size_t len) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    struct tm tm;
+    gmtime_r(&ts.tv_sec, &tm);
+    char when[40];
+    size_t w = strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(when + w, sizeof(when) - w, ".%03ldZ", ts.tv_nsec / 1000000);
+
+    std::string rec;
+    rec.reserve(len + 128);
+    if (f.format == F_JSON) {
+        rec += "{\"time\":\"";
+        rec += when;
+        rec += "\",\"container_id\":";
+        append_json_string(rec, f.container_id.data(), f.container_id.size());
+        rec += ",\"stream\":\"";
+        rec += s.name;
+        rec += "\",\"log\":";
+        append_json_string(rec, line, len);
+        rec += "}";
+        if (!f.dgram) rec += '\n';
+        return rec;
+    }
+
+    // RFC 5424: <PRI>VERSION TIMESTAMP HOSTNAME APP-NAME PROCID MSGID SD MSG
+    char head[256];
+    snprintf(head, sizeof(head), "<%d>1 %s %s neoshell %s %s - ",
+             8 /* facility: user */ + s.severity, when, f.hostname.c_str(), f.container_id.c_str(), s.name);
+    std::string msg = head;
+    msg.append(line, len);
+    if (!f.dgram) rec = std::to_string(msg.size()) + " "; // RFC 6587 octet counting
+    rec += msg;
+    return rec;
+}
+
+static void enqueue(Forwarder& f, std::string rec) {
+    if (f.queue_bytes + rec.size() > QUEUE_MAX_BYTES) {
+        ++f.dropped;
+        return;
+    }
+    if (f.queue.empty()) f.batch_deadline = now_seconds() + BATCH_WINDOW;
+    f.queue_bytes += rec.size();
+    f.queue.push_back(std::move(rec));
+}
+
+static void enqueue_line(Forwarder& f, const StreamIn& s, const char* line, size_t len) {
+    // Tell the collector about losses as soon as there is room again
+    if (f.dropped > f.dropped_reported) {
+        std::string note = "[nsi-logfwd] dropped " + std::to_string(f.dropped - f.dropped_reported) + " lines (collector backpressure or too large for a datagram)";
+        StreamIn meta = {s.fd, s.out_fd, "stderr", 4 /* warning */, std::string()};
+        std::string rec = build_record(f, meta, note.data(), note.size());
+        if (f.queue_bytes + rec.size() <= QUEUE_MAX_BYTES) {
+            f.dropped_reported = f.dropped;
+            enqueue(f, std::move(rec));
+        }
+    }
+    enqueue(f, build_record(f, s, line, len));
+}
+
+// Splits newly read bytes into lines; the tail without '\n' waits for more.
+static void consume(Forwarder& f, StreamIn& s, const char* buf, size_t n, bool eof) {
+    s.partial.append(buf, n);
+    size_t start = 0;
+    for (;;) {
+        size_t nl = s.partial.find('\n', start);
+        if (nl == std::string::npos) {
+            if (s.partial.size() - start >= MAX_LINE) nl = start + MAX_LINE;
+            else break;
+        }
+        size_t len = nl - start;
+        if (len > 0 && s.partial[start + len - 1] == '\r') --len;
+        enqueue_line(f, s, s.partial.data() + start, len);
+        start = (nl < s.partial.size() && s.partial[nl] == '\n') ? nl + 1 : nl;
+    }
+    s.partial.erase(0, start);
+    if (eof && !s.partial.empty()) {
+        enqueue_line(f, s, s.partial.data(), s.partial.size());
+        s.partial.clear();
+    }
+}
+
+// --- Collector Connection ---
+
+static void collector_close(Forwarder& f) {
+    if (f.sock != -1) close(f.sock);
+    f.sock = -1;
+    f.connecting = false;
+    f.head_off = 0; // A partially sent stream record is resent whole
+    f.next_retry = now_seconds() + RETRY_INTERVAL;
+}
+
+static void collector_connect(Forwarder& f) {
+    int type = f.ep.transport == T_UDP ? SOCK_DGRAM : SOCK_STREAM;
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        f.sock = socket(f.ep.addr.ss_family, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (f.sock == -1) break;
+        f.dgram = type == SOCK_DGRAM;
+        if (connect(f.sock, reinterpret_cast<struct sockaddr*>(&f.ep.addr), f.ep.addr_len) == 0) return;
+        if (errno == EINPROGRESS) {
+            f.connecting = true;
+            return;
+        }
+        close(f.sock);
+        f.sock = -1;
+        // Unix collectors such as /dev/log only accept datagrams
+        if (errno == EPROTOTYPE && f.ep.transport == T_UNIX && type == SOCK_STREAM) {
+            type = SOCK_DGRAM;
+            continue;
+        }
+        break;
+    }
+    collector_close(f);
+}
+
+// Sends as much of the queue as the socket takes without blocking.
+static void collector_flush(Forwarder& f) {
+    while (!f.queue.empty() && f.sock != -1) {
+        if (f.dgram) {
+            struct mmsghdr msgs[MAX_BATCH_RECORDS];
+            struct iovec iov[MAX_BATCH_RECORDS];
+            int n = 0;
+            for (auto it = f.queue.begin(); it != f.queue.end() && n < MAX_BATCH_RECORDS; ++it, ++n) {
+                iov[n].iov_base = const_cast<char*>(it->data());
+                iov[n].iov_len = it->size();
+                memset(&msgs[n], 0, sizeof(msgs[n]));
+                msgs[n].msg_hdr.msg_iov = &iov[n];
+                msgs[n].msg_hdr.msg_iovlen = 1;
+            }
+            int sent = sendmmsg(f.sock, msgs, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (sent == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return;
+                if (errno == EMSGSIZE) {
+                    // The head record can never be sent; reconnecting would not change that
+                    f.queue_bytes -= f.queue.front().size();
+                    f.queue.pop_front();
+                    ++f.dropped;
+                    ++f.oversized;
+                    continue;
+                }
+                collector_close(f);
+                return;
+            }
+            for (int i = 0; i < sent; ++i) {
+                f.queue_bytes -= f.queue.front().size();
+                f.queue.pop_front();
+            }
+            f.sent += sent;
+        } else {
+            struct iovec iov[MAX_BATCH_RECORDS];
+            int n = 0;
+            for (auto it = f.queue.begin(); it != f.queue.end() && n < MAX_BATCH_RECORDS; ++it, ++n) {
+                size_t off = n == 0 ? f.head_off : 0;
+                iov[n].iov_base = const_cast<char*>(it->data()) + off;
+                iov[n].iov_len = it->size() - off;
+            }
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = n;
+            ssize_t sent = sendmsg(f.sock, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (sent == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return;
+                collector_close(f);
+                return;
+            }
+            size_t left = (size_t)sent + f.head_off;
+            f.head_off = 0;
+            while (left > 0 && left >= f.queue.front().size()) {
+                left -= f.queue.front().size();
+                f.queue_bytes -= f.queue.front().size();
+                f.queue.pop_front();
+                ++f.sent;
+            }
+            f.head_off = left;
+            if (left > 0) return; // Socket buffer is full
+        }
+    }
+}
+
+// --- Forwarder Process ---
+
+static void forwarder_main(Forwarder& f, StreamIn* streams, int nstreams) {
+    prctl(PR_SET_NAME, "nsi-logfwd", 0, 0, 0);
+    signal(SIGINT, SIG_IGN);  // Keep draining; we exit when the container's pipes close
+    signal(SIGPIPE, SIG_IGN);
+
+    static char buf[64 * 1024];
+    int open_streams = nstreams;
+    double drain_deadline = 0;
+
+    for (;;) {
+        double now = now_seconds();
+        if (open_streams == 0) {
+            if (drain_deadline == 0) drain_deadline = now + DRAIN_TIMEOUT;
+            if (f.queue.empty() || now >= drain_deadline) break;
+        }
+        if (f.sock == -1 && now >= f.next_retry) collector_connect(f);
+
+        bool flush_due = !f.queue.empty() && (f.queue_bytes >= BATCH_BYTES || now >= f.batch_deadline || open_streams == 0);
+        if (flush_due && f.sock != -1 && !f.connecting) collector_flush(f);
+
+        struct pollfd pfds[3];
+        int npfd = 0;
+        for (int i = 0; i < nstreams; ++i) {
+            if (streams[i].fd != -1) pfds[npfd++] = {streams[i].fd, POLLIN, 0};
+        }
+        int sock_idx = -1;
+        if (f.sock != -1 && (f.connecting || (flush_due && !f.queue.empty()))) {
+            sock_idx = npfd;
+            pfds[npfd++] = {f.sock, POLLOUT, 0};
+        }
+
+        // Wake for the next batch deadline, reconnect or drain timeout.
+        // A due flush on a full socket waits for POLLOUT instead.
+        double wake = now + 1.0;
+        if (!f.queue.empty() && !flush_due && f.batch_deadline < wake) wake = f.batch_deadline;
+        if (f.sock == -1 && f.next_retry < wake) wake = f.next_retry;
+        if (drain_deadline != 0 && drain_deadline < wake) wake = drain_deadline;
+        int timeout_ms = wake > now ? (int)((wake - now) * 1000) + 1 : 0;
+
+        if (poll(pfds, npfd, timeout_ms) == -1) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        if (sock_idx != -1 && pfds[sock_idx].revents) {
+            if (f.connecting) {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                getsockopt(f.sock, SOL_SOCKET, SO_ERROR, &err, &len);
+                if (err != 0) collector_close(f);
+                else f.connecting = false;
+            } else if (pfds[sock_idx].revents & (POLLERR | POLLHUP)) {
+                collector_close(f);
+            } else {
+                collector_flush(f);
+            }
+        }
+
+        for (int i = 0, p = 0; i < nstreams; ++i) {
+            StreamIn& s = streams[i];
+            if (s.fd == -1) continue;
+            short rev = pfds[p++].revents;
+            if (!rev) continue;
+            ssize_t n = read(s.fd, buf, sizeof(buf));
+            if (n == -1 && (errno == EINTR || errno == EAGAIN)) continue;
+            if (n <= 0) {
+                consume(f, s, buf, 0, true);
+                close(s.fd);
+                s.fd = -1;
+                --open_streams;
+                continue;
+            }
+            // Passthrough first: the terminal / nsi run capture sees output unchanged
+            if (s.out_fd != -1) {
+                for (ssize_t off = 0; off < n;) {
+                    ssize_t w = write(s.out_fd, buf + off, n - off);
+                    if (w == -1 && errno == EINTR) continue;
+                    if (w <= 0) { s.out_fd = -1; break; } // Reader went away; keep forwarding
+                    off += w;
+                }
+            }
+            consume(f, s, buf, n, false);
+        }
+    }
+
+    // With the sandbox's own lines: stderr is the container's, relayed and stored
+    if (f.dropped > 0 || !f.queue.empty()) {
+        dprintf(log_fd(), "[nsi-logfwd] %llu lines forwarded, %llu dropped (%llu too large for a datagram), %zu unsent at exit\n",
+                  f.sent, f.dropped, f.oversized, f.queue.size());
+    }
+}
+
+void logfwd_start(const std::string& endpoint, const std::string& format,
+                  const std::string& container_id, LogForwarder& fwd) {
+    Forwarder f;
+    parse_endpoint(endpoint, f.ep);
+    if (format.empty() || format == "json") f.format = F_JSON;
+    else if (format == "syslog") f.format = F_SYSLOG;
+    else die(("Unknown log format (expected json or syslog): " + format).c_str());
+    f.container_id = container_id;
+    char host[256] = "-";
+    gethostname(host, sizeof(host) - 1);
+    f.hostname = host;
+
+    int out_pipe[2], err_pipe[2];
+    errno = 0;
+    if (pipe2(out_pipe, O_CLOEXEC) == -1 || pipe2(err_pipe, O_CLOEXEC) == -1) die("pipe for log forwarding failed");
+    // Larger pipes absorb bursts while we are busy with the collector (best effort)
+    fcntl(out_pipe[1], F_SETPIPE_SZ, 1024 * 1024);
+    fcntl(err_pipe[1], F_SETPIPE_SZ, 1024 * 1024);
+
+    errno = 0;
+    pid_t pid = fork();
+    if (pid == -1) die("fork for log forwarder failed");
+    if (pid == 0) {
+        close(out_pipe[1]);
+        close(err_pipe[1]);
+        StreamIn streams[2] = {
+            {out_pipe[0], STDOUT_FILENO, "stdout", 6, std::string()},
+            {err_pipe[0], STDERR_FILENO, "stderr", 3, std::string()},
+        };
+        forwarder_main(f, streams, 2);
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(out_pipe[0]);
+    close(err_pipe[0]);
+    fwd.pid = pid;
+    fwd.stdout_w = out_pipe[1];
+    fwd.stderr_w = err_pipe[1];
+    log_msg(("-> Forwarding container output to " + endpoint + " (forwarder PID " + std::to_string(pid) + ")").c_str());
+}
+
+void logfwd_attach(LogForwarder& fwd) {
+    if (fwd.stdout_w == -1) return;
+    // dup2 clears O_CLOEXEC on the targets; the originals close at execve
+    if (dup2(fwd.stdout_w, STDOUT_FILENO) == -1 || dup2(fwd.stderr_w, STDERR_FILENO) == -1) {
+        die("dup2 of log pipes failed");
+    }
+}
+
+void logfwd_release(LogForwarder& fwd) {
+    if (fwd.stdout_w != -1) close(fwd.stdout_w);
+    if (fwd.stderr_w != -1) close(fwd.stderr_w);
+    fwd.stdout_w = fwd.stderr_w = -1;
+}
@@ -0,0 +1,46 @@
+// neoshell/src/sandbox/logfwd.h
+#ifndef NSI_SANDBOX_LOGFWD_H
+#define NSI_SANDBOX_LOGFWD_H
+
+#include <string>
+#include <sys/types.h>
+
+// Forwarding of container stdout/stderr to a local log collector.
+//
+// The container's stdout and stderr become pipes read by a small forwarder
+// process. It passes every byte through to nsi-sandbox's own stdout/stderr
+// (so the terminal and `nsi run` capture are unchanged) and also ships each
+// line, tagged with the container id and stream, to the collector:
+//
+//   unix:/run/collector.sock   Unix stream socket (falls back to datagram)
+//   tcp:127.0.0.1:5170         TCP (e.g. fluent-bit in_tcp, rsyslog imtcp)
+//   udp:127.0.0.1:514          UDP (e.g. syslog)
+//
+// Records are "json" (one object per line: time, container_id, stream, log)
+// or "syslog" (RFC 5424; octet-counted framing on stream sockets).
+//
+// Shipping never blocks the container: records are batched into a bounded
+// queue and sent with non-blocking I/O. When the collector is slow or gone,
+// new lines are dropped and counted, and the count is reported to the
+// collector once it catches up (and on stderr at exit). Records too large
+// for a datagram socket are dropped and counted the same way.
+
+struct LogForwarder {
+    pid_t pid = -1;
+    int stdout_w = -1; // Write ends handed to the container
+    int stderr_w = -1;
+};
+
+// Forks the forwarder. Must run before any namespace is unshared, so the
+// forwarder keeps the host's network and filesystem view. Dies on a bad endpoint.
+void logfwd_start(const std::string& endpoint, const std::string& format,
+                  const std::string& container_id, LogForwarder& fwd);
+// In the container init, right before execve: make the pipes fd 1 and 2.
+void logfwd_attach(LogForwarder& fwd);
+// In the sandbox parent after forking the container: drop our write ends.
+void logfwd_release(LogForwarder& fwd);
+
+// Appends p[0..n) to out as a quoted, escaped JSON string (per-line hot path).
+void append_json_string(std::string& out, const char* p, size_t n);
+
+#endif // NSI_SANDBOX_LOGFWD_H
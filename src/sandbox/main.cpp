@@ -10,181 +10,66 @@
 #include <sys/mount.h> // For mount, umount2
 #include <sys/stat.h> // For mkdir
 #include <sys/syscall.h> // For pivot_root syscall number if needed
+#include <sys/xattr.h> // For setxattr (oomd priority)
 #include <sys/wait.h> // For waitpid (might be needed for advanced uid_map setup)
 #include <fcntl.h>  // For open
 #include <cstdlib>  // For exit
-#include <getopt.h> // For argument parsing
-#include <map>      // For environment variables
+#include <climits>  // For PATH_MAX
 #include <errno.h>  // Include errno for error checking
 
-// Include the utils header (even if currently empty)
+// Shared helpers: die(), log_msg(), cgroup paths, small file readers
 #include "utils.h"
-
-// --- Basic Error Handling ---
-void die(const char* msg) {
-    int saved_errno = errno; // Save errno immediately
-    fprintf(stderr, "[nsi-sandbox] FATAL ERROR: %s", msg);
-    if (saved_errno != 0) { // Only print strerror if errno was set by a syscall
-         fprintf(stderr, ": %s (errno %d)\n", strerror(saved_errno), saved_errno);
-    } else {
-         fprintf(stderr, "\n"); // Just print newline if no syscall error
-    }
-    exit(EXIT_FAILURE);
-}
-
-// Log messages to stderr to avoid interfering with container stdout
-void log_msg(const char* msg) {
-    fprintf(stderr, "[nsi-sandbox] %s\n", msg);
-}
-
-// --- Argument Parsing Structure ---
-struct Args {
-    std::string rootfs;
-    std::string workdir;
-    std::string cgroup_id;
-    std::string mem_limit;
-    // std::string cpu_limit; // TODO: Add later if needed
-    std::vector<std::string> cmd;
-    std::map<std::string, std::string> env_vars;
-};
-
-// --- Argument Parsing Function (Revised) ---
-void parse_args(int argc, char* argv[], Args& args) {
-    struct option long_options[] = {
-        {"rootfs",    required_argument, 0, 'r'},
-        {"workdir",   required_argument, 0, 'w'},
-        {"env",       required_argument, 0, 'e'},
-        {"mem",       required_argument, 0, 'm'},
-        {"cgroup-id", required_argument, 0, 'g'},
-        // {"cpu",     required_argument, 0, 'p'}, // Example for future cpu limit
-        {0, 0, 0, 0}
-    };
-
-    int opt;
-    // Options string matching short options in long_options
-    const char *optstring = "r:w:e:m:g:";
-
-    // Reset getopt's internal index
-    optind = 1;
-
-    // Parse all options first
-    while ((opt = getopt_long(argc, argv, optstring, long_options, NULL)) != -1) {
-        switch (opt) {
-            case 'r': args.rootfs = optarg; break;
-            case 'w': args.workdir = optarg; break;
-            case 'm': args.mem_limit = optarg; break;
-            case 'g': args.cgroup_id = optarg; break;
-            // case 'p': args.cpu_limit = optarg; break; // Future cpu limit
-            case 'e': {
-                std::string env_pair = optarg;
-                size_t eq_pos = env_pair.find('=');
-                // Ensure there's an '=' and the key part isn't empty
-                if (eq_pos != std::string::npos && eq_pos > 0) {
-                    args.env_vars[env_pair.substr(0, eq_pos)] = env_pair.substr(eq_pos + 1);
-                } else {
-                    fprintf(stderr, "[nsi-sandbox] Warning: Ignoring invalid env var format: %s\n", optarg);
-                }
-                break;
-            }
-            case '?': // Unknown option or missing argument detected by getopt
-                // getopt_long usually prints its own error message for '?'
-                fprintf(stderr, "Usage: %s --rootfs <path> --cgroup-id <id> [--workdir <path>] [--mem <limit>] [--env KEY=VAL] ... -- <command> [args...]\n", argv[0]);
-                exit(EXIT_FAILURE);
-            default:
-                // Should not happen with the current setup, but handle defensively
-                 fprintf(stderr, "Usage: %s --rootfs <path> --cgroup-id <id> [--workdir <path>] [--mem <limit>] [--env KEY=VAL] ... -- <command> [args...]\n", argv[0]);
-                exit(EXIT_FAILURE);
-        }
-    }
-
-    // After the loop, optind points to the first non-option argument (the command)
-    if (optind >= argc) {
-        die("Missing required command after options (use '--' if command resembles an option)");
-    }
-
-    // Collect the command and its arguments
-    for (int i = optind; i < argc; ++i) {
-        args.cmd.push_back(argv[i]);
-    }
-
-    // ---- Validation of parsed arguments ----
-    if (args.rootfs.empty()) die("Missing required argument: --rootfs");
-    if (args.cmd.empty()) die("Missing required command after options"); // Should be caught above, but double-check
-    if (args.cgroup_id.empty()) die("Missing required argument: --cgroup-id");
-    if (args.workdir.empty()) {
-        args.workdir = "/"; // Default workdir if not provided
-        log_msg("Workdir not specified, defaulting to '/'");
-    }
-    // Check if rootfs path exists (basic check)
-    struct stat st;
-    if (stat(args.rootfs.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
-        die(("Rootfs path specified is not a valid directory: " + args.rootfs).c_str());
-    }
-}
+#include "args.h"
+#include "procfs.h"
+#include "verity.h"
+#include "netshape.h"
+#include "stats.h"
+#include "oomd.h"
+#include "reclaim.h"
+#include "metrics.h"
+#include "profile.h"
+#include "runq.h"
+#include "pod.h"
+#include "tenant.h"
+#include "rootfs.h"
+#include "logfwd.h"
+#include "netstack.h"
+#include "handover.h"
+#include "state.h"
+#include "plan.h"
 
 // --- Helper Functions ---
 
-// Writes UID/GID maps for rootless operation.
-// Maps the current host user/group to root (0) inside the container.
-// WARNING: This is sensitive to kernel configuration and permissions.
-void setup_user_namespace_mappings() {
-    log_msg("Setting up user namespace mappings (simplified)...");
-    uid_t host_uid = getuid();
-    gid_t host_gid = getgid();
-    int fd = -1;
-
-    // --- Deny setgroups ---
-    // REQUIRED for writing gid_map as an unprivileged user in the *parent* namespace
-    // trying to map groups in the *child* namespace. Must happen *before* writing gid_map.
-    errno = 0;
-    fd = open("/proc/self/setgroups", O_WRONLY);
-    if (fd >= 0) {
-        if (write(fd, "deny", 4) == -1) {
-            // Non-fatal warning if this fails (depends on kernel config)
-             log_msg(("Warning: Failed to write 'deny' to /proc/self/setgroups: " + std::string(strerror(errno))).c_str());
-        }
-        close(fd);
-    } else {
-         // Non-fatal warning if file doesn't exist or can't be opened
-         log_msg(("Warning: Could not open /proc/self/setgroups: " + std::string(strerror(errno))).c_str());
+// Opens nsi-waiter, installed next to this binary, for the parent's handoff
+// after the fork. Opened early and executed by fd: the container's
+// pivot_root also moves the root of its parent (same mount namespace).
+// Returns -1 if missing; the parent then waits in-process.
+static int open_waiter() {
+    char self[PATH_MAX];
+    ssize_t n = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (n <= 0) return -1;
+    self[n] = '\0';
+    std::string path(self);
+    path = path.substr(0, path.rfind('/') + 1) + "nsi-waiter";
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        log_msg(("Note: " + path + " unavailable (" + std::string(strerror(errno)) + "), parent will wait in-process").c_str());
     }
-
-    // --- Write UID Map ---
-    // Format: container_uid host_uid range
-    char uid_map_buf[100];
-    snprintf(uid_map_buf, sizeof(uid_map_buf), "0 %d 1", host_uid);
-    errno = 0;
-    fd = open("/proc/self/uid_map", O_WRONLY);
-    if (fd == -1) die("open /proc/self/uid_map");
-    if (write(fd, uid_map_buf, strlen(uid_map_buf)) == -1) die("write /proc/self/uid_map");
-    close(fd);
-    log_msg("-> UID map written");
-
-    // --- Write GID Map ---
-    // Format: container_gid host_gid range
-    char gid_map_buf[100];
-    snprintf(gid_map_buf, sizeof(gid_map_buf), "0 %d 1", host_gid);
-    errno = 0;
-    fd = open("/proc/self/gid_map", O_WRONLY);
-    if (fd == -1) die("open /proc/self/gid_map");
-    if (write(fd, gid_map_buf, strlen(gid_map_buf)) == -1) die("write /proc/self/gid_map");
-    close(fd);
-    log_msg("-> GID map written");
+    return fd;
 }
 
 // Sets up cgroups v2 using the unified hierarchy.
 void setup_cgroups(const Args& args) {
     log_msg("Setting up cgroups v2...");
-    std::string cgroup_base = "/sys/fs/cgroup"; // Assumes unified hierarchy mounted here
-    std::string cgroup_path = cgroup_base + "/neoshell/" + args.cgroup_id;
+    std::string cgroup_path = container_cgroup_path(args.cgroup_id);
     int fd = -1;
 
     // 1. Create cgroup directory (needs appropriate permissions)
     // Use mkdir directly instead of system(). Needs mode 0755 typically.
     errno = 0;
     // Create parent dir "neoshell" if it doesn't exist
-    if (mkdir((cgroup_base + "/neoshell").c_str(), 0755) == -1 && errno != EEXIST) {
-         log_msg(("Warning: Could not create parent cgroup dir " + cgroup_base + "/neoshell: " + std::string(strerror(errno))).c_str());
+    if (mkdir(NSI_CGROUP_ROOT, 0755) == -1 && errno != EEXIST) {
+         log_msg(("Warning: Could not create parent cgroup dir " NSI_CGROUP_ROOT ": " + std::string(strerror(errno))).c_str());
          // Attempt to continue, maybe only the leaf dir creation failed before
     }
     errno = 0; // Reset errno before the next mkdir
@@ -219,6 +104,29 @@ void setup_cgroups(const Args& args) {
          log_msg("-> No memory limit specified.");
     }
 
+    // 2b. Memory request: protected from reclaim; oomd also reads it back
+    if (!args.mem_request.empty()) {
+        std::string mem_low_path = cgroup_path + "/memory.low";
+        errno = 0;
+        fd = open(mem_low_path.c_str(), O_WRONLY | O_TRUNC);
+        if (fd == -1 || write(fd, args.mem_request.c_str(), args.mem_request.length()) == -1) {
+            log_msg(("Warning: Could not set " + mem_low_path + ": " + std::string(strerror(errno))).c_str());
+        } else {
+            log_msg(("-> Set memory.low = " + args.mem_request).c_str());
+        }
+        if (fd != -1) close(fd);
+    }
+
+    // 2c. Priority class for oomd, kept on the cgroup itself
+    if (!args.priority.empty()) {
+        errno = 0;
+        if (setxattr(cgroup_path.c_str(), NSI_PRIORITY_XATTR, args.priority.c_str(), args.priority.length(), 0) == -1) {
+            log_msg(("Warning: Could not set oomd priority (cgroupfs user xattrs need Linux 5.7+): " + std::string(strerror(errno))).c_str());
+        } else {
+            log_msg(("-> oomd priority = " + args.priority).c_str());
+        }
+    }
+
     // TODO: Apply CPU limits (e.g., using cpu.max requires parsing format like "quota period")
 
     // 3. Add current process (PID 1 in the container) to the cgroup
@@ -259,22 +167,52 @@ void setup_filesystem(const Args& args) {
          log_msg("-> Made host root mount private.");
     }
 
-    // 2. Bind mount the new rootfs onto itself (required by pivot_root if old/new are on same fs)
+    // 2. Bind mount the new rootfs onto itself (pivot_root needs a mount point).
+    //    A memory-backed rootfs is a mount of its own: fill it from the image stream instead.
+    //    A shared one goes under a private overlay (see rootfs.h).
+    std::string root = args.rootfs;
+    if (!args.rootfs_tmpfs.empty()) {
+        rootfs_tmpfs_populate(args.rootfs, args.rootfs_tmpfs, NSI_ROOTFS_TAR_FD);
+    } else if (args.rootfs_overlay) {
+        root = rootfs_overlay_mount(args.rootfs);
+    } else {
+        errno = 0;
+        if (mount(args.rootfs.c_str(), args.rootfs.c_str(), "bind", MS_BIND | MS_REC, NULL) == -1) {
+            die(("bind mount failed for " + args.rootfs).c_str());
+        }
+        log_msg(("-> Bind mounted " + args.rootfs + " onto itself.").c_str());
+    }
+
+    // 3. /proc and /sys, while the host's are still in view: in a user
+    //    namespace the kernel only mounts new ones next to a fully visible
+    //    one, and after step 6 there is none left in this mount namespace
     errno = 0;
-     if (mount(args.rootfs.c_str(), args.rootfs.c_str(), "bind", MS_BIND | MS_REC, NULL) == -1) {
-         die(("bind mount failed for " + args.rootfs).c_str());
-     }
-     log_msg(("-> Bind mounted " + args.rootfs + " onto itself.").c_str());
+    if (mount("proc", (root + "/proc").c_str(), "proc", MS_NOSUID | MS_NODEV | MS_NOEXEC, NULL) == -1) {
+        die("mount /proc failed");
+    }
+    log_msg("-> Mounted /proc.");
+    // A new sysfs needs a network namespace of our own; with the host's
+    // (--net host), the host's /sys is bound instead
+    std::string sys = root + "/sys";
+    errno = 0;
+    if (mount("sysfs", sys.c_str(), "sysfs", MS_RDONLY | MS_NOSUID | MS_NODEV | MS_NOEXEC, NULL) == 0) {
+        log_msg("-> Mounted /sys (read-only).");
+    } else if (errno == EPERM && mount("/sys", sys.c_str(), NULL, MS_BIND | MS_REC, NULL) == 0 &&
+               mount(NULL, sys.c_str(), NULL, MS_REMOUNT | MS_BIND | MS_RDONLY | MS_NOSUID | MS_NODEV | MS_NOEXEC, NULL) == 0) {
+        log_msg("-> Bound the host's /sys (read-only).");
+    } else {
+        die("mount /sys failed"); // Usually needed, make it fatal
+    }
 
-    // 3. Create directory for old root *within* the new rootfs
-    std::string put_old_path = args.rootfs + "/.old_root";
+    // 4. Change directory into the new root
     errno = 0;
-    if (mkdir(put_old_path.c_str(), 0700) == -1 && errno != EEXIST) { // Use 0700 for restricted access
-        die(("mkdir .old_root failed in " + args.rootfs).c_str());
+    if (chdir(root.c_str()) == -1) {
+        die(("chdir to new root failed: " + root).c_str());
     }
-    log_msg(("-> Ensured " + put_old_path + " exists.").c_str());
 
-    // 4. Perform the pivot_root
+    // 5. Perform the pivot_root, with the old root stacked on the new one
+    //    (new_root == put_old == "."): nothing is created in the rootfs,
+    //    which may be read-only or shared by other containers.
     errno = 0;
     // pivot_root system call might not be in glibc headers depending on version
     #ifndef SYS_pivot_root
@@ -287,42 +225,29 @@ void setup_filesystem(const Args& args) {
              #error "SYS_pivot_root syscall number not defined for this architecture"
         #endif
     #endif
-    if (syscall(SYS_pivot_root, args.rootfs.c_str(), put_old_path.c_str()) == -1) {
+    if (syscall(SYS_pivot_root, ".", ".") == -1) {
         die("pivot_root failed");
     }
     log_msg("-> pivot_root successful.");
 
-    // 5. Change directory to the *new* root (which is now "/")
+    // 6. Unmount the old root (the top of the stack) to remove access to the host filesystem
+    // MNT_DETACH performs a lazy unmount.
     errno = 0;
-    if (chdir("/") == -1) {
-        die("chdir / failed after pivot_root");
+    if (umount2(".", MNT_DETACH) == -1) {
+        // Fatal: the host filesystem would still be the container's root
+        die("umount2 of the old root failed");
     }
-    log_msg("-> Changed directory to new root (/).");
+    log_msg("-> Unmounted the old root.");
 
-    // 6. Unmount the old root to remove access to host filesystem
-    // MNT_DETACH performs a lazy unmount.
+    // 7. Change directory to the *new* root (which is now "/")
     errno = 0;
-    if (umount2("/.old_root", MNT_DETACH) == -1) {
-        // Non-fatal warning, but means host fs might still be accessible
-        log_msg(("Warning: umount2 /.old_root failed: " + std::string(strerror(errno))).c_str());
-    } else {
-        log_msg("-> Unmounted /.old_root.");
-        // Optional: Remove the directory now it's unmounted
-        errno = 0;
-        if (rmdir("/.old_root") == -1) {
-             log_msg(("Warning: rmdir /.old_root failed: " + std::string(strerror(errno))).c_str());
-        }
+    if (chdir("/") == -1) {
+        die("chdir / failed after pivot_root");
     }
+    log_msg("-> Changed directory to new root (/).");
 
     // ---- Mount essential virtual filesystems inside the new root ----
 
-    // 7. Mount /proc
-    errno = 0;
-    if (mount("proc", "/proc", "proc", MS_NOSUID | MS_NODEV | MS_NOEXEC, NULL) == -1) {
-        die("mount /proc failed");
-    }
-    log_msg("-> Mounted /proc.");
-
     // 8. Mount /dev (minimal tmpfs - populating needed nodes is advanced)
     errno = 0;
     // Use stricter options: noexec
@@ -333,13 +258,15 @@ void setup_filesystem(const Args& args) {
     // TODO: Create essential device nodes in /dev: null, zero, random, urandom, tty, pts/ptmx
     // This typically requires mknod and correct permissions.
 
-    // 9. Mount /sys (read-only for safety)
+    // 9. Mount cgroup2 (read-only) so runtimes can read their own limits
+    // Because the cgroup namespace was unshared after joining the container's
+    // cgroup, this mount is rooted at that cgroup: /sys/fs/cgroup/memory.max etc.
+    // are the container's own files. Non-fatal: the app can still run without it.
     errno = 0;
-    if (mount("sysfs", "/sys", "sysfs", MS_RDONLY | MS_NOSUID | MS_NODEV | MS_NOEXEC, NULL) == -1) {
-         // Usually needed, make it fatal if mount fails
-         die("mount /sys failed");
+    if (mount("cgroup2", "/sys/fs/cgroup", "cgroup2", MS_RDONLY | MS_NOSUID | MS_NODEV | MS_NOEXEC, NULL) == -1) {
+        log_msg(("Warning: mount cgroup2 on /sys/fs/cgroup failed: " + std::string(strerror(errno))).c_str());
     } else {
-        log_msg("-> Mounted /sys (read-only).");
+        log_msg("-> Mounted cgroup2 on /sys/fs/cgroup (read-only).");
     }
 
     log_msg("Filesystem setup finished.");
@@ -348,33 +275,152 @@ void setup_filesystem(const Args& args) {
 
 // --- Main Execution ---
 int main(int argc, char* argv[]) {
+    log_init();
+
+    // --- Tool Subcommands ---
+    // nsi-sandbox is the only native binary the CLI ships, so host-side
+    // helpers are dispatched from here: `nsi-sandbox <tool> ...`
+    if (argc > 1 && strcmp(argv[1], "verity") == 0) {
+        return verity_main(argc - 1, argv + 1);
+    }
+    if (argc > 1 && strcmp(argv[1], "net-stats") == 0) {
+        return netstats_main(argc - 1, argv + 1);
+    }
+    if (argc > 1 && strcmp(argv[1], "stats") == 0) {
+        return stats_main(argc - 1, argv + 1);
+    }
+    if (argc > 1 && strcmp(argv[1], "oomd") == 0) {
+        return oomd_main(argc - 1, argv + 1);
+    }
+    if (argc > 1 && strcmp(argv[1], "reclaim") == 0) {
+        return reclaim_main(argc - 1, argv + 1);
+    }
+    if (argc > 1 && strcmp(argv[1], "pod") == 0) {
+        return pod_main(argc - 1, argv + 1);
+    }
+    if (argc > 1 && strcmp(argv[1], "tenant") == 0) {
+        return tenant_main(argc - 1, argv + 1);
+    }
+    if (argc > 1 && strcmp(argv[1], "metrics") == 0) {
+        return metrics_main(argc - 1, argv + 1);
+    }
+    if (argc > 1 && strcmp(argv[1], "profile") == 0) {
+        return profile_main(argc - 1, argv + 1);
+    }
+    if (argc > 1 && strcmp(argv[1], "runq") == 0) {
+        return runq_main(argc - 1, argv + 1);
+    }
+    if (argc > 1 && strcmp(argv[1], "handover") == 0) {
+        return handover_main(argc - 1, argv + 1);
+    }
+    if (argc > 1 && strcmp(argv[1], "adopt") == 0) {
+        return adopt_main(argc - 1, argv + 1);
+    }
+
     Args args;
+    LaunchPlan plan;
     errno = 0; // Clear errno before parsing potentially bad args
-    parse_args(argc, argv, args);
+    if (argc > 1 && strcmp(argv[1], "--plan") == 0) {
+        // Precompiled (see plan.h): parsed and validated when it was compiled
+        plan_load(argc - 1, argv + 1, args, plan);
+    } else {
+        parse_args(argc, argv, args);
+        if (!args.compile_plan.empty()) return plan_compile(args);
+    }
+
+    // Command for execve, nullptr-terminated
+    std::vector<char*> cmd_argv = plan.argv;
+    if (cmd_argv.empty()) {
+        for (const auto& s : args.cmd) {
+            cmd_argv.push_back(const_cast<char*>(s.c_str()));
+        }
+        cmd_argv.push_back(nullptr);
+    }
 
     // Use log_msg for all sandbox output
     log_msg("--- Neoshell Sandbox Starting ---");
-    log_msg(("RootFS: " + args.rootfs).c_str());
+    log_msg(("RootFS: " + (args.rootfs_tmpfs.empty() ? args.rootfs : "tmpfs, " + args.rootfs_tmpfs + " (image streamed on fd 3)")).c_str());
     log_msg(("Workdir: " + args.workdir).c_str());
     std::string cmd_str;
-    for(const auto& p : args.cmd) { cmd_str += p + " "; } // Construct command string for logging
+    for (size_t i = 0; cmd_argv[i]; ++i) { cmd_str += std::string(cmd_argv[i]) + " "; } // Construct command string for logging
     log_msg(("Command: " + cmd_str).c_str());
     log_msg(("Cgroup ID: " + args.cgroup_id).c_str());
     log_msg(("Memory Limit: " + (args.mem_limit.empty() ? "(default)" : args.mem_limit)).c_str());
     log_msg(("Host UID: " + std::to_string(getuid()) + ", Host GID: " + std::to_string(getgid())).c_str());
 
-    // --- Stage 1: Create User Namespace ---
-    log_msg("Entering Stage 1: Creating User Namespace...");
-    errno = 0;
-    // CLONE_NEWUSER must often be the *first* flag used when calling unshare as non-root
-    if (unshare(CLONE_NEWUSER) == -1) {
-        die("unshare CLONE_NEWUSER failed. Check kernel config (CONFIG_USER_NS=y) and permissions (/proc/sys/user/max_user_namespaces).");
+    int waiter_fd = open_waiter();
+
+    // --- Metrics Recorder (optional) ---
+    // Samples the container's cgroup from the host side; forked first so it
+    // holds none of the log forwarder's pipes.
+    pid_t recorder_pid = -1;
+    if (args.metrics_interval_ms != 0) {
+        recorder_pid = metrics_start(args.cgroup_id, args.metrics_interval_ms, args.metrics_slots);
+    }
+
+    // --- Log Forwarding (optional) ---
+    // Started before any namespace exists, so the forwarder reaches the
+    // collector through the host's network and filesystem.
+    LogForwarder logfwd;
+    if (!args.log_forward.empty()) {
+        logfwd_start(args.log_forward, args.log_format, args.cgroup_id, logfwd);
+    }
+
+    // --- User-Mode Networking (--net user) ---
+    // nsi-net keeps the host's network; it gets the container's tap once
+    // the network namespace exists (Stage 2).
+    NetStack netstack;
+    if (args.net == "user") {
+        netstack_start(netstack);
+    }
+
+    // --- Listening Sockets (--listen, --takeover) ---
+    // Bound (or taken over) on the host; the keeper forked last, so it
+    // holds none of the other helpers' descriptors.
+    Handover handover;
+    if (!args.listen.empty()) {
+        handover_start(handover, args.cgroup_id, args.listen, args.takeover);
+    }
+
+    // --- State File (see state.h) ---
+    // Lets `nsi-sandbox adopt` take the container over if our launcher goes
+    // away. Created after the helpers are forked, so they hold none of it.
+    StateFile state;
+    state_create(state, args.cgroup_id, args.rootfs_tmpfs.empty() ? args.rootfs : "");
+
+    // Remember the host network namespace: bandwidth shaping must only ever
+    // touch a network namespace of the container's own.
+    struct stat host_netns;
+    if (stat("/proc/self/ns/net", &host_netns) == -1) {
+        memset(&host_netns, 0, sizeof(host_netns));
     }
-    log_msg("-> User namespace created. Process now has root privileges *within* this namespace.");
 
-    // Setup UID/GID mapping. This happens *after* CLONE_NEWUSER.
-    // The process writing the map needs privileges over the namespace (which it has now).
-    setup_user_namespace_mappings();
+    // --- Stage 1: Create User Namespace ---
+    if (!args.pod.empty()) {
+        // Pod member: the pod's user namespace (already mapped) and its
+        // network, IPC and UTS namespaces instead of new ones
+        log_msg(("Entering Stage 1: Joining pod " + args.pod + "...").c_str());
+        pod_join(args.pod);
+    } else if (!args.tenant.empty()) {
+        // Tenant member: the tenant's user namespace, already mapped (see
+        // tenant.h); everything below is still new per container
+        log_msg(("Entering Stage 1: Joining the user namespace of tenant " + args.tenant + "...").c_str());
+        tenant_join(args.tenant);
+    } else {
+        log_msg("Entering Stage 1: Creating User Namespace...");
+        uid_t host_uid = getuid(); // Unmapped in the new namespace until the maps are written
+        gid_t host_gid = getgid();
+        errno = 0;
+        // CLONE_NEWUSER must often be the *first* flag used when calling unshare as non-root
+        if (unshare(CLONE_NEWUSER) == -1) {
+            die("unshare CLONE_NEWUSER failed. Check kernel config (CONFIG_USER_NS=y) and permissions (/proc/sys/user/max_user_namespaces).");
+        }
+        log_msg("-> User namespace created. Process now has root privileges *within* this namespace.");
+
+        // Setup UID/GID mapping. This happens *after* CLONE_NEWUSER.
+        // The process writing the map needs privileges over the namespace (which it has now).
+        setup_user_namespace_mappings(host_uid, host_gid);
+    }
 
 
     // --- Stage 2: Create Other Namespaces and Setup Environment ---
@@ -382,20 +428,40 @@ int main(int argc, char* argv[]) {
     log_msg("Entering Stage 2: Setting up other namespaces and environment...");
 
     // Unshare other namespaces
+    // Note: CLONE_NEWCGROUP is deferred to the child, after it has joined its
+    // cgroup, so the namespace root is the container's cgroup (see below).
+    // Pod members keep the pod's UTS and IPC namespaces.
     errno = 0;
-    if (unshare(CLONE_NEWPID | CLONE_NEWNS | CLONE_NEWUTS | CLONE_NEWIPC | CLONE_NEWCGROUP) == -1) {
-        die("unshare (PID, NS, UTS, IPC, CGROUP) failed");
-    }
-    log_msg("-> PID, Mount, UTS, IPC, Cgroup namespaces created.");
-
-    // Set hostname inside the new UTS namespace
-    errno = 0;
-    // Use a simple default hostname if needed, perhaps based on cgroup_id
-    std::string hostname = args.cgroup_id.substr(0, 63); // Limit hostname length
-    if (sethostname(hostname.c_str(), hostname.length()) == -1) {
-         log_msg(("Warning: sethostname failed: " + std::string(strerror(errno))).c_str());
+    std::string hostname;
+    if (!args.pod.empty()) {
+        if (unshare(CLONE_NEWPID | CLONE_NEWNS) == -1) {
+            die("unshare (PID, NS) failed");
+        }
+        log_msg("-> PID, Mount namespaces created (UTS, IPC shared with the pod).");
+        char pod_hostname[HOST_NAME_MAX + 1] = "";
+        gethostname(pod_hostname, sizeof(pod_hostname));
+        hostname = pod_hostname;
     } else {
-        log_msg(("-> Set container hostname to " + hostname).c_str());
+        int net_flag = args.net == "host" ? 0 : CLONE_NEWNET;
+        if (unshare(CLONE_NEWPID | CLONE_NEWNS | CLONE_NEWUTS | CLONE_NEWIPC | net_flag) == -1) {
+            die("unshare (PID, NS, UTS, IPC) failed");
+        }
+        log_msg(net_flag ? "-> PID, Mount, UTS, IPC, Network namespaces created." : "-> PID, Mount, UTS, IPC namespaces created.");
+        if (args.net == "user") {
+            netstack_attach(netstack);
+        } else if (args.net == "none") {
+            netns_loopback_up();
+        }
+
+        // Set hostname inside the new UTS namespace
+        errno = 0;
+        // Use a simple default hostname if needed, perhaps based on cgroup_id
+        hostname = args.cgroup_id.substr(0, 63); // Limit hostname length
+        if (sethostname(hostname.c_str(), hostname.length()) == -1) {
+             log_msg(("Warning: sethostname failed: " + std::string(strerror(errno))).c_str());
+        } else {
+            log_msg(("-> Set container hostname to " + hostname).c_str());
+        }
     }
 
     // ---- Fork here to become PID 1 in the new PID namespace ----
@@ -410,28 +476,117 @@ int main(int argc, char* argv[]) {
 
     if (child_pid != 0) {
         // --- Parent Process ---
+        logfwd_release(logfwd); // Only the container may hold the write ends
+        netstack_watch(netstack, child_pid); // nsi-net exits with the container
+        handover_watch(handover, child_pid);
+        state_publish(state, child_pid);
+        if (!args.rootfs_tmpfs.empty()) {
+            close(NSI_ROOTFS_TAR_FD); // The container reads the image stream
+        }
         log_msg(("Parent (PID " + std::to_string(getpid()) + "): Waiting for child (PID " + std::to_string(child_pid) + ")").c_str());
+
+        // Hand off to the tiny waiter: same PID and children, so whoever
+        // waits for nsi-sandbox still sees the container's exit status
+        if (waiter_fd != -1) {
+            std::string child_arg = std::to_string(child_pid);
+            std::string logfwd_arg = std::to_string(logfwd.pid);
+            std::string recorder_arg = std::to_string(recorder_pid);
+            std::string netstack_arg = std::to_string(netstack.pid);
+            std::string handover_arg = std::to_string(handover.pid);
+            std::string state_arg = std::to_string(state.fd);
+            std::vector<char*> waiter_argv = {const_cast<char*>("nsi-waiter")};
+            if (state.st) {
+                waiter_argv.push_back(const_cast<char*>("-s"));
+                waiter_argv.push_back(const_cast<char*>(state_arg.c_str()));
+            }
+            waiter_argv.push_back(const_cast<char*>(child_arg.c_str()));
+            if (logfwd.pid != -1) waiter_argv.push_back(const_cast<char*>(logfwd_arg.c_str()));
+            if (recorder_pid != -1) waiter_argv.push_back(const_cast<char*>(recorder_arg.c_str()));
+            if (netstack.pid != -1) waiter_argv.push_back(const_cast<char*>(netstack_arg.c_str()));
+            if (handover.pid != -1) waiter_argv.push_back(const_cast<char*>(handover_arg.c_str()));
+            waiter_argv.push_back(nullptr);
+            char* waiter_envp[] = {nullptr};
+            if (log_fd() != STDERR_FILENO) dup2(log_fd(), STDERR_FILENO); // The waiter reports there too
+            syscall(SYS_execveat, waiter_fd, "", waiter_argv.data(), waiter_envp, AT_EMPTY_PATH);
+            log_msg(("Warning: exec nsi-waiter failed, waiting in-process: " + std::string(strerror(errno))).c_str());
+        }
         int status;
         errno = 0;
         if (waitpid(child_pid, &status, 0) == -1) {
             // Don't use die() here, just report error and exit
-            fprintf(stderr, "[nsi-sandbox] Parent: waitpid failed: %s\n", strerror(errno));
+            dprintf(log_fd(), "[nsi-sandbox] Parent: waitpid failed: %s\n", strerror(errno));
             exit(EXIT_FAILURE);
         }
-        log_msg(("Parent: Child exited with status " + std::to_string(WEXITSTATUS(status))).c_str());
+        // Same code as nsi-waiter: 128 + signal if the container was killed
+        int code = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+        log_msg(("Parent: Child exited with status " + std::to_string(code)).c_str());
+        state_exit(state, code);
+        // Let the forwarder drain the last lines, and the recorder take its
+        // last sample, before we report the exit
+        if (logfwd.pid != -1) {
+            waitpid(logfwd.pid, NULL, 0);
+        }
+        if (recorder_pid != -1) {
+            waitpid(recorder_pid, NULL, 0);
+        }
+        if (netstack.pid != -1) {
+            waitpid(netstack.pid, NULL, 0);
+        }
+        if (handover.pid != -1) {
+            waitpid(handover.pid, NULL, 0);
+        }
         // Exit with the same status code as the child (container)
-        exit(WEXITSTATUS(status));
+        exit(code);
 
     } else {
         // --- Child Process (becomes PID 1 in the container) ---
         log_msg(("Child (PID " + std::to_string(getpid()) + ", should be PID 1 in container): Continuing setup...").c_str());
+        if (waiter_fd != -1) close(waiter_fd);
+        if (netstack.sock != -1) close(netstack.sock);
+        if (handover.ctl != -1) close(handover.ctl);
+        state_release(state);
 
         // Setup Cgroups (Add *this* process, the child, to the cgroup)
         setup_cgroups(args);
 
+        // Create the cgroup namespace *now*: its root becomes the cgroup we
+        // were just moved into, so /proc/self/cgroup reads "0::/" and the
+        // cgroup2 mount in setup_filesystem() shows only this container.
+        errno = 0;
+        if (unshare(CLONE_NEWCGROUP) == -1) {
+            die("unshare CLONE_NEWCGROUP failed");
+        }
+        log_msg("-> Cgroup namespace created (rooted at container cgroup).");
+
+        // Grab /dev/fuse and the cgroup dir while the host view is still visible
+        ProcfsState procfs;
+        if (args.virtual_proc) {
+            procfs_prepare(container_cgroup_path(args.cgroup_id), procfs);
+        }
+
         // Setup Filesystem (pivot_root or chroot, mount /proc, etc.)
         setup_filesystem(args);
 
+        // Point the resolver at nsi-net's DNS forwarder
+        if (args.net == "user") {
+            netstack_resolv_conf();
+        }
+
+        // Cover host totals in /proc with values derived from our cgroup
+        if (args.virtual_proc) {
+            procfs_start(procfs);
+        }
+
+        // Limit bandwidth on the container's interfaces (private netns only)
+        if (args.net_rate_bps != 0) {
+            struct stat netns;
+            if (stat("/proc/self/ns/net", &netns) == 0 && netns.st_ino == host_netns.st_ino && netns.st_dev == host_netns.st_dev) {
+                log_msg("Warning: --net-rate ignored, the container shares the host network namespace.");
+            } else {
+                netshape_apply(args.net_rate_bps, args.net_burst_bytes);
+            }
+        }
+
         // Change to working directory *inside* the new root
         errno = 0;
         if (chdir(args.workdir.c_str()) == -1) {
@@ -439,42 +594,25 @@ int main(int argc, char* argv[]) {
         }
         log_msg(("-> Changed to working directory: " + args.workdir).c_str());
 
-        // Prepare command arguments for execve
-        std::vector<char*> cmd_argv;
-        for (const auto& s : args.cmd) {
-            cmd_argv.push_back(const_cast<char*>(s.c_str()));
-        }
-        cmd_argv.push_back(nullptr); // Null-terminate the argument list
-
         // Prepare environment variables for execve
         clearenv(); // Start with a clean environment
+        std::vector<std::string> env_storage;
+        std::string hostname_entry;
         std::vector<char*> envp;
-        // Using static is simple but not thread-safe (not an issue here as we exec immediately)
-        static std::vector<std::string> env_storage;
-        env_storage.clear(); // Clear from previous runs if static
-        for(const auto& pair : args.env_vars) {
-            env_storage.push_back(pair.first + "=" + pair.second);
-            envp.push_back(const_cast<char*>(env_storage.back().c_str()));
-        }
-        // Add minimal required PATH if not set by user? Better to rely on image.
-        if (args.env_vars.find("PATH") == args.env_vars.end()) {
-             env_storage.push_back("PATH=/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin");
-             envp.push_back(const_cast<char*>(env_storage.back().c_str()));
-             log_msg("-> Setting default PATH=/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin");
+        if (!plan.argv.empty()) {
+            plan_envp(plan, hostname, hostname_entry, envp); // Built when the plan was compiled
+        } else {
+            build_envp(args, hostname, env_storage, envp);
         }
-        // Add container indicator
-        env_storage.push_back("NEOSHELL_CONTAINER=true");
-        envp.push_back(const_cast<char*>(env_storage.back().c_str()));
-        // Add hostname
-        env_storage.push_back("HOSTNAME=" + hostname);
-        envp.push_back(const_cast<char*>(env_storage.back().c_str()));
-
-        envp.push_back(nullptr); // Null-terminate the environment list
 
         // --- Stage 3: Execute the Target Command ---
         log_msg("Entering Stage 3: Executing command...");
         log_msg(("-> execve: " + std::string(cmd_argv[0])).c_str());
 
+        // From here on, stdout/stderr belong to the app (and the log forwarder)
+        logfwd_attach(logfwd);
+        handover_attach(handover); // fds 3, 4, ... (LISTEN_FDS)
+
         // Clear errno before execve, as it only returns on error.
         errno = 0;
         if (execve(cmd_argv[0], cmd_argv.data(), envp.data()) == -1) {
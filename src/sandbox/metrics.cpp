@@ -0,0 +1,473 @@
+// neoshell/src/sandbox/metrics.cpp
+#include "metrics.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cinttypes>      // For PRIu64
+#include <csignal>
+#include <cstddef>        // For offsetof
+#include <ctime>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>        // For open, openat
+#include <poll.h>         // For waiting on cgroup.events
+#include <dirent.h>       // For listing recordings
+#include <getopt.h>
+#include <sys/mman.h>     // For mmap
+#include <sys/prctl.h>    // For PR_SET_NAME
+#include <sys/stat.h>     // For mkdir, fstat
+
+static const int CGROUP_WAIT_MS = 10000; // For the container to join its cgroup
+static const int RETENTION_DAYS = 7;      // Recordings untouched this long are pruned
+
+static_assert(sizeof(MetricsHeader) <= METRICS_SLOTS_OFFSET, "metrics header overlaps the slots");
+
+// The sample fields by name, for the JSON dump
+static const struct {
+    const char* name;
+    size_t offset;
+} FIELDS[] = {
+#define FIELD(f) {#f, offsetof(MetricsSample, f)}
+    FIELD(memory_current), FIELD(memory_oom), FIELD(memory_oom_kill),
+    FIELD(cpu_usage_usec), FIELD(cpu_user_usec), FIELD(cpu_system_usec), FIELD(cpu_nr_throttled), FIELD(cpu_throttled_usec),
+    FIELD(io_rbytes), FIELD(io_wbytes), FIELD(io_rios), FIELD(io_wios),
+    FIELD(pids_current),
+    FIELD(cpu_some_usec), FIELD(memory_some_usec), FIELD(memory_full_usec), FIELD(io_some_usec), FIELD(io_full_usec),
+#undef FIELD
+};
+
+static uint64_t now_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static std::string metrics_dir() {
+    return runtime_dir() + "/metrics";
+}
+
+static size_t ring_size(uint32_t slots) {
+    return METRICS_SLOTS_OFFSET + (size_t)slots * sizeof(MetricsSample);
+}
+
+// --- Sampling ---
+
+// Re-reads an open cgroup file into buf, NUL-terminated. False on error.
+static bool pread_buf(int fd, char* buf, size_t size) {
+    if (fd == -1) return false;
+    ssize_t n = pread(fd, buf, size - 1, 0);
+    if (n < 0) return false;
+    buf[n] = '\0';
+    return true;
+}
+
+// Sum of every "key value" or "key=value" field in buf (io.stat has one
+// line per device; the other files have each key once).
+static uint64_t sum_field(const char* buf, const char* key) {
+    size_t len = strlen(key);
+    uint64_t sum = 0;
+    for (const char* p = buf; (p = strstr(p, key)) != nullptr; p += len) {
+        bool at_start = p == buf || p[-1] == ' ' || p[-1] == '\n';
+        if (at_start && (p[len] == ' ' || p[len] == '=')) sum += strtoull(p + len + 1, nullptr, 10);
+    }
+    return sum;
+}
+
+// The total= stall time (usec) of the "some" or "full" line of a *.pressure file.
+static uint64_t psi_total(const char* buf, const char* line) {
+    const char* p = strstr(buf, line);
+    if (!p) return 0;
+    const char* eol = strchr(p, '\n');
+    const char* total = strstr(p, "total=");
+    if (!total || (eol && total > eol)) return 0;
+    return strtoull(total + 6, nullptr, 10);
+}
+
+void metrics_open_source(int cgfd, MetricsSource& src) {
+    auto open_at = [cgfd](const char* name) { return openat(cgfd, name, O_RDONLY | O_CLOEXEC); };
+    src.memory_current = open_at("memory.current");
+    src.memory_events = open_at("memory.events");
+    src.cpu_stat = open_at("cpu.stat");
+    src.io_stat = open_at("io.stat");
+    src.pids_current = open_at("pids.current");
+    src.cpu_pressure = open_at("cpu.pressure");
+    src.memory_pressure = open_at("memory.pressure");
+    src.io_pressure = open_at("io.pressure");
+}
+
+void metrics_close_source(MetricsSource& src) {
+    for (int* fd : {&src.memory_current, &src.memory_events, &src.cpu_stat, &src.io_stat, &src.pids_current,
+                    &src.cpu_pressure, &src.memory_pressure, &src.io_pressure}) {
+        if (*fd != -1) close(*fd);
+        *fd = -1;
+    }
+}
+
+void metrics_sample(const MetricsSource& src, MetricsSample& s) {
+    char buf[8192]; // io.stat: ~100 bytes per device
+    memset(&s, 0, sizeof(s));
+    s.time_ns = now_ns(CLOCK_REALTIME);
+    if (pread_buf(src.memory_current, buf, sizeof(buf))) s.memory_current = strtoull(buf, nullptr, 10);
+    if (pread_buf(src.memory_events, buf, sizeof(buf))) {
+        s.memory_oom = sum_field(buf, "oom");
+        s.memory_oom_kill = sum_field(buf, "oom_kill");
+    }
+    if (pread_buf(src.cpu_stat, buf, sizeof(buf))) {
+        s.cpu_usage_usec = sum_field(buf, "usage_usec");
+        s.cpu_user_usec = sum_field(buf, "user_usec");
+        s.cpu_system_usec = sum_field(buf, "system_usec");
+        s.cpu_nr_throttled = sum_field(buf, "nr_throttled");
+        s.cpu_throttled_usec = sum_field(buf, "throttled_usec");
+    }
+    if (pread_buf(src.io_stat, buf, sizeof(buf))) {
+        s.io_rbytes = sum_field(buf, "rbytes");
+        s.io_wbytes = sum_field(buf, "wbytes");
+        s.io_rios = sum_field(buf, "rios");
+        s.io_wios = sum_field(buf, "wios");
+    }
+    if (pread_buf(src.pids_current, buf, sizeof(buf))) s.pids_current = strtoull(buf, nullptr, 10);
+    if (pread_buf(src.cpu_pressure, buf, sizeof(buf))) s.cpu_some_usec = psi_total(buf, "some");
+    if (pread_buf(src.memory_pressure, buf, sizeof(buf))) {
+        s.memory_some_usec = psi_total(buf, "some");
+        s.memory_full_usec = psi_total(buf, "full");
+    }
+    if (pread_buf(src.io_pressure, buf, sizeof(buf))) {
+        s.io_some_usec = psi_total(buf, "some");
+        s.io_full_usec = psi_total(buf, "full");
+    }
+}
+
+// --- Recorder ---
+
+static void ring_append(MetricsHeader* hdr, MetricsSample* slots, const MetricsSample& s) {
+    uint64_t n = hdr->written;
+    slots[n % hdr->slots] = s;
+    // Readers trust slots below written: publish the count after the sample
+    __atomic_store_n(&hdr->written, n + 1, __ATOMIC_RELEASE);
+}
+
+// cgroup.events "populated" flag. False if the file cannot be read (cgroup removed).
+static bool read_populated(int events_fd, bool& populated) {
+    char buf[256];
+    if (!pread_buf(events_fd, buf, sizeof(buf))) return false;
+    const char* p = strstr(buf, "populated ");
+    populated = p && p[10] == '1';
+    return p != nullptr;
+}
+
+static void recorder_main(const std::string& id, int ring_fd, uint32_t interval_ms, uint32_t slot_count) {
+    prctl(PR_SET_NAME, "nsi-metrics", 0, 0, 0);
+    // Ctrl+C reaches the whole foreground group: we stop when the container does
+    signal(SIGINT, SIG_IGN);
+    signal(SIGHUP, SIG_IGN);
+    int null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (null_fd != -1) { // Don't hold `nsi run`'s output pipes open
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+    }
+
+    void* map = mmap(nullptr, ring_size(slot_count), PROT_READ | PROT_WRITE, MAP_SHARED, ring_fd, 0);
+    close(ring_fd);
+    if (map == MAP_FAILED) {
+        log_msg(("Warning: metrics: mmap of the ring file failed: " + std::string(strerror(errno))).c_str());
+        _exit(EXIT_FAILURE);
+    }
+    MetricsHeader* hdr = static_cast<MetricsHeader*>(map);
+    MetricsSample* slots = reinterpret_cast<MetricsSample*>(static_cast<char*>(map) + METRICS_SLOTS_OFFSET);
+
+    // 1. Wait for the container to join its cgroup (setup_cgroups, in the child)
+    std::string path = container_cgroup_path(id);
+    int cgfd = -1, events_fd = -1;
+    bool populated = false;
+    for (int waited = 0; waited < CGROUP_WAIT_MS && !populated; waited += 10) {
+        if (cgfd == -1) cgfd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (cgfd != -1 && events_fd == -1) events_fd = openat(cgfd, "cgroup.events", O_RDONLY | O_CLOEXEC);
+        if (events_fd == -1 || !read_populated(events_fd, populated) || !populated) usleep(10000);
+    }
+    if (!populated) {
+        log_msg(("Warning: metrics: container never joined " + path + ", nothing recorded").c_str());
+        hdr->ended_ns = now_ns(CLOCK_REALTIME);
+        _exit(EXIT_FAILURE);
+    }
+    MetricsSource src;
+    metrics_open_source(cgfd, src);
+    close(cgfd);
+
+    // 2. Sample until the cgroup empties. cgroup.events signals POLLPRI on
+    //    every change, so the exit is recorded without waiting out the interval
+    uint64_t next = now_ns(CLOCK_MONOTONIC);
+    bool gone = false;
+    for (;;) {
+        MetricsSample s;
+        metrics_sample(src, s);
+        ring_append(hdr, slots, s);
+
+        uint64_t now = now_ns(CLOCK_MONOTONIC);
+        next += interval_ms * 1000000ULL;
+        if (next < now) next = now; // Fell behind (suspend, overload): don't burst
+        struct pollfd pfd = {events_fd, POLLPRI, 0};
+        int rc;
+        do {
+            int timeout = (int)((next - std::min(next, now_ns(CLOCK_MONOTONIC)) + 999999) / 1000000);
+            rc = poll(&pfd, 1, timeout);
+        } while (rc == -1 && errno == EINTR);
+        if (!read_populated(events_fd, populated)) {
+            gone = true; // Removed under us
+            break;
+        }
+        if (!populated) break;
+    }
+
+    // 3. Last sample (final CPU and I/O totals, what memory is still charged)
+    if (!gone) {
+        MetricsSample s;
+        metrics_sample(src, s);
+        ring_append(hdr, slots, s);
+    }
+    __atomic_store_n(&hdr->ended_ns, now_ns(CLOCK_REALTIME), __ATOMIC_RELEASE);
+    metrics_close_source(src);
+    _exit(EXIT_SUCCESS);
+}
+
+// Removes recordings last written more than RETENTION_DAYS ago. A live
+// recorder rewrites its file every interval, so only finished ones qualify.
+static void prune_recordings(const std::string& dir) {
+    DIR* d = opendir(dir.c_str());
+    if (!d) return;
+    time_t cutoff = time(nullptr) - RETENTION_DAYS * 24 * 3600;
+    while (struct dirent* e = readdir(d)) {
+        std::string name = e->d_name;
+        if (name.size() <= 5 || name.compare(name.size() - 5, 5, ".ring") != 0) continue;
+        struct stat st;
+        if (fstatat(dirfd(d), name.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISREG(st.st_mode) && st.st_mtime < cutoff) {
+            unlinkat(dirfd(d), name.c_str(), 0);
+        }
+    }
+    closedir(d);
+}
+
+pid_t metrics_start(const std::string& container_id, uint32_t interval_ms, uint32_t slots) {
+    std::string dir = metrics_dir();
+    errno = 0;
+    if (mkdir(dir.c_str(), 0700) == -1 && errno != EEXIST) die(("mkdir " + dir + " failed").c_str());
+    prune_recordings(dir);
+    std::string path = dir + "/" + container_id + ".ring";
+
+    // The header goes in before the fork, so the file is valid even if the
+    // container never starts
+    MetricsHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, NSI_METRICS_MAGIC, sizeof(hdr.magic));
+    hdr.sample_size = sizeof(MetricsSample);
+    hdr.slots = slots;
+    hdr.interval_ms = interval_ms;
+    hdr.started_ns = now_ns(CLOCK_REALTIME);
+    strncpy(hdr.id, container_id.c_str(), sizeof(hdr.id) - 1);
+    errno = 0;
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1 || ftruncate(fd, ring_size(slots)) == -1 || pwrite(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) {
+        die(("creating metrics ring file " + path + " failed").c_str());
+    }
+
+    errno = 0;
+    pid_t pid = fork();
+    if (pid == -1) die("fork for metrics recorder failed");
+    if (pid == 0) recorder_main(container_id, fd, interval_ms, slots);
+    close(fd);
+    log_msg(("-> Recording metrics every " + std::to_string(interval_ms) + "ms to " + path +
+             " (recorder PID " + std::to_string(pid) + ")").c_str());
+    return pid;
+}
+
+// --- Reader ---
+
+struct Recording {
+    void* map = MAP_FAILED;
+    size_t size = 0;
+    const MetricsHeader* hdr = nullptr;
+    std::vector<MetricsSample> samples; // Oldest first
+};
+
+// Maps a ring file and copies out its samples. False (message printed) if it is not one.
+static bool load_recording(const std::string& path, Recording& rec) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        fprintf(stderr, "metrics: cannot open %s: %s\n", path.c_str(), strerror(errno));
+        if (fd != -1) close(fd);
+        return false;
+    }
+    rec.size = st.st_size;
+    if (rec.size >= sizeof(MetricsHeader)) rec.map = mmap(nullptr, rec.size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    rec.hdr = static_cast<const MetricsHeader*>(rec.map);
+    if (rec.map == MAP_FAILED || memcmp(rec.hdr->magic, NSI_METRICS_MAGIC, sizeof(rec.hdr->magic)) != 0 ||
+        rec.hdr->sample_size != sizeof(MetricsSample) || rec.hdr->slots == 0 || rec.size < ring_size(rec.hdr->slots)) {
+        fprintf(stderr, "metrics: %s is not a metrics ring file of this version\n", path.c_str());
+        return false;
+    }
+
+    // A live recorder overwrites the oldest slot next: keep only slots it
+    // cannot have reached while we copied
+    const MetricsSample* slots = reinterpret_cast<const MetricsSample*>(static_cast<const char*>(rec.map) + METRICS_SLOTS_OFFSET);
+    uint32_t n_slots = rec.hdr->slots;
+    uint64_t written = __atomic_load_n(&rec.hdr->written, __ATOMIC_ACQUIRE);
+    uint64_t first = written > n_slots ? written - n_slots : 0;
+    for (uint64_t i = first; i < written; ++i) rec.samples.push_back(slots[i % n_slots]);
+    uint64_t after = __atomic_load_n(&rec.hdr->written, __ATOMIC_ACQUIRE);
+    bool live = __atomic_load_n(&rec.hdr->ended_ns, __ATOMIC_ACQUIRE) == 0;
+    uint64_t valid_from = after >= n_slots ? after - n_slots + (live ? 1 : 0) : 0;
+    if (valid_from > first) rec.samples.erase(rec.samples.begin(), rec.samples.begin() + std::min<uint64_t>(valid_from - first, rec.samples.size()));
+    return true;
+}
+
+static std::string format_time(uint64_t ns, const char* fmt) {
+    time_t t = ns / 1000000000ULL;
+    struct tm tm;
+    localtime_r(&t, &tm);
+    char buf[64];
+    strftime(buf, sizeof(buf), fmt, &tm);
+    return buf;
+}
+
+static std::string format_bytes(double v) {
+    static const char* units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    int u = 0;
+    while (v >= 1024 && u < 4) {
+        v /= 1024;
+        ++u;
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), u == 0 ? "%.0f%s" : "%.1f%s", v, units[u]);
+    return buf;
+}
+
+static void print_json(const MetricsSample& s) {
+    printf("{\"time\":\"%s.%03" PRIu64 "\",\"time_ns\":%" PRIu64, format_time(s.time_ns, "%Y-%m-%dT%H:%M:%S").c_str(),
+           s.time_ns / 1000000 % 1000, s.time_ns);
+    for (const auto& f : FIELDS) {
+        printf(",\"%s\":%" PRIu64, f.name, *reinterpret_cast<const uint64_t*>(reinterpret_cast<const char*>(&s) + f.offset));
+    }
+    printf("}\n");
+}
+
+// One table row; rates over the interval since prev (nullptr: none before it).
+static void print_row(const MetricsSample& s, const MetricsSample* prev) {
+    std::string cpu = "-", throttled = "-", rd = "-", wr = "-", psi = "-";
+    if (prev && s.time_ns > prev->time_ns) {
+        double dt_us = (s.time_ns - prev->time_ns) / 1000.0;
+        auto pct = [&](uint64_t a, uint64_t b) { return a >= b ? (a - b) * 100.0 / dt_us : 0.0; };
+        auto per_sec = [&](uint64_t a, uint64_t b) { return format_bytes(a >= b ? (a - b) * 1e6 / dt_us : 0) + "/s"; };
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.1f", pct(s.cpu_usage_usec, prev->cpu_usage_usec));
+        cpu = buf;
+        snprintf(buf, sizeof(buf), "%.0fms", s.cpu_throttled_usec >= prev->cpu_throttled_usec ? (s.cpu_throttled_usec - prev->cpu_throttled_usec) / 1000.0 : 0.0);
+        throttled = buf;
+        rd = per_sec(s.io_rbytes, prev->io_rbytes);
+        wr = per_sec(s.io_wbytes, prev->io_wbytes);
+        snprintf(buf, sizeof(buf), "%.1f/%.1f/%.1f", pct(s.cpu_some_usec, prev->cpu_some_usec),
+                 pct(s.memory_some_usec, prev->memory_some_usec), pct(s.io_some_usec, prev->io_some_usec));
+        psi = buf;
+    }
+    bool oom_kill = prev && s.memory_oom_kill > prev->memory_oom_kill;
+    printf("%-12s %10s %7s %9s %11s %11s %5" PRIu64 "  %-16s%s\n", format_time(s.time_ns, "%H:%M:%S").c_str(),
+           format_bytes(s.memory_current).c_str(), cpu.c_str(), throttled.c_str(), rd.c_str(), wr.c_str(),
+           s.pids_current, psi.c_str(), oom_kill ? "  OOM-KILL" : "");
+}
+
+static int metrics_dump(const std::string& id, double last_minutes, bool json) {
+    Recording rec;
+    if (!load_recording(metrics_dir() + "/" + id + ".ring", rec)) return EXIT_FAILURE;
+    const MetricsHeader* hdr = rec.hdr;
+    const std::vector<MetricsSample>& samples = rec.samples;
+
+    // The last N minutes of the recording (before the exit, for a dead container)
+    size_t from = 0;
+    if (last_minutes > 0 && !samples.empty()) {
+        uint64_t end = samples.back().time_ns;
+        uint64_t span = (uint64_t)(last_minutes * 60e9);
+        uint64_t cutoff = end > span ? end - span : 0;
+        while (from < samples.size() && samples[from].time_ns < cutoff) ++from;
+    }
+
+    if (json) {
+        for (size_t i = from; i < samples.size(); ++i) print_json(samples[i]);
+    } else {
+        std::string state = hdr->ended_ns ? "exited " + format_time(hdr->ended_ns, "%Y-%m-%d %H:%M:%S")
+                                          : std::string(container_pid(id) != -1 ? "recording" : "recorder stopped");
+        printf("# container %s: %zu samples every %ums (ring of %u), started %s, %s\n", id.c_str(),
+               samples.size() - from, hdr->interval_ms, hdr->slots,
+               format_time(hdr->started_ns, "%Y-%m-%d %H:%M:%S").c_str(), state.c_str());
+        printf("%-12s %10s %7s %9s %11s %11s %5s  %s\n", "TIME", "MEMORY", "CPU%", "THROTTLED", "READ", "WRITE",
+               "PIDS", "PSI cpu/mem/io%");
+        for (size_t i = from; i < samples.size(); ++i) print_row(samples[i], i > 0 ? &samples[i - 1] : nullptr);
+        if (!samples.empty()) {
+            const MetricsSample& last = samples.back();
+            printf("# last: oom %" PRIu64 ", oom_kill %" PRIu64 ", cpu user %.1fs system %.1fs, throttled %" PRIu64 "x\n",
+                   last.memory_oom, last.memory_oom_kill, last.cpu_user_usec / 1e6, last.cpu_system_usec / 1e6,
+                   last.cpu_nr_throttled);
+        }
+    }
+    munmap(rec.map, rec.size);
+    return EXIT_SUCCESS;
+}
+
+static int metrics_ls() {
+    std::string dir = metrics_dir();
+    DIR* d = opendir(dir.c_str());
+    if (!d) return EXIT_SUCCESS; // Nothing was ever recorded
+    while (struct dirent* e = readdir(d)) {
+        std::string name = e->d_name;
+        if (name.size() <= 5 || name.compare(name.size() - 5, 5, ".ring") != 0) continue;
+        Recording rec;
+        if (!load_recording(dir + "/" + name, rec)) continue;
+        std::string id = name.substr(0, name.size() - 5);
+        printf("%s\t%s\t%zu samples\t%s\n", id.c_str(), format_time(rec.hdr->started_ns, "%Y-%m-%d %H:%M:%S").c_str(),
+               rec.samples.size(),
+               rec.hdr->ended_ns ? ("exited " + format_time(rec.hdr->ended_ns, "%Y-%m-%d %H:%M:%S")).c_str() : "recording");
+        munmap(rec.map, rec.size);
+    }
+    closedir(d);
+    return EXIT_SUCCESS;
+}
+
+static int metrics_rm(const std::string& id) {
+    std::string path = metrics_dir() + "/" + id + ".ring";
+    if (unlink(path.c_str()) == -1) {
+        fprintf(stderr, "metrics: cannot remove %s: %s\n", path.c_str(), strerror(errno));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+static void usage() {
+    fprintf(stderr, "Usage: nsi-sandbox metrics <container-id> [--last <minutes>] [--json] | rm <container-id> | ls\n");
+    exit(EXIT_FAILURE);
+}
+
+int metrics_main(int argc, char* argv[]) {
+    struct option long_options[] = {
+        {"last", required_argument, 0, 'l'},
+        {"json", no_argument,       0, 'j'},
+        {0, 0, 0, 0}
+    };
+    double last_minutes = 0;
+    bool json = false;
+    optind = 1;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "l:j", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'l': last_minutes = atof(optarg); break;
+            case 'j': json = true; break;
+            default: usage();
+        }
+    }
+    bool rm = optind == argc - 2 && strcmp(argv[optind], "rm") == 0;
+    if (rm) ++optind;
+    if (optind != argc - 1) usage();
+    std::string id = argv[optind];
+    if (id == "ls" && !rm) return metrics_ls();
+    if (id.empty() || id.find('/') != std::string::npos || id[0] == '.') usage();
+    return rm ? metrics_rm(id) : metrics_dump(id, last_minutes, json);
+}
@@ -0,0 +1,99 @@
+// neoshell/src/sandbox/metrics.h
+#ifndef NSI_SANDBOX_METRICS_H
+#define NSI_SANDBOX_METRICS_H
+
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+
+// Per-container resource history for post-mortem analysis.
+//
+// With --metrics-interval, nsi-sandbox forks a recorder (before any
+// namespace exists, like the log forwarder) that samples the container's
+// cgroup at that interval into a fixed-size ring file:
+//
+//   <runtime dir>/metrics/<container id>.ring
+//
+// The file is mmap'd, so every sample is in the page cache as soon as it is
+// written and survives the container, the recorder and nsi-sandbox; only
+// the last --metrics-slots samples are kept. The recorder stops when the
+// container's cgroup is empty, after one last sample.
+//
+// Recordings stay until removed with `metrics rm`, or until a later
+// recording starts more than a week after they were last written.
+//
+// Sampling is a pread of each kept-open cgroup file into a stack buffer and
+// an in-place parse: no allocation, a few microseconds per sample.
+//
+//   nsi-sandbox metrics <id> [--last <minutes>] [--json]   dump a recording
+//   nsi-sandbox metrics ls                                   list recordings
+//   nsi-sandbox metrics rm <id>                              delete a recording
+
+#define NSI_METRICS_MAGIC "NSIMETR1"
+
+// One sample: cumulative counters as the kernel reports them (rates are
+// derived by the reader). Fields the cgroup lacks (controller not enabled,
+// no PSI) read 0.
+struct MetricsSample {
+    uint64_t time_ns;            // CLOCK_REALTIME
+    uint64_t memory_current;     // Bytes
+    uint64_t memory_oom;         // memory.events
+    uint64_t memory_oom_kill;
+    uint64_t cpu_usage_usec;     // cpu.stat
+    uint64_t cpu_user_usec;
+    uint64_t cpu_system_usec;
+    uint64_t cpu_nr_throttled;
+    uint64_t cpu_throttled_usec;
+    uint64_t io_rbytes;          // io.stat, summed over devices
+    uint64_t io_wbytes;
+    uint64_t io_rios;
+    uint64_t io_wios;
+    uint64_t pids_current;
+    uint64_t cpu_some_usec;      // *.pressure stall totals
+    uint64_t memory_some_usec;
+    uint64_t memory_full_usec;
+    uint64_t io_some_usec;
+    uint64_t io_full_usec;
+};
+
+// Start of the ring file; the slots follow at METRICS_SLOTS_OFFSET.
+struct MetricsHeader {
+    char magic[8];               // NSI_METRICS_MAGIC
+    uint32_t sample_size;        // sizeof(MetricsSample) of the writer
+    uint32_t slots;
+    uint32_t interval_ms;
+    uint32_t reserved;
+    uint64_t started_ns;         // CLOCK_REALTIME, recorder start
+    uint64_t ended_ns;           // Container exit (cgroup emptied); 0 while recording
+    uint64_t written;            // Samples ever appended; the next goes to slot written % slots
+    char id[64];                 // Container ID, NUL-terminated
+};
+
+#define METRICS_SLOTS_OFFSET 4096
+
+// The cgroup files a sample reads, opened once. -1 where a file is missing.
+struct MetricsSource {
+    int memory_current = -1;
+    int memory_events = -1;
+    int cpu_stat = -1;
+    int io_stat = -1;
+    int pids_current = -1;
+    int cpu_pressure = -1;
+    int memory_pressure = -1;
+    int io_pressure = -1;
+};
+
+// Opens the files of the cgroup directory cgfd.
+void metrics_open_source(int cgfd, MetricsSource& src);
+void metrics_close_source(MetricsSource& src);
+// Reads one sample (hot path: no allocation).
+void metrics_sample(const MetricsSource& src, MetricsSample& s);
+
+// Creates the ring file and forks the recorder for container_id. Must run
+// before any namespace is unshared. Returns the recorder's PID; dies if the
+// file cannot be created.
+pid_t metrics_start(const std::string& container_id, uint32_t interval_ms, uint32_t slots);
+
+int metrics_main(int argc, char* argv[]);
+
+#endif // NSI_SANDBOX_METRICS_H
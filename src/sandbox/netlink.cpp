@@ -0,0 +1,125 @@
+// neoshell/src/sandbox/netlink.cpp
+#include "netlink.h"
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+
+NlMsg::NlMsg(uint16_t type, uint16_t flags) {
+    struct nlmsghdr h;
+    memset(&h, 0, sizeof(h));
+    h.nlmsg_type = type;
+    h.nlmsg_flags = NLM_F_REQUEST | flags;
+    append(&h, sizeof(h));
+}
+
+void NlMsg::append(const void* data, size_t len) {
+    size_t off = buf_.size();
+    buf_.resize(off + NLMSG_ALIGN(len), 0);
+    if (len) memcpy(buf_.data() + off, data, len);
+    hdr()->nlmsg_len = buf_.size();
+}
+
+void NlMsg::put_header(const void* data, size_t len) {
+    append(data, len);
+}
+
+void NlMsg::put_attr(uint16_t type, const void* data, size_t len) {
+    struct nlattr a;
+    a.nla_type = type;
+    a.nla_len = NLA_HDRLEN + len;
+    size_t off = buf_.size();
+    buf_.resize(off + NLA_HDRLEN + NLA_ALIGN(len), 0);
+    memcpy(buf_.data() + off, &a, sizeof(a));
+    if (len) memcpy(buf_.data() + off + NLA_HDRLEN, data, len);
+    hdr()->nlmsg_len = buf_.size();
+}
+
+void NlMsg::put_str(uint16_t type, const char* s) {
+    put_attr(type, s, strlen(s) + 1);
+}
+
+size_t NlMsg::nest_begin(uint16_t type) {
+    size_t off = buf_.size();
+    put_attr(type, nullptr, 0);
+    return off;
+}
+
+void NlMsg::nest_end(size_t offset) {
+    struct nlattr* a = reinterpret_cast<struct nlattr*>(buf_.data() + offset);
+    a->nla_len = buf_.size() - offset;
+}
+
+int nl_open(int protocol) {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, protocol);
+    if (fd == -1) return -1;
+    struct sockaddr_nl sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.nl_family = AF_NETLINK;
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&sa), sizeof(sa)) == -1) {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return -1;
+    }
+    return fd;
+}
+
+// Receives replies for seq until an ACK/error (or NLMSG_DONE for dumps).
+static int nl_recv(int fd, uint32_t seq, const std::function<void(const struct nlmsghdr*)>* cb) {
+    static char buf[32 * 1024];
+    for (;;) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return -errno;
+        }
+        for (struct nlmsghdr* h = reinterpret_cast<struct nlmsghdr*>(buf); NLMSG_OK(h, (size_t)n); h = NLMSG_NEXT(h, n)) {
+            if (h->nlmsg_seq != seq) continue;
+            if (h->nlmsg_type == NLMSG_DONE) return 0;
+            if (h->nlmsg_type == NLMSG_ERROR) {
+                const struct nlmsgerr* err = reinterpret_cast<const struct nlmsgerr*>(NLMSG_DATA(h));
+                return err->error; // 0 for an ACK
+            }
+            if (cb) (*cb)(h);
+        }
+    }
+}
+
+static int nl_send(int fd, NlMsg& msg, uint32_t& seq) {
+    static uint32_t next_seq = 1;
+    seq = next_seq++;
+    msg.hdr()->nlmsg_seq = seq;
+    if (send(fd, msg.hdr(), msg.hdr()->nlmsg_len, 0) == -1) return -errno;
+    return 0;
+}
+
+int nl_transact(int fd, NlMsg& msg) {
+    msg.hdr()->nlmsg_flags |= NLM_F_ACK;
+    uint32_t seq;
+    int rc = nl_send(fd, msg, seq);
+    return rc ? rc : nl_recv(fd, seq, nullptr);
+}
+
+int nl_dump(int fd, NlMsg& msg, const std::function<void(const struct nlmsghdr*)>& cb) {
+    msg.hdr()->nlmsg_flags |= NLM_F_DUMP;
+    uint32_t seq;
+    int rc = nl_send(fd, msg, seq);
+    return rc ? rc : nl_recv(fd, seq, &cb);
+}
+
+void nl_parse(const void* attrs, size_t len, const struct nlattr** tb, int max) {
+    for (int i = 0; i <= max; ++i) tb[i] = nullptr;
+    const char* p = static_cast<const char*>(attrs);
+    while (len >= NLA_HDRLEN) {
+        const struct nlattr* a = reinterpret_cast<const struct nlattr*>(p);
+        if (a->nla_len < NLA_HDRLEN || a->nla_len > len) break;
+        int type = a->nla_type & NLA_TYPE_MASK;
+        if (type <= max) tb[type] = a;
+        size_t step = NLA_ALIGN(a->nla_len);
+        if (step > len) break;
+        p += step;
+        len -= step;
+    }
+}
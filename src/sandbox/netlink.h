@@ -0,0 +1,48 @@
+// neoshell/src/sandbox/netlink.h
+#ifndef NSI_SANDBOX_NETLINK_H
+#define NSI_SANDBOX_NETLINK_H
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include <linux/netlink.h>
+
+// Minimal netlink plumbing shared by the rtnetlink (traffic control) and
+// sock_diag code. Attributes use the common {u16 len, u16 type} layout, so
+// this works for both struct rtattr and struct nlattr payloads.
+
+class NlMsg {
+public:
+    NlMsg(uint16_t type, uint16_t flags);
+
+    // Appends the family header (e.g. struct tcmsg); call once, before attributes.
+    void put_header(const void* data, size_t len);
+    void put_attr(uint16_t type, const void* data, size_t len);
+    void put_u32(uint16_t type, uint32_t v) { put_attr(type, &v, sizeof(v)); }
+    void put_u64(uint16_t type, uint64_t v) { put_attr(type, &v, sizeof(v)); }
+    void put_str(uint16_t type, const char* s);
+    // Nested attributes: size_t n = nest_begin(T); ...; nest_end(n);
+    size_t nest_begin(uint16_t type);
+    void nest_end(size_t offset);
+
+    struct nlmsghdr* hdr() { return reinterpret_cast<struct nlmsghdr*>(buf_.data()); }
+
+private:
+    void append(const void* data, size_t len);
+    std::vector<char> buf_;
+};
+
+// Opens and binds a netlink socket (NETLINK_ROUTE, NETLINK_SOCK_DIAG, ...). -1 on error.
+int nl_open(int protocol);
+// Sends a request with NLM_F_ACK and waits for the kernel's answer. 0 or -errno.
+int nl_transact(int fd, NlMsg& msg);
+// Sends a NLM_F_DUMP request and calls cb for every reply message. 0 or -errno.
+int nl_dump(int fd, NlMsg& msg, const std::function<void(const struct nlmsghdr*)>& cb);
+// Indexes attributes by type into tb[0..max] (missing ones are nullptr).
+void nl_parse(const void* attrs, size_t len, const struct nlattr** tb, int max);
+
+inline const void* nl_data(const struct nlattr* a) { return reinterpret_cast<const char*>(a) + NLA_HDRLEN; }
+inline size_t nl_len(const struct nlattr* a) { return a->nla_len - NLA_HDRLEN; }
+
+#endif // NSI_SANDBOX_NETLINK_H
@@ -0,0 +1,275 @@
+// neoshell/src/sandbox/netshape.cpp
+#include "netshape.h"
+#include "netlink.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <strings.h>       // For strcasecmp
+#include <unistd.h>
+#include <fcntl.h>         // For AT_FDCWD
+#include <arpa/inet.h>     // For htons
+#include <net/if.h>        // For if_nameindex
+#include <linux/rtnetlink.h>
+#include <linux/pkt_sched.h>
+#include <linux/pkt_cls.h>
+#include <linux/gen_stats.h>
+#include <linux/if_ether.h> // For ETH_P_ALL
+
+static const uint32_t MIN_BURST = 32 * 1024;  // Must at least cover a few MTU-sized packets
+static const double QUEUE_LATENCY = 0.05;     // Egress queue: 50ms worth of traffic at the rate
+static const uint32_t POLICE_MTU = 65535;      // Large enough for GRO/GSO aggregates
+
+bool parse_rate(const std::string& s, uint64_t& bytes_per_sec) {
+    char* end = nullptr;
+    double v = strtod(s.c_str(), &end);
+    if (end == s.c_str() || v <= 0) return false;
+    std::string unit = end;
+    // tc(8): *bit are bits per second, *bps are bytes per second; SI multipliers
+    static const struct { const char* name; double mult; } units[] = {
+        {"bit", 1.0 / 8}, {"kbit", 1e3 / 8}, {"mbit", 1e6 / 8}, {"gbit", 1e9 / 8},
+        {"bps", 1}, {"kbps", 1e3}, {"mbps", 1e6}, {"gbps", 1e9},
+    };
+    if (unit.empty()) unit = "bit";
+    for (const auto& u : units) {
+        if (strcasecmp(unit.c_str(), u.name) == 0) {
+            bytes_per_sec = (uint64_t)(v * u.mult);
+            return bytes_per_sec > 0;
+        }
+    }
+    return false;
+}
+
+bool parse_size(const std::string& s, uint32_t& bytes) {
+    char* end = nullptr;
+    double v = strtod(s.c_str(), &end);
+    if (end == s.c_str() || v <= 0) return false;
+    std::string unit = end;
+    double mult;
+    if (unit.empty() || unit == "b") mult = 1;
+    else if (unit == "k" || unit == "kb") mult = 1024;
+    else if (unit == "m" || unit == "mb") mult = 1024 * 1024;
+    else return false;
+    if (v * mult > 0xffffffffu) return false;
+    bytes = (uint32_t)(v * mult);
+    return true;
+}
+
+// --- Time Units ---
+// Traffic control expresses times in "psched ticks"; the conversion factor
+// comes from /proc/net/psched, exactly as tc(8) does it.
+static double tick_in_usec() {
+    static double cached = 0;
+    if (cached != 0) return cached;
+    unsigned t2us = 1000, us2t = 64, clock_res = 1000000;
+    std::string s;
+    if (read_file_at(AT_FDCWD, "/proc/net/psched", s)) sscanf(s.c_str(), "%08x%08x%08x", &t2us, &us2t, &clock_res);
+    if (clock_res == 1000000000) t2us = us2t; // Same compatibility hack as iproute2
+    cached = (double)t2us / us2t * ((double)clock_res / 1000000);
+    return cached;
+}
+
+// Ticks needed to send size bytes at rate bytes/s.
+static uint32_t xmit_time(uint64_t rate, uint32_t size) {
+    double ticks = 1e6 * ((double)size / (double)rate) * tick_in_usec();
+    return ticks > 0xffffffffu ? 0xffffffffu : (uint32_t)ticks;
+}
+
+static void fill_ratespec(struct tc_ratespec& r, uint64_t rate) {
+    memset(&r, 0, sizeof(r));
+    r.rate = rate >= (1ULL << 32) ? ~0U : (uint32_t)rate; // RATE64 attribute carries the rest
+    r.linklayer = TC_LINKLAYER_ETHERNET;
+}
+
+// --- Egress: root TBF qdisc ---
+static int install_tbf(int nl, int ifindex, uint64_t rate, uint32_t burst) {
+    NlMsg msg(RTM_NEWQDISC, NLM_F_CREATE | NLM_F_REPLACE);
+    struct tcmsg tc;
+    memset(&tc, 0, sizeof(tc));
+    tc.tcm_family = AF_UNSPEC;
+    tc.tcm_ifindex = ifindex;
+    tc.tcm_parent = TC_H_ROOT;
+    tc.tcm_handle = TC_H_MAKE(1 << 16, 0);
+    msg.put_header(&tc, sizeof(tc));
+    msg.put_str(TCA_KIND, "tbf");
+
+    struct tc_tbf_qopt q;
+    memset(&q, 0, sizeof(q));
+    fill_ratespec(q.rate, rate);
+    q.limit = burst + (uint32_t)(rate * QUEUE_LATENCY);
+    q.buffer = xmit_time(rate, burst);
+    size_t opts = msg.nest_begin(TCA_OPTIONS);
+    msg.put_attr(TCA_TBF_PARMS, &q, sizeof(q));
+    msg.put_u32(TCA_TBF_BURST, burst);
+    if (rate >= (1ULL << 32)) msg.put_u64(TCA_TBF_RATE64, rate);
+    msg.nest_end(opts);
+    return nl_transact(nl, msg);
+}
+
+// --- Ingress: ingress qdisc + matchall filter with a police action ---
+static int install_ingress_police(int nl, int ifindex, uint64_t rate, uint32_t burst) {
+    struct tcmsg tc;
+    memset(&tc, 0, sizeof(tc));
+    tc.tcm_family = AF_UNSPEC;
+    tc.tcm_ifindex = ifindex;
+    tc.tcm_parent = TC_H_INGRESS;
+    tc.tcm_handle = TC_H_MAKE(TC_H_INGRESS, 0);
+    {
+        NlMsg msg(RTM_NEWQDISC, NLM_F_CREATE | NLM_F_REPLACE);
+        msg.put_header(&tc, sizeof(tc));
+        msg.put_str(TCA_KIND, "ingress");
+        int rc = nl_transact(nl, msg);
+        if (rc != 0 && rc != -EEXIST) return rc;
+    }
+
+    struct tc_police p;
+    memset(&p, 0, sizeof(p));
+    p.action = TC_POLICE_SHOT; // Exceeding packets are dropped
+    p.mtu = POLICE_MTU;
+    p.burst = xmit_time(rate, burst);
+    fill_ratespec(p.rate, rate);
+
+    // The police action still requires a rate table (tc_calc_rtable)
+    uint32_t rtab[256];
+    int cell_log = 0;
+    while ((POLICE_MTU >> cell_log) > 255) ++cell_log;
+    for (int i = 0; i < 256; ++i) rtab[i] = xmit_time(rate, (uint32_t)(i + 1) << cell_log);
+    p.rate.cell_log = cell_log;
+    p.rate.cell_align = -1;
+
+    NlMsg msg(RTM_NEWTFILTER, NLM_F_CREATE | NLM_F_EXCL);
+    struct tcmsg ftc = tc;
+    ftc.tcm_parent = TC_H_MAKE(TC_H_INGRESS, 0);
+    ftc.tcm_handle = 1;
+    ftc.tcm_info = TC_H_MAKE(1 << 16, htons(ETH_P_ALL)); // prio 1, all protocols
+    msg.put_header(&ftc, sizeof(ftc));
+    msg.put_str(TCA_KIND, "matchall");
+    size_t opts = msg.nest_begin(TCA_OPTIONS);
+    size_t acts = msg.nest_begin(TCA_MATCHALL_ACT);
+    size_t act = msg.nest_begin(1); // First (only) action in the list
+    msg.put_str(TCA_ACT_KIND, "police");
+    size_t aopts = msg.nest_begin(TCA_ACT_OPTIONS);
+    msg.put_attr(TCA_POLICE_TBF, &p, sizeof(p));
+    msg.put_attr(TCA_POLICE_RATE, rtab, sizeof(rtab));
+    if (rate >= (1ULL << 32)) msg.put_u64(TCA_POLICE_RATE64, rate);
+    msg.nest_end(aopts);
+    msg.nest_end(act);
+    msg.nest_end(acts);
+    msg.nest_end(opts);
+    int rc = nl_transact(nl, msg);
+    return rc == -EEXIST ? 0 : rc;
+}
+
+void netshape_apply(uint64_t rate, uint32_t burst) {
+    log_msg("Setting up network bandwidth shaping...");
+    if (burst == 0) {
+        // ~10ms at the rate, but never below a few full-size packets
+        burst = (uint32_t)std::min<uint64_t>(rate / 100, 0xffffffffu);
+        if (burst < MIN_BURST) burst = MIN_BURST;
+    }
+    int nl = nl_open(NETLINK_ROUTE);
+    if (nl == -1) {
+        log_msg(("Warning: rtnetlink socket failed, bandwidth not limited: " + std::string(strerror(errno))).c_str());
+        return;
+    }
+    struct if_nameindex* ifs = if_nameindex();
+    int shaped = 0;
+    for (struct if_nameindex* i = ifs; i && i->if_index != 0; ++i) {
+        if (strcmp(i->if_name, "lo") == 0) continue;
+        std::string name = i->if_name;
+        int rc = install_tbf(nl, i->if_index, rate, burst);
+        if (rc != 0) {
+            log_msg(("Warning: egress tbf on " + name + " failed: " + std::string(strerror(-rc))).c_str());
+        }
+        int rc2 = install_ingress_police(nl, i->if_index, rate, burst);
+        if (rc2 != 0) {
+            log_msg(("Warning: ingress policer on " + name + " failed: " + std::string(strerror(-rc2))).c_str());
+        }
+        if (rc == 0 || rc2 == 0) {
+            ++shaped;
+            log_msg(("-> Shaped " + name + ": " + std::to_string(rate * 8 / 1000) + " kbit/s, burst " +
+                     std::to_string(burst) + " bytes").c_str());
+        }
+    }
+    if (ifs) if_freenameindex(ifs);
+    close(nl);
+    if (shaped == 0) log_msg("-> No interfaces to shape (only loopback).");
+}
+
+// --- Stats ---
+
+static void print_stats(const char* ifname, const char* direction, const char* kind, const struct nlattr* stats2) {
+    const struct nlattr* st[TCA_STATS_MAX + 1];
+    nl_parse(nl_data(stats2), nl_len(stats2), st, TCA_STATS_MAX);
+    struct gnet_stats_basic basic;
+    struct gnet_stats_queue queue;
+    memset(&basic, 0, sizeof(basic));
+    memset(&queue, 0, sizeof(queue));
+    if (st[TCA_STATS_BASIC]) memcpy(&basic, nl_data(st[TCA_STATS_BASIC]), std::min(sizeof(basic), nl_len(st[TCA_STATS_BASIC])));
+    if (st[TCA_STATS_QUEUE]) memcpy(&queue, nl_data(st[TCA_STATS_QUEUE]), std::min(sizeof(queue), nl_len(st[TCA_STATS_QUEUE])));
+    printf("{\"iface\":\"%s\",\"direction\":\"%s\",\"kind\":\"%s\",\"bytes\":%llu,\"packets\":%u,"
+           "\"drops\":%u,\"overlimits\":%u,\"backlog\":%u,\"qlen\":%u}\n",
+           ifname, direction, kind, (unsigned long long)basic.bytes, basic.packets,
+           queue.drops, queue.overlimits, queue.backlog, queue.qlen);
+}
+
+int netstats_main(int argc, char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: nsi-sandbox net-stats <container-id>\n");
+        return EXIT_FAILURE;
+    }
+    errno = 0;
+    int pid = container_pid(argv[1]);
+    if (pid == -1) die(("No running container with id " + std::string(argv[1])).c_str());
+    if (!enter_netns(pid)) die("Could not enter the container's network namespace");
+
+    int nl = nl_open(NETLINK_ROUTE);
+    if (nl == -1) die("rtnetlink socket failed");
+
+    // Egress: the tbf qdiscs
+    NlMsg qmsg(RTM_GETQDISC, 0);
+    struct tcmsg tc;
+    memset(&tc, 0, sizeof(tc));
+    tc.tcm_family = AF_UNSPEC;
+    qmsg.put_header(&tc, sizeof(tc));
+    int rc = nl_dump(nl, qmsg, [](const struct nlmsghdr* h) {
+        const struct tcmsg* t = reinterpret_cast<const struct tcmsg*>(NLMSG_DATA(h));
+        const struct nlattr* tb[TCA_MAX + 1];
+        nl_parse(reinterpret_cast<const char*>(t) + NLMSG_ALIGN(sizeof(*t)), h->nlmsg_len - NLMSG_LENGTH(sizeof(*t)), tb, TCA_MAX);
+        if (!tb[TCA_KIND] || !tb[TCA_STATS2] || strcmp(static_cast<const char*>(nl_data(tb[TCA_KIND])), "tbf") != 0) return;
+        char ifname[IF_NAMESIZE] = "?";
+        if_indextoname(t->tcm_ifindex, ifname);
+        print_stats(ifname, "egress", "tbf", tb[TCA_STATS2]);
+    });
+    if (rc != 0) die(("qdisc dump failed: " + std::string(strerror(-rc))).c_str());
+
+    // Ingress: police action counters on each interface's matchall filter
+    struct if_nameindex* ifs = if_nameindex();
+    for (struct if_nameindex* i = ifs; i && i->if_index != 0; ++i) {
+        if (strcmp(i->if_name, "lo") == 0) continue;
+        NlMsg fmsg(RTM_GETTFILTER, 0);
+        memset(&tc, 0, sizeof(tc));
+        tc.tcm_family = AF_UNSPEC;
+        tc.tcm_ifindex = i->if_index;
+        tc.tcm_parent = TC_H_MAKE(TC_H_INGRESS, 0);
+        fmsg.put_header(&tc, sizeof(tc));
+        const char* ifname = i->if_name;
+        nl_dump(nl, fmsg, [ifname](const struct nlmsghdr* h) {
+            const struct tcmsg* t = reinterpret_cast<const struct tcmsg*>(NLMSG_DATA(h));
+            const struct nlattr* tb[TCA_MAX + 1];
+            nl_parse(reinterpret_cast<const char*>(t) + NLMSG_ALIGN(sizeof(*t)), h->nlmsg_len - NLMSG_LENGTH(sizeof(*t)), tb, TCA_MAX);
+            if (!tb[TCA_KIND] || !tb[TCA_OPTIONS] || strcmp(static_cast<const char*>(nl_data(tb[TCA_KIND])), "matchall") != 0) return;
+            const struct nlattr* mt[TCA_MATCHALL_MAX + 1];
+            nl_parse(nl_data(tb[TCA_OPTIONS]), nl_len(tb[TCA_OPTIONS]), mt, TCA_MATCHALL_MAX);
+            if (!mt[TCA_MATCHALL_ACT]) return;
+            const struct nlattr* acts[TCA_ACT_MAX_PRIO + 1];
+            nl_parse(nl_data(mt[TCA_MATCHALL_ACT]), nl_len(mt[TCA_MATCHALL_ACT]), acts, TCA_ACT_MAX_PRIO);
+            if (!acts[1]) return;
+            const struct nlattr* at[TCA_ACT_MAX + 1];
+            nl_parse(nl_data(acts[1]), nl_len(acts[1]), at, TCA_ACT_MAX);
+            if (at[TCA_ACT_STATS]) print_stats(ifname, "ingress", "police", at[TCA_ACT_STATS]);
+        });
+    }
+    if (ifs) if_freenameindex(ifs);
+    close(nl);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,31 @@
+// neoshell/src/sandbox/netshape.h
+#ifndef NSI_SANDBOX_NETSHAPE_H
+#define NSI_SANDBOX_NETSHAPE_H
+
+#include <cstdint>
+#include <string>
+
+// Per-container bandwidth shaping with traffic control (rtnetlink, no tc binary).
+//
+// On every non-loopback interface of the container's network namespace:
+//   egress:  a root "tbf" qdisc (token bucket: rate, burst, ~50ms of queue)
+//   ingress: an "ingress" qdisc with a matchall filter whose "police" action
+//            drops traffic above the same rate/burst
+//
+// Shaping only makes sense in a private network namespace; the caller must
+// never apply it to the host's interfaces.
+
+// "10mbit", "500kbit", "2mbps" (bytes), ... as in tc(8). Result in bytes/s.
+bool parse_rate(const std::string& s, uint64_t& bytes_per_sec);
+// "64k", "1m", "32768" (1024-based, as in tc(8)). Result in bytes.
+bool parse_size(const std::string& s, uint32_t& bytes);
+
+// Installs the qdiscs/filters in the current network namespace.
+// burst == 0 picks a default. Failures are logged as warnings.
+void netshape_apply(uint64_t rate, uint32_t burst);
+
+// `nsi-sandbox net-stats <container-id>`: prints one JSON object per shaping
+// qdisc/policer (bytes, packets, drops, overlimits, backlog) of a running container.
+int netstats_main(int argc, char* argv[]);
+
+#endif // NSI_SANDBOX_NETSHAPE_H
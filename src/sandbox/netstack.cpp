@@ -0,0 +1,996 @@
+// neoshell/src/sandbox/netstack.cpp
+#include "netstack.h"
+#include "netlink.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <csignal>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <linux/if_tun.h>     // For TUNSETIFF, IFF_TAP
+#include <linux/rtnetlink.h>  // For RTM_NEWLINK, RTM_NEWADDR, RTM_NEWROUTE
+#include <linux/sockios.h>    // For SIOCOUTQ
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <netinet/if_ether.h> // For struct ether_arp
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>        // For PR_SET_NAME
+#include <sys/random.h>       // For getrandom (initial sequence numbers)
+#include <sys/socket.h>
+#include <sys/syscall.h>      // For SYS_pidfd_open, SYS_close_range
+
+// --- Virtual Network (host byte order) ---
+static const uint32_t SUBNET = 0x0a000200;       // 10.0.2.0/24
+static const uint32_t NETMASK = 0xffffff00;
+static const int PREFIX_LEN = 24;
+static const uint32_t GATEWAY_ADDR = 0x0a000202; // 10.0.2.2: the host's loopback
+static const uint32_t DNS_ADDR = 0x0a000203;     // 10.0.2.3: the host's nameserver
+static const uint32_t GUEST_ADDR = 0x0a000264;   // 10.0.2.100: the container
+static const uint8_t GATEWAY_MAC[ETH_ALEN] = {0x52, 0x55, 0x0a, 0x00, 0x02, 0x02};
+static const char* TAP_NAME = "eth0";
+static const int TAP_MTU = 65520;
+static const size_t FRAME_MAX = ETH_HLEN + TAP_MTU;
+static const size_t IP_HLEN = sizeof(struct iphdr);   // We never send IP options
+static const size_t TCP_HLEN = sizeof(struct tcphdr);
+static const size_t UDP_HLEN = sizeof(struct udphdr);
+
+// --- Tuning ---
+static const int TAP_BATCH = 64;          // Frames read per wakeup before ACKs go out
+static const int UDP_BATCH = 32;          // Datagrams forwarded per wakeup and flow
+static const int TICK_MS = 50;            // Retransmit and expiry timer resolution
+static const int RTO_MIN_MS = 200, RTO_MAX_MS = 10000;
+static const int MAX_RETRIES = 8;         // Then the connection is reset
+static const int UDP_IDLE_MS = 60000;
+static const uint8_t RCV_WSCALE = 7;      // Our window: 65535 << 7, ~8 MiB
+static const uint32_t RCV_WINDOW = 65535u << RCV_WSCALE;
+static const size_t PEEK_FALLBACK_MAX = 1 << 20; // In-flight cap without SO_PEEK_OFF
+
+#ifndef SO_PEEK_OFF
+#define SO_PEEK_OFF 42
+#endif
+
+// =====================================================================
+// Namespace side: the tap and its configuration
+// =====================================================================
+
+static void link_up(int nl, int index, int mtu) {
+    struct ifinfomsg ifi;
+    memset(&ifi, 0, sizeof(ifi));
+    ifi.ifi_family = AF_UNSPEC;
+    ifi.ifi_index = index;
+    ifi.ifi_flags = IFF_UP;
+    ifi.ifi_change = IFF_UP;
+    NlMsg msg(RTM_NEWLINK, 0);
+    msg.put_header(&ifi, sizeof(ifi));
+    if (mtu) msg.put_u32(IFLA_MTU, mtu);
+    int rc = nl_transact(nl, msg);
+    if (rc < 0) {
+        errno = -rc;
+        die(("bringing up interface " + std::to_string(index) + " failed").c_str());
+    }
+}
+
+void netns_loopback_up() {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) die("socket for loopback setup failed");
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, "lo", IFNAMSIZ - 1);
+    if (ioctl(fd, SIOCGIFFLAGS, &ifr) == -1) die("SIOCGIFFLAGS lo failed");
+    ifr.ifr_flags |= IFF_UP;
+    if (ioctl(fd, SIOCSIFFLAGS, &ifr) == -1) die("bringing up lo failed");
+    close(fd);
+}
+
+static void netstack_main(int sock);
+
+void netstack_start(NetStack& ns) {
+    int sv[2];
+    errno = 0;
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) die("socketpair for nsi-net failed");
+    pid_t pid = fork();
+    if (pid == -1) die("fork of nsi-net failed");
+    if (pid == 0) {
+        close(sv[0]);
+        netstack_main(sv[1]);
+        _exit(EXIT_SUCCESS);
+    }
+    close(sv[1]);
+    ns.pid = pid;
+    ns.sock = sv[0];
+    log_msg(("-> Started nsi-net (PID " + std::to_string(pid) + ") for user-mode networking.").c_str());
+}
+
+void netstack_attach(NetStack& ns) {
+    // 1. The tap, in this (new) network namespace
+    errno = 0;
+    int tap = open("/dev/net/tun", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (tap == -1) die("open /dev/net/tun failed (--net user needs the tun driver)");
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, TAP_NAME, IFNAMSIZ - 1);
+    ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+    if (ioctl(tap, TUNSETIFF, &ifr) == -1) die("creating tap device eth0 failed");
+    int index = if_nametoindex(TAP_NAME);
+
+    // 2. Loopback and eth0 up, address, default route via the gateway
+    int nl = nl_open(NETLINK_ROUTE);
+    if (nl == -1) die("rtnetlink socket failed");
+    netns_loopback_up();
+    link_up(nl, index, TAP_MTU);
+
+    struct ifaddrmsg ifa;
+    memset(&ifa, 0, sizeof(ifa));
+    ifa.ifa_family = AF_INET;
+    ifa.ifa_prefixlen = PREFIX_LEN;
+    ifa.ifa_index = index;
+    uint32_t addr = htonl(GUEST_ADDR);
+    NlMsg amsg(RTM_NEWADDR, NLM_F_CREATE | NLM_F_EXCL);
+    amsg.put_header(&ifa, sizeof(ifa));
+    amsg.put_u32(IFA_LOCAL, addr);
+    amsg.put_u32(IFA_ADDRESS, addr);
+    int rc = nl_transact(nl, amsg);
+
+    struct rtmsg rtm;
+    memset(&rtm, 0, sizeof(rtm));
+    rtm.rtm_family = AF_INET;
+    rtm.rtm_table = RT_TABLE_MAIN;
+    rtm.rtm_protocol = RTPROT_BOOT;
+    rtm.rtm_scope = RT_SCOPE_UNIVERSE;
+    rtm.rtm_type = RTN_UNICAST;
+    NlMsg rmsg(RTM_NEWROUTE, NLM_F_CREATE | NLM_F_EXCL);
+    rmsg.put_header(&rtm, sizeof(rtm));
+    rmsg.put_u32(RTA_GATEWAY, htonl(GATEWAY_ADDR));
+    rmsg.put_u32(RTA_OIF, index);
+    if (rc == 0) rc = nl_transact(nl, rmsg);
+    close(nl);
+    if (rc < 0) {
+        errno = -rc;
+        die("configuring eth0 failed");
+    }
+
+    // 3. Hand the tap to nsi-net
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    memset(cbuf, 0, sizeof(cbuf));
+    char byte = 'T';
+    struct iovec iov = {&byte, 1};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &tap, sizeof(int));
+    if (sendmsg(ns.sock, &msg, MSG_NOSIGNAL) != 1) die("handing the tap to nsi-net failed");
+    close(tap);
+    log_msg("-> eth0 up: 10.0.2.100/24 via 10.0.2.2 (host), DNS 10.0.2.3, MTU 65520.");
+}
+
+void netstack_watch(NetStack& ns, pid_t pid) {
+    if (ns.sock == -1) return;
+    if (write(ns.sock, &pid, sizeof(pid)) != sizeof(pid)) {
+        log_msg(("Warning: nsi-net did not take the PID to watch: " + std::string(strerror(errno))).c_str());
+    }
+    close(ns.sock);
+    ns.sock = -1;
+}
+
+void netstack_resolv_conf() {
+    static const char conf[] = "nameserver 10.0.2.3\n";
+    unlink("/etc/resolv.conf"); // Often a symlink into the image's /run
+    int fd = open("/etc/resolv.conf", O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0644);
+    if (fd == -1 || write(fd, conf, sizeof(conf) - 1) != (ssize_t)sizeof(conf) - 1) {
+        log_msg(("Warning: writing /etc/resolv.conf failed: " + std::string(strerror(errno))).c_str());
+    }
+    if (fd != -1) close(fd);
+}
+
+// =====================================================================
+// nsi-net: the host side
+// =====================================================================
+
+// Everything registered with epoll starts with this
+struct Flow {
+    enum Kind { TAP, EXIT, TCP, UDP } kind;
+    int fd;
+};
+
+struct TcpConn : Flow {
+    enum State { CONNECTING, SYN_ACKED, ESTABLISHED } state = CONNECTING;
+    uint32_t guest_addr, dst_addr;
+    uint16_t guest_port, dst_port;
+    // Toward the container (our sequence space)
+    uint32_t snd_una = 0, snd_nxt = 0;
+    uint32_t snd_wnd = 0;       // Its window, bytes
+    uint8_t snd_wscale = 0;
+    bool wscale_ok = false;
+    uint16_t mss = 536;         // Its MSS
+    // From the container
+    uint32_t rcv_nxt = 0;
+    bool guest_fin = false;     // Received (and passed on as shutdown(SHUT_WR))
+    bool rdhup = false;         // The host peer closed its side
+    bool fin_sent = false;
+    uint32_t rcv_wnd = RCV_WINDOW; // Advertised: what the host socket can still take
+    bool dropped = false;       // Data beyond what the host socket took was refused
+    bool ack_pending = false;
+    bool dead = false;
+    int dupacks = 0, retries = 0;
+    int rto_ms = RTO_MIN_MS;
+    uint64_t rto_at = 0;        // 0: nothing in flight
+    uint32_t events = 0;        // Current epoll interest
+};
+
+struct UdpFlow : Flow {
+    uint32_t guest_addr, dst_addr;
+    uint16_t guest_port, dst_port;
+    uint64_t last_ms;
+};
+
+static struct {
+    int tap = -1, epoll = -1;
+    uint8_t guest_mac[ETH_ALEN];
+    uint32_t dns = 0;           // Host nameserver (network order), 0 if none
+    bool peek_off = true;       // SO_PEEK_OFF works on TCP sockets (Linux 6.9+)
+    uint64_t now = 0;           // ms, CLOCK_MONOTONIC
+    std::unordered_map<uint64_t, TcpConn*> tcp;
+    std::unordered_map<uint64_t, UdpFlow*> udp;
+    std::vector<TcpConn*> acks; // Owed an ACK at the end of the batch
+    std::vector<TcpConn*> dead; // Freed at the end of the loop iteration
+    std::vector<TcpConn*> due;  // Retransmit timers that fired this tick
+} st;
+
+// Frames are built in place here: headers, then payload read straight from the host socket
+static uint8_t rx_frame[FRAME_MAX];
+static uint8_t tx_frame[FRAME_MAX];
+static uint8_t peek_discard[PEEK_FALLBACK_MAX];
+
+static uint64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool seq_lt(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+static uint64_t flow_key(uint32_t dst_addr, uint16_t dst_port, uint16_t guest_port) {
+    return (uint64_t)dst_addr << 32 | (uint32_t)dst_port << 16 | guest_port;
+}
+
+// --- Checksums ---
+
+// One's complement sum; 32-bit chunks fold to the same 16-bit result
+static uint64_t csum_add(uint64_t sum, const void* data, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        sum += (v & 0xffffffff) + (v >> 32);
+    }
+    for (; len >= 2; p += 2, len -= 2) {
+        uint16_t v;
+        memcpy(&v, p, 2);
+        sum += v;
+    }
+    if (len) {
+        uint16_t v = 0;
+        memcpy(&v, p, 1);
+        sum += v;
+    }
+    return sum;
+}
+
+static uint16_t csum_finish(uint64_t sum) {
+    while (sum >> 16) sum = (sum & 0xffff) + (sum >> 16);
+    return ~sum & 0xffff;
+}
+
+// --- Frames to the Container ---
+
+// Fills in Ethernet and IPv4 headers; returns where the L4 header goes.
+static uint8_t* begin_frame(uint32_t src, uint32_t dst, uint8_t proto) {
+    struct ether_header* eth = reinterpret_cast<struct ether_header*>(tx_frame);
+    memcpy(eth->ether_dhost, st.guest_mac, ETH_ALEN);
+    memcpy(eth->ether_shost, GATEWAY_MAC, ETH_ALEN);
+    eth->ether_type = htons(ETHERTYPE_IP);
+    struct iphdr* ip = reinterpret_cast<struct iphdr*>(tx_frame + ETH_HLEN);
+    memset(ip, 0, IP_HLEN);
+    ip->version = 4;
+    ip->ihl = IP_HLEN / 4;
+    ip->frag_off = htons(IP_DF);
+    ip->ttl = 64;
+    ip->protocol = proto;
+    ip->saddr = htonl(src);
+    ip->daddr = htonl(dst);
+    return tx_frame + ETH_HLEN + IP_HLEN;
+}
+
+// Completes the checksums of the frame begin_frame() started and writes it to the tap.
+static void send_frame(size_t l4_len) {
+    struct iphdr* ip = reinterpret_cast<struct iphdr*>(tx_frame + ETH_HLEN);
+    uint8_t* l4 = tx_frame + ETH_HLEN + IP_HLEN;
+    ip->tot_len = htons(IP_HLEN + l4_len);
+    ip->check = 0;
+    ip->check = csum_finish(csum_add(0, ip, IP_HLEN));
+
+    // Pseudo-header: addresses, protocol, length
+    uint16_t tail[2] = {htons(ip->protocol), htons(l4_len)};
+    uint64_t sum = csum_add(csum_add(0, &ip->saddr, 8), tail, 4);
+    uint16_t* check = reinterpret_cast<uint16_t*>(l4 + (ip->protocol == IPPROTO_TCP ? 16 : 6));
+    *check = 0;
+    uint16_t c = csum_finish(csum_add(sum, l4, l4_len));
+    *check = (c == 0 && ip->protocol == IPPROTO_UDP) ? 0xffff : c;
+
+    size_t len = ETH_HLEN + IP_HLEN + l4_len;
+    while (write(st.tap, tx_frame, len) == -1 && errno == EINTR) {}
+    // Other errors (queue full) drop the frame like a wire would; TCP recovers
+}
+
+static uint8_t* tcp_payload() {
+    return tx_frame + ETH_HLEN + IP_HLEN + TCP_HLEN;
+}
+
+// A TCP segment; its payload (if any) is already at tcp_payload().
+static void tcp_frame(uint32_t src, uint16_t sport, uint32_t dst, uint16_t dport, uint32_t seq, uint32_t ack,
+                      uint8_t flags, uint16_t window, size_t payload_len) {
+    struct tcphdr* th = reinterpret_cast<struct tcphdr*>(begin_frame(src, dst, IPPROTO_TCP));
+    memset(th, 0, TCP_HLEN);
+    th->th_sport = htons(sport);
+    th->th_dport = htons(dport);
+    th->th_seq = htonl(seq);
+    th->th_ack = htonl(ack);
+    th->th_off = TCP_HLEN / 4;
+    th->th_flags = flags;
+    th->th_win = htons(window);
+    send_frame(TCP_HLEN + payload_len);
+}
+
+static void tcp_segment(TcpConn* c, uint8_t flags, uint32_t seq, size_t payload_len) {
+    uint16_t window = c->wscale_ok ? c->rcv_wnd >> RCV_WSCALE : std::min<uint32_t>(c->rcv_wnd, 65535);
+    tcp_frame(c->dst_addr, c->dst_port, c->guest_addr, c->guest_port, seq, c->rcv_nxt, flags | TH_ACK, window, payload_len);
+    c->ack_pending = false;
+}
+
+static void tcp_syn_ack(TcpConn* c) {
+    struct tcphdr* th = reinterpret_cast<struct tcphdr*>(begin_frame(c->dst_addr, c->guest_addr, IPPROTO_TCP));
+    memset(th, 0, TCP_HLEN);
+    th->th_sport = htons(c->dst_port);
+    th->th_dport = htons(c->guest_port);
+    th->th_seq = htonl(c->snd_una);
+    th->th_ack = htonl(c->rcv_nxt);
+    th->th_flags = TH_SYN | TH_ACK;
+    th->th_win = htons(65535); // Never scaled in a SYN
+    // Options: MSS, and window scaling if the container offered it
+    uint8_t* opt = tcp_payload();
+    uint16_t mss = htons(TAP_MTU - IP_HLEN - TCP_HLEN);
+    opt[0] = TCPOPT_MAXSEG;
+    opt[1] = TCPOLEN_MAXSEG;
+    memcpy(opt + 2, &mss, 2);
+    size_t len = TCPOLEN_MAXSEG;
+    if (c->wscale_ok) {
+        opt[len++] = TCPOPT_NOP;
+        opt[len++] = TCPOPT_WINDOW;
+        opt[len++] = TCPOLEN_WINDOW;
+        opt[len++] = RCV_WSCALE;
+    }
+    th->th_off = (TCP_HLEN + len) / 4;
+    send_frame(TCP_HLEN + len);
+}
+
+// Answers a segment that belongs to no connection (RFC 793 reset generation).
+static void tcp_reset_reply(const struct iphdr* ip, const struct tcphdr* th, size_t data_len) {
+    uint32_t src = ntohl(ip->daddr), dst = ntohl(ip->saddr);
+    if (th->th_flags & TH_ACK) {
+        tcp_frame(src, ntohs(th->th_dport), dst, ntohs(th->th_sport), ntohl(th->th_ack), 0, TH_RST, 0, 0);
+    } else {
+        uint32_t ack = ntohl(th->th_seq) + data_len + !!(th->th_flags & TH_SYN) + !!(th->th_flags & TH_FIN);
+        tcp_frame(src, ntohs(th->th_dport), dst, ntohs(th->th_sport), 0, ack, TH_RST | TH_ACK, 0, 0);
+    }
+}
+
+// --- TCP Connections ---
+
+static void set_events(TcpConn* c, uint32_t events) {
+    if (events == c->events) return;
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = c;
+    epoll_ctl(st.epoll, EPOLL_CTL_MOD, c->fd, &ev);
+    c->events = events;
+}
+
+// Host data arrives as edges; EPOLLOUT only while our window is nearly closed
+static void update_events(TcpConn* c) {
+    bool watch = c->rcv_wnd < 4u * c->mss;
+    set_events(c, EPOLLIN | EPOLLRDHUP | EPOLLET | (watch ? (uint32_t)EPOLLOUT : 0));
+}
+
+// Our window is the free space of the host socket's send buffer, so the
+// container sends no faster than the host peer takes data.
+static void tcp_update_window(TcpConn* c) {
+    int sndbuf = 0, queued = 0;
+    socklen_t len = sizeof(sndbuf);
+    if (getsockopt(c->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, &len) == -1 || ioctl(c->fd, SIOCOUTQ, &queued) == -1) {
+        c->rcv_wnd = RCV_WINDOW;
+    } else {
+        // The buffer is charged per skb, payload plus overhead: count half
+        c->rcv_wnd = sndbuf > queued ? std::min<uint32_t>((sndbuf - queued) / 2, RCV_WINDOW) : 0;
+        if (c->rcv_wnd < c->mss) c->rcv_wnd = 0; // No silly windows
+    }
+    update_events(c);
+}
+
+static void tcp_free(TcpConn* c, bool abort_host) {
+    if (abort_host) {
+        struct linger lg = {1, 0}; // close() sends a RST
+        setsockopt(c->fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    }
+    close(c->fd);
+    st.tcp.erase(flow_key(c->dst_addr, c->dst_port, c->guest_port));
+    c->dead = true;
+    st.dead.push_back(c);
+}
+
+static void tcp_reset(TcpConn* c) {
+    tcp_segment(c, TH_RST, c->snd_nxt, 0);
+    tcp_free(c, true);
+}
+
+static void queue_ack(TcpConn* c) {
+    if (c->ack_pending) return;
+    c->ack_pending = true;
+    st.acks.push_back(c);
+}
+
+static void tcp_check_done(TcpConn* c) {
+    if (c->guest_fin && c->fin_sent && c->snd_una == c->snd_nxt) tcp_free(c, false);
+}
+
+// Sends host data (and then FIN) as far as the container's window allows.
+// The data stays in the host socket until acknowledged: each segment is
+// peeked at the offset after what is already in flight.
+static void tcp_push(TcpConn* c) {
+    if (c->state != TcpConn::ESTABLISHED || c->fin_sent) return;
+    for (;;) {
+        uint32_t in_flight = c->snd_nxt - c->snd_una;
+        uint32_t window = c->snd_wnd;
+        if (!st.peek_off) window = std::min<uint32_t>(window, PEEK_FALLBACK_MAX);
+        if (in_flight >= window) return; // Its next ACK calls us again
+        size_t want = std::min<size_t>({c->mss, window - in_flight, TAP_MTU - IP_HLEN - TCP_HLEN});
+        ssize_t n;
+        if (st.peek_off) {
+            n = recv(c->fd, tcp_payload(), want, MSG_PEEK | MSG_DONTWAIT);
+        } else {
+            // Peek the in-flight bytes again, into a scratch buffer
+            struct iovec iov[2] = {{peek_discard, in_flight}, {tcp_payload(), want}};
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = 2;
+            n = recvmsg(c->fd, &msg, MSG_PEEK | MSG_DONTWAIT);
+            if (n >= 0) {
+                n = n > (ssize_t)in_flight ? n - in_flight : 0;
+                if (n == 0 && !c->rdhup) return; // Nothing new yet
+            }
+        }
+        if (n > 0) {
+            tcp_segment(c, TH_PUSH, c->snd_nxt, n);
+            c->snd_nxt += n;
+            if (!c->rto_at) c->rto_at = st.now + c->rto_ms;
+            if ((size_t)n < want && !c->rdhup) return; // Drained; the next edge brings more
+            continue;
+        }
+        if (n == 0) {
+            // The host side closed and everything before it is sent
+            tcp_segment(c, TH_FIN, c->snd_nxt, 0);
+            c->snd_nxt++;
+            c->fin_sent = true;
+            if (!c->rto_at) c->rto_at = st.now + c->rto_ms;
+            tcp_check_done(c);
+            return;
+        }
+        if (errno == EAGAIN || errno == EINTR) return;
+        tcp_reset(c);
+        return;
+    }
+}
+
+// Go-back-N from the first unacknowledged byte.
+static void tcp_rewind(TcpConn* c) {
+    if (c->state == TcpConn::SYN_ACKED) {
+        tcp_syn_ack(c);
+        return;
+    }
+    c->snd_nxt = c->snd_una;
+    c->fin_sent = false;
+    c->dupacks = 0;
+    if (st.peek_off) {
+        int zero = 0;
+        setsockopt(c->fd, SOL_SOCKET, SO_PEEK_OFF, &zero, sizeof(zero));
+    }
+    tcp_push(c);
+}
+
+static void tcp_ack(TcpConn* c, uint32_t ack, uint16_t win, bool pure) {
+    uint32_t wnd = c->wscale_ok ? (uint32_t)win << c->snd_wscale : win;
+    if (seq_lt(c->snd_una, ack) && !seq_lt(c->snd_nxt, ack)) {
+        uint32_t acked = ack - c->snd_una;
+        if (c->state == TcpConn::SYN_ACKED) {
+            c->state = TcpConn::ESTABLISHED;
+            acked--;
+            update_events(c);
+        }
+        if (c->fin_sent && ack == c->snd_nxt) acked--;
+        // Acknowledged data leaves the host socket (and the peek offset moves back with it)
+        if (acked && recv(c->fd, NULL, acked, MSG_TRUNC | MSG_DONTWAIT) != (ssize_t)acked) {
+            tcp_reset(c);
+            return;
+        }
+        c->snd_una = ack;
+        c->dupacks = 0;
+        c->retries = 0;
+        c->rto_ms = RTO_MIN_MS;
+        c->rto_at = c->snd_una == c->snd_nxt ? 0 : st.now + c->rto_ms;
+    } else if (pure && ack == c->snd_una && c->snd_una != c->snd_nxt && wnd == c->snd_wnd) {
+        if (++c->dupacks == 3) {
+            c->snd_wnd = wnd;
+            tcp_rewind(c);
+            return;
+        }
+    }
+    c->snd_wnd = wnd;
+    tcp_check_done(c);
+    if (!c->dead) tcp_push(c);
+}
+
+// Container data in order goes to the host socket; what does not fit
+// (the container overran our window) is dropped and retransmitted later.
+static void tcp_data(TcpConn* c, uint32_t seq, const uint8_t* data, size_t len, bool fin) {
+    if (seq_lt(c->rcv_nxt, seq)) { // A segment is missing: the duplicate ACK asks for it
+        queue_ack(c);
+        return;
+    }
+    uint32_t skip = c->rcv_nxt - seq; // Already have these bytes
+    if (skip < len && !c->guest_fin) {
+        ssize_t n = send(c->fd, data + skip, len - skip, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n == -1 && errno != EAGAIN) {
+            tcp_reset(c);
+            return;
+        }
+        if (n == -1) n = 0;
+        c->rcv_nxt += n;
+        tcp_update_window(c);
+        if ((size_t)n < len - skip) {
+            c->dropped = true;
+            queue_ack(c);
+            return;
+        }
+    }
+    if (fin && !c->guest_fin && c->rcv_nxt == seq + len) {
+        c->rcv_nxt++;
+        c->guest_fin = true;
+        shutdown(c->fd, SHUT_WR);
+    }
+    queue_ack(c);
+    tcp_check_done(c);
+}
+
+// The host socket drained: announce the reopened window. Duplicate ACKs
+// make the container retransmit what was dropped without waiting for its RTO.
+static void tcp_window_update(TcpConn* c) {
+    uint32_t before = c->rcv_wnd;
+    tcp_update_window(c);
+    if (c->rcv_wnd <= before) return;
+    tcp_segment(c, 0, c->snd_nxt, 0);
+    if (c->dropped) {
+        for (int i = 0; i < 3; ++i) tcp_segment(c, 0, c->snd_nxt, 0);
+        c->dropped = false;
+    }
+}
+
+// Where a connection to addr (host order) goes on the host; false if nowhere.
+static bool host_address(uint32_t addr, uint16_t port, struct sockaddr_in& out) {
+    memset(&out, 0, sizeof(out));
+    out.sin_family = AF_INET;
+    out.sin_port = htons(port);
+    if (addr == GATEWAY_ADDR) {
+        out.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    } else if (addr == DNS_ADDR) {
+        if (st.dns == 0) return false;
+        out.sin_addr.s_addr = st.dns;
+    } else if ((addr & NETMASK) == SUBNET || (addr >> 24) == 127 || (addr >> 28) >= 14 || addr == 0) {
+        return false; // Nothing else in the subnet; loopback, multicast, broadcast
+    } else {
+        out.sin_addr.s_addr = htonl(addr);
+    }
+    return true;
+}
+
+// A SYN for a new connection: connect on the host first, answer once that succeeds.
+static void tcp_open(const struct iphdr* ip, const struct tcphdr* th, size_t hlen) {
+    uint32_t dst = ntohl(ip->daddr);
+    struct sockaddr_in to;
+    int fd = -1;
+    if (host_address(dst, ntohs(th->th_dport), to)) fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        tcp_reset_reply(ip, th, 0);
+        return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // The container already batched
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&to), sizeof(to)) == -1 && errno != EINPROGRESS) {
+        close(fd);
+        tcp_reset_reply(ip, th, 0);
+        return;
+    }
+
+    TcpConn* c = new TcpConn();
+    c->kind = Flow::TCP;
+    c->fd = fd;
+    c->guest_addr = ntohl(ip->saddr);
+    c->dst_addr = dst;
+    c->guest_port = ntohs(th->th_sport);
+    c->dst_port = ntohs(th->th_dport);
+    c->rcv_nxt = ntohl(th->th_seq) + 1;
+    c->snd_wnd = ntohs(th->th_win);
+    uint32_t isn = 0;
+    getrandom(&isn, sizeof(isn), 0);
+    c->snd_una = c->snd_nxt = isn;
+    // Options: MSS and window scale
+    const uint8_t* opt = reinterpret_cast<const uint8_t*>(th) + TCP_HLEN;
+    for (size_t i = 0; i < hlen - TCP_HLEN;) {
+        if (opt[i] == TCPOPT_EOL) break;
+        if (opt[i] == TCPOPT_NOP) { ++i; continue; }
+        if (i + 1 >= hlen - TCP_HLEN || opt[i + 1] < 2 || i + opt[i + 1] > hlen - TCP_HLEN) break;
+        if (opt[i] == TCPOPT_MAXSEG && opt[i + 1] == TCPOLEN_MAXSEG) {
+            c->mss = std::max(opt[i + 2] << 8 | opt[i + 3], 64);
+        } else if (opt[i] == TCPOPT_WINDOW && opt[i + 1] == TCPOLEN_WINDOW) {
+            c->wscale_ok = true;
+            c->snd_wscale = std::min<uint8_t>(opt[i + 2], 14);
+        }
+        i += opt[i + 1];
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLOUT; // Connect completion
+    ev.data.ptr = c;
+    epoll_ctl(st.epoll, EPOLL_CTL_ADD, fd, &ev);
+    c->events = EPOLLOUT;
+    st.tcp[flow_key(c->dst_addr, c->dst_port, c->guest_port)] = c;
+}
+
+static void tcp_connected(TcpConn* c) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err != 0) {
+        // Refused or unreachable: the container sees a reset, as from the server
+        tcp_frame(c->dst_addr, c->dst_port, c->guest_addr, c->guest_port, 0, c->rcv_nxt, TH_RST | TH_ACK, 0, 0);
+        tcp_free(c, false);
+        return;
+    }
+    if (st.peek_off) {
+        int zero = 0;
+        if (setsockopt(c->fd, SOL_SOCKET, SO_PEEK_OFF, &zero, sizeof(zero)) == -1) st.peek_off = false;
+    }
+    c->state = TcpConn::SYN_ACKED;
+    tcp_syn_ack(c);
+    c->snd_nxt = c->snd_una + 1;
+    c->rto_at = st.now + c->rto_ms;
+    set_events(c, EPOLLRDHUP | EPOLLET); // Data waits until the handshake completes
+}
+
+static void tcp_input(const struct iphdr* ip, const uint8_t* seg, size_t len) {
+    if (len < TCP_HLEN) return;
+    const struct tcphdr* th = reinterpret_cast<const struct tcphdr*>(seg);
+    size_t hlen = th->th_off * 4;
+    if (hlen < TCP_HLEN || hlen > len) return;
+    uint8_t flags = th->th_flags;
+    auto it = st.tcp.find(flow_key(ntohl(ip->daddr), ntohs(th->th_dport), ntohs(th->th_sport)));
+    if (it == st.tcp.end()) {
+        if ((flags & (TH_SYN | TH_ACK | TH_RST)) == TH_SYN) tcp_open(ip, th, hlen);
+        else if (!(flags & TH_RST)) tcp_reset_reply(ip, th, len - hlen);
+        return;
+    }
+    TcpConn* c = it->second;
+    if (flags & TH_RST) {
+        tcp_free(c, true);
+        return;
+    }
+    if (flags & TH_SYN) { // Retransmitted SYN
+        if (c->state == TcpConn::SYN_ACKED) tcp_syn_ack(c);
+        return;
+    }
+    if (c->state == TcpConn::CONNECTING) return;
+    size_t data_len = len - hlen;
+    if (flags & TH_ACK) {
+        tcp_ack(c, ntohl(th->th_ack), ntohs(th->th_win), data_len == 0 && !(flags & TH_FIN));
+        if (c->dead) return;
+    }
+    if (data_len || (flags & TH_FIN)) tcp_data(c, ntohl(th->th_seq), seg + hlen, data_len, flags & TH_FIN);
+}
+
+static void tcp_event(TcpConn* c, uint32_t events) {
+    if (c->state == TcpConn::CONNECTING) {
+        tcp_connected(c);
+        return;
+    }
+    if (events & EPOLLRDHUP) c->rdhup = true;
+    if (events & EPOLLERR) {
+        tcp_reset(c);
+        return;
+    }
+    if (events & EPOLLOUT) tcp_window_update(c);
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) tcp_push(c);
+}
+
+static void tcp_timers() {
+    // Collected first: a reset (and a rewind that fails) erases from st.tcp
+    for (auto& [key, c] : st.tcp) {
+        if (c->rto_at && st.now >= c->rto_at) st.due.push_back(c);
+    }
+    for (TcpConn* c : st.due) {
+        if (c->dead) continue;
+        if (++c->retries > MAX_RETRIES) {
+            tcp_reset(c);
+            continue;
+        }
+        c->rto_ms = std::min(c->rto_ms * 2, RTO_MAX_MS);
+        c->rto_at = st.now + c->rto_ms;
+        tcp_rewind(c);
+    }
+    st.due.clear();
+}
+
+static void flush_acks() {
+    for (TcpConn* c : st.acks) {
+        if (!c->dead && c->ack_pending) tcp_segment(c, 0, c->snd_nxt, 0);
+    }
+    st.acks.clear();
+}
+
+// --- UDP ---
+
+static void udp_input(const struct iphdr* ip, const uint8_t* seg, size_t len) {
+    if (len < UDP_HLEN) return;
+    const struct udphdr* uh = reinterpret_cast<const struct udphdr*>(seg);
+    size_t ulen = ntohs(uh->uh_ulen);
+    if (ulen < UDP_HLEN || ulen > len) return;
+    uint32_t dst = ntohl(ip->daddr);
+    uint64_t key = flow_key(dst, ntohs(uh->uh_dport), ntohs(uh->uh_sport));
+    auto it = st.udp.find(key);
+    UdpFlow* f;
+    if (it != st.udp.end()) {
+        f = it->second;
+    } else {
+        struct sockaddr_in to;
+        if (!host_address(dst, ntohs(uh->uh_dport), to)) return;
+        int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd == -1) return;
+        if (connect(fd, reinterpret_cast<struct sockaddr*>(&to), sizeof(to)) == -1) {
+            close(fd);
+            return;
+        }
+        f = new UdpFlow();
+        f->kind = Flow::UDP;
+        f->fd = fd;
+        f->guest_addr = ntohl(ip->saddr);
+        f->dst_addr = dst;
+        f->guest_port = ntohs(uh->uh_sport);
+        f->dst_port = ntohs(uh->uh_dport);
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = f;
+        epoll_ctl(st.epoll, EPOLL_CTL_ADD, fd, &ev);
+        st.udp[key] = f;
+    }
+    f->last_ms = st.now;
+    send(f->fd, seg + UDP_HLEN, ulen - UDP_HLEN, MSG_DONTWAIT);
+}
+
+// Host datagrams back to the container, from the address it sent to
+static void udp_event(UdpFlow* f) {
+    for (int i = 0; i < UDP_BATCH; ++i) {
+        uint8_t* l4 = begin_frame(f->dst_addr, f->guest_addr, IPPROTO_UDP);
+        ssize_t n = recv(f->fd, l4 + UDP_HLEN, TAP_MTU - IP_HLEN - UDP_HLEN, MSG_DONTWAIT);
+        if (n < 0) break;
+        struct udphdr* uh = reinterpret_cast<struct udphdr*>(l4);
+        uh->uh_sport = htons(f->dst_port);
+        uh->uh_dport = htons(f->guest_port);
+        uh->uh_ulen = htons(UDP_HLEN + n);
+        send_frame(UDP_HLEN + n);
+        f->last_ms = st.now;
+    }
+}
+
+static void udp_expire() {
+    for (auto it = st.udp.begin(); it != st.udp.end();) {
+        UdpFlow* f = it->second;
+        if (st.now - f->last_ms < (uint64_t)UDP_IDLE_MS) {
+            ++it;
+            continue;
+        }
+        close(f->fd);
+        delete f;
+        it = st.udp.erase(it);
+    }
+}
+
+// --- Frames from the Container ---
+
+// Replies for every address of the subnet but the container's own
+static void arp_input(const uint8_t* frame, size_t len) {
+    if (len < ETH_HLEN + sizeof(struct ether_arp)) return;
+    const struct ether_arp* req = reinterpret_cast<const struct ether_arp*>(frame + ETH_HLEN);
+    if (ntohs(req->ea_hdr.ar_op) != ARPOP_REQUEST || ntohs(req->ea_hdr.ar_pro) != ETHERTYPE_IP) return;
+    uint32_t target, sender;
+    memcpy(&target, req->arp_tpa, 4);
+    memcpy(&sender, req->arp_spa, 4);
+    if ((ntohl(target) & NETMASK) != SUBNET || target == sender) return; // Not ours, or its own probe
+
+    struct ether_header* eth = reinterpret_cast<struct ether_header*>(tx_frame);
+    memcpy(eth->ether_dhost, req->arp_sha, ETH_ALEN);
+    memcpy(eth->ether_shost, GATEWAY_MAC, ETH_ALEN);
+    eth->ether_type = htons(ETHERTYPE_ARP);
+    struct ether_arp* rep = reinterpret_cast<struct ether_arp*>(tx_frame + ETH_HLEN);
+    rep->ea_hdr = req->ea_hdr;
+    rep->ea_hdr.ar_op = htons(ARPOP_REPLY);
+    memcpy(rep->arp_sha, GATEWAY_MAC, ETH_ALEN);
+    memcpy(rep->arp_spa, &target, 4);
+    memcpy(rep->arp_tha, req->arp_sha, ETH_ALEN);
+    memcpy(rep->arp_tpa, &sender, 4);
+    while (write(st.tap, tx_frame, ETH_HLEN + sizeof(struct ether_arp)) == -1 && errno == EINTR) {}
+}
+
+static void ip_input(const uint8_t* pkt, size_t len) {
+    if (len < IP_HLEN) return;
+    const struct iphdr* ip = reinterpret_cast<const struct iphdr*>(pkt);
+    size_t hlen = ip->ihl * 4;
+    size_t total = ntohs(ip->tot_len);
+    if (ip->version != 4 || hlen < IP_HLEN || total < hlen || total > len) return;
+    if (ntohs(ip->frag_off) & (IP_MF | IP_OFFMASK)) return; // Fragments are not reassembled
+    if (ip->protocol == IPPROTO_TCP) tcp_input(ip, pkt + hlen, total - hlen);
+    else if (ip->protocol == IPPROTO_UDP) udp_input(ip, pkt + hlen, total - hlen);
+}
+
+// Drains up to a batch of frames, then sends the ACKs they made due at once.
+static void tap_event() {
+    for (int i = 0; i < TAP_BATCH; ++i) {
+        ssize_t n = read(st.tap, rx_frame, sizeof(rx_frame));
+        if (n == -1 && errno == EINTR) continue;
+        if (n < (ssize_t)ETH_HLEN) break;
+        const struct ether_header* eth = reinterpret_cast<const struct ether_header*>(rx_frame);
+        memcpy(st.guest_mac, eth->ether_shost, ETH_ALEN);
+        uint16_t type = ntohs(eth->ether_type);
+        if (type == ETHERTYPE_ARP) arp_input(rx_frame, n);
+        else if (type == ETHERTYPE_IP) ip_input(rx_frame + ETH_HLEN, n - ETH_HLEN);
+    }
+    flush_acks();
+}
+
+// First nameserver of the host's resolv.conf
+static uint32_t host_nameserver() {
+    std::string conf;
+    if (!read_file_at(AT_FDCWD, "/etc/resolv.conf", conf)) return 0;
+    size_t pos = 0;
+    while (pos < conf.size()) {
+        size_t end = conf.find('\n', pos);
+        if (end == std::string::npos) end = conf.size();
+        char addr[64];
+        struct in_addr in;
+        if (sscanf(conf.substr(pos, end - pos).c_str(), " nameserver %63s", addr) == 1 && inet_pton(AF_INET, addr, &in) == 1) {
+            return in.s_addr;
+        }
+        pos = end + 1;
+    }
+    return 0;
+}
+
+static int receive_fd(int sock) {
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    char byte;
+    struct iovec iov = {&byte, 1};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1) return -1;
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) return -1;
+    int fd;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    return fd;
+}
+
+// The nsi-net process. Returns when the watched process exits.
+static void netstack_main(int sock) {
+    prctl(PR_SET_NAME, "nsi-net", 0, 0, 0);
+    signal(SIGINT, SIG_IGN); // Ctrl+C is for the container; we follow it out
+    signal(SIGHUP, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+    int null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (null_fd != -1) {
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+    }
+    // Hold none of the sandbox's other descriptors (log pipes, image stream)
+    if (sock > 3) syscall(SYS_close_range, 3, sock - 1, 0);
+    syscall(SYS_close_range, sock + 1, ~0U, 0);
+
+    // 1. The tap, then the PID whose exit ends us
+    st.tap = receive_fd(sock);
+    if (st.tap == -1) return; // The sandbox gave up before attaching
+    pid_t watched;
+    if (read(sock, &watched, sizeof(watched)) != sizeof(watched)) return;
+    close(sock);
+    int exit_fd = syscall(SYS_pidfd_open, watched, 0);
+    if (exit_fd == -1 && errno != ENOSYS) return; // Already gone
+
+    // 2. Host state and the event loop
+    st.dns = host_nameserver();
+    int probe = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int zero = 0;
+    st.peek_off = probe != -1 && setsockopt(probe, SOL_SOCKET, SO_PEEK_OFF, &zero, sizeof(zero)) == 0;
+    if (probe != -1) close(probe);
+    st.acks.reserve(1024);
+    st.epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (st.epoll == -1) die("nsi-net: epoll_create1 failed");
+    static Flow tap_flow = {Flow::TAP, st.tap};
+    static Flow exit_flow = {Flow::EXIT, exit_fd};
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = &tap_flow;
+    epoll_ctl(st.epoll, EPOLL_CTL_ADD, st.tap, &ev);
+    if (exit_fd != -1) {
+        ev.data.ptr = &exit_flow;
+        epoll_ctl(st.epoll, EPOLL_CTL_ADD, exit_fd, &ev);
+    }
+
+    struct epoll_event events[64];
+    uint64_t next_tick = now_ms() + TICK_MS;
+    for (;;) {
+        // Idle (no flows, pidfd to wake us): no timer either
+        bool idle = st.tcp.empty() && st.udp.empty() && exit_fd != -1;
+        int n = epoll_wait(st.epoll, events, 64, idle ? -1 : TICK_MS);
+        st.now = now_ms();
+        for (int i = 0; i < n; ++i) {
+            Flow* f = static_cast<Flow*>(events[i].data.ptr);
+            switch (f->kind) {
+                case Flow::TAP: tap_event(); break;
+                case Flow::EXIT: return;
+                case Flow::TCP: {
+                    TcpConn* c = static_cast<TcpConn*>(f);
+                    if (!c->dead) tcp_event(c, events[i].events);
+                    break;
+                }
+                case Flow::UDP: udp_event(static_cast<UdpFlow*>(f)); break;
+            }
+        }
+        if (st.now >= next_tick) {
+            next_tick = st.now + TICK_MS;
+            tcp_timers();
+            udp_expire();
+            // Without pidfds (Linux < 5.3), poll for the watched process
+            if (exit_fd == -1 && kill(watched, 0) == -1 && errno == ESRCH) return;
+        }
+        flush_acks();
+        for (TcpConn* c : st.dead) delete c;
+        st.dead.clear();
+    }
+}
@@ -0,0 +1,56 @@
+// neoshell/src/sandbox/netstack.h
+#ifndef NSI_SANDBOX_NETSTACK_H
+#define NSI_SANDBOX_NETSTACK_H
+
+#include <sys/types.h>
+
+// Rootless outbound networking (`--net user`, `pod create --net`).
+//
+// An unprivileged network namespace has only loopback, and nothing to
+// route through: veth pairs and bridges need root on the host. Instead the
+// namespace gets a tap device, eth0, and a helper process on the host side
+// (nsi-net) terminates its traffic and replays it with ordinary sockets,
+// as slirp4netns and pasta do:
+//
+//   container 10.0.2.100/24 --eth0 (tap)--> nsi-net --host sockets--> world
+//
+//   10.0.2.2    gateway; connections to it go to the host's 127.0.0.1, so
+//               local services are reachable (e.g. 10.0.2.2:5432)
+//   10.0.2.3    DNS; forwarded to the host's first nameserver
+//
+// TCP is terminated: a container's SYN becomes a connect() on the host,
+// and only when that succeeds does the container get its SYN-ACK. Data
+// from the host is peeked from the host socket (MSG_PEEK, SO_PEEK_OFF) and
+// only discarded when the container acknowledges it, so the kernel's socket
+// buffer is the retransmit queue and no data is copied twice. UDP flows map
+// to connected host sockets. ARP is answered for every other address in
+// the subnet; ICMP, IPv6 and inbound connections are not supported.
+//
+// The tap's MTU is 65520, so bulk transfers move in 64 KiB frames. Frames
+// are read in batches from one static buffer; acknowledgements for a batch
+// are coalesced; nothing is allocated per packet.
+
+struct NetStack {
+    pid_t pid = -1; // nsi-net
+    int sock = -1;  // Our end of its control socket
+};
+
+// Forks nsi-net. Call before any namespace is created: it must keep the
+// host's network and user namespace. Dies on error.
+void netstack_start(NetStack& ns);
+
+// In a new network namespace: creates and configures eth0 (address, MTU,
+// default route) and loopback, and hands the tap to nsi-net. Dies on error.
+void netstack_attach(NetStack& ns);
+
+// Tells nsi-net whose exit ends it (the container's first process, or a
+// pod's infra process) and closes our end of the control socket.
+void netstack_watch(NetStack& ns, pid_t pid);
+
+// Inside the container's root: /etc/resolv.conf names 10.0.2.3. Warns on error.
+void netstack_resolv_conf();
+
+// Brings up lo in the current network namespace (--net none, pods). Dies on error.
+void netns_loopback_up();
+
+#endif // NSI_SANDBOX_NETSTACK_H
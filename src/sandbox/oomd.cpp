@@ -0,0 +1,302 @@
+// neoshell/src/sandbox/oomd.cpp
+#include "oomd.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <csignal>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>        // For open
+#include <poll.h>
+#include <dirent.h>       // For scanning NSI_CGROUP_ROOT
+#include <getopt.h>
+#include <sys/xattr.h>    // For the priority attribute
+
+static const char* const PRIORITY_NAMES[] = {"critical", "high", "normal", "low"};
+static const int PRIORITY_DEFAULT = 2; // normal
+
+int oomd_priority_rank(const std::string& name) {
+    for (int i = 0; i < 4; ++i) {
+        if (name == PRIORITY_NAMES[i]) return i;
+    }
+    return -1;
+}
+
+struct OomdConfig {
+    double sys_some = 40;     // %: host memory "some" avg10 that counts as pressure
+    double sys_full = 10;     // %: host memory "full" avg10 that counts as pressure
+    double cg_full = 60;      // %: a container's own "full" avg10 that counts as thrashing
+    double duration = 3;      // s: pressure must persist this long before acting
+    int interval_ms = 1000;   // Rescan period (PSI triggers wake us earlier)
+    double cooldown = 10;     // s: after a kill, let memory be reclaimed before the next one
+    std::vector<std::string> policy = {"priority", "overage", "age"};
+    bool dry_run = false;
+};
+
+struct Psi {
+    double some = 0; // avg10, percent
+    double full = 0;
+};
+
+struct Candidate {
+    std::string id;
+    int priority;           // Rank, see oomd_priority_rank
+    unsigned long long usage;   // memory.current
+    unsigned long long request; // memory.low
+    double age;             // Seconds since the container's init started
+    Psi psi;
+};
+
+static double monotonic_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool read_psi(int dirfd, const char* name, Psi& psi) {
+    std::string s;
+    if (!read_file_at(dirfd, name, s)) return false;
+    const char* some = strstr(s.c_str(), "some avg10=");
+    const char* full = strstr(s.c_str(), "full avg10=");
+    if (!some) return false;
+    psi.some = atof(some + 11);
+    psi.full = full ? atof(full + 11) : 0;
+    return true;
+}
+
+static unsigned long long read_u64_at(int dirfd, const char* name) {
+    std::string s;
+    if (!read_file_at(dirfd, name, s)) return 0;
+    return strtoull(s.c_str(), nullptr, 10); // "max" reads as 0, like no request
+}
+
+// Seconds since pid started, from its start time and /proc/uptime.
+static double process_age(int pid) {
+    unsigned long long ticks;
+    std::string uptime;
+    if (!proc_start_ticks(pid, ticks) || !read_file_at(AT_FDCWD, "/proc/uptime", uptime)) return 0;
+    return std::max(0.0, atof(uptime.c_str()) - ticks / (double)sysconf(_SC_CLK_TCK));
+}
+
+static std::vector<Candidate> scan_containers() {
+    std::vector<Candidate> out;
+    DIR* d = opendir(NSI_CGROUP_ROOT);
+    if (!d) return out;
+    while (struct dirent* e = readdir(d)) {
+        if (e->d_type != DT_DIR || e->d_name[0] == '.') continue;
+        int fd = openat(dirfd(d), e->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd == -1) continue;
+        Candidate c;
+        c.id = e->d_name;
+        c.priority = PRIORITY_DEFAULT;
+        char prio[32];
+        ssize_t n = fgetxattr(fd, NSI_PRIORITY_XATTR, prio, sizeof(prio) - 1);
+        if (n > 0) {
+            prio[n] = '\0';
+            int rank = oomd_priority_rank(prio);
+            if (rank != -1) c.priority = rank;
+        }
+        c.usage = read_u64_at(fd, "memory.current");
+        c.request = read_u64_at(fd, "memory.low");
+        read_psi(fd, "memory.pressure", c.psi);
+        close(fd);
+        int pid = container_pid(c.id);
+        if (pid == -1) continue; // Nothing running (yet, or any more)
+        c.age = process_age(pid);
+        out.push_back(c);
+    }
+    closedir(d);
+    return out;
+}
+
+// Orders candidates so the first one is the victim.
+static bool kill_before(const Candidate& a, const Candidate& b, const std::vector<std::string>& policy) {
+    for (const std::string& key : policy) {
+        if (key == "priority" && a.priority != b.priority) return a.priority > b.priority;
+        if (key == "overage") {
+            long long oa = (long long)a.usage - (long long)a.request;
+            long long ob = (long long)b.usage - (long long)b.request;
+            if (oa != ob) return oa > ob;
+        }
+        if (key == "usage" && a.usage != b.usage) return a.usage > b.usage;
+        if (key == "age" && a.age != b.age) return a.age < b.age;
+    }
+    return a.id < b.id;
+}
+
+// Kills every process of the container at once. Falls back to SIGKILL per
+// process on kernels without cgroup.kill (< 5.14).
+static bool kill_cgroup(const std::string& id) {
+    std::string path = container_cgroup_path(id);
+    int fd = open((path + "/cgroup.kill").c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd != -1) {
+        bool ok = write(fd, "1", 1) == 1;
+        close(fd);
+        if (ok) return true;
+    }
+    bool any = false;
+    for (int pass = 0; pass < 10; ++pass) { // Processes may fork while we kill
+        std::string procs;
+        if (!read_file_at(AT_FDCWD, (path + "/cgroup.procs").c_str(), procs) || procs.empty()) break;
+        std::istringstream in(procs);
+        int pid;
+        while (in >> pid) any |= kill(pid, SIGKILL) == 0;
+    }
+    return any;
+}
+
+static std::string mib(unsigned long long bytes) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.0fMiB", bytes / 1048576.0);
+    return buf;
+}
+
+// Kills (or with --dry-run reports) c; false if the kill failed.
+static bool act(const OomdConfig& cfg, const Candidate& c, const std::string& reason) {
+    char age[32];
+    snprintf(age, sizeof(age), "%.0fs", c.age);
+    std::string what = c.id + " (priority " + PRIORITY_NAMES[c.priority] + ", usage " + mib(c.usage) +
+                       ", request " + mib(c.request) + ", age " + age + "): " + reason;
+    if (cfg.dry_run) {
+        log_msg(("oomd: would kill " + what).c_str());
+    } else if (kill_cgroup(c.id)) {
+        log_msg(("oomd: killed " + what).c_str());
+    } else {
+        log_msg(("oomd: Warning: failed to kill " + what + ": " + std::string(strerror(errno))).c_str());
+        return false;
+    }
+    return true;
+}
+
+// Arms a PSI trigger so poll() wakes us as soon as the host starts stalling:
+// 10% of a 2s window (the window unprivileged triggers are allowed to use).
+static int open_psi_trigger() {
+    int fd = open("/proc/pressure/memory", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd == -1) return -1;
+    static const char trigger[] = "some 200000 2000000";
+    if (write(fd, trigger, sizeof(trigger)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void usage() {
+    fprintf(stderr,
+            "Usage: nsi-sandbox oomd [--some <pct>] [--full <pct>] [--cgroup-full <pct>] [--duration <s>]\n"
+            "                        [--interval <ms>] [--cooldown <s>] [--policy priority,overage,age] [--dry-run]\n");
+    exit(EXIT_FAILURE);
+}
+
+int oomd_main(int argc, char* argv[]) {
+    OomdConfig cfg;
+    struct option long_options[] = {
+        {"some",        required_argument, 0, 's'},
+        {"full",        required_argument, 0, 'f'},
+        {"cgroup-full", required_argument, 0, 'c'},
+        {"duration",    required_argument, 0, 'd'},
+        {"interval",    required_argument, 0, 'i'},
+        {"cooldown",    required_argument, 0, 'k'},
+        {"policy",      required_argument, 0, 'p'},
+        {"dry-run",     no_argument,       0, 'n'},
+        {0, 0, 0, 0}
+    };
+    optind = 1;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:f:c:d:i:k:p:n", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 's': cfg.sys_some = atof(optarg); break;
+            case 'f': cfg.sys_full = atof(optarg); break;
+            case 'c': cfg.cg_full = atof(optarg); break;
+            case 'd': cfg.duration = atof(optarg); break;
+            case 'i': cfg.interval_ms = atoi(optarg); break;
+            case 'k': cfg.cooldown = atof(optarg); break;
+            case 'p': {
+                cfg.policy.clear();
+                std::istringstream in(optarg);
+                std::string key;
+                while (std::getline(in, key, ',')) {
+                    if (key != "priority" && key != "overage" && key != "usage" && key != "age") {
+                        fprintf(stderr, "oomd: unknown policy key '%s' (priority, overage, usage, age)\n", key.c_str());
+                        usage();
+                    }
+                    cfg.policy.push_back(key);
+                }
+                break;
+            }
+            case 'n': cfg.dry_run = true; break;
+            default: usage();
+        }
+    }
+    if (optind != argc || cfg.interval_ms <= 0) usage();
+
+    Psi host;
+    if (!read_psi(AT_FDCWD, "/proc/pressure/memory", host)) die("oomd: /proc/pressure/memory unavailable (kernel without CONFIG_PSI or psi=0)");
+    int trigger = open_psi_trigger();
+    log_msg(("oomd: watching " NSI_CGROUP_ROOT ", host pressure via " +
+             std::string(trigger != -1 ? "PSI trigger" : "polling")).c_str());
+
+    double host_since = -1;               // When host pressure started
+    std::map<std::string, double> thrash; // Container id -> when its own pressure started
+    double last_kill = -1e9;
+    bool starved = false;                 // Already reported "nothing to kill" for this episode
+    for (;;) {
+        struct pollfd pfd = {trigger, POLLPRI, 0};
+        if (poll(&pfd, trigger != -1 ? 1 : 0, cfg.interval_ms) == -1 && errno != EINTR) die("oomd: poll failed");
+        if (trigger != -1 && (pfd.revents & POLLERR)) die("oomd: PSI trigger went away");
+
+        double now = monotonic_seconds();
+        read_psi(AT_FDCWD, "/proc/pressure/memory", host);
+        bool pressured = host.full >= cfg.sys_full || host.some >= cfg.sys_some;
+        host_since = pressured ? (host_since < 0 ? now : host_since) : -1;
+        if (!pressured) starved = false;
+
+        std::vector<Candidate> containers = scan_containers();
+        std::map<std::string, double> still;
+        for (const Candidate& c : containers) {
+            if (c.psi.full < cfg.cg_full) continue;
+            auto it = thrash.find(c.id);
+            still[c.id] = it != thrash.end() ? it->second : now;
+        }
+        thrash.swap(still);
+        if (now - last_kill < cfg.cooldown) continue;
+
+        // 1. Host pressure: the policy picks the victim among killable containers
+        if (host_since >= 0 && now - host_since >= cfg.duration) {
+            std::vector<Candidate> killable;
+            for (const Candidate& c : containers) {
+                if (c.priority != 0) killable.push_back(c);
+            }
+            if (killable.empty()) {
+                if (!starved) log_msg("oomd: host under memory pressure but no killable container");
+                starved = true;
+                continue;
+            }
+            std::sort(killable.begin(), killable.end(),
+                      [&](const Candidate& a, const Candidate& b) { return kill_before(a, b, cfg.policy); });
+            char reason[96];
+            snprintf(reason, sizeof(reason), "host memory pressure some=%.1f%% full=%.1f%%", host.some, host.full);
+            // The cooldown only starts once a kill went through; else try the next one
+            for (const Candidate& c : killable) {
+                if (!act(cfg, c, reason)) continue;
+                last_kill = now;
+                host_since = -1;
+                break;
+            }
+            continue;
+        }
+
+        // 2. A container thrashing against its own memory.max
+        for (const Candidate& c : containers) {
+            auto it = thrash.find(c.id);
+            if (it == thrash.end() || now - it->second < cfg.duration || c.priority == 0) continue;
+            char reason[96];
+            snprintf(reason, sizeof(reason), "stalled on its own memory, full=%.1f%%", c.psi.full);
+            if (!act(cfg, c, reason)) continue;
+            last_kill = now;
+            break;
+        }
+    }
+}
@@ -0,0 +1,29 @@
+// neoshell/src/sandbox/oomd.h
+#ifndef NSI_SANDBOX_OOMD_H
+#define NSI_SANDBOX_OOMD_H
+
+#include <string>
+
+// Userspace OOM killer for neoshell containers (`nsi-sandbox oomd`).
+//
+// Runs on the host and watches memory PSI: the system's /proc/pressure/memory
+// (woken by a PSI trigger, so an idle host costs nothing) and each
+// container's memory.pressure. Before the host thrashes, it kills a whole
+// container cgroup at once via cgroup.kill, chosen by policy:
+//
+//   priority  class set with `--priority` (low < normal < high; critical is never killed)
+//   overage   memory.current above the container's request (memory.low, `--mem-request`)
+//   age       younger containers first
+//
+// A container stalled on its own memory.max for long enough is killed on
+// its own, regardless of host pressure.
+
+// Extended attribute on the container's cgroup holding its priority class.
+#define NSI_PRIORITY_XATTR "user.nsi.priority"
+
+// Kill order of a priority class name: 0 = critical (exempt) .. 3 = low; -1 if unknown.
+int oomd_priority_rank(const std::string& name);
+
+int oomd_main(int argc, char* argv[]);
+
+#endif // NSI_SANDBOX_OOMD_H
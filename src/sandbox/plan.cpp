@@ -0,0 +1,233 @@
+// neoshell/src/sandbox/plan.cpp
+#include "plan.h"
+#include "tenant.h"
+#include "utils.h"
+
+#include <cstdint>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define NSI_PLAN_MAGIC "NSIPLAN"
+#define NSI_PLAN_VERSION 3 // Bump on any change to the header or to Args' meaning
+
+// The Args strings a plan carries, in header order
+static std::string Args::* const PLAN_STRINGS[] = {
+    &Args::rootfs, &Args::workdir, &Args::cgroup_id, &Args::mem_limit,
+    &Args::mem_request, &Args::priority, &Args::log_forward, &Args::log_format,
+    &Args::net, &Args::net_rate, &Args::net_burst, &Args::pod,
+    &Args::takeover, &Args::rootfs_tmpfs, &Args::tenant,
+};
+static const size_t PLAN_STRING_COUNT = sizeof(PLAN_STRINGS) / sizeof(PLAN_STRINGS[0]);
+
+// Offsets are from the start of the image; lists are arrays of offsets.
+struct PlanHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;          // Whole image, header included
+    uint64_t checksum;      // plan_checksum() of the image after the header
+    uint64_t net_rate_bps;
+    uint32_t net_burst_bytes;
+    uint32_t metrics_interval_ms;
+    uint32_t metrics_slots;
+    uint32_t virtual_proc;
+    uint32_t rootfs_overlay;
+    uint32_t strings[PLAN_STRING_COUNT];
+    uint32_t argv, argc;
+    uint32_t envp, envc;
+    uint32_t listen, listen_count;
+};
+
+static const size_t PLAN_MAX_BYTES = 1 << 20; // Far above any command line (ARG_MAX is 2 MiB, shared with the environment)
+
+// FNV-1a, a 64-bit word at a time (the image is padded to whole words):
+// catches truncation and stray edits, at a fraction of a byte-wise hash.
+static uint64_t plan_checksum(const char* p, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, sizeof(w));
+        h ^= w;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// --- Compiling ---
+
+// Appends s and its NUL to the image; returns its offset.
+static uint32_t put_string(std::string& image, const char* s) {
+    uint32_t off = image.size();
+    image.append(s, strlen(s) + 1);
+    return off;
+}
+
+// Appends an offset array for the strings (aligned for reading in place).
+static uint32_t put_list(std::string& image, const std::vector<uint32_t>& offsets) {
+    image.resize((image.size() + 3) & ~size_t(3), '\0');
+    uint32_t off = image.size();
+    image.append(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint32_t));
+    return off;
+}
+
+int plan_compile(const Args& args) {
+    // A descriptor is the compiling process's, gone by the time the plan runs
+    if (tenant_inherited_fd(args.tenant) != -1) {
+        errno = 0;
+        die(("--tenant " + args.tenant + " cannot go into a plan: compile it with the tenant's name").c_str());
+    }
+
+    PlanHeader h;
+    memset(&h, 0, sizeof(h));
+    std::string image(sizeof(h), '\0');
+
+    // 1. Options, numbers already parsed
+    for (size_t i = 0; i < PLAN_STRING_COUNT; ++i) {
+        h.strings[i] = put_string(image, (args.*PLAN_STRINGS[i]).c_str());
+    }
+    h.net_rate_bps = args.net_rate_bps;
+    h.net_burst_bytes = args.net_burst_bytes;
+    h.metrics_interval_ms = args.metrics_interval_ms;
+    h.metrics_slots = args.metrics_slots;
+    h.virtual_proc = args.virtual_proc;
+    h.rootfs_overlay = args.rootfs_overlay;
+
+    // 2. Command line, listeners and the finished environment (HOSTNAME is per launch)
+    std::vector<uint32_t> argv_offs, envp_offs, listen_offs;
+    for (const std::string& s : args.cmd) argv_offs.push_back(put_string(image, s.c_str()));
+    for (const std::string& s : args.listen) listen_offs.push_back(put_string(image, s.c_str()));
+    std::vector<std::string> env_storage;
+    std::vector<char*> envp;
+    build_envp(args, "", env_storage, envp);
+    for (const std::string& entry : env_storage) {
+        if (entry != "HOSTNAME=") envp_offs.push_back(put_string(image, entry.c_str()));
+    }
+    h.argv = put_list(image, argv_offs);
+    h.argc = argv_offs.size();
+    h.envp = put_list(image, envp_offs);
+    h.envc = envp_offs.size();
+    h.listen = put_list(image, listen_offs);
+    h.listen_count = listen_offs.size();
+    image.resize((image.size() + 8) & ~size_t(7), '\0'); // Whole words, and ends in a NUL: no string runs off the end
+
+    // 3. Header last: it covers the rest
+    memcpy(h.magic, NSI_PLAN_MAGIC, sizeof(h.magic));
+    h.version = NSI_PLAN_VERSION;
+    h.size = image.size();
+    h.checksum = plan_checksum(image.data() + sizeof(h), image.size() - sizeof(h));
+    memcpy(&image[0], &h, sizeof(h));
+
+    // Replaced atomically, so launches running from it never see half a plan
+    std::string tmp = args.compile_plan + ".tmp";
+    errno = 0;
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1 || write(fd, image.data(), image.size()) != (ssize_t)image.size() || close(fd) == -1 || rename(tmp.c_str(), args.compile_plan.c_str()) == -1) {
+        unlink(tmp.c_str());
+        die(("Writing launch plan " + args.compile_plan + " failed").c_str());
+    }
+    log_msg(("Launch plan written to " + args.compile_plan + " (" + std::to_string(image.size()) + " bytes; run it with: nsi-sandbox --plan " + args.compile_plan + " [--cgroup-id <id>])").c_str());
+    return EXIT_SUCCESS;
+}
+
+// --- Loading ---
+
+// Offset array at off with n entries, each in bounds and NUL-terminated
+// within the image: points into it. False on anything out of place.
+static bool plan_list(std::string& image, uint32_t off, uint32_t n, std::vector<char*>& out) {
+    if (off % 4 != 0 || off > image.size() || n > (image.size() - off) / sizeof(uint32_t)) return false;
+    const uint32_t* offs = reinterpret_cast<const uint32_t*>(image.data() + off);
+    out.reserve(n + 1);
+    for (uint32_t i = 0; i < n; ++i) {
+        if (offs[i] >= image.size()) return false;
+        out.push_back(&image[offs[i]]);
+    }
+    return true;
+}
+
+void plan_load(int argc, char* argv[], Args& args, LaunchPlan& plan) {
+    const char* cgroup_id = nullptr;
+    if (argc == 4 && strcmp(argv[2], "--cgroup-id") == 0) {
+        cgroup_id = argv[3];
+    } else if (argc == 3 && strncmp(argv[2], "--cgroup-id=", 12) == 0) {
+        cgroup_id = argv[2] + 12;
+    } else if (argc != 2) {
+        fprintf(stderr, "Usage: nsi-sandbox --plan <file> [--cgroup-id <id>]\n");
+        exit(EXIT_FAILURE);
+    }
+    std::string path = argv[1];
+
+    // 1. The whole file, then the header and checksum. A launcher that keeps
+    //    the plan open passes /dev/fd/<n>: read in place with pread(),
+    //    without an open() per launch. A short pread() is the end of the
+    //    file; a pipe may return less at any time, so it is read until EOF.
+    std::string& image = plan.image;
+    char buf[16384];
+    int fd = -1;
+    bool inherited = false;
+    if (path.compare(0, 8, "/dev/fd/") == 0 && path.size() > 8) {
+        char* end;
+        long n = strtol(path.c_str() + 8, &end, 10);
+        inherited = *end == '\0' && n >= 0 && n <= INT32_MAX;
+        if (inherited) fd = n;
+    }
+    errno = 0;
+    if (!inherited) fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) die(("Cannot read launch plan " + path).c_str());
+    bool seekable = true;
+    for (;;) {
+        ssize_t n = seekable ? pread(fd, buf, sizeof(buf), image.size()) : read(fd, buf, sizeof(buf));
+        if (n == -1 && errno == ESPIPE && seekable) {
+            seekable = false; // A pipe (e.g. --plan <(...))
+            continue;
+        }
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1) die(("Cannot read launch plan " + path).c_str());
+        image.append(buf, n);
+        if (n == 0 || (seekable && (size_t)n < sizeof(buf)) || image.size() > PLAN_MAX_BYTES) break;
+    }
+    if (!inherited) close(fd);
+    PlanHeader h;
+    errno = 0;
+    if (image.size() < sizeof(h)) die(("Not a launch plan: " + path).c_str());
+    memcpy(&h, image.data(), sizeof(h));
+    if (memcmp(h.magic, NSI_PLAN_MAGIC, sizeof(h.magic)) != 0) die(("Not a launch plan: " + path).c_str());
+    if (h.version != NSI_PLAN_VERSION) {
+        die(("Launch plan " + path + " is version " + std::to_string(h.version) + ", this nsi-sandbox runs version " + std::to_string(NSI_PLAN_VERSION) + " (compile it again)").c_str());
+    }
+    if (h.size != image.size() || h.size % 8 != 0 || h.checksum != plan_checksum(image.data() + sizeof(h), image.size() - sizeof(h)) || image.back() != '\0') {
+        die(("Launch plan " + path + " is damaged (size or checksum mismatch); compile it again").c_str());
+    }
+
+    // 2. Point into the image (the last byte is a NUL, so every string ends in it)
+    for (size_t i = 0; i < PLAN_STRING_COUNT; ++i) {
+        if (h.strings[i] >= image.size()) die(("Launch plan " + path + " is damaged").c_str());
+        args.*PLAN_STRINGS[i] = image.data() + h.strings[i];
+    }
+    std::vector<char*> listen;
+    if (!plan_list(image, h.argv, h.argc, plan.argv) || h.argc == 0 ||
+        !plan_list(image, h.envp, h.envc, plan.envp) ||
+        !plan_list(image, h.listen, h.listen_count, listen)) {
+        die(("Launch plan " + path + " is damaged").c_str());
+    }
+    plan.argv.push_back(nullptr);
+    args.listen.assign(listen.begin(), listen.end());
+    args.net_rate_bps = h.net_rate_bps;
+    args.net_burst_bytes = h.net_burst_bytes;
+    args.metrics_interval_ms = h.metrics_interval_ms;
+    args.metrics_slots = h.metrics_slots;
+    args.virtual_proc = h.virtual_proc != 0;
+    args.rootfs_overlay = h.rootfs_overlay != 0;
+    if (cgroup_id) {
+        errno = 0;
+        if (!*cgroup_id) die("Empty --cgroup-id");
+        args.cgroup_id = cgroup_id;
+    }
+}
+
+void plan_envp(const LaunchPlan& plan, const std::string& hostname,
+               std::string& hostname_entry, std::vector<char*>& envp) {
+    hostname_entry = "HOSTNAME=" + hostname;
+    envp.reserve(plan.envp.size() + 2);
+    envp.assign(plan.envp.begin(), plan.envp.end());
+    envp.push_back(const_cast<char*>(hostname_entry.c_str()));
+    envp.push_back(nullptr);
+}
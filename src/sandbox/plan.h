@@ -0,0 +1,49 @@
+// neoshell/src/sandbox/plan.h
+#ifndef NSI_SANDBOX_PLAN_H
+#define NSI_SANDBOX_PLAN_H
+
+#include <string>
+#include <vector>
+#include "args.h"
+
+// Precompiled launch plans, for launching the same image with the same
+// options over and over.
+//
+//   nsi-sandbox --compile-plan <file> <options> -- <command> [args...]
+//       parses and validates the options as a launch would, then writes
+//       them to <file> instead of launching.
+//   nsi-sandbox --plan <file> [--cgroup-id <id>]
+//       launches from <file>: no option parsing, validation or
+//       environment building, just a checksum over the file.
+//
+// A plan is one flat image: a header with the already parsed numbers and
+// the offsets of NUL-terminated strings that follow it (each option, the
+// command line, and the finished environment, default PATH and LISTEN_FDS
+// included). Offsets are relative to the image, so it can be copied or
+// moved anywhere; loading it is one read() and pointer arithmetic. A
+// launcher that starts many containers can open the plan once and pass
+// `--plan /dev/fd/<n>`: it is then read in place, without an open().
+//
+// Only the container id is per launch (it names the cgroup and the
+// hostname; the compiled one is the default). What depends on the moment
+// (the rootfs still being there, the tar stream on fd 3 for --rootfs-tmpfs)
+// is not re-checked: the launch fails at that step instead.
+
+struct LaunchPlan {
+    std::string image;       // The plan file, argv and envp point into it
+    std::vector<char*> argv; // Command for execve, nullptr-terminated
+    std::vector<char*> envp; // Environment without HOSTNAME, not terminated
+};
+
+// Writes the validated args to args.compile_plan. Returns the exit status.
+int plan_compile(const Args& args);
+
+// Loads `--plan <file> [--cgroup-id <id>]` (argv[0] is "--plan") into args
+// and plan. Dies if the file is not an intact plan of this version.
+void plan_load(int argc, char* argv[], Args& args, LaunchPlan& plan);
+
+// The plan's environment plus HOSTNAME, nullptr-terminated, for execve.
+void plan_envp(const LaunchPlan& plan, const std::string& hostname,
+               std::string& hostname_entry, std::vector<char*>& envp);
+
+#endif // NSI_SANDBOX_PLAN_H
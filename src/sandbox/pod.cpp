@@ -0,0 +1,66 @@
+// neoshell/src/sandbox/pod.cpp
+#include "pod.h"
+#include "holder.h"
+#include "netstack.h"
+#include "utils.h"
+
+#include <unistd.h>
+#include <sched.h>        // For unshare, CLONE_*
+#include <sys/socket.h>
+
+static const HolderKind POD = {"pods", "pod", "infra", "nsi-pod"};
+
+void pod_join(const std::string& name) {
+    int pid = holder_pid(POD, name);
+    errno = 0;
+    if (pid == -1) die(("No running pod named " + name + " (create it with: nsi-sandbox pod create " + name + ")").c_str());
+    // The user namespace first: it owns the others, and makes us root over them
+    if (!join_ns(pid, "user", CLONE_NEWUSER)) die("setns into the pod's user namespace failed");
+    if (!join_ns(pid, "net", CLONE_NEWNET)) die("setns into the pod's network namespace failed");
+    if (!join_ns(pid, "ipc", CLONE_NEWIPC)) die("setns into the pod's IPC namespace failed");
+    if (!join_ns(pid, "uts", CLONE_NEWUTS)) die("setns into the pod's UTS namespace failed");
+    log_msg(("-> Joined pod " + name + " (infra PID " + std::to_string(pid) + "): user, network, IPC, UTS namespaces.").c_str());
+}
+
+// The infra process's setup: creates the namespaces the pod's containers join.
+static void pod_infra(const std::string& name, bool user_net) {
+    NetStack netstack;
+    if (user_net) netstack_start(netstack); // Keeps the host's namespaces
+
+    // 1. User namespace, mapped like a container's
+    uid_t host_uid = getuid();
+    gid_t host_gid = getgid();
+    errno = 0;
+    if (unshare(CLONE_NEWUSER) == -1) die("unshare CLONE_NEWUSER failed");
+    setup_user_namespace_mappings(host_uid, host_gid);
+
+    // 2. The namespaces the pod's containers share
+    errno = 0;
+    if (unshare(CLONE_NEWNET | CLONE_NEWIPC | CLONE_NEWUTS) == -1) die("unshare (NET, IPC, UTS) failed");
+    if (sethostname(name.c_str(), name.length()) == -1) {
+        log_msg(("Warning: sethostname failed: " + std::string(strerror(errno))).c_str());
+    }
+    if (user_net) {
+        netstack_attach(netstack);
+        netstack_watch(netstack, getpid()); // nsi-net ends with the pod
+    } else {
+        netns_loopback_up();
+    }
+}
+
+int pod_main(int argc, char* argv[]) {
+    std::string cmd = argc > 1 ? argv[1] : "";
+    if (cmd == "ls" && argc == 2) return holder_ls(POD);
+    bool user_net = cmd == "create" && argc == 4 && std::string(argv[3]) == "--net";
+    if ((cmd == "create" || cmd == "rm") && (argc == 3 || user_net)) {
+        std::string name = argv[2];
+        if (!holder_valid_name(name)) { // Also the hostname: 63 is its limit
+            fprintf(stderr, "Invalid pod name '%s' (letters, digits, '_', '.', '-'; at most 63)\n", name.c_str());
+            return EXIT_FAILURE;
+        }
+        if (cmd == "rm") return holder_rm(POD, name);
+        return holder_create(POD, name, [&] { pod_infra(name, user_net); });
+    }
+    fprintf(stderr, "Usage: nsi-sandbox pod create <name> [--net] | rm <name> | ls\n");
+    return EXIT_FAILURE;
+}
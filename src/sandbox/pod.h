@@ -0,0 +1,32 @@
+// neoshell/src/sandbox/pod.h
+#ifndef NSI_SANDBOX_POD_H
+#define NSI_SANDBOX_POD_H
+
+#include <string>
+
+// Pods: containers that share network, IPC and UTS namespaces (`nsi-sandbox pod`).
+//
+// `pod create <name>` starts a small infrastructure process that creates a
+// user namespace (mapped like a container's), new network, IPC and UTS
+// namespaces with loopback up and the pod name as hostname, and then only
+// holds them. Containers started with `--pod <name>` join these with setns()
+// instead of creating their own, and keep their own PID and mount
+// namespaces and cgroup. An app and its sidecars then talk over 127.0.0.1,
+// abstract unix sockets and SysV shared memory rather than the host network.
+//
+// The pod's network namespace has only loopback: nothing outside the pod
+// can reach it, and it cannot reach out. With `pod create <name> --net` it
+// also gets user-mode outbound networking (see netstack.h), served by an
+// nsi-net process that lives as long as the infra process.
+//
+// The infra process is a named holder process (holder.h), found through
+// <runtime_dir>/pods/<name>, which holds its PID and start time.
+
+// Joins the pod's user, network, IPC and UTS namespaces (in that order).
+// Must run before any thread exists. Dies if the pod is not running.
+void pod_join(const std::string& name);
+
+// `nsi-sandbox pod create|rm|ls`
+int pod_main(int argc, char* argv[]);
+
+#endif // NSI_SANDBOX_POD_H
@@ -0,0 +1,583 @@
+// neoshell/src/sandbox/procfs.cpp
+#include "procfs.h"
+#include "utils.h"
+
+#include <map>
+#include <cmath>    // For exp, ceil
+#include <ctime>    // For clock_gettime
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+#include <sched.h>  // For sched_getaffinity
+#include <signal.h>
+#include <sys/mount.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/uio.h> // For writev
+#include <linux/fuse.h>
+
+// Mountpoint for the FUSE filesystem before its files are bound over /proc.
+// /dev is our own tmpfs, so it is always writable regardless of the image.
+static const char* PROCFS_MOUNTPOINT = "/dev/.nsi-procfs";
+
+// --- Virtual Files ---
+// Node IDs are fixed: FUSE_ROOT_ID (1) is the directory, files follow.
+enum VirtualFile { VF_MEMINFO = 2, VF_CPUINFO, VF_STAT, VF_LOADAVG, VF_END };
+
+static const char* vf_name(uint64_t node) {
+    switch (node) {
+        case VF_MEMINFO: return "meminfo";
+        case VF_CPUINFO: return "cpuinfo";
+        case VF_STAT:    return "stat";
+        case VF_LOADAVG: return "loadavg";
+        default:         return nullptr;
+    }
+}
+
+// State owned by the server process.
+struct Server {
+    int fuse_fd = -1;
+    int cgroup_fd = -1;
+    int host_fd[VF_END] = {-1, -1, -1, -1, -1, -1}; // Host /proc files, indexed by node ID
+    double start_time = 0;                          // Monotonic seconds at server start
+    double next_load_sample = 0;
+    double load[3] = {0, 0, 0};
+    unsigned nr_running = 0, nr_threads = 0, last_pid = 0;
+    std::map<uint64_t, std::string> open_files; // fh -> snapshot taken at open()
+    uint64_t next_fh = 1;
+};
+
+static double monotonic_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Reads a single numeric cgroup value. Returns false for "max" or on error.
+static bool cgroup_read_u64(int cgroup_fd, const char* name, unsigned long long& out) {
+    std::string s;
+    if (cgroup_fd < 0 || !read_file_at(cgroup_fd, name, s)) return false;
+    if (s.compare(0, 3, "max") == 0) return false;
+    char* end = nullptr;
+    out = strtoull(s.c_str(), &end, 10);
+    return end != s.c_str();
+}
+
+// Looks up "key value" in flat-keyed files like memory.stat and cpu.stat.
+static unsigned long long keyed_value(const std::string& text, const char* key) {
+    size_t klen = strlen(key);
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t eol = text.find('\n', pos);
+        if (eol == std::string::npos) eol = text.size();
+        if (text.compare(pos, klen, key) == 0 && pos + klen < eol && text[pos + klen] == ' ') {
+            return strtoull(text.c_str() + pos + klen + 1, nullptr, 10);
+        }
+        pos = eol + 1;
+    }
+    return 0;
+}
+
+// Parses a cpu list such as "0-3,6" into CPU ids.
+static std::vector<int> parse_cpu_list(const std::string& s) {
+    std::vector<int> cpus;
+    const char* p = s.c_str();
+    while (*p && *p != '\n') {
+        char* end;
+        long a = strtol(p, &end, 10);
+        if (end == p) break;
+        long b = a;
+        if (*end == '-') {
+            p = end + 1;
+            b = strtol(p, &end, 10);
+        }
+        for (long c = a; c <= b; ++c) cpus.push_back((int)c);
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return cpus;
+}
+
+// Host CPUs usable by the container, truncated to its cpu.max quota.
+static std::vector<int> container_cpus(const Server& srv) {
+    std::string s;
+    std::vector<int> cpus;
+    if (read_file_at(srv.cgroup_fd, "cpuset.cpus.effective", s)) cpus = parse_cpu_list(s);
+    if (cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int c = 0; c < CPU_SETSIZE; ++c) {
+                if (CPU_ISSET(c, &set)) cpus.push_back(c);
+            }
+        }
+    }
+    if (cpus.empty()) cpus.push_back(0);
+
+    // cpu.max is "<quota> <period>" or "max <period>"
+    if (read_file_at(srv.cgroup_fd, "cpu.max", s) && s.compare(0, 3, "max") != 0) {
+        unsigned long long quota = 0, period = 0;
+        if (sscanf(s.c_str(), "%llu %llu", &quota, &period) == 2 && period > 0) {
+            size_t n = (size_t)std::ceil((double)quota / (double)period);
+            if (n < 1) n = 1;
+            if (n < cpus.size()) cpus.resize(n);
+        }
+    }
+    return cpus;
+}
+
+// --- Renderers ---
+
+static std::string render_meminfo(const Server& srv) {
+    std::string host, stat;
+    pread_all(srv.host_fd[VF_MEMINFO], host);
+    read_file_at(srv.cgroup_fd, "memory.stat", stat);
+
+    // Host values in kB, used where the cgroup sets no limit
+    unsigned long long host_total = 0, host_swap = 0;
+    sscanf(host.c_str(), "MemTotal: %llu", &host_total);
+    size_t sw = host.find("SwapTotal:");
+    if (sw != std::string::npos) sscanf(host.c_str() + sw, "SwapTotal: %llu", &host_swap);
+
+    // Without the memory controller there is nothing to virtualize.
+    unsigned long long limit = 0, usage = 0, swap_limit = 0, swap_usage = 0;
+    if (!cgroup_read_u64(srv.cgroup_fd, "memory.current", usage)) return host;
+    usage /= 1024;
+    unsigned long long total = host_total;
+    if (cgroup_read_u64(srv.cgroup_fd, "memory.max", limit) && limit / 1024 < host_total) total = limit / 1024;
+    unsigned long long swap_total = host_swap;
+    if (cgroup_read_u64(srv.cgroup_fd, "memory.swap.max", swap_limit) && swap_limit / 1024 < host_swap) swap_total = swap_limit / 1024;
+    cgroup_read_u64(srv.cgroup_fd, "memory.swap.current", swap_usage);
+    swap_usage /= 1024;
+
+    unsigned long long free_kb = total > usage ? total - usage : 0;
+    unsigned long long cached = keyed_value(stat, "file") / 1024;
+    unsigned long long available = free_kb + cached < total ? free_kb + cached : total;
+
+    std::map<std::string, unsigned long long> over = {
+        {"MemTotal", total},
+        {"MemFree", free_kb},
+        {"MemAvailable", available},
+        {"Buffers", 0},
+        {"Cached", cached},
+        {"SwapCached", 0},
+        {"Active", (keyed_value(stat, "active_anon") + keyed_value(stat, "active_file")) / 1024},
+        {"Inactive", (keyed_value(stat, "inactive_anon") + keyed_value(stat, "inactive_file")) / 1024},
+        {"Active(anon)", keyed_value(stat, "active_anon") / 1024},
+        {"Inactive(anon)", keyed_value(stat, "inactive_anon") / 1024},
+        {"Active(file)", keyed_value(stat, "active_file") / 1024},
+        {"Inactive(file)", keyed_value(stat, "inactive_file") / 1024},
+        {"AnonPages", keyed_value(stat, "anon") / 1024},
+        {"Shmem", keyed_value(stat, "shmem") / 1024},
+        {"SwapTotal", swap_total},
+        {"SwapFree", swap_total > swap_usage ? swap_total - swap_usage : 0},
+    };
+
+    // Keep the host's line order and any fields we don't virtualize.
+    std::string out;
+    size_t pos = 0;
+    while (pos < host.size()) {
+        size_t eol = host.find('\n', pos);
+        if (eol == std::string::npos) eol = host.size();
+        std::string line = host.substr(pos, eol - pos);
+        size_t colon = line.find(':');
+        auto it = colon == std::string::npos ? over.end() : over.find(line.substr(0, colon));
+        if (it != over.end()) {
+            char buf[128];
+            snprintf(buf, sizeof(buf), "%-16s%8llu kB\n", (it->first + ":").c_str(), it->second);
+            out += buf;
+        } else {
+            out += line + "\n";
+        }
+        pos = eol + 1;
+    }
+    return out;
+}
+
+static std::string render_cpuinfo(const Server& srv) {
+    std::string host;
+    pread_all(srv.host_fd[VF_CPUINFO], host);
+    std::vector<int> cpus = container_cpus(srv);
+
+    // Host cpuinfo is one blank-line separated block per processor (plus,
+    // on some architectures, trailing blocks without a "processor" line).
+    std::string out;
+    size_t pos = 0;
+    while (pos < host.size()) {
+        size_t end = host.find("\n\n", pos);
+        end = (end == std::string::npos) ? host.size() : end + 2;
+        std::string block = host.substr(pos, end - pos);
+        pos = end;
+
+        int id = -1;
+        if (block.compare(0, 9, "processor") != 0 || sscanf(block.c_str(), "processor : %d", &id) != 1) {
+            out += block;
+            continue;
+        }
+        size_t idx = 0;
+        while (idx < cpus.size() && cpus[idx] != id) ++idx;
+        if (idx == cpus.size()) continue; // Not one of ours
+
+        size_t eol = block.find('\n');
+        out += "processor\t: " + std::to_string(idx) + block.substr(eol);
+    }
+    return out;
+}
+
+static std::string render_stat(const Server& srv) {
+    std::string host, cpu_stat;
+    pread_all(srv.host_fd[VF_STAT], host);
+    read_file_at(srv.cgroup_fd, "cpu.stat", cpu_stat);
+    size_t n = container_cpus(srv).size();
+
+    // Spread the cgroup's CPU time evenly over its virtual CPUs; whatever is
+    // left of the wall time since start is idle.
+    const double hz = (double)sysconf(_SC_CLK_TCK);
+    unsigned long long user = (unsigned long long)(keyed_value(cpu_stat, "user_usec") * hz / 1e6);
+    unsigned long long system = (unsigned long long)(keyed_value(cpu_stat, "system_usec") * hz / 1e6);
+    unsigned long long elapsed = (unsigned long long)((monotonic_seconds() - srv.start_time) * hz);
+    unsigned long long user_i = user / n, system_i = system / n;
+    unsigned long long idle_i = elapsed > user_i + system_i ? elapsed - user_i - system_i : 0;
+
+    char buf[256];
+    snprintf(buf, sizeof(buf), "cpu  %llu 0 %llu %llu 0 0 0 0 0 0\n", user, system, idle_i * n);
+    std::string out = buf;
+    for (size_t i = 0; i < n; ++i) {
+        snprintf(buf, sizeof(buf), "cpu%zu %llu 0 %llu %llu 0 0 0 0 0 0\n", i, user_i, system_i, idle_i);
+        out += buf;
+    }
+
+    size_t pos = 0;
+    while (pos < host.size()) {
+        size_t eol = host.find('\n', pos);
+        if (eol == std::string::npos) eol = host.size();
+        std::string line = host.substr(pos, eol - pos);
+        pos = eol + 1;
+        if (line.compare(0, 3, "cpu") == 0) continue; // Replaced above
+        if (line.compare(0, 14, "procs_running ") == 0) line = "procs_running " + std::to_string(srv.nr_running);
+        out += line + "\n";
+    }
+    return out;
+}
+
+static std::string render_loadavg(const Server& srv) {
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%.2f %.2f %.2f %u/%u %u\n",
+             srv.load[0], srv.load[1], srv.load[2], srv.nr_running, srv.nr_threads, srv.last_pid);
+    return buf;
+}
+
+// Counts runnable (R) and uninterruptible (D) threads in the cgroup and folds
+// them into the 1/5/15 minute averages, the same way the kernel does every 5s.
+static void sample_load(Server& srv) {
+    std::string threads;
+    unsigned running = 0, total = 0, max_tid = 0;
+    if (read_file_at(srv.cgroup_fd, "cgroup.threads", threads)) {
+        const char* p = threads.c_str();
+        char* end;
+        for (unsigned long tid = strtoul(p, &end, 10); end != p; tid = strtoul(p, &end, 10)) {
+            p = end;
+            ++total;
+            if (tid > max_tid) max_tid = (unsigned)tid;
+            char path[64];
+            snprintf(path, sizeof(path), "/proc/%lu/stat", tid);
+            std::string st;
+            if (!read_file_at(AT_FDCWD, path, st)) continue;
+            size_t paren = st.rfind(')');
+            if (paren != std::string::npos && paren + 2 < st.size()) {
+                char state = st[paren + 2];
+                if (state == 'R' || state == 'D') ++running;
+            }
+        }
+    }
+    if (running > 0) --running; // Don't count ourselves answering this very read
+
+    static const double periods[3] = {60.0, 300.0, 900.0};
+    for (int i = 0; i < 3; ++i) {
+        double e = std::exp(-5.0 / periods[i]);
+        srv.load[i] = srv.load[i] * e + running * (1.0 - e);
+    }
+    srv.nr_running = running;
+    srv.nr_threads = total;
+    srv.last_pid = max_tid;
+}
+
+// --- FUSE Protocol ---
+
+static void fuse_reply(const Server& srv, uint64_t unique, int error, const void* data, size_t len) {
+    struct fuse_out_header out;
+    out.unique = unique;
+    out.error = error;
+    out.len = sizeof(out) + (error == 0 ? len : 0);
+    struct iovec iov[2] = {{&out, sizeof(out)}, {const_cast<void*>(data), error == 0 ? len : 0}};
+    // ENOENT here just means the request was interrupted; nothing to do.
+    if (writev(srv.fuse_fd, iov, 2) == -1 && errno != ENOENT) {
+        fprintf(stderr, "[nsi-procfs] Warning: reply failed: %s\n", strerror(errno));
+    }
+}
+
+static void fill_attr(uint64_t node, struct fuse_attr& attr) {
+    memset(&attr, 0, sizeof(attr));
+    attr.ino = node;
+    if (node == FUSE_ROOT_ID) {
+        attr.mode = S_IFDIR | 0555;
+        attr.nlink = 2;
+    } else {
+        // Size 0 like real procfs; reads use direct I/O and run to EOF.
+        attr.mode = S_IFREG | 0444;
+        attr.nlink = 1;
+    }
+    attr.blksize = 4096;
+}
+
+static void handle_request(Server& srv, const struct fuse_in_header* in, const char* arg) {
+    switch (in->opcode) {
+        case FUSE_INIT: {
+            const struct fuse_init_in* init = reinterpret_cast<const struct fuse_init_in*>(arg);
+            struct fuse_init_out out;
+            memset(&out, 0, sizeof(out));
+            out.major = FUSE_KERNEL_VERSION;
+            out.minor = FUSE_KERNEL_MINOR_VERSION;
+            out.max_readahead = init->max_readahead;
+            out.max_background = 16;
+            out.congestion_threshold = 12;
+            out.max_write = 4096;
+            out.time_gran = 1;
+            size_t len = init->minor < 23 ? FUSE_COMPAT_22_INIT_OUT_SIZE : sizeof(out);
+            fuse_reply(srv, in->unique, 0, &out, len);
+            break;
+        }
+        case FUSE_LOOKUP: {
+            uint64_t node = 0;
+            for (uint64_t n = VF_MEMINFO; n < VF_END; ++n) {
+                if (in->nodeid == FUSE_ROOT_ID && strcmp(arg, vf_name(n)) == 0) node = n;
+            }
+            if (node == 0) {
+                fuse_reply(srv, in->unique, -ENOENT, nullptr, 0);
+                break;
+            }
+            struct fuse_entry_out out;
+            memset(&out, 0, sizeof(out));
+            out.nodeid = node;
+            out.entry_valid = out.attr_valid = 1;
+            fill_attr(node, out.attr);
+            fuse_reply(srv, in->unique, 0, &out, sizeof(out));
+            break;
+        }
+        case FUSE_GETATTR: {
+            struct fuse_attr_out out;
+            memset(&out, 0, sizeof(out));
+            out.attr_valid = 1;
+            fill_attr(in->nodeid, out.attr);
+            fuse_reply(srv, in->unique, 0, &out, sizeof(out));
+            break;
+        }
+        case FUSE_OPEN: {
+            const struct fuse_open_in* open_in = reinterpret_cast<const struct fuse_open_in*>(arg);
+            if ((open_in->flags & O_ACCMODE) != O_RDONLY) {
+                fuse_reply(srv, in->unique, -EACCES, nullptr, 0);
+                break;
+            }
+            // Render once per open so sequential reads see a consistent snapshot.
+            std::string content;
+            switch (in->nodeid) {
+                case VF_MEMINFO: content = render_meminfo(srv); break;
+                case VF_CPUINFO: content = render_cpuinfo(srv); break;
+                case VF_STAT:    content = render_stat(srv); break;
+                case VF_LOADAVG: content = render_loadavg(srv); break;
+                default:
+                    fuse_reply(srv, in->unique, -EISDIR, nullptr, 0);
+                    return;
+            }
+            struct fuse_open_out out;
+            memset(&out, 0, sizeof(out));
+            out.fh = srv.next_fh++;
+            out.open_flags = FOPEN_DIRECT_IO;
+            srv.open_files[out.fh] = content;
+            fuse_reply(srv, in->unique, 0, &out, sizeof(out));
+            break;
+        }
+        case FUSE_READ: {
+            const struct fuse_read_in* rd = reinterpret_cast<const struct fuse_read_in*>(arg);
+            auto it = srv.open_files.find(rd->fh);
+            if (it == srv.open_files.end()) {
+                fuse_reply(srv, in->unique, -EBADF, nullptr, 0);
+                break;
+            }
+            const std::string& c = it->second;
+            size_t off = rd->offset < c.size() ? rd->offset : c.size();
+            size_t len = c.size() - off < rd->size ? c.size() - off : rd->size;
+            fuse_reply(srv, in->unique, 0, c.data() + off, len);
+            break;
+        }
+        case FUSE_RELEASE: {
+            const struct fuse_release_in* rel = reinterpret_cast<const struct fuse_release_in*>(arg);
+            srv.open_files.erase(rel->fh);
+            fuse_reply(srv, in->unique, 0, nullptr, 0);
+            break;
+        }
+        case FUSE_OPENDIR: {
+            struct fuse_open_out out;
+            memset(&out, 0, sizeof(out));
+            fuse_reply(srv, in->unique, 0, &out, sizeof(out));
+            break;
+        }
+        case FUSE_READDIR: {
+            const struct fuse_read_in* rd = reinterpret_cast<const struct fuse_read_in*>(arg);
+            char buf[512];
+            size_t used = 0;
+            for (uint64_t n = VF_MEMINFO + rd->offset; n < VF_END; ++n) {
+                const char* name = vf_name(n);
+                struct fuse_dirent* de = reinterpret_cast<struct fuse_dirent*>(buf + used);
+                size_t namelen = strlen(name);
+                size_t entlen = FUSE_DIRENT_ALIGN(FUSE_NAME_OFFSET + namelen);
+                if (used + entlen > rd->size || used + entlen > sizeof(buf)) break;
+                memset(de, 0, entlen);
+                de->ino = n;
+                de->off = n - VF_MEMINFO + 1; // Offset of the *next* entry
+                de->namelen = namelen;
+                de->type = DT_REG;
+                memcpy(de->name, name, namelen);
+                used += entlen;
+            }
+            fuse_reply(srv, in->unique, 0, buf, used);
+            break;
+        }
+        case FUSE_RELEASEDIR:
+        case FUSE_FLUSH:
+        case FUSE_ACCESS:
+            fuse_reply(srv, in->unique, 0, nullptr, 0);
+            break;
+        case FUSE_FORGET:
+        case FUSE_BATCH_FORGET:
+        case FUSE_INTERRUPT:
+            break; // No reply expected
+        case FUSE_DESTROY:
+            fuse_reply(srv, in->unique, 0, nullptr, 0);
+            _exit(EXIT_SUCCESS);
+        default:
+            fuse_reply(srv, in->unique, -ENOSYS, nullptr, 0);
+            break;
+    }
+}
+
+// Server main loop: answers FUSE requests and samples load every 5 seconds.
+static void serve(Server& srv) {
+    // Must hold the largest request the kernel may send (max_write + headers).
+    static char buf[FUSE_MIN_READ_BUFFER + 128 * 1024];
+    srv.start_time = monotonic_seconds();
+    srv.next_load_sample = srv.start_time;
+
+    for (;;) {
+        double now = monotonic_seconds();
+        if (now >= srv.next_load_sample) {
+            sample_load(srv);
+            srv.next_load_sample = now + 5.0;
+        }
+        struct pollfd pfd = {srv.fuse_fd, POLLIN, 0};
+        int timeout_ms = (int)((srv.next_load_sample - now) * 1000) + 1;
+        if (poll(&pfd, 1, timeout_ms) <= 0) continue;
+
+        ssize_t n = read(srv.fuse_fd, buf, sizeof(buf));
+        if (n == -1) {
+            if (errno == EINTR || errno == EAGAIN || errno == ENOENT) continue;
+            if (errno == ENODEV) _exit(EXIT_SUCCESS); // Unmounted: container is gone
+            fprintf(stderr, "[nsi-procfs] FATAL ERROR: read /dev/fuse: %s\n", strerror(errno));
+            _exit(EXIT_FAILURE);
+        }
+        if ((size_t)n < sizeof(struct fuse_in_header)) continue;
+        const struct fuse_in_header* in = reinterpret_cast<const struct fuse_in_header*>(buf);
+        handle_request(srv, in, buf + sizeof(*in));
+    }
+}
+
+// --- Setup (runs in the container init process) ---
+
+void procfs_prepare(const std::string& cgroup_path, ProcfsState& state) {
+    log_msg("Preparing container-aware /proc files...");
+    errno = 0;
+    state.fuse_fd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+    if (state.fuse_fd == -1) {
+        log_msg(("Warning: Could not open /dev/fuse, keeping host /proc values: " + std::string(strerror(errno))).c_str());
+        return;
+    }
+    errno = 0;
+    state.cgroup_fd = open(cgroup_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (state.cgroup_fd == -1) {
+        // Still useful: without a cgroup we report the host limits.
+        log_msg(("Warning: Could not open " + cgroup_path + ", /proc values will be unlimited: " + std::string(strerror(errno))).c_str());
+    }
+    log_msg("-> Opened /dev/fuse.");
+}
+
+void procfs_start(ProcfsState& state) {
+    if (state.fuse_fd == -1) return;
+
+    // 1. Keep handles on the real files; they get covered by our bind mounts.
+    Server srv;
+    srv.fuse_fd = state.fuse_fd;
+    srv.cgroup_fd = state.cgroup_fd;
+    for (uint64_t n = VF_MEMINFO; n < VF_END; ++n) {
+        std::string path = std::string("/proc/") + vf_name(n);
+        errno = 0;
+        srv.host_fd[n] = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (srv.host_fd[n] == -1) {
+            log_msg(("Warning: Could not open " + path + ": " + std::string(strerror(errno))).c_str());
+        }
+    }
+
+    // 2. Mount the FUSE filesystem on a private mountpoint
+    errno = 0;
+    if (mkdir(PROCFS_MOUNTPOINT, 0555) == -1 && errno != EEXIST) {
+        log_msg(("Warning: mkdir " + std::string(PROCFS_MOUNTPOINT) + " failed: " + std::string(strerror(errno))).c_str());
+        return;
+    }
+    char opts[128];
+    snprintf(opts, sizeof(opts), "fd=%d,rootmode=%o,user_id=0,group_id=0,allow_other,default_permissions",
+             state.fuse_fd, S_IFDIR);
+    errno = 0;
+    if (mount("nsi-procfs", PROCFS_MOUNTPOINT, "fuse.nsi-procfs", MS_NOSUID | MS_NODEV | MS_NOEXEC | MS_RDONLY, opts) == -1) {
+        log_msg(("Warning: mount FUSE on " + std::string(PROCFS_MOUNTPOINT) + " failed: " + std::string(strerror(errno))).c_str());
+        rmdir(PROCFS_MOUNTPOINT);
+        return;
+    }
+    log_msg(("-> Mounted FUSE on " + std::string(PROCFS_MOUNTPOINT)).c_str());
+
+    // 3. Fork the server. It must be answering before the bind mounts below,
+    // which look up the files through FUSE.
+    errno = 0;
+    pid_t pid = fork();
+    if (pid == -1) {
+        log_msg(("Warning: fork for /proc server failed: " + std::string(strerror(errno))).c_str());
+        umount2(PROCFS_MOUNTPOINT, MNT_DETACH);
+        rmdir(PROCFS_MOUNTPOINT);
+        return;
+    }
+    if (pid == 0) {
+        prctl(PR_SET_NAME, "nsi-procfs", 0, 0, 0);
+        signal(SIGINT, SIG_IGN); // Ctrl+C is for the app; we go when the namespace does
+        serve(srv);
+        _exit(EXIT_SUCCESS);
+    }
+
+    // 4. Bind the virtual files over the real ones
+    for (uint64_t n = VF_MEMINFO; n < VF_END; ++n) {
+        std::string src = std::string(PROCFS_MOUNTPOINT) + "/" + vf_name(n);
+        std::string dst = std::string("/proc/") + vf_name(n);
+        errno = 0;
+        if (mount(src.c_str(), dst.c_str(), NULL, MS_BIND, NULL) == -1) {
+            log_msg(("Warning: bind " + src + " over " + dst + " failed: " + std::string(strerror(errno))).c_str());
+        } else {
+            log_msg(("-> Virtualized " + dst).c_str());
+        }
+        if (srv.host_fd[n] != -1) close(srv.host_fd[n]);
+    }
+
+    // 5. Hide the mountpoint; the bind mounts keep the filesystem alive.
+    umount2(PROCFS_MOUNTPOINT, MNT_DETACH);
+    rmdir(PROCFS_MOUNTPOINT);
+    close(state.fuse_fd);
+    if (state.cgroup_fd != -1) close(state.cgroup_fd);
+    state.fuse_fd = state.cgroup_fd = -1;
+    log_msg(("-> /proc server running as PID " + std::to_string(pid)).c_str());
+}
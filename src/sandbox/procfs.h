@@ -0,0 +1,30 @@
+// neoshell/src/sandbox/procfs.h
+#ifndef NSI_SANDBOX_PROCFS_H
+#define NSI_SANDBOX_PROCFS_H
+
+#include <string>
+
+// Container-aware /proc/{meminfo,cpuinfo,stat,loadavg} (lxcfs-style).
+//
+// A tiny FUSE server (speaking the kernel protocol directly, no libfuse)
+// renders these files from the container's cgroup limits and usage. Its
+// files are bind-mounted over the real ones in the container's /proc, so
+// os.totalmem(), os.cpus() and friends report the container's share instead
+// of the whole host.
+//
+// Usage from the container init (PID 1) process:
+//   1. procfs_prepare() while the host /dev and cgroupfs are still visible
+//      (after setup_cgroups(), before pivot_root).
+//   2. procfs_start() after the container's /proc has been mounted. This forks
+//      the server process and bind-mounts its files over /proc.
+// Failures are logged as warnings and leave the host values in place.
+
+struct ProcfsState {
+    int fuse_fd = -1;   // /dev/fuse, opened before pivot_root
+    int cgroup_fd = -1; // the container's cgroup directory
+};
+
+void procfs_prepare(const std::string& cgroup_path, ProcfsState& state);
+void procfs_start(ProcfsState& state);
+
+#endif // NSI_SANDBOX_PROCFS_H
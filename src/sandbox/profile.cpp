@@ -0,0 +1,324 @@
+// neoshell/src/sandbox/profile.cpp
+#include "profile.h"
+#include "symbols.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <csignal>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>    // For PERF_EVENT_IOC_*
+#include <sys/mman.h>     // For the sample ring buffers
+#include <sys/syscall.h>  // For SYS_perf_event_open
+
+static const size_t CPU_RING_PAGES = 64;   // Per CPU (cgroup mode)
+static const size_t THREAD_RING_PAGES = 8; // Per thread (per-thread mode)
+static const size_t MAX_THREADS = 1024;    // Each needs an fd and a ring buffer
+
+struct ProfileConfig {
+    double seconds = 10;
+    int frequency = 99; // Hz; off the usual timer rates, so periodic work doesn't alias
+    bool kernel = false;
+    std::string output;
+};
+
+struct Ring {
+    int fd = -1;
+    char* base = nullptr; // Metadata page, then data_size bytes of samples
+    size_t data_size = 0;
+};
+
+struct Profile {
+    SymbolResolver symbols;
+    std::map<int, std::string> comms; // Processes seen so far
+    std::map<std::pair<int, std::vector<uint64_t>>, uint64_t> stacks; // (pid, callchain) -> samples
+    uint64_t samples = 0;
+    uint64_t lost = 0;
+};
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_sigint(int) {
+    stop_requested = 1;
+}
+
+static int open_sampler(const ProfileConfig& cfg, pid_t pid, int cpu, unsigned long flags) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_SOFTWARE;
+    attr.config = PERF_COUNT_SW_CPU_CLOCK;
+    attr.freq = 1;
+    attr.sample_freq = cfg.frequency;
+    attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_CALLCHAIN;
+    attr.exclude_kernel = !cfg.kernel;
+    attr.exclude_callchain_kernel = !cfg.kernel;
+    attr.exclude_hv = 1;
+    attr.disabled = 1;
+    return syscall(SYS_perf_event_open, &attr, pid, cpu, -1, flags | PERF_FLAG_FD_CLOEXEC);
+}
+
+static bool map_ring(Ring& r, size_t pages) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    void* base = mmap(nullptr, (pages + 1) * page, PROT_READ | PROT_WRITE, MAP_SHARED, r.fd, 0);
+    if (base == MAP_FAILED) return false;
+    r.base = static_cast<char*>(base);
+    r.data_size = pages * page;
+    return true;
+}
+
+// "0-3,6" from /sys/devices/system/cpu/online
+static std::vector<int> online_cpus() {
+    std::vector<int> cpus;
+    std::string s;
+    if (!read_file_at(AT_FDCWD, "/sys/devices/system/cpu/online", s)) return cpus;
+    std::istringstream in(s);
+    std::string range;
+    while (std::getline(in, range, ',')) {
+        int lo = 0, hi = 0;
+        int n = sscanf(range.c_str(), "%d-%d", &lo, &hi);
+        if (n < 1) continue;
+        for (int cpu = lo; cpu <= (n == 2 ? hi : lo); ++cpu) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// Opens and maps a sampler for every thread of the cgroup not attached yet.
+// The kernel refuses buffers for inherited per-task events, so threads
+// started later are picked up by calling this again. Returns the last
+// error, 0 if none.
+static int attach_threads(const ProfileConfig& cfg, int cgfd, std::vector<Ring>& rings, std::set<int>& attached) {
+    std::string threads;
+    read_file_at(cgfd, "cgroup.threads", threads);
+    std::istringstream in(threads);
+    int tid;
+    int error = 0;
+    while (in >> tid) {
+        if (attached.count(tid)) continue;
+        if (attached.size() >= MAX_THREADS) {
+            static bool warned = false;
+            if (!warned) log_msg(("Warning: profile: sampling only the first " + std::to_string(MAX_THREADS) + " threads").c_str());
+            warned = true;
+            break;
+        }
+        Ring r;
+        r.fd = open_sampler(cfg, tid, -1, 0);
+        if (r.fd == -1) {
+            if (errno != ESRCH) error = errno; // ESRCH: exited meanwhile
+            continue;
+        }
+        if (!map_ring(r, THREAD_RING_PAGES)) {
+            error = errno;
+            close(r.fd);
+            continue;
+        }
+        attached.insert(tid);
+        rings.push_back(r);
+    }
+    return error;
+}
+
+// --- Collecting Samples ---
+
+static void record_sample(Profile& prof, const char* rec, size_t size) {
+    // PERF_SAMPLE_IP | TID | CALLCHAIN: u64 ip; u32 pid, tid; u64 nr; u64 ips[nr]
+    const char* p = rec + sizeof(struct perf_event_header);
+    if (size < sizeof(struct perf_event_header) + 24) return;
+    uint64_t ip, nr;
+    uint32_t pid;
+    memcpy(&ip, p, 8);
+    memcpy(&pid, p + 8, 4);
+    memcpy(&nr, p + 16, 8);
+    if (nr > (size - sizeof(struct perf_event_header) - 24) / 8) return;
+    std::vector<uint64_t> chain(nr);
+    if (nr) memcpy(chain.data(), p + 24, nr * 8);
+    if (chain.empty()) chain.push_back(ip);
+
+    // Maps are read on first sight, while the process (likely) still exists
+    if (prof.comms.find(pid) == prof.comms.end()) {
+        prof.symbols.add_process(pid);
+        std::string comm;
+        read_file_at(AT_FDCWD, ("/proc/" + std::to_string(pid) + "/comm").c_str(), comm);
+        while (!comm.empty() && comm.back() == '\n') comm.pop_back();
+        prof.comms[pid] = comm.empty() ? "[" + std::to_string(pid) + "]" : comm;
+    }
+    prof.stacks[{(int)pid, std::move(chain)}]++;
+    prof.samples++;
+}
+
+// Copies len bytes at offset off of the circular data area, wrapping around.
+static void ring_copy(const Ring& r, uint64_t off, void* dst, size_t len) {
+    const char* data = r.base + sysconf(_SC_PAGESIZE);
+    size_t at = off % r.data_size;
+    size_t first = std::min(len, r.data_size - at);
+    memcpy(dst, data + at, first);
+    memcpy(static_cast<char*>(dst) + first, data, len - first);
+}
+
+static void drain(Profile& prof, Ring& r) {
+    auto* meta = reinterpret_cast<struct perf_event_mmap_page*>(r.base);
+    uint64_t head = __atomic_load_n(&meta->data_head, __ATOMIC_ACQUIRE);
+    uint64_t tail = meta->data_tail;
+    static char rec[65536]; // perf_event_header.size is 16 bits
+    while (tail < head) {
+        struct perf_event_header hdr;
+        ring_copy(r, tail, &hdr, sizeof(hdr));
+        if (hdr.size < sizeof(hdr) || hdr.size > head - tail) break;
+        ring_copy(r, tail, rec, hdr.size);
+        if (hdr.type == PERF_RECORD_SAMPLE) {
+            record_sample(prof, rec, hdr.size);
+        } else if (hdr.type == PERF_RECORD_LOST && hdr.size >= sizeof(hdr) + 16) {
+            uint64_t lost; // u64 id; u64 lost
+            memcpy(&lost, rec + sizeof(hdr) + 8, 8);
+            prof.lost += lost;
+        }
+        tail += hdr.size;
+    }
+    __atomic_store_n(&meta->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+// --- Folding ---
+
+// "comm;outermost;...;innermost" per stack, summed over identical lines.
+static std::map<std::string, uint64_t> fold(Profile& prof) {
+    std::map<std::string, uint64_t> folded;
+    for (const auto& entry : prof.stacks) {
+        int pid = entry.first.first;
+        const std::vector<uint64_t>& chain = entry.first.second;
+        std::vector<std::string> frames; // Innermost first, like the callchain
+        bool kernel = false;
+        for (uint64_t ip : chain) {
+            if (ip >= PERF_CONTEXT_MAX) { // Marks where kernel and user frames begin
+                kernel = ip == PERF_CONTEXT_KERNEL;
+                continue;
+            }
+            // Every frame but the sampled instruction is a return address
+            std::string name = kernel ? prof.symbols.resolve_kernel(ip) : prof.symbols.resolve(pid, ip, !frames.empty());
+            for (char& c : name) {
+                if (c == ';' || c == '\n') c = ':'; // Separators of the folded format
+            }
+            frames.push_back(std::move(name));
+        }
+        std::string line = prof.comms[pid];
+        for (auto it = frames.rbegin(); it != frames.rend(); ++it) line += ";" + *it;
+        folded[line] += entry.second;
+    }
+    return folded;
+}
+
+static void usage() {
+    fprintf(stderr, "Usage: nsi-sandbox profile <container-id> [--seconds <n>] [--frequency <hz>] [--kernel] [--output <file>]\n");
+    exit(EXIT_FAILURE);
+}
+
+int profile_main(int argc, char* argv[]) {
+    ProfileConfig cfg;
+    struct option long_options[] = {
+        {"seconds",   required_argument, 0, 's'},
+        {"frequency", required_argument, 0, 'F'},
+        {"kernel",    no_argument,       0, 'k'},
+        {"output",    required_argument, 0, 'o'},
+        {0, 0, 0, 0}
+    };
+    optind = 1;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:F:ko:", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 's': cfg.seconds = atof(optarg); break;
+            case 'F': cfg.frequency = atoi(optarg); break;
+            case 'k': cfg.kernel = true; break;
+            case 'o': cfg.output = optarg; break;
+            default: usage();
+        }
+    }
+    if (optind != argc - 1 || cfg.seconds <= 0 || cfg.frequency < 1 || cfg.frequency > 10000) usage();
+    std::string id = argv[optind];
+    std::string cgroup_path = container_cgroup_path(id);
+    int cgfd = open(cgroup_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (id.find('/') != std::string::npos || cgfd == -1) {
+        fprintf(stderr, "No running container %s (%s)\n", id.c_str(), cgroup_path.c_str());
+        return EXIT_FAILURE;
+    }
+
+    // 1. Samplers: per CPU on the cgroup, else per thread
+    std::vector<Ring> rings;
+    const char* mode = "cgroup";
+    int cgroup_errno = 0;
+    for (int cpu : online_cpus()) {
+        Ring r;
+        r.fd = open_sampler(cfg, cgfd, cpu, PERF_FLAG_PID_CGROUP);
+        if (r.fd == -1) {
+            cgroup_errno = errno;
+            for (Ring& opened : rings) close(opened.fd);
+            rings.clear();
+            break;
+        }
+        rings.push_back(r);
+    }
+    std::set<int> attached; // Threads with a sampler (per-thread mode)
+    if (rings.empty()) {
+        mode = "per-thread";
+        int thread_errno = attach_threads(cfg, cgfd, rings, attached);
+        if (rings.empty()) {
+            errno = thread_errno ? thread_errno : cgroup_errno;
+            if (errno == 0) die(("profile: no processes in " + cgroup_path).c_str());
+            die("profile: perf_event_open failed (needs CAP_PERFMON, or kernel.perf_event_paranoid <= 2 as the "
+                "container's owner; <= 1 for --kernel)");
+        }
+    }
+    for (Ring& r : rings) {
+        errno = 0;
+        if (!r.base && !map_ring(r, CPU_RING_PAGES)) die("profile: mmap of the sample buffer failed");
+    }
+
+    // 2. Sample for the requested time (Ctrl+C stops early and still reports)
+    log_msg(("profile: sampling container " + id + " at " + std::to_string(cfg.frequency) + " Hz for " +
+             std::to_string((int)cfg.seconds) + "s (" + mode + " mode, " + std::to_string(rings.size()) + " buffers)").c_str());
+    signal(SIGINT, on_sigint);
+    Profile prof;
+    for (Ring& r : rings) ioctl(r.fd, PERF_EVENT_IOC_ENABLE, 0);
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int ticks = 1;; ++ticks) {
+        struct timespec tick = {0, 50 * 1000000}; // Drain often enough that small buffers don't overflow
+        nanosleep(&tick, nullptr);
+        for (Ring& r : rings) drain(prof, r);
+        // Threads started since: sampled from now on
+        if (!attached.empty() && ticks % 10 == 0) {
+            size_t before = rings.size();
+            attach_threads(cfg, cgfd, rings, attached);
+            for (size_t i = before; i < rings.size(); ++i) ioctl(rings[i].fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (stop_requested || (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9 >= cfg.seconds) break;
+    }
+    close(cgfd);
+    for (Ring& r : rings) {
+        ioctl(r.fd, PERF_EVENT_IOC_DISABLE, 0);
+        drain(prof, r);
+        munmap(r.base, r.data_size + sysconf(_SC_PAGESIZE));
+        close(r.fd);
+    }
+    signal(SIGINT, SIG_DFL);
+
+    // 3. Folded stacks
+    std::map<std::string, uint64_t> folded = fold(prof);
+    FILE* out = stdout;
+    if (!cfg.output.empty()) {
+        errno = 0;
+        out = fopen(cfg.output.c_str(), "w");
+        if (!out) die(("profile: cannot write " + cfg.output).c_str());
+    }
+    for (const auto& line : folded) fprintf(out, "%s %llu\n", line.first.c_str(), (unsigned long long)line.second);
+    if (out != stdout) fclose(out);
+    log_msg(("profile: " + std::to_string(prof.samples) + " samples (" + std::to_string(prof.lost) + " lost) from " +
+             std::to_string(prof.comms.size()) + " processes, " + std::to_string(folded.size()) + " distinct stacks").c_str());
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,29 @@
+// neoshell/src/sandbox/profile.h
+#ifndef NSI_SANDBOX_PROFILE_H
+#define NSI_SANDBOX_PROFILE_H
+
+// On-demand CPU profile of a running container (`nsi-sandbox profile`).
+//
+// Samples the container's call stacks with perf_event_open for a while and
+// prints them as folded stacks ("comm;outer;...;inner <count>" per line),
+// the input of flamegraph.pl, speedscope and inferno. Nothing has to be
+// installed in the container: frames are symbolized from the host against
+// the container's own files (see symbols.h).
+//
+// The sampler is the cpu-clock software event, so it works without a
+// hardware PMU (VMs), in one of two modes:
+//
+//   cgroup      one event per CPU, filtered to the container's cgroup
+//               (PERF_FLAG_PID_CGROUP). Sees every process, including ones
+//               started during the profile. Needs CAP_PERFMON or
+//               kernel.perf_event_paranoid <= 0.
+//   per-thread  one event per thread in cgroup.threads, rescanned every
+//               half second for new threads. Used when the cgroup mode is
+//               not permitted; works as the container's owner with the
+//               default perf_event_paranoid of 2.
+//
+// Kernel frames (--kernel) need perf_event_paranoid <= 1 or CAP_PERFMON.
+
+int profile_main(int argc, char* argv[]);
+
+#endif // NSI_SANDBOX_PROFILE_H
@@ -0,0 +1,244 @@
+// neoshell/src/sandbox/reclaim.cpp
+#include "reclaim.h"
+#include "netshape.h"     // For parse_size
+#include "utils.h"
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>        // For openat
+#include <poll.h>         // For poll (sleeping)
+#include <dirent.h>       // For scanning NSI_CGROUP_ROOT
+#include <getopt.h>
+#include <sys/xattr.h>    // For the working-set attribute
+
+static const unsigned long long PAGE = 4096; // Smallest step worth a syscall
+
+struct ReclaimConfig {
+    double target = 0.1;       // %: memory stall time per interval we accept from probing
+    double interval = 6;       // s between probes (PSI needs a few seconds to show refaults)
+    double step = 1;           // %: of memory.current reclaimed per probe at zero pressure
+    uint32_t max_step = 64 << 20;
+    double report = 60;        // s between logged estimates
+    bool zswap = false;
+};
+
+struct Probe {
+    unsigned long long stall = 0;     // memory.pressure "some" total, usec
+    double at = 0;                    // When stall was read
+    double wss = 0;                   // Smoothed estimate, bytes
+    unsigned long long reclaimed = 0; // Bytes given back so far
+    double pressure = 0;              // % of the last interval stalled
+    bool converged = false;           // Found the edge: pressure, or nothing left to reclaim
+    bool unsupported = false;         // No memory.reclaim in this cgroup
+};
+
+static double monotonic_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long long read_u64_at(int dirfd, const char* name) {
+    std::string s;
+    if (!read_file_at(dirfd, name, s)) return 0;
+    return strtoull(s.c_str(), nullptr, 10); // "max" reads as 0, like no request
+}
+
+// Cumulative "some" stall time in usec from a *.pressure file.
+static bool read_stall_total(int dirfd, const char* name, unsigned long long& total) {
+    std::string s;
+    if (!read_file_at(dirfd, name, s)) return false;
+    const char* p = strstr(s.c_str(), "total=");
+    if (!p) return false;
+    total = strtoull(p + 6, nullptr, 10);
+    return true;
+}
+
+// A "key value" line of memory.stat, 0 if absent.
+static unsigned long long memory_stat(int cgfd, const char* key) {
+    std::string s;
+    if (!read_file_at(cgfd, "memory.stat", s)) return 0;
+    std::istringstream in(s);
+    std::string k;
+    unsigned long long v;
+    while (in >> k >> v) {
+        if (k == key) return v;
+    }
+    return 0;
+}
+
+static bool write_at(int dirfd, const char* name, const std::string& value) {
+    int fd = openat(dirfd, name, O_WRONLY | O_CLOEXEC);
+    if (fd == -1) return false;
+    bool ok = write(fd, value.c_str(), value.length()) == (ssize_t)value.length();
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return ok;
+}
+
+static std::string mib(double bytes) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.1fMiB", bytes / 1048576.0);
+    return buf;
+}
+
+// Keeps reclaimed anonymous pages compressed in memory rather than written to swap.
+static void enable_zswap(int cgfd, const std::string& id) {
+    if (!write_at(cgfd, "memory.zswap.max", "max")) {
+        log_msg(("reclaim: Warning: " + id + ": memory.zswap.max: " + std::string(strerror(errno))).c_str());
+        return;
+    }
+    if (!write_at(cgfd, "memory.zswap.writeback", "0")) { // Linux 6.8+
+        log_msg(("reclaim: Warning: " + id + ": memory.zswap.writeback: " + std::string(strerror(errno)) +
+                 " (compressed pages may be written back to swap)").c_str());
+    }
+}
+
+// One probe of one container; updates p.
+static void probe(const ReclaimConfig& cfg, int cgfd, const std::string& id, Probe& p, double now) {
+    unsigned long long stall;
+    if (!read_stall_total(cgfd, "memory.pressure", stall)) return;
+    double elapsed = now - p.at;
+    p.pressure = elapsed > 0 ? (stall - p.stall) / (elapsed * 1e6) * 100 : 0;
+    p.stall = stall;
+    p.at = now;
+
+    // 1. Size the step: full at zero pressure, nothing at the target
+    unsigned long long current = read_u64_at(cgfd, "memory.current");
+    unsigned long long request = read_u64_at(cgfd, "memory.low");
+    unsigned long long amount = 0;
+    if (p.pressure >= cfg.target) {
+        p.converged = true;
+    } else {
+        amount = (unsigned long long)(current * cfg.step / 100 * (1 - p.pressure / cfg.target));
+        amount = std::min<unsigned long long>(amount, cfg.max_step);
+        if (current <= request + amount) { // Never below the request
+            amount = current > request ? current - request : 0;
+            p.converged = true;
+        }
+    }
+
+    // 2. Reclaim. EAGAIN: the kernel found less than asked, i.e. the rest is in use
+    if (amount >= PAGE && !p.unsupported) {
+        if (!write_at(cgfd, "memory.reclaim", std::to_string(amount))) {
+            if (errno == EAGAIN) {
+                p.converged = true;
+            } else {
+                log_msg(("reclaim: Warning: " + id + ": memory.reclaim: " + std::string(strerror(errno)) +
+                         " (needs Linux 5.19+), only estimating").c_str());
+                p.unsupported = true;
+            }
+        }
+        unsigned long long after = read_u64_at(cgfd, "memory.current");
+        if (after < current) p.reclaimed += current - after;
+        current = after;
+    }
+
+    // 3. Estimate: memory.current smoothed over probes, once reclaim has found the edge
+    p.wss = p.wss > 0 ? 0.8 * p.wss + 0.2 * current : current;
+    if (p.converged || p.unsupported) {
+        std::string value = std::to_string((unsigned long long)p.wss);
+        fsetxattr(cgfd, NSI_WSS_XATTR, value.c_str(), value.length(), 0); // Best effort, see stats
+    }
+}
+
+static void usage() {
+    fprintf(stderr,
+            "Usage: nsi-sandbox reclaim [--target <pct>] [--interval <s>] [--step <pct>] [--max-step <size>]\n"
+            "                           [--report <s>] [--zswap]\n");
+    exit(EXIT_FAILURE);
+}
+
+int reclaim_main(int argc, char* argv[]) {
+    ReclaimConfig cfg;
+    struct option long_options[] = {
+        {"target",   required_argument, 0, 't'},
+        {"interval", required_argument, 0, 'i'},
+        {"step",     required_argument, 0, 's'},
+        {"max-step", required_argument, 0, 'm'},
+        {"report",   required_argument, 0, 'r'},
+        {"zswap",    no_argument,       0, 'z'},
+        {0, 0, 0, 0}
+    };
+    optind = 1;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:i:s:m:r:z", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 't': cfg.target = atof(optarg); break;
+            case 'i': cfg.interval = atof(optarg); break;
+            case 's': cfg.step = atof(optarg); break;
+            case 'm':
+                if (!parse_size(optarg, cfg.max_step)) {
+                    fprintf(stderr, "reclaim: invalid --max-step '%s'\n", optarg);
+                    usage();
+                }
+                break;
+            case 'r': cfg.report = atof(optarg); break;
+            case 'z': cfg.zswap = true; break;
+            default: usage();
+        }
+    }
+    if (optind != argc || cfg.target <= 0 || cfg.interval <= 0 || cfg.step <= 0 || cfg.step > 100) usage();
+
+    if (access("/proc/pressure/memory", R_OK) != 0) die("reclaim: /proc/pressure/memory unavailable (kernel without CONFIG_PSI or psi=0)");
+    if (cfg.zswap) {
+        std::string enabled;
+        if (!read_file_at(AT_FDCWD, "/sys/module/zswap/parameters/enabled", enabled) || enabled[0] != 'Y') {
+            log_msg("reclaim: Warning: zswap is not enabled on this host (zswap.enabled=1), --zswap has no effect");
+        }
+    }
+    char banner[128];
+    snprintf(banner, sizeof(banner), "reclaim: probing " NSI_CGROUP_ROOT " every %.0fs, target %.2f%% stalled", cfg.interval, cfg.target);
+    log_msg(banner);
+
+    std::map<std::string, Probe> probes; // Container id -> state
+    double last_report = monotonic_seconds();
+    for (;;) {
+        poll(nullptr, 0, (int)(cfg.interval * 1000));
+        double now = monotonic_seconds();
+
+        DIR* d = opendir(NSI_CGROUP_ROOT);
+        if (!d) die("reclaim: open " NSI_CGROUP_ROOT " failed");
+        std::map<std::string, Probe> seen;
+        while (struct dirent* e = readdir(d)) {
+            if (e->d_type != DT_DIR || e->d_name[0] == '.') continue;
+            int cgfd = openat(dirfd(d), e->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (cgfd == -1) continue;
+            std::string id = e->d_name;
+            auto it = probes.find(id);
+            if (it == probes.end()) {
+                // New container: baseline its stall counter, probe from the next round
+                Probe p;
+                p.at = now;
+                if (read_stall_total(cgfd, "memory.pressure", p.stall)) {
+                    if (cfg.zswap) enable_zswap(cgfd, id);
+                    seen[id] = p;
+                }
+            } else {
+                probe(cfg, cgfd, id, it->second, now);
+                seen[id] = it->second;
+            }
+            close(cgfd);
+        }
+        closedir(d);
+        probes.swap(seen); // Drops containers that are gone
+
+        if (now - last_report < cfg.report) continue;
+        last_report = now;
+        for (const auto& [id, p] : probes) {
+            if (p.wss == 0) continue; // Not probed yet
+            char line[256];
+            int cgfd = open(container_cgroup_path(id).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            unsigned long long zswapped = cgfd != -1 ? memory_stat(cgfd, "zswapped") : 0;
+            if (cgfd != -1) close(cgfd);
+            snprintf(line, sizeof(line), "reclaim: %s working set %s%s (pressure %.2f%%, reclaimed %s, zswapped %s)",
+                     id.c_str(), p.converged || p.unsupported ? "~" : "<= ", mib(p.wss).c_str(), p.pressure,
+                     mib(p.reclaimed).c_str(), mib(zswapped).c_str());
+            log_msg(line);
+        }
+    }
+}
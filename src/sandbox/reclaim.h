@@ -0,0 +1,29 @@
+// neoshell/src/sandbox/reclaim.h
+#ifndef NSI_SANDBOX_RECLAIM_H
+#define NSI_SANDBOX_RECLAIM_H
+
+// Proactive reclaim and working-set estimation (`nsi-sandbox reclaim`).
+//
+// Runs on the host. Every interval it asks the kernel to reclaim a small step
+// of each container's memory (memory.reclaim, Linux 5.19+) and watches how
+// much of that interval the container then spent stalled on memory (the
+// "some" total of its memory.pressure):
+//
+//   below --target  cold pages only: reclaim the next step (smaller as
+//                   pressure approaches the target)
+//   at/above it     the container is faulting back pages it needs: stop and
+//                   let it refault, memory.current is now its working set
+//
+// Memory never drops below the container's request (memory.low). With
+// --zswap, reclaimed anonymous pages are kept compressed in RAM
+// (memory.zswap.max, memory.zswap.writeback=0) instead of going to swap.
+//
+// The estimate is logged periodically and stored on the container's cgroup,
+// where `nsi-sandbox stats` reports it as "working_set".
+
+// Extended attribute on the container's cgroup holding the estimate in bytes.
+#define NSI_WSS_XATTR "user.nsi.wss"
+
+int reclaim_main(int argc, char* argv[]);
+
+#endif // NSI_SANDBOX_RECLAIM_H
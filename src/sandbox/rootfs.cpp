@@ -0,0 +1,444 @@
+// neoshell/src/sandbox/rootfs.cpp
+#include "rootfs.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <set>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <linux/openat2.h> // For struct open_how, RESOLVE_IN_ROOT
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>  // For SYS_openat2
+
+// --- Tar Format ---
+// ustar headers, plus GNU long names ('L', 'K') and pax extended headers
+// ('x') for paths over 100 bytes, as written by tar-fs and image builders.
+static const size_t BLOCK = 512;
+static const char* WHITEOUT = ".wh.";
+static const char* OPAQUE = ".wh..wh..opq";
+
+struct TarEntry {
+    std::string path, linkpath;
+    char type;
+    mode_t mode;
+    uint64_t size;
+    time_t mtime;
+};
+
+// Numeric field: octal text, or big-endian binary when the top bit is set (GNU)
+static uint64_t tar_number(const unsigned char* p, size_t len) {
+    uint64_t v = 0;
+    if (p[0] & 0x80) {
+        v = p[0] & 0x7f;
+        for (size_t i = 1; i < len; ++i) v = (v << 8) | p[i];
+        return v;
+    }
+    size_t i = 0;
+    while (i < len && p[i] == ' ') ++i;
+    for (; i < len && p[i] >= '0' && p[i] <= '7'; ++i) v = v * 8 + (p[i] - '0');
+    return v;
+}
+
+static std::string tar_string(const unsigned char* p, size_t len) {
+    const char* s = reinterpret_cast<const char*>(p);
+    return std::string(s, strnlen(s, len));
+}
+
+// The checksum field counts as spaces
+static bool checksum_ok(const unsigned char* h) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < BLOCK; ++i) sum += (i >= 148 && i < 156) ? ' ' : h[i];
+    return sum == tar_number(h + 148, 8);
+}
+
+// --- Stream Reading ---
+
+// Reads up to len bytes; fewer only at end of stream.
+static size_t read_full(int fd, void* buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = read(fd, static_cast<char*>(buf) + got, len - got);
+        if (n == 0) break;
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            die("read of the image stream failed");
+        }
+        got += n;
+    }
+    return got;
+}
+
+static void skip(int fd, uint64_t len) {
+    char buf[65536];
+    while (len > 0) {
+        size_t want = std::min<uint64_t>(len, sizeof(buf));
+        if (read_full(fd, buf, want) != want) {
+            errno = 0;
+            die("image stream ends in the middle of an entry");
+        }
+        len -= want;
+    }
+}
+
+static uint64_t padding(uint64_t size) {
+    return (BLOCK - size % BLOCK) % BLOCK;
+}
+
+// Data of a metadata entry (long name, pax header), padding consumed.
+static std::string read_data(int fd, uint64_t size) {
+    if (size > (1 << 20)) {
+        errno = 0;
+        die("oversized tar metadata entry in image stream");
+    }
+    std::string data(size, '\0');
+    if (read_full(fd, &data[0], size) != size) {
+        errno = 0;
+        die("image stream ends in the middle of an entry");
+    }
+    skip(fd, padding(size));
+    return data;
+}
+
+// Copies len bytes of file data from the stream into out. splice() moves
+// the pipe's pages straight into the tmpfs file; plain reads otherwise.
+static void copy_data(int in, int out, uint64_t len, const std::string& path) {
+    const std::string err = "writing /" + path + " failed (does the image fit in --rootfs-tmpfs?)";
+    while (len > 0) {
+        ssize_t n = splice(in, NULL, out, NULL, std::min<uint64_t>(len, 1 << 20), SPLICE_F_MOVE);
+        if (n > 0) {
+            len -= n;
+            continue;
+        }
+        if (n == 0) {
+            errno = 0;
+            die("image stream ends in the middle of a file");
+        }
+        if (errno == EINTR) continue;
+        if (errno != EINVAL) die(err.c_str());
+        break; // Not a pipe
+    }
+    char buf[65536];
+    while (len > 0) {
+        size_t want = std::min<uint64_t>(len, sizeof(buf));
+        if (read_full(in, buf, want) != want) {
+            errno = 0;
+            die("image stream ends in the middle of a file");
+        }
+        for (size_t done = 0; done < want;) {
+            ssize_t n = write(out, buf + done, want - done);
+            if (n == -1 && errno == EINTR) continue;
+            if (n == -1) die(err.c_str());
+            done += n;
+        }
+        len -= want;
+    }
+}
+
+// --- Paths Inside the New Root ---
+
+// "./usr/bin/" -> "usr/bin"; "" for the root itself. False if it contains "..".
+static bool normalize(const std::string& name, std::string& out) {
+    out.clear();
+    size_t pos = 0;
+    while (pos <= name.size()) {
+        size_t slash = name.find('/', pos);
+        if (slash == std::string::npos) slash = name.size();
+        std::string part = name.substr(pos, slash - pos);
+        pos = slash + 1;
+        if (part.empty() || part == ".") continue;
+        if (part == "..") return false;
+        if (!out.empty()) out += '/';
+        out += part;
+    }
+    return true;
+}
+
+static void split(const std::string& rel, std::string& parent, std::string& base) {
+    size_t slash = rel.rfind('/');
+    parent = slash == std::string::npos ? "" : rel.substr(0, slash);
+    base = slash == std::string::npos ? rel : rel.substr(slash + 1);
+}
+
+// Opens rel as if root were "/": symlinks (absolute ones included) and
+// ".." cannot lead out of it.
+static int open_in_root(int root, const std::string& rel, int flags) {
+    struct open_how how;
+    memset(&how, 0, sizeof(how));
+    how.flags = flags | O_CLOEXEC;
+    how.resolve = RESOLVE_IN_ROOT | RESOLVE_NO_MAGICLINKS;
+    return syscall(SYS_openat2, root, rel.empty() ? "." : rel.c_str(), &how, sizeof(how));
+}
+
+// Directory rel (O_PATH), created with its parents if missing. -1 if
+// something other than a directory is in the way.
+static int open_dir(int root, const std::string& rel) {
+    int fd = open_in_root(root, rel, O_PATH | O_DIRECTORY);
+    if (fd != -1 || errno != ENOENT) return fd;
+    std::string parent, base;
+    split(rel, parent, base);
+    int parent_fd = open_dir(root, parent);
+    if (parent_fd == -1) return -1;
+    int rc = mkdirat(parent_fd, base.c_str(), 0755);
+    close(parent_fd);
+    if (rc == -1 && errno != EEXIST) return -1;
+    return open_in_root(root, rel, O_PATH | O_DIRECTORY);
+}
+
+static void remove_tree(int dirfd, const std::string& name);
+
+// Removes the entries of directory fd (rel inside the root), except the
+// paths in keep.
+static void clear_dir(int fd, const std::string& rel, const std::set<std::string>& keep) {
+    DIR* dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        return;
+    }
+    std::vector<std::string> names;
+    while (struct dirent* d = readdir(dir)) {
+        if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0) continue;
+        std::string path = rel.empty() ? d->d_name : rel + "/" + d->d_name;
+        if (!keep.count(path)) names.push_back(d->d_name);
+    }
+    for (const std::string& name : names) remove_tree(dirfd(dir), name);
+    closedir(dir);
+}
+
+static void remove_tree(int dirfd, const std::string& name) {
+    if (unlinkat(dirfd, name.c_str(), 0) == 0 || errno != EISDIR) return;
+    int fd = openat(dirfd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd != -1) clear_dir(fd, "", {});
+    unlinkat(dirfd, name.c_str(), AT_REMOVEDIR);
+}
+
+// --- Extraction ---
+
+struct Extractor {
+    int root;                    // The tmpfs
+    int tar_fd;
+    std::set<std::string> layer; // Paths written by the current layer (spared by its opaque whiteouts)
+    uint64_t files = 0, bytes = 0;
+};
+
+// Creates one entry. Returns how much of its data it consumed from the stream.
+static uint64_t apply_entry(Extractor& x, const TarEntry& e) {
+    std::string rel, parent, base;
+    if (!normalize(e.path, rel)) {
+        log_msg(("Warning: skipping image entry outside the root: " + e.path).c_str());
+        return 0;
+    }
+    if (rel.empty()) {
+        if (e.type == '5') fchmod(x.root, e.mode);
+        return 0;
+    }
+    split(rel, parent, base);
+    std::string fail = "creating /" + rel + " in the tmpfs rootfs failed";
+
+    // 1. Whiteouts (OCI layers): remove what the lower layers put there
+    if (base.compare(0, strlen(WHITEOUT), WHITEOUT) == 0) {
+        int dir = open_in_root(x.root, parent, O_PATH | O_DIRECTORY);
+        if (dir == -1) return 0;
+        if (base == OPAQUE) {
+            int fd = openat(dir, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (fd != -1) clear_dir(fd, parent, x.layer);
+        } else {
+            remove_tree(dir, base.substr(strlen(WHITEOUT)));
+        }
+        close(dir);
+        return 0;
+    }
+
+    // 2. Replace what is there, unless a directory lands on a directory
+    int dir = open_dir(x.root, parent);
+    if (dir == -1) {
+        // E.g. below a dangling symlink; skipped like the CLI's extraction does
+        log_msg(("Warning: skipping image entry, its directory cannot be created: " + rel).c_str());
+        return 0;
+    }
+    x.layer.insert(rel);
+    struct stat st;
+    bool exists = fstatat(dir, base.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0;
+    if (exists && !(S_ISDIR(st.st_mode) && e.type == '5')) {
+        remove_tree(dir, base);
+        exists = false;
+    }
+
+    // 3. The entry itself. Device nodes are skipped: /dev is a tmpfs of its own
+    uint64_t consumed = 0;
+    switch (e.type) {
+        case '5':
+            if (!exists && mkdirat(dir, base.c_str(), 0700) == -1) die(fail.c_str());
+            fchmodat(dir, base.c_str(), e.mode, 0);
+            break;
+        case '2':
+            if (symlinkat(e.linkpath.c_str(), dir, base.c_str()) == -1) die(fail.c_str());
+            break;
+        case '1': {
+            std::string target, target_parent, target_base;
+            if (!normalize(e.linkpath, target) || target.empty()) break;
+            split(target, target_parent, target_base);
+            int target_dir = open_in_root(x.root, target_parent, O_PATH | O_DIRECTORY);
+            if (target_dir == -1 || linkat(target_dir, target_base.c_str(), dir, base.c_str(), 0) == -1) die(fail.c_str());
+            close(target_dir);
+            break;
+        }
+        case '6':
+            if (mknodat(dir, base.c_str(), S_IFIFO | e.mode, 0) == -1) die(fail.c_str());
+            break;
+        case '0': case '\0': case '7': {
+            int out = openat(dir, base.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+            if (out == -1) die(fail.c_str());
+            copy_data(x.tar_fd, out, e.size, rel);
+            consumed = e.size;
+            fchmod(out, e.mode);
+            struct timespec times[2] = {{0, UTIME_OMIT}, {e.mtime, 0}};
+            futimens(out, times);
+            close(out);
+            x.files++;
+            x.bytes += e.size;
+            break;
+        }
+        default:
+            break;
+    }
+    close(dir);
+    return consumed;
+}
+
+bool rootfs_tmpfs_valid_size(const std::string& size) {
+    if (size.empty() || size[0] < '0' || size[0] > '9') return false;
+    char* end = nullptr;
+    unsigned long long v = strtoull(size.c_str(), &end, 10);
+    if (v == 0) return false;
+    return *end == '\0' || (strchr("kKmMgG", *end) && end[1] == '\0');
+}
+
+void rootfs_tmpfs_populate(const std::string& mountpoint, const std::string& size, int tar_fd) {
+    // 1. The tmpfs. Its pages are charged to our (the container's) memory cgroup
+    std::string options = "size=" + size + ",mode=755";
+    errno = 0;
+    if (mount("tmpfs", mountpoint.c_str(), "tmpfs", MS_NOSUID | MS_NODEV, options.c_str()) == -1) {
+        die(("mount tmpfs rootfs on " + mountpoint + " failed").c_str());
+    }
+    log_msg(("-> Mounted tmpfs rootfs (size " + size + ") on " + mountpoint).c_str());
+    Extractor x;
+    x.root = open(mountpoint.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    x.tar_fd = tar_fd;
+    if (x.root == -1) die("open tmpfs rootfs failed");
+    if (open_in_root(x.root, "", O_PATH | O_DIRECTORY) == -1 && errno == ENOSYS) {
+        die("--rootfs-tmpfs needs openat2() (Linux 5.6+)");
+    }
+
+    // 2. Entries until the end of the stream; every end-of-archive block
+    //    closes a layer
+    unsigned char h[BLOCK];
+    std::string long_path, long_link;
+    std::string pax_path, pax_link;
+    int64_t pax_size = -1;
+    int layers = 0;
+    for (;;) {
+        size_t n = read_full(tar_fd, h, BLOCK);
+        if (n == 0) break;
+        errno = 0;
+        if (n < BLOCK) die("image stream ends in the middle of a tar header");
+        if (std::all_of(h, h + BLOCK, [](unsigned char c) { return c == 0; })) {
+            if (!x.layer.empty()) layers++;
+            x.layer.clear();
+            continue;
+        }
+        if (!checksum_ok(h)) die("corrupt tar header in image stream");
+
+        TarEntry e;
+        e.type = h[156];
+        e.mode = tar_number(h + 100, 8) & 07777;
+        e.size = tar_number(h + 124, 12);
+        e.mtime = tar_number(h + 136, 12);
+        e.path = tar_string(h, 100);
+        e.linkpath = tar_string(h + 157, 100);
+        std::string prefix = memcmp(h + 257, "ustar", 5) == 0 ? tar_string(h + 345, 155) : "";
+        if (!prefix.empty()) e.path = prefix + "/" + e.path;
+
+        if (e.type == 'L' || e.type == 'K') {
+            std::string name = read_data(tar_fd, e.size);
+            (e.type == 'L' ? long_path : long_link) = name.c_str(); // NUL-terminated
+            continue;
+        }
+        if (e.type == 'x') {
+            // "<len> <key>=<value>\n" records
+            std::string data = read_data(tar_fd, e.size);
+            for (size_t pos = 0; pos < data.size();) {
+                size_t len = strtoul(data.c_str() + pos, NULL, 10);
+                size_t space = data.find(' ', pos);
+                if (len == 0 || space == std::string::npos || pos + len > data.size()) break;
+                std::string record = data.substr(space + 1, pos + len - space - 2);
+                size_t eq = record.find('=');
+                std::string key = record.substr(0, eq), value = eq == std::string::npos ? "" : record.substr(eq + 1);
+                if (key == "path") pax_path = value;
+                else if (key == "linkpath") pax_link = value;
+                else if (key == "size") pax_size = strtoll(value.c_str(), NULL, 10);
+                pos += len;
+            }
+            continue;
+        }
+        if (e.type == 'g') {
+            skip(tar_fd, e.size + padding(e.size));
+            continue;
+        }
+        if (!long_path.empty()) e.path = long_path;
+        if (!long_link.empty()) e.linkpath = long_link;
+        if (!pax_path.empty()) e.path = pax_path;
+        if (!pax_link.empty()) e.linkpath = pax_link;
+        if (pax_size >= 0) e.size = pax_size;
+        long_path.clear();
+        long_link.clear();
+        pax_path.clear();
+        pax_link.clear();
+        pax_size = -1;
+
+        uint64_t consumed = apply_entry(x, e);
+        skip(tar_fd, e.size - consumed + padding(e.size));
+    }
+    if (!x.layer.empty()) layers++;
+    close(tar_fd);
+    close(x.root);
+    log_msg(("-> Extracted " + std::to_string(x.files) + " files (" + std::to_string(x.bytes >> 10) + " KiB, " +
+             std::to_string(layers) + (layers == 1 ? " layer" : " layers") + ") into the tmpfs rootfs").c_str());
+}
+
+std::string rootfs_overlay_mount(const std::string& rootfs) {
+    // 1. The tree, by descriptor: the tmpfs is about to cover its path. The
+    //    /proc/self/fd path also keeps ',' and ':' in it out of the options.
+    errno = 0;
+    int lower_fd = open(rootfs.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (lower_fd == -1) die(("open rootfs failed: " + rootfs).c_str());
+    std::string lower = "/proc/self/fd/" + std::to_string(lower_fd);
+
+    // 2. Upper and work directories, and the merged root, on a private tmpfs
+    errno = 0;
+    if (mount("tmpfs", rootfs.c_str(), "tmpfs", MS_NOSUID | MS_NODEV, "mode=755") == -1) {
+        die(("mount tmpfs over " + rootfs + " failed").c_str());
+    }
+    std::string upper = rootfs + "/upper", work = rootfs + "/work", merged = rootfs + "/merged";
+    for (const std::string& dir : {upper, work, merged}) {
+        if (mkdir(dir.c_str(), 0755) == -1) die(("mkdir " + dir + " failed").c_str());
+    }
+
+    // 3. The overlay (userxattr: the only kind a user namespace may mount)
+    std::string options = "lowerdir=" + lower + ",upperdir=" + upper + ",workdir=" + work + ",userxattr";
+    errno = 0;
+    if (mount("overlay", merged.c_str(), "overlay", 0, options.c_str()) == 0) {
+        log_msg(("-> Mounted " + rootfs + " under a private overlay (writes stay in this container).").c_str());
+    } else {
+        log_msg(("Warning: overlay on " + rootfs + " failed (" + std::string(strerror(errno)) + "); mounting it read-only instead.").c_str());
+        errno = 0;
+        if (mount(lower.c_str(), merged.c_str(), NULL, MS_BIND | MS_REC, NULL) == -1 ||
+            mount(NULL, merged.c_str(), NULL, MS_BIND | MS_REMOUNT | MS_RDONLY, NULL) == -1) {
+            die(("read-only bind mount of " + rootfs + " failed").c_str());
+        }
+        log_msg(("-> Bind mounted " + rootfs + " read-only.").c_str());
+    }
+    close(lower_fd);
+    return merged;
+}
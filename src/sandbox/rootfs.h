@@ -0,0 +1,49 @@
+// neoshell/src/sandbox/rootfs.h
+#ifndef NSI_SANDBOX_ROOTFS_H
+#define NSI_SANDBOX_ROOTFS_H
+
+#include <string>
+
+// Memory-backed rootfs (`--rootfs-tmpfs <size>`).
+//
+// Instead of a directory extracted by the CLI, the image arrives as tar
+// streams on NSI_ROOTFS_TAR_FD: one for a plain image, one per layer for a
+// chunked one (OCI whiteouts are applied). The container's first process
+// mounts a tmpfs of the given size in its own mount namespace and extracts
+// the streams into it before pivot_root, so:
+//
+//   - nothing is written to disk, and the files' pages are charged to the
+//     container's memory cgroup (it has joined it by then);
+//   - there is nothing to clean up: the tmpfs goes away with the mount
+//     namespace when the container exits.
+//
+// Paths are resolved with openat2(RESOLVE_IN_ROOT), so no entry (symlinks
+// included) can lead outside the new root.
+
+// The CLI passes the tar streams on this fd (a pipe).
+#define NSI_ROOTFS_TAR_FD 3
+// Where the tmpfs is mounted before pivot_root. Any existing directory
+// works: the mount is only visible in the container's mount namespace.
+#define NSI_ROOTFS_TMPFS_MOUNTPOINT "/tmp"
+
+// True if size is a tmpfs size: a number with an optional k, m or g suffix.
+bool rootfs_tmpfs_valid_size(const std::string& size);
+
+// Mounts a tmpfs of size bytes on mountpoint and extracts the tar streams
+// read from tar_fd (until EOF) into it, then closes tar_fd. Dies on error.
+// Call in the container's private mount namespace.
+void rootfs_tmpfs_populate(const std::string& mountpoint, const std::string& size, int tar_fd);
+
+// Shared rootfs (`--rootfs-overlay`): a kept tree that any number of
+// containers launch from at once (`nsi run --reuse-rootfs`). The tree is
+// the read-only lower layer of an overlay whose upper layer is a tmpfs of
+// this container's own, so the app can write anywhere, and its writes are
+// charged to its memory cgroup and gone when it exits; the tree itself is
+// never written. Where overlayfs cannot be mounted in a user namespace
+// (Linux before 5.11), the tree is bind-mounted read-only instead.
+//
+// Mounts the tmpfs on rootfs (covering it in this mount namespace only) and
+// the merged tree inside it; returns the new root. Dies on error.
+std::string rootfs_overlay_mount(const std::string& rootfs);
+
+#endif // NSI_SANDBOX_ROOTFS_H
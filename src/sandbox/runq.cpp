@@ -0,0 +1,321 @@
+// neoshell/src/sandbox/runq.cpp
+#include "runq.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>        // For open
+#include <dirent.h>       // For scanning NSI_CGROUP_ROOT
+#include <getopt.h>
+
+struct RunqConfig {
+    int interval_ms = 1000;
+    double duration = 10; // s
+    bool json = false;
+};
+
+// /proc/<tid>/schedstat: ns on a CPU, ns waiting on a run queue, timeslices
+struct SchedStat {
+    uint64_t run_ns = 0, wait_ns = 0, slices = 0;
+};
+
+struct CpuStat {
+    uint64_t usage_usec = 0, nr_periods = 0, nr_throttled = 0, throttled_usec = 0;
+    uint64_t psi_some_usec = 0, psi_full_usec = 0;
+};
+
+struct Watched {
+    std::string id;
+    int cgfd = -1;
+    std::map<int, SchedStat> threads; // At the last sample
+    CpuStat first, last;
+    double first_at = -1, last_at = -1; // Monotonic times of those samples
+    // Sums over the window, from threads seen in consecutive samples
+    uint64_t run_ns = 0, wait_ns = 0, slices = 0;
+    std::vector<std::pair<double, uint64_t>> per_slice; // (avg wait per timeslice in us, timeslices) per thread and interval
+    bool gone = false;
+};
+
+static double monotonic_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool read_schedstat(int tid, SchedStat& st) {
+    std::string s;
+    if (!read_file_at(AT_FDCWD, ("/proc/" + std::to_string(tid) + "/schedstat").c_str(), s)) return false;
+    unsigned long long run, wait, slices;
+    if (sscanf(s.c_str(), "%llu %llu %llu", &run, &wait, &slices) != 3) return false;
+    st = {run, wait, slices};
+    return true;
+}
+
+// The "total=" of the some and full lines of a *.pressure file, in usec.
+static void read_psi_totals(int dirfd, const char* name, uint64_t& some, uint64_t& full) {
+    std::string s;
+    some = full = 0;
+    if (!read_file_at(dirfd, name, s)) return;
+    std::istringstream in(s);
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t total = line.find("total=");
+        if (total == std::string::npos) continue;
+        uint64_t v = strtoull(line.c_str() + total + 6, nullptr, 10);
+        if (line.compare(0, 4, "some") == 0) some = v;
+        else if (line.compare(0, 4, "full") == 0) full = v;
+    }
+}
+
+static bool read_cpu(Watched& w, CpuStat& c) {
+    std::string s;
+    if (!read_file_at(w.cgfd, "cpu.stat", s)) return false;
+    std::istringstream in(s);
+    std::string key;
+    unsigned long long v;
+    while (in >> key >> v) {
+        if (key == "usage_usec") c.usage_usec = v;
+        else if (key == "nr_periods") c.nr_periods = v;
+        else if (key == "nr_throttled") c.nr_throttled = v;
+        else if (key == "throttled_usec") c.throttled_usec = v;
+    }
+    read_psi_totals(w.cgfd, "cpu.pressure", c.psi_some_usec, c.psi_full_usec);
+    return true;
+}
+
+// One sample of every thread; intervals are counted for threads already
+// seen in the previous one. The container's own window starts at its first
+// sample with threads and ends at its last.
+static void sample(Watched& w) {
+    if (w.gone) return;
+    std::string s;
+    CpuStat c;
+    if (!read_file_at(w.cgfd, "cgroup.threads", s) || !read_cpu(w, c)) {
+        w.gone = true; // Container exited: report the window up to here
+        return;
+    }
+    if (s.find_first_not_of(" \n") == std::string::npos) { // No threads: not started yet, or exited
+        if (w.first_at >= 0) w.gone = true;
+        return;
+    }
+    double at = monotonic_seconds();
+    if (w.first_at < 0) {
+        w.first = c;
+        w.first_at = at;
+    }
+    w.last = c;
+    w.last_at = at;
+    std::map<int, SchedStat> now;
+    std::istringstream in(s);
+    int tid;
+    while (in >> tid) {
+        SchedStat st;
+        if (!read_schedstat(tid, st)) continue; // Exited meanwhile
+        now[tid] = st;
+        auto prev = w.threads.find(tid);
+        if (prev == w.threads.end() || st.slices < prev->second.slices || st.wait_ns < prev->second.wait_ns) continue;
+        uint64_t run = st.run_ns - prev->second.run_ns;
+        uint64_t wait = st.wait_ns - prev->second.wait_ns;
+        uint64_t slices = st.slices - prev->second.slices;
+        w.run_ns += run;
+        w.wait_ns += wait;
+        w.slices += slices;
+        if (slices > 0) w.per_slice.emplace_back(wait / 1000.0 / slices, slices);
+    }
+    w.threads.swap(now);
+}
+
+// Weighted percentile of (value, weight) pairs sorted by value.
+static double percentile(const std::vector<std::pair<double, uint64_t>>& v, uint64_t total, double q) {
+    double target = q * total;
+    uint64_t seen = 0;
+    for (const auto& p : v) {
+        seen += p.second;
+        if (seen >= target) return p.first;
+    }
+    return v.empty() ? 0 : v.back().first;
+}
+
+// CPUs the container may run on (cpuset.cpus.effective, "0-3,6"), else all online ones.
+static int cpus_allowed(int cgfd) {
+    std::string s;
+    if (!read_file_at(cgfd, "cpuset.cpus.effective", s) || s.find_first_of("0123456789") == std::string::npos) {
+        return (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    int count = 0;
+    std::istringstream in(s);
+    std::string range;
+    while (std::getline(in, range, ',')) {
+        int lo, hi;
+        int n = sscanf(range.c_str(), "%d-%d", &lo, &hi);
+        if (n == 1) count += 1;
+        else if (n == 2 && hi >= lo) count += hi - lo + 1;
+    }
+    return count > 0 ? count : (int)sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+// cpu.max as cores ("50000 100000" -> 0.5); 0 when unlimited.
+static double quota_cores(int cgfd) {
+    std::string s;
+    if (!read_file_at(cgfd, "cpu.max", s)) return 0;
+    unsigned long long quota, period;
+    if (sscanf(s.c_str(), "%llu %llu", &quota, &period) != 2 || period == 0) return 0; // "max ..."
+    return (double)quota / period;
+}
+
+struct Report {
+    double cpu_cores, wait_ms_per_s, wait_pct;
+    double p50, p90, p99, max; // us per timeslice
+    double throttled_pct, throttled_ms_per_s;
+    double psi_some_pct, psi_full_pct;
+    int cpus;
+    double quota;
+    double seconds; // The container's own window
+    const char* verdict;
+};
+
+static Report analyze(Watched& w) {
+    Report r;
+    // Its own window: one that started or exited meanwhile ran for less of ours
+    double seconds = w.last_at - w.first_at;
+    r.seconds = seconds;
+    if (seconds <= 0) seconds = INFINITY; // Seen at most once: no rates
+    const CpuStat& a = w.first;
+    const CpuStat& b = w.last;
+    auto delta = [](uint64_t x, uint64_t y) { return y >= x ? (double)(y - x) : 0.0; };
+    r.cpu_cores = delta(a.usage_usec, b.usage_usec) / 1e6 / seconds;
+    r.wait_ms_per_s = w.wait_ns / 1e6 / seconds;
+    r.wait_pct = w.run_ns + w.wait_ns ? 100.0 * w.wait_ns / (w.run_ns + w.wait_ns) : 0;
+    std::sort(w.per_slice.begin(), w.per_slice.end());
+    r.p50 = percentile(w.per_slice, w.slices, 0.50);
+    r.p90 = percentile(w.per_slice, w.slices, 0.90);
+    r.p99 = percentile(w.per_slice, w.slices, 0.99);
+    r.max = w.per_slice.empty() ? 0 : w.per_slice.back().first;
+    double periods = delta(a.nr_periods, b.nr_periods);
+    r.throttled_pct = periods > 0 ? 100.0 * delta(a.nr_throttled, b.nr_throttled) / periods : 0;
+    r.throttled_ms_per_s = delta(a.throttled_usec, b.throttled_usec) / 1e3 / seconds;
+    r.psi_some_pct = delta(a.psi_some_usec, b.psi_some_usec) / 1e4 / seconds;
+    r.psi_full_pct = delta(a.psi_full_usec, b.psi_full_usec) / 1e4 / seconds;
+    r.cpus = cpus_allowed(w.cgfd);
+    r.quota = quota_cores(w.cgfd);
+
+    // What the waiting comes from, most specific first
+    if (r.wait_pct < 5 && r.psi_some_pct < 5) r.verdict = "ok";
+    else if (r.throttled_pct >= 10 || r.throttled_ms_per_s >= 50) r.verdict = "quota";
+    else if (r.cpu_cores >= 0.9 * r.cpus) r.verdict = "cores";
+    else r.verdict = "contended";
+    return r;
+}
+
+static std::string verdict_text(const Report& r, double host_some_pct) {
+    char buf[160];
+    std::string v = r.verdict;
+    if (v == "quota") snprintf(buf, sizeof(buf), "quota: throttled by cpu.max (%.2f cores), raise it", r.quota);
+    else if (v == "cores") snprintf(buf, sizeof(buf), "cores: busy on all %d CPUs it may use, add cores", r.cpus);
+    else if (v == "contended") snprintf(buf, sizeof(buf), "contended: other work holds the CPUs (host cpu pressure %.1f%%), move it", host_some_pct);
+    else snprintf(buf, sizeof(buf), "ok");
+    return buf;
+}
+
+static void usage() {
+    fprintf(stderr, "Usage: nsi-sandbox runq [<container-id>...] [--interval <ms>] [--duration <s>] [--json]\n");
+    exit(EXIT_FAILURE);
+}
+
+int runq_main(int argc, char* argv[]) {
+    RunqConfig cfg;
+    struct option long_options[] = {
+        {"interval", required_argument, 0, 'i'},
+        {"duration", required_argument, 0, 'd'},
+        {"json",     no_argument,       0, 'j'},
+        {0, 0, 0, 0}
+    };
+    optind = 1;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "i:d:j", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'i': cfg.interval_ms = atoi(optarg); break;
+            case 'd': cfg.duration = atof(optarg); break;
+            case 'j': cfg.json = true; break;
+            default: usage();
+        }
+    }
+    if (cfg.interval_ms < 10 || cfg.duration <= 0) usage();
+
+    // 1. The containers: the ones named, else all running ones
+    std::vector<std::string> ids(argv + optind, argv + argc);
+    if (ids.empty()) {
+        if (DIR* d = opendir(NSI_CGROUP_ROOT)) {
+            while (struct dirent* e = readdir(d)) {
+                if (e->d_type == DT_DIR && e->d_name[0] != '.') ids.push_back(e->d_name);
+            }
+            closedir(d);
+        }
+        std::sort(ids.begin(), ids.end());
+    }
+    std::vector<Watched> watched;
+    for (const std::string& id : ids) {
+        Watched w;
+        w.id = id;
+        w.cgfd = id.find('/') == std::string::npos ? open(container_cgroup_path(id).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1;
+        if (w.cgfd == -1) {
+            fprintf(stderr, "runq: no running container %s\n", id.c_str());
+            continue;
+        }
+        watched.push_back(std::move(w));
+    }
+    if (watched.empty()) {
+        fprintf(stderr, "runq: no containers to watch\n");
+        return EXIT_FAILURE;
+    }
+
+    // 2. Sample over the window
+    uint64_t host_some_first = 0, host_some_last = 0, unused;
+    read_psi_totals(AT_FDCWD, "/proc/pressure/cpu", host_some_first, unused);
+    for (Watched& w : watched) {
+        sample(w);
+    }
+    double start = monotonic_seconds();
+    double end = start + cfg.duration;
+    for (double now = start; now < end; now = monotonic_seconds()) {
+        usleep((useconds_t)(std::min((double)cfg.interval_ms / 1000, end - now) * 1e6));
+        for (Watched& w : watched) sample(w);
+    }
+    double seconds = monotonic_seconds() - start;
+    read_psi_totals(AT_FDCWD, "/proc/pressure/cpu", host_some_last, unused);
+    double host_some_pct = host_some_last >= host_some_first ? (host_some_last - host_some_first) / 1e4 / seconds : 0;
+
+    // 3. Report
+    if (cfg.json) printf("{\"seconds\":%.3f,\"host_cpu_some_pct\":%.2f,\"containers\":[", seconds, host_some_pct);
+    else printf("%-10s %6s %10s %6s  %-26s %14s %10s  %s\n", "CONTAINER", "CPU", "WAIT ms/s", "WAIT%",
+                "WAIT/SLICE p50/p90/p99/max", "THROTTLED", "CPU PSI%", "VERDICT");
+    bool first = true;
+    for (Watched& w : watched) {
+        Report r = analyze(w);
+        if (cfg.json) {
+            printf("%s{\"id\":\"%s\",\"exited\":%s,\"seconds\":%.3f,\"cpu_cores\":%.3f,\"wait_ms_per_s\":%.3f,\"wait_pct\":%.2f,"
+                   "\"wait_per_slice_us\":{\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"max\":%.1f},"
+                   "\"throttled_pct\":%.2f,\"throttled_ms_per_s\":%.3f,\"psi_some_pct\":%.2f,\"psi_full_pct\":%.2f,"
+                   "\"cpus_allowed\":%d,\"quota_cores\":%s,\"verdict\":\"%s\"}",
+                   first ? "" : ",", w.id.c_str(), w.gone ? "true" : "false", r.seconds, r.cpu_cores, r.wait_ms_per_s, r.wait_pct,
+                   r.p50, r.p90, r.p99, r.max, r.throttled_pct, r.throttled_ms_per_s, r.psi_some_pct, r.psi_full_pct,
+                   r.cpus, r.quota > 0 ? std::to_string(r.quota).c_str() : "null", r.verdict);
+        } else {
+            char slice[64], throttled[32], psi[32];
+            snprintf(slice, sizeof(slice), "%.2f/%.2f/%.2f/%.2fms", r.p50 / 1e3, r.p90 / 1e3, r.p99 / 1e3, r.max / 1e3);
+            snprintf(throttled, sizeof(throttled), "%.0f%% %.0fms/s", r.throttled_pct, r.throttled_ms_per_s);
+            snprintf(psi, sizeof(psi), "%.1f/%.1f", r.psi_some_pct, r.psi_full_pct);
+            printf("%-10s %6.2f %10.1f %6.1f  %-26s %14s %10s  %s%s\n", w.id.c_str(), r.cpu_cores, r.wait_ms_per_s,
+                   r.wait_pct, slice, throttled, psi, verdict_text(r, host_some_pct).c_str(), w.gone ? " (exited)" : "");
+        }
+        first = false;
+        close(w.cgfd);
+    }
+    if (cfg.json) printf("]}\n");
+    else printf("# %.1fs window; host cpu pressure (some) %.1f%%\n", seconds, host_some_pct);
+    return EXIT_SUCCESS;
+}
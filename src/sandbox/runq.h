@@ -0,0 +1,30 @@
+// neoshell/src/sandbox/runq.h
+#ifndef NSI_SANDBOX_RUNQ_H
+#define NSI_SANDBOX_RUNQ_H
+
+// Scheduler run-queue latency of containers (`nsi-sandbox runq`).
+//
+// CPU usage shows how much a container ran, not how long its runnable
+// threads sat waiting for a CPU, which is what adds to request latency.
+// Over a window this samples, per container:
+//
+//   /proc/<tid>/schedstat   time run, time waited on a run queue, and
+//                           timeslices, for every thread in cgroup.threads
+//   cpu.stat                usage, and periods throttled by cpu.max
+//   cpu.pressure            time some/all of its tasks were stalled on CPU
+//
+// and reports the wait rate, the wait per timeslice as percentiles (from
+// each thread's average in each interval, weighted by its timeslices), and
+// which of these explains the waiting:
+//
+//   quota       throttled by its own cpu.max: raise the quota
+//   cores       using all the CPUs it may run on: give it more cores
+//   contended   other work holds the CPUs: move it (or the other work)
+//
+// Rates are over each container's own samples with threads, first to last,
+// so one that starts or exits during the window is not averaged over time
+// it did not run ("seconds" in --json).
+
+int runq_main(int argc, char* argv[]);
+
+#endif // NSI_SANDBOX_RUNQ_H
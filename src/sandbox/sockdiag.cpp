@@ -0,0 +1,161 @@
+// neoshell/src/sandbox/sockdiag.cpp
+#include "sockdiag.h"
+#include "netlink.h"
+#include "utils.h"
+
+#include <set>
+#include <sstream>
+#include <unistd.h>
+#include <fcntl.h>          // For AT_FDCWD
+#include <dirent.h>         // For the /proc/<pid>/fd scan
+#include <arpa/inet.h>      // For ntohs
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>     // For IPPROTO_TCP
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+#include <linux/tcp.h>      // For struct tcp_info
+
+// Kernel TCP states (include/net/tcp_states.h); not exported by linux/tcp.h
+enum { NSI_TCP_ESTABLISHED = 1, NSI_TCP_LISTEN = 10 };
+static const char* const TCP_STATE_NAMES[13] = {
+    nullptr, "established", "syn_sent", "syn_recv", "fin_wait1", "fin_wait2", "time_wait",
+    "close", "close_wait", "last_ack", "listen", "closing", "new_syn_recv",
+};
+
+static bool same_netns(int pid) {
+    struct stat ours, theirs;
+    if (stat("/proc/self/ns/net", &ours) == -1) return false;
+    if (stat(("/proc/" + std::to_string(pid) + "/ns/net").c_str(), &theirs) == -1) return false;
+    return ours.st_dev == theirs.st_dev && ours.st_ino == theirs.st_ino;
+}
+
+// Inodes of all sockets held open by the processes of the container's cgroup.
+static std::set<uint32_t> cgroup_socket_inodes(const std::string& cgroup_id) {
+    std::set<uint32_t> inodes;
+    std::string procs;
+    if (!read_file_at(AT_FDCWD, (container_cgroup_path(cgroup_id) + "/cgroup.procs").c_str(), procs)) return inodes;
+    std::istringstream in(procs);
+    std::string pid;
+    while (in >> pid) {
+        std::string fd_dir = "/proc/" + pid + "/fd";
+        DIR* d = opendir(fd_dir.c_str());
+        if (!d) continue; // Exited meanwhile, or not ours to inspect
+        while (struct dirent* e = readdir(d)) {
+            char target[64];
+            ssize_t n = readlinkat(dirfd(d), e->d_name, target, sizeof(target) - 1);
+            if (n <= 0) continue;
+            target[n] = '\0';
+            unsigned long ino;
+            if (sscanf(target, "socket:[%lu]", &ino) == 1) inodes.insert((uint32_t)ino);
+        }
+        closedir(d);
+    }
+    return inodes;
+}
+
+// TcpExt counters from /proc/<pid>/net/netstat: a header line of names
+// followed by a line of values.
+static void read_tcpext(int pid, TcpStats& st) {
+    std::string text;
+    if (!read_file_at(AT_FDCWD, ("/proc/" + std::to_string(pid) + "/net/netstat").c_str(), text)) return;
+    std::istringstream in(text);
+    std::string names, values;
+    while (std::getline(in, names) && std::getline(in, values)) {
+        if (names.compare(0, 7, "TcpExt:") != 0) continue;
+        std::istringstream n(names.substr(7)), v(values.substr(7));
+        std::string name;
+        long long value;
+        while (n >> name && v >> value) {
+            if (name == "ListenOverflows") st.listen_overflows = value;
+            else if (name == "ListenDrops") st.listen_drops = value;
+        }
+        break;
+    }
+}
+
+static void account(const struct nlmsghdr* h, const std::set<uint32_t>* only, TcpStats& st) {
+    const struct inet_diag_msg* m = reinterpret_cast<const struct inet_diag_msg*>(NLMSG_DATA(h));
+    if (only && only->count(m->idiag_inode) == 0) return;
+    st.sockets++;
+    if (m->idiag_state < 13) st.states[m->idiag_state]++;
+
+    if (m->idiag_state == NSI_TCP_LISTEN) {
+        // For listeners rqueue is the accept queue length and wqueue its limit
+        st.listeners.push_back({ntohs(m->id.idiag_sport), m->idiag_rqueue, m->idiag_wqueue});
+        return;
+    }
+    if (m->idiag_state != NSI_TCP_ESTABLISHED) return;
+
+    const struct nlattr* tb[INET_DIAG_MAX + 1];
+    nl_parse(reinterpret_cast<const char*>(m) + NLMSG_ALIGN(sizeof(*m)), h->nlmsg_len - NLMSG_LENGTH(sizeof(*m)), tb, INET_DIAG_MAX);
+    if (!tb[INET_DIAG_INFO]) return;
+    struct tcp_info info;
+    memset(&info, 0, sizeof(info));
+    memcpy(&info, nl_data(tb[INET_DIAG_INFO]), std::min(sizeof(info), nl_len(tb[INET_DIAG_INFO])));
+    st.rtt_us_sum += info.tcpi_rtt;
+    if (info.tcpi_rtt > st.rtt_us_max) st.rtt_us_max = info.tcpi_rtt;
+    st.rtt_samples++;
+    st.retransmits += info.tcpi_total_retrans;
+    st.lost += info.tcpi_lost;
+    st.unacked += info.tcpi_unacked;
+}
+
+bool sockdiag_collect(int pid, const std::string& cgroup_id, TcpStats& st) {
+    std::set<uint32_t> owned;
+    st.private_netns = !same_netns(pid);
+    if (st.private_netns) {
+        read_tcpext(pid, st); // Readable from the host side, before switching namespaces
+        if (!enter_netns(pid)) return false;
+    } else {
+        owned = cgroup_socket_inodes(cgroup_id);
+    }
+
+    int nl = nl_open(NETLINK_SOCK_DIAG);
+    if (nl == -1) return false;
+    for (int family : {AF_INET, AF_INET6}) {
+        NlMsg msg(SOCK_DIAG_BY_FAMILY, 0);
+        struct inet_diag_req_v2 req;
+        memset(&req, 0, sizeof(req));
+        req.sdiag_family = family;
+        req.sdiag_protocol = IPPROTO_TCP;
+        req.idiag_ext = 1 << (INET_DIAG_INFO - 1);
+        req.idiag_states = ~0U; // All states
+        msg.put_header(&req, sizeof(req));
+        int rc = nl_dump(nl, msg, [&](const struct nlmsghdr* h) {
+            account(h, st.private_netns ? nullptr : &owned, st);
+        });
+        if (rc != 0 && !(family == AF_INET6 && rc == -ENOENT)) { // IPv6 may be disabled
+            close(nl);
+            errno = -rc;
+            return false;
+        }
+    }
+    close(nl);
+    return true;
+}
+
+void sockdiag_json(const TcpStats& st, std::string& out) {
+    auto opt = [](int64_t v) { return v < 0 ? std::string("null") : std::to_string(v); };
+    out += "{\"private_netns\":" + std::string(st.private_netns ? "true" : "false");
+    out += ",\"sockets\":" + std::to_string(st.sockets) + ",\"states\":{";
+    bool first = true;
+    for (int s = 1; s < 13; ++s) {
+        if (st.states[s] == 0) continue;
+        out += std::string(first ? "" : ",") + "\"" + TCP_STATE_NAMES[s] + "\":" + std::to_string(st.states[s]);
+        first = false;
+    }
+    out += "},\"listeners\":[";
+    for (size_t i = 0; i < st.listeners.size(); ++i) {
+        const TcpListener& l = st.listeners[i];
+        out += std::string(i ? "," : "") + "{\"port\":" + std::to_string(l.port) + ",\"backlog\":" +
+               std::to_string(l.backlog) + ",\"max_backlog\":" + std::to_string(l.max_backlog) + "}";
+    }
+    out += "],\"rtt_us_avg\":" + (st.rtt_samples ? std::to_string(st.rtt_us_sum / st.rtt_samples) : std::string("null"));
+    out += ",\"rtt_us_max\":" + (st.rtt_samples ? std::to_string(st.rtt_us_max) : std::string("null"));
+    out += ",\"retransmits\":" + std::to_string(st.retransmits);
+    out += ",\"lost\":" + std::to_string(st.lost);
+    out += ",\"unacked\":" + std::to_string(st.unacked);
+    out += ",\"listen_overflows\":" + opt(st.listen_overflows);
+    out += ",\"listen_drops\":" + opt(st.listen_drops) + "}";
+}
@@ -0,0 +1,47 @@
+// neoshell/src/sandbox/sockdiag.h
+#ifndef NSI_SANDBOX_SOCKDIAG_H
+#define NSI_SANDBOX_SOCKDIAG_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// TCP socket statistics of one container, from NETLINK_SOCK_DIAG.
+//
+// With a private network namespace every TCP socket in it belongs to the
+// container, and the namespace's TcpExt counters (listen queue overflows)
+// are the container's own. When the host namespace is shared, only sockets
+// held open by processes of the container's cgroup are counted and the
+// namespace-wide counters are not reported.
+
+struct TcpListener {
+    uint16_t port;
+    uint32_t backlog;     // Connections waiting in the accept queue
+    uint32_t max_backlog; // listen() backlog
+};
+
+struct TcpStats {
+    bool private_netns = false;
+    uint32_t sockets = 0;
+    uint32_t states[13] = {};  // Indexed by kernel TCP state (1 = established, 10 = listen, ...)
+    std::vector<TcpListener> listeners;
+    // Over established connections
+    uint64_t rtt_us_sum = 0;
+    uint32_t rtt_us_max = 0;
+    uint32_t rtt_samples = 0;
+    uint64_t retransmits = 0;  // tcpi_total_retrans
+    uint64_t lost = 0;         // Segments currently considered lost
+    uint64_t unacked = 0;
+    // TcpExt counters of the namespace (-1 when not available)
+    int64_t listen_overflows = -1;
+    int64_t listen_drops = -1;
+};
+
+// Collects stats for the container whose (host) PID is pid. Must run before
+// anything else that depends on the current network namespace, as it may
+// join the container's. False on error (errno set).
+bool sockdiag_collect(int pid, const std::string& cgroup_id, TcpStats& out);
+// Appends out as a JSON object.
+void sockdiag_json(const TcpStats& st, std::string& out);
+
+#endif // NSI_SANDBOX_SOCKDIAG_H
@@ -0,0 +1,400 @@
+// neoshell/src/sandbox/state.cpp
+#include "state.h"
+#include "utils.h"
+
+#include <set>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>       // For listing state files and cgroups
+#include <getopt.h>
+#include <poll.h>
+#include <sys/file.h>     // For flock
+#include <sys/mman.h>     // For mmap
+#include <sys/stat.h>
+#include <sys/syscall.h>  // For SYS_pidfd_open, SYS_pidfd_getfd
+
+static const int CGROUP_EMPTY_TIMEOUT_MS = 5000; // Init is gone; the rest of its PID namespace follows
+
+static std::string containers_dir() {
+    return runtime_dir() + "/containers";
+}
+
+static bool state_valid_id(const std::string& id) {
+    return !id.empty() && id.size() < sizeof(((struct nsi_state*)nullptr)->id) && id[0] != '.' && id.find('/') == std::string::npos;
+}
+
+static std::string state_tmp_name(const std::string& id) {
+    return "." + id + ".tmp"; // Starts with '.', so ls and adopt skip it
+}
+
+// --- Writing (nsi-sandbox) ---
+
+// A new read-only description of the pipe behind fd, or -1 if fd is not a
+// pipe (a terminal or file needs no keeping alive).
+static int pipe_read_end(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISFIFO(st.st_mode)) return -1;
+    int r = open(("/proc/self/fd/" + std::to_string(fd)).c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (r != -1) fcntl(r, F_SETFL, 0); // Shared with the adopter, which expects blocking reads
+    return r;
+}
+
+static bool same_file(int a, int b) {
+    struct stat sa, sb;
+    return fstat(a, &sa) == 0 && fstat(b, &sb) == 0 && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+void state_create(StateFile& sf, const std::string& container_id, const std::string& rootfs) {
+    std::string dir = containers_dir();
+    if (!state_valid_id(container_id)) {
+        log_msg(("Warning: no state file for container id '" + container_id + "' (too long or not a file name); it cannot be adopted").c_str());
+        return;
+    }
+    // 1. The record, mapped; unnamed until init exists (O_TMPFILE), so a
+    //    launch that fails before then leaves nothing behind
+    if (mkdir(dir.c_str(), 0700) == -1 && errno != EEXIST) {
+        log_msg(("Warning: mkdir " + dir + " failed, the container cannot be adopted: " + std::string(strerror(errno))).c_str());
+        return;
+    }
+    std::string tmp = state_tmp_name(container_id);
+    sf.dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    sf.proc_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    sf.fd = sf.dir_fd == -1 ? -1 : openat(sf.dir_fd, ".", O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    sf.unnamed = sf.fd != -1;
+    if (sf.fd == -1 && sf.dir_fd != -1) {
+        // Filesystems without O_TMPFILE: a temporary name instead
+        sf.fd = openat(sf.dir_fd, tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    }
+    void* map = MAP_FAILED;
+    if (sf.fd != -1 && sf.proc_fd != -1 && ftruncate(sf.fd, sizeof(struct nsi_state)) == 0) {
+        map = mmap(nullptr, sizeof(struct nsi_state), PROT_READ | PROT_WRITE, MAP_SHARED, sf.fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        log_msg(("Warning: could not create the state file in " + dir + ", the container cannot be adopted: " + std::string(strerror(errno))).c_str());
+        if (sf.fd != -1 && !sf.unnamed) unlinkat(sf.dir_fd, tmp.c_str(), 0);
+        state_release(sf);
+        return;
+    }
+    sf.st = static_cast<struct nsi_state*>(map); // Zero-filled by ftruncate
+
+    // 2. Who we are and who started us; init is filled in by state_publish()
+    struct nsi_state* st = sf.st;
+    unsigned long long start = 0;
+    st->exit_code = NSI_STATE_RUNNING;
+    st->init_pid = -1;
+    st->waiter_pid = getpid();
+    if (proc_start_ticks(st->waiter_pid, start)) st->waiter_start = start;
+    st->launcher_pid = getppid();
+    if (proc_start_ticks(st->launcher_pid, start)) st->launcher_start = start;
+    snprintf(st->id, sizeof(st->id), "%s", container_id.c_str());
+    snprintf(st->cgroup, sizeof(st->cgroup), "%s", container_cgroup_path(container_id).c_str());
+    if (rootfs.size() < sizeof(st->rootfs)) snprintf(st->rootfs, sizeof(st->rootfs), "%s", rootfs.c_str());
+
+    // 3. Keep the output pipes open for an adopter if the launcher goes away
+    st->out_fd = pipe_read_end(STDOUT_FILENO);
+    st->err_fd = st->out_fd != -1 && same_file(STDOUT_FILENO, STDERR_FILENO) ? st->out_fd : pipe_read_end(STDERR_FILENO);
+    st->dir_fd = sf.dir_fd;
+    st->version = NSI_STATE_VERSION;
+    st->magic = NSI_STATE_MAGIC;
+    log_msg(("-> State file: " + dir + "/" + container_id + " (re-attach with: nsi-sandbox adopt " + container_id + ")").c_str());
+}
+
+void state_publish(StateFile& sf, pid_t init_pid) {
+    if (!sf.st) return;
+    // Through our /proc fd: the container's pivot_root may already have moved ours
+    unsigned long long start = 0;
+    if (!proc_start_ticks(init_pid, start, sf.proc_fd)) {
+        log_msg(("Warning: could not read the start time of PID " + std::to_string(init_pid) + ": " + std::string(strerror(errno))).c_str());
+    }
+    sf.st->init_start = start;
+    sf.st->init_pid = init_pid;
+    int rc;
+    if (sf.unnamed) {
+        unlinkat(sf.dir_fd, sf.st->id, 0); // Left by an earlier container with this id
+        rc = linkat(sf.proc_fd, ("self/fd/" + std::to_string(sf.fd)).c_str(), sf.dir_fd, sf.st->id, AT_SYMLINK_FOLLOW);
+    } else {
+        rc = renameat(sf.dir_fd, state_tmp_name(sf.st->id).c_str(), sf.dir_fd, sf.st->id);
+    }
+    if (rc == -1) {
+        log_msg(("Warning: could not publish the state file: " + std::string(strerror(errno))).c_str());
+    }
+    close(sf.proc_fd);
+    sf.proc_fd = -1;
+    // Inherited by nsi-waiter, which finds them in the record
+    for (int fd : {sf.fd, sf.dir_fd, sf.st->out_fd, sf.st->err_fd}) {
+        if (fd != -1) fcntl(fd, F_SETFD, 0);
+    }
+}
+
+void state_release(StateFile& sf) {
+    if (sf.st) {
+        if (sf.st->out_fd != -1) close(sf.st->out_fd);
+        if (sf.st->err_fd != -1 && sf.st->err_fd != sf.st->out_fd) close(sf.st->err_fd);
+        munmap(sf.st, sizeof(struct nsi_state));
+        sf.st = nullptr;
+    }
+    for (int* fd : {&sf.fd, &sf.dir_fd, &sf.proc_fd}) {
+        if (*fd != -1) close(*fd);
+        *fd = -1;
+    }
+}
+
+void state_exit(StateFile& sf, int code) {
+    if (!sf.st) return;
+    __atomic_store_n(&sf.st->exit_code, code, __ATOMIC_RELEASE);
+    // Our launcher gets the status from us; an orphan's waits for its adopter
+    if (getppid() == sf.st->launcher_pid) unlinkat(sf.dir_fd, sf.st->id, 0);
+    state_release(sf);
+}
+
+// --- Adopting (nsi-sandbox adopt) ---
+
+static bool still_running(int pid, uint64_t start) {
+    unsigned long long now = 0;
+    return pid > 0 && proc_start_ticks(pid, now) && now == start;
+}
+
+// Maps a state file read-only; nullptr if it is not one of this version's.
+static const struct nsi_state* state_map(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(struct nsi_state)) return nullptr;
+    void* map = mmap(nullptr, sizeof(struct nsi_state), PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) return nullptr;
+    const struct nsi_state* s = static_cast<const struct nsi_state*>(map);
+    if (s->magic != NSI_STATE_MAGIC || s->version != NSI_STATE_VERSION) {
+        munmap(map, sizeof(struct nsi_state));
+        return nullptr;
+    }
+    return s;
+}
+
+// "attached" (its launcher still waits), "orphaned", "exited:<status>", or
+// "gone" (exited without a waiter to record the status).
+static std::string container_status(const struct nsi_state* s) {
+    int code = __atomic_load_n(&s->exit_code, __ATOMIC_ACQUIRE);
+    if (code == NSI_STATE_RUNNING) {
+        if (still_running(s->waiter_pid, s->waiter_start)) {
+            return still_running(s->launcher_pid, s->launcher_start) ? "attached" : "orphaned";
+        }
+        if (still_running(s->init_pid, s->init_start)) return "orphaned";
+        code = __atomic_load_n(&s->exit_code, __ATOMIC_ACQUIRE); // The waiter may just have finished
+        if (code == NSI_STATE_RUNNING) return "gone";
+    }
+    return "exited:" + std::to_string(code);
+}
+
+// The container's init in cgroup id (PID 1 innermost in its NSpid), -1 if none.
+static int cgroup_init_pid(const std::string& id) {
+    std::string procs;
+    if (!read_file_at(AT_FDCWD, (container_cgroup_path(id) + "/cgroup.procs").c_str(), procs)) return -1;
+    for (const char* p = procs.c_str(); *p;) {
+        int pid = atoi(p);
+        std::string status;
+        if (pid > 0 && read_file_at(AT_FDCWD, ("/proc/" + std::to_string(pid) + "/status").c_str(), status)) {
+            size_t line = status.find("\nNSpid:");
+            size_t end = line == std::string::npos ? line : status.find('\n', line + 1);
+            size_t last = end == std::string::npos ? end : status.find_last_of(" \t", end);
+            if (last != std::string::npos && last > line && status.compare(last + 1, end - last - 1, "1") == 0) return pid;
+        }
+        const char* nl = strchr(p, '\n');
+        if (!nl) break;
+        p = nl + 1;
+    }
+    return -1;
+}
+
+static int adopt_ls() {
+    std::set<std::string> listed;
+    DIR* d = opendir(containers_dir().c_str());
+    while (d) {
+        struct dirent* e = readdir(d);
+        if (!e) break;
+        if (e->d_name[0] == '.') continue; // ".", ".." and unpublished files
+        int fd = openat(dirfd(d), e->d_name, O_RDONLY | O_CLOEXEC);
+        const struct nsi_state* s = fd == -1 ? nullptr : state_map(fd);
+        if (fd != -1) close(fd);
+        if (!s) {
+            // Another runtime version's: adopt treats the container as untracked
+            int pid = cgroup_init_pid(e->d_name);
+            if (pid != -1) printf("%s\tuntracked\t%d\t-\n", e->d_name, pid);
+            else printf("%s\tunknown-version\t-\t-\n", e->d_name);
+            listed.insert(e->d_name);
+            continue;
+        }
+        printf("%s\t%s\t%d\t%s\n", s->id, container_status(s).c_str(), s->init_pid, s->rootfs[0] ? s->rootfs : "-");
+        listed.insert(s->id);
+        munmap(const_cast<struct nsi_state*>(s), sizeof(struct nsi_state));
+    }
+    if (d) closedir(d);
+    // Running containers without a state file (started by an older runtime)
+    d = opendir(NSI_CGROUP_ROOT);
+    while (d) {
+        struct dirent* e = readdir(d);
+        if (!e) break;
+        if (e->d_type != DT_DIR || e->d_name[0] == '.' || listed.count(e->d_name)) continue;
+        int pid = cgroup_init_pid(e->d_name);
+        if (pid != -1) printf("%s\tuntracked\t%d\t-\n", e->d_name, pid);
+    }
+    if (d) closedir(d);
+    return EXIT_SUCCESS;
+}
+
+// Our own read end of the pipe the waiter keeps as fd; -1 if it has none
+// or it cannot be taken.
+static int take_pipe(int pidfd, int pid, int fd) {
+    if (fd < 0) return -1;
+    int got = syscall(SYS_pidfd_getfd, pidfd, fd, 0);
+    if (got == -1) {
+        // Linux < 5.6, or ptrace attach limited to descendants (Yama): opening
+        // the pipe through /proc only needs read access to the waiter
+        got = open(("/proc/" + std::to_string(pid) + "/fd/" + std::to_string(fd)).c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    }
+    return got;
+}
+
+static void write_out(int fd, const char* p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w == -1 && errno == EINTR) continue;
+        if (w <= 0) return; // Our own output is gone; keep draining the container's
+        p += w;
+        n -= w;
+    }
+}
+
+// Copies the container's output to ours until the process behind pidfd has
+// exited and nothing writes to the pipes any more.
+static void relay_until_exit(int pidfd, int out, int err) {
+    static char buf[65536];
+    bool exited = false;
+    while (!exited || out != -1 || err != -1) {
+        struct pollfd fds[3] = {{out, POLLIN, 0}, {err, POLLIN, 0}, {exited ? -1 : pidfd, POLLIN, 0}};
+        if (poll(fds, 3, -1) == -1) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        if (fds[2].revents) exited = true;
+        int* ends[2] = {&out, &err};
+        for (int i = 0; i < 2; ++i) {
+            if (!fds[i].revents) continue;
+            ssize_t n = read(*ends[i], buf, sizeof(buf));
+            if (n > 0) {
+                write_out(i == 0 ? STDOUT_FILENO : STDERR_FILENO, buf, n);
+            } else if (n == 0 || (errno != EINTR && errno != EAGAIN)) {
+                close(*ends[i]);
+                *ends[i] = -1;
+            }
+        }
+    }
+}
+
+// Waits until the rest of the container's PID namespace is gone, then
+// removes its cgroup.
+static void remove_cgroup(const std::string& path) {
+    int rc;
+    for (int waited = 0; (rc = rmdir(path.c_str())) == -1 && errno == EBUSY && waited < CGROUP_EMPTY_TIMEOUT_MS; waited += 100) {
+        usleep(100000);
+    }
+    if (rc == -1 && errno != ENOENT) {
+        log_msg(("Warning: could not remove cgroup " + path + ": " + std::string(strerror(errno))).c_str());
+    }
+}
+
+// A container found only through its cgroup: we can wait for it and clean
+// up, but its output and exit status went with its launcher.
+static int adopt_untracked(const std::string& id) {
+    int pid = cgroup_init_pid(id);
+    int pidfd = pid == -1 ? -1 : syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd == -1 || cgroup_init_pid(id) != pid) {
+        dprintf(log_fd(), "No container %s to adopt (no usable state file, and no running container in its cgroup)\n", id.c_str());
+        return EXIT_FAILURE;
+    }
+    log_msg(("Adopted container " + id + " (init PID " + std::to_string(pid) + "), untracked: its output and exit status are not available").c_str());
+    relay_until_exit(pidfd, -1, -1);
+    close(pidfd);
+    remove_cgroup(container_cgroup_path(id));
+    log_msg(("Container " + id + " exited").c_str());
+    return EXIT_FAILURE;
+}
+
+static int adopt(const std::string& id, bool force) {
+    int dir_fd = open(containers_dir().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int fd = dir_fd == -1 ? -1 : openat(dir_fd, id.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return adopt_untracked(id);
+    const struct nsi_state* s = state_map(fd);
+    if (!s) {
+        // Written by another runtime version: the container can still be
+        // followed through its cgroup, like one without a state file
+        close(fd);
+        log_msg(("Warning: " + containers_dir() + "/" + id + " is not a state file of this runtime version; adopting the container as untracked").c_str());
+        int rc = adopt_untracked(id);
+        // Its container is gone now (or was already): free the id, and ls of it
+        unlinkat(dir_fd, id.c_str(), 0);
+        close(dir_fd);
+        return rc;
+    }
+    // One adopter at a time; the lock goes with us
+    if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+        dprintf(log_fd(), "Container %s is already being adopted\n", id.c_str());
+        return EXIT_FAILURE;
+    }
+    std::string status = container_status(s);
+    if (status == "attached" && !force) {
+        dprintf(log_fd(), "Container %s is still attached to its launcher (PID %d); use --force to adopt it anyway\n", id.c_str(), s->launcher_pid);
+        return EXIT_FAILURE;
+    }
+
+    // 1. Follow the waiter while it exists (it records the status), else init
+    if (status == "attached" || status == "orphaned") {
+        bool waiter = still_running(s->waiter_pid, s->waiter_start);
+        int pid = waiter ? s->waiter_pid : s->init_pid;
+        int pidfd = syscall(SYS_pidfd_open, pid, 0);
+        // The pidfd pins the process; check it is still the one recorded
+        if (pidfd != -1 && still_running(pid, waiter ? s->waiter_start : s->init_start)) {
+            int out = waiter ? take_pipe(pidfd, pid, s->out_fd) : -1;
+            int err = waiter && s->err_fd != s->out_fd ? take_pipe(pidfd, pid, s->err_fd) : -1;
+            std::string note = waiter ? "" : ", its waiter is gone: no output or exit status";
+            if (waiter && s->out_fd != -1 && out == -1) note = ", its output could not be taken: " + std::string(strerror(errno));
+            log_msg(("Adopted container " + id + " (init PID " + std::to_string(s->init_pid) + note + ")").c_str());
+            relay_until_exit(pidfd, out, err);
+        }
+        if (pidfd != -1) close(pidfd);
+    }
+
+    // 2. Collect the status and clean up after it
+    int code = __atomic_load_n(&s->exit_code, __ATOMIC_ACQUIRE);
+    remove_cgroup(s->cgroup);
+    unlinkat(dir_fd, id.c_str(), 0);
+    if (code == NSI_STATE_RUNNING) {
+        log_msg(("Container " + id + " exited; its exit status was lost with its waiter").c_str());
+        return EXIT_FAILURE;
+    }
+    log_msg(("Container " + id + " exited with status " + std::to_string(code)).c_str());
+    return code;
+}
+
+static void usage() {
+    fprintf(stderr, "Usage: nsi-sandbox adopt ls | <container-id> [--force]\n");
+    exit(EXIT_FAILURE);
+}
+
+int adopt_main(int argc, char* argv[]) {
+    bool force = false;
+    struct option long_options[] = {
+        {"force", no_argument, 0, 'f'},
+        {0, 0, 0, 0}
+    };
+    optind = 1;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "f", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'f': force = true; break;
+            default: usage();
+        }
+    }
+    if (optind != argc - 1) usage();
+    std::string id = argv[optind];
+    if (id == "ls" && !force) return adopt_ls();
+    if (!state_valid_id(id)) usage();
+    return adopt(id, force);
+}
@@ -0,0 +1,88 @@
+// neoshell/src/sandbox/state.h
+#ifndef NSI_SANDBOX_STATE_H
+#define NSI_SANDBOX_STATE_H
+
+#include <stdint.h>
+
+// Container state files, and re-adopting running containers whose launcher
+// (`nsi run`, a supervisor) died or was replaced by a newer runtime.
+//
+// Each container has <runtime_dir>/containers/<id>: one fixed-size record,
+// mapped shared by nsi-sandbox while it starts the container and then by
+// nsi-waiter, which stores the container's exit status in it. The waiter
+// also keeps a read end of each stdout/stderr pipe (when those are pipes),
+// so the container's output survives its launcher: writes block once the
+// pipe is full instead of killing the app with SIGPIPE, until an adopter
+// reads them again.
+//
+// `nsi-sandbox adopt <id>` re-attaches: it takes the waiter (or, without
+// one, the container init) by pidfd, takes the output pipes with
+// pidfd_getfd, relays the output until the container exits, exits with its
+// status, and removes its cgroup and state file. `adopt ls` lists state
+// files, plus populated cgroups under NSI_CGROUP_ROOT that have none
+// (containers started by an older runtime). A state file of another
+// runtime version is listed and adopted the same way, through the cgroup
+// ("unknown-version" once nothing runs there; adopting it then removes
+// the file). Nothing about the running
+// container changes, so the runtime can be upgraded under it.
+//
+// When the container exits while its launcher is still waiting, the waiter
+// removes the state file itself; otherwise it stays, with the exit status,
+// until an adopter collects it.
+
+#define NSI_STATE_MAGIC 0x7473736eu // "nsst"
+#define NSI_STATE_VERSION 1         // Bump on any layout change
+#define NSI_STATE_RUNNING (-1)      // exit_code until the container exits
+
+// PIDs are host PIDs; *_start are their start times in clock ticks since
+// boot (see proc_start_ticks), which tell them apart from reused PIDs.
+struct nsi_state {
+    uint32_t magic;
+    uint32_t version;
+    int32_t exit_code;      // Written once by the waiter: status, or 128 + signal
+    int32_t init_pid;       // Container init
+    int32_t waiter_pid;     // nsi-sandbox's parent, later nsi-waiter (same process)
+    int32_t launcher_pid;   // nsi-sandbox's own parent
+    uint64_t init_start;
+    uint64_t waiter_start;
+    uint64_t launcher_start;
+    int32_t out_fd;         // In the waiter: read end of the stdout pipe, or -1
+    int32_t err_fd;         // Same for stderr (== out_fd if they share a pipe)
+    int32_t dir_fd;         // In the waiter: the containers directory
+    int32_t reserved;
+    char id[64];
+    char cgroup[256];       // Host path of the container's cgroup
+    char rootfs[4096];      // Host path of the rootfs; empty for --rootfs-tmpfs
+};
+
+#ifdef __cplusplus
+#include <string>
+#include <sys/types.h>
+
+struct StateFile {
+    int fd = -1;      // The state file (unnamed, or under a temporary name, until published)
+    bool unnamed = false; // fd is an O_TMPFILE
+    int dir_fd = -1;  // <runtime_dir>/containers
+    int proc_fd = -1; // Host /proc: the parent shares the container's mount
+                      // namespace, so its paths move with pivot_root
+    struct nsi_state* st = nullptr;
+};
+
+// Creates the (not yet visible) state file and the output pipes' read
+// ends. Call after the helpers are forked and before any namespace exists.
+// Best effort: on failure the container runs, but cannot be adopted.
+void state_create(StateFile& sf, const std::string& container_id, const std::string& rootfs);
+// In the sandbox parent after forking init: completes the record and
+// publishes it; its descriptors are then inherited by nsi-waiter.
+void state_publish(StateFile& sf, pid_t init_pid);
+// In the container init: drops the sandbox's descriptors.
+void state_release(StateFile& sf);
+// In the sandbox parent when it waits in-process (no nsi-waiter): records
+// the exit status, as the waiter would.
+void state_exit(StateFile& sf, int code);
+
+// `nsi-sandbox adopt ls | <container-id> [--force]`
+int adopt_main(int argc, char* argv[]);
+#endif
+
+#endif // NSI_SANDBOX_STATE_H
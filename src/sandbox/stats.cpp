@@ -0,0 +1,79 @@
+// neoshell/src/sandbox/stats.cpp
+#include "stats.h"
+#include "logfwd.h"
+#include "reclaim.h"
+#include "sockdiag.h"
+#include "utils.h"
+
+#include <sstream>
+#include <unistd.h>
+#include <fcntl.h>  // For open
+#include <sys/xattr.h> // For the working-set estimate
+
+// A single-value cgroup file ("max" and missing files become null).
+static std::string cg_value(int cgfd, const char* name) {
+    std::string s;
+    if (!read_file_at(cgfd, name, s)) return "null";
+    while (!s.empty() && (s.back() == '\n' || s.back() == ' ')) s.pop_back();
+    if (s.empty() || s == "max") return "null";
+    return s;
+}
+
+// Selected "key value" lines of a flat-keyed cgroup file, as JSON members.
+static void cg_keyed(int cgfd, const char* name, std::initializer_list<const char*> keys, std::string& out) {
+    std::string s;
+    bool have = read_file_at(cgfd, name, s);
+    for (const char* key : keys) {
+        std::string value = "null";
+        if (have) {
+            std::istringstream in(s);
+            std::string k, v;
+            while (in >> k >> v) {
+                if (k == key) { value = v; break; }
+            }
+        }
+        out += ",\"" + std::string(key) + "\":" + value;
+    }
+}
+
+int stats_main(int argc, char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: nsi-sandbox stats <container-id>\n");
+        return EXIT_FAILURE;
+    }
+    std::string id = argv[1];
+    errno = 0;
+    int pid = container_pid(id);
+    if (pid == -1) die(("No running container with id " + id).c_str());
+
+    // 1. Cgroup counters (read first: joining the container's namespaces
+    //    below may change what we are allowed to open)
+    int cgfd = open(container_cgroup_path(id).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cgfd == -1) die("open container cgroup failed");
+    std::string out = "{\"id\":";
+    append_json_string(out, id.data(), id.size()); // Any id the cgroup path allows
+    out += ",\"cgroup\":{";
+    out += "\"memory_current\":" + cg_value(cgfd, "memory.current");
+    out += ",\"memory_max\":" + cg_value(cgfd, "memory.max");
+    char wss[32];
+    ssize_t n = fgetxattr(cgfd, NSI_WSS_XATTR, wss, sizeof(wss) - 1); // Set by `nsi-sandbox reclaim`
+    out += ",\"working_set\":" + (n > 0 ? std::string(wss, n) : std::string("null"));
+    cg_keyed(cgfd, "memory.events", {"oom", "oom_kill"}, out);
+    cg_keyed(cgfd, "cpu.stat", {"usage_usec", "nr_throttled", "throttled_usec"}, out);
+    out += ",\"pids_current\":" + cg_value(cgfd, "pids.current") + "}";
+    close(cgfd);
+
+    // 2. TCP sockets
+    TcpStats tcp;
+    errno = 0;
+    if (sockdiag_collect(pid, id, tcp)) {
+        out += ",\"tcp\":";
+        sockdiag_json(tcp, out);
+    } else {
+        log_msg(("Warning: TCP socket stats unavailable: " + std::string(strerror(errno))).c_str());
+        out += ",\"tcp\":null";
+    }
+    out += "}\n";
+    fputs(out.c_str(), stdout);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,13 @@
+// neoshell/src/sandbox/stats.h
+#ifndef NSI_SANDBOX_STATS_H
+#define NSI_SANDBOX_STATS_H
+
+// `nsi-sandbox stats <container-id>`: one JSON object with the running
+// container's resource usage, from the host side:
+//
+//   "cgroup": memory, cpu and pids counters of the container's cgroup, plus
+//             the working-set estimate of `nsi-sandbox reclaim` if it runs
+//   "tcp":    socket states, listen queues, rtt and retransmits (sock_diag)
+int stats_main(int argc, char* argv[]);
+
+#endif // NSI_SANDBOX_STATS_H
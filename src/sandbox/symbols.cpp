@@ -0,0 +1,227 @@
+// neoshell/src/sandbox/symbols.cpp
+#include "symbols.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cxxabi.h>       // For abi::__cxa_demangle
+#include <elf.h>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>     // For mapping ELF files
+#include <sys/stat.h>
+
+struct SymbolResolver::ElfFile {
+    struct Load {
+        uint64_t offset, filesz, vaddr; // PT_LOAD: file range and where it is linked
+    };
+    struct Symbol {
+        uint64_t addr, size;
+        std::string name;
+        bool demangled = false;
+    };
+    std::string name; // Basename, for "[file]" frames
+    std::vector<Load> loads;
+    std::vector<Symbol> symbols; // Functions, sorted by address
+};
+
+SymbolResolver::SymbolResolver() = default;
+SymbolResolver::~SymbolResolver() = default;
+
+static std::string basename_of(const std::string& path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+SymbolResolver::ElfFile* SymbolResolver::load_elf(int pid, const std::string& path) {
+    std::string host_path = "/proc/" + std::to_string(pid) + "/root" + path;
+    int fd = open(host_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return nullptr;
+    }
+    // Shared libraries are usually the same file in every process
+    auto key = std::make_pair(st.st_dev, st.st_ino);
+    auto it = files_.find(key);
+    if (it != files_.end()) {
+        close(fd);
+        return it->second.get();
+    }
+    std::unique_ptr<ElfFile> elf(new ElfFile());
+    elf->name = basename_of(path);
+    void* map = st.st_size > 0 ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    bool ok = false;
+    if (map != MAP_FAILED) {
+        ok = parse_elf(static_cast<const unsigned char*>(map), st.st_size, *elf);
+        munmap(map, st.st_size);
+    }
+    // Remembered either way, so a non-ELF file is only tried once
+    ElfFile* result = ok ? elf.get() : nullptr;
+    files_[key] = ok ? std::move(elf) : nullptr;
+    return result;
+}
+
+bool SymbolResolver::parse_elf(const unsigned char* p, size_t size, ElfFile& elf) {
+    if (size < sizeof(Elf64_Ehdr) || memcmp(p, ELFMAG, SELFMAG) != 0 || p[EI_CLASS] != ELFCLASS64) return false;
+    const Elf64_Ehdr* eh = reinterpret_cast<const Elf64_Ehdr*>(p);
+    auto in_file = [size](uint64_t off, uint64_t len) { return off <= size && len <= size - off; };
+
+    // 1. Program headers: file offset -> link-time address
+    if (!in_file(eh->e_phoff, (uint64_t)eh->e_phnum * sizeof(Elf64_Phdr))) return false;
+    const Elf64_Phdr* ph = reinterpret_cast<const Elf64_Phdr*>(p + eh->e_phoff);
+    for (int i = 0; i < eh->e_phnum; ++i) {
+        if (ph[i].p_type == PT_LOAD) elf.loads.push_back({ph[i].p_offset, ph[i].p_filesz, ph[i].p_vaddr});
+    }
+
+    // 2. Function symbols: .symtab if present, else .dynsym
+    if (eh->e_shentsize != sizeof(Elf64_Shdr) || !in_file(eh->e_shoff, (uint64_t)eh->e_shnum * sizeof(Elf64_Shdr))) {
+        return !elf.loads.empty();
+    }
+    const Elf64_Shdr* sh = reinterpret_cast<const Elf64_Shdr*>(p + eh->e_shoff);
+    const Elf64_Shdr* table = nullptr;
+    for (int i = 0; i < eh->e_shnum; ++i) {
+        if (sh[i].sh_type == SHT_SYMTAB) table = &sh[i];
+        else if (sh[i].sh_type == SHT_DYNSYM && !table) table = &sh[i];
+    }
+    if (table && table->sh_link < eh->e_shnum && in_file(table->sh_offset, table->sh_size)) {
+        const Elf64_Shdr& strtab = sh[table->sh_link];
+        if (in_file(strtab.sh_offset, strtab.sh_size)) {
+            const char* strs = reinterpret_cast<const char*>(p + strtab.sh_offset);
+            const Elf64_Sym* syms = reinterpret_cast<const Elf64_Sym*>(p + table->sh_offset);
+            size_t count = table->sh_size / sizeof(Elf64_Sym);
+            for (size_t i = 0; i < count; ++i) {
+                int type = ELF64_ST_TYPE(syms[i].st_info);
+                if ((type != STT_FUNC && type != STT_GNU_IFUNC) || syms[i].st_shndx == SHN_UNDEF || syms[i].st_value == 0) continue;
+                if (syms[i].st_name >= strtab.sh_size) continue;
+                const char* name = strs + syms[i].st_name;
+                size_t len = strnlen(name, strtab.sh_size - syms[i].st_name);
+                if (len == 0 || len == strtab.sh_size - syms[i].st_name) continue;
+                elf.symbols.push_back({syms[i].st_value, syms[i].st_size, std::string(name, len)});
+            }
+        }
+    }
+    std::sort(elf.symbols.begin(), elf.symbols.end(),
+              [](const ElfFile::Symbol& a, const ElfFile::Symbol& b) { return a.addr < b.addr; });
+    return !elf.loads.empty();
+}
+
+bool SymbolResolver::add_process(int pid) {
+    std::string proc = "/proc/" + std::to_string(pid);
+    std::ifstream maps(proc + "/maps");
+    if (!maps) return false;
+    Process& p = procs_[pid];
+    p = Process();
+    std::string line;
+    while (std::getline(maps, line)) {
+        // start-end perms offset dev inode [path]
+        unsigned long long start, end, offset;
+        char perms[5];
+        int path_at = 0;
+        if (sscanf(line.c_str(), "%llx-%llx %4s %llx %*s %*s %n", &start, &end, perms, &offset, &path_at) < 4) continue;
+        if (perms[2] != 'x') continue;
+        std::string path = path_at > 0 ? line.substr(path_at) : "";
+        Mapping m = {start, end, offset, path, nullptr};
+        if (!path.empty() && path[0] == '/' && path.find(" (deleted)") == std::string::npos) m.elf = load_elf(pid, path);
+        p.maps.push_back(m);
+    }
+    std::sort(p.maps.begin(), p.maps.end(), [](const Mapping& a, const Mapping& b) { return a.start < b.start; });
+
+    // The PID the process knows itself by: last field of "NSpid:"
+    std::ifstream status(proc + "/status");
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "NSpid:") != 0) continue;
+        std::istringstream in(line.substr(6));
+        int id;
+        while (in >> id) p.nspid = id;
+    }
+    return true;
+}
+
+void SymbolResolver::load_perfmap(int pid, Process& proc) {
+    proc.perfmap_loaded = true;
+    if (proc.nspid == -1) return;
+    // "<start hex> <size hex> <name>" per line; later lines win for reused addresses
+    std::ifstream in("/proc/" + std::to_string(pid) + "/root/tmp/perf-" + std::to_string(proc.nspid) + ".map");
+    std::string line;
+    while (std::getline(in, line)) {
+        char* end;
+        uint64_t start = strtoull(line.c_str(), &end, 16);
+        if (*end != ' ') continue;
+        uint64_t size = strtoull(end + 1, &end, 16);
+        if (*end != ' ') continue;
+        proc.jit.push_back({start, size, std::string(end + 1)});
+    }
+    std::stable_sort(proc.jit.begin(), proc.jit.end(), [](const JitSymbol& a, const JitSymbol& b) { return a.start < b.start; });
+}
+
+std::string SymbolResolver::resolve(int pid, uint64_t ip, bool caller) {
+    auto pit = procs_.find(pid);
+    if (pit == procs_.end()) return "[unknown]";
+    Process& proc = pit->second;
+    uint64_t addr = caller ? ip - 1 : ip;
+
+    auto mit = std::upper_bound(proc.maps.begin(), proc.maps.end(), addr,
+                                [](uint64_t a, const Mapping& m) { return a < m.start; });
+    const Mapping* m = (mit != proc.maps.begin() && addr < std::prev(mit)->end) ? &*std::prev(mit) : nullptr;
+
+    if (m && m->elf) {
+        // Runtime address -> file offset -> link-time address
+        uint64_t file_off = addr - m->start + m->offset;
+        for (const ElfFile::Load& load : m->elf->loads) {
+            if (file_off < load.offset || file_off >= load.offset + load.filesz) continue;
+            uint64_t vaddr = file_off - load.offset + load.vaddr;
+            auto& syms = m->elf->symbols;
+            auto sit = std::upper_bound(syms.begin(), syms.end(), vaddr,
+                                        [](uint64_t a, const ElfFile::Symbol& s) { return a < s.addr; });
+            if (sit == syms.begin()) break;
+            ElfFile::Symbol& sym = *std::prev(sit);
+            if (sym.size != 0 && vaddr >= sym.addr + sym.size) break;
+            if (!sym.demangled) {
+                int rc = 0;
+                char* d = abi::__cxa_demangle(sym.name.c_str(), nullptr, nullptr, &rc);
+                if (rc == 0 && d) sym.name = d;
+                free(d);
+                sym.demangled = true;
+            }
+            return sym.name;
+        }
+        return "[" + m->elf->name + "]";
+    }
+    if (m && !m->path.empty() && m->path[0] == '/') return "[" + basename_of(m->path) + "]";
+
+    // Anonymous executable memory: JIT code
+    if (!proc.perfmap_loaded) load_perfmap(pid, proc);
+    auto jit = std::upper_bound(proc.jit.begin(), proc.jit.end(), addr,
+                                [](uint64_t a, const JitSymbol& s) { return a < s.start; });
+    if (jit != proc.jit.begin() && addr < std::prev(jit)->start + std::prev(jit)->size) return std::prev(jit)->name;
+    return "[unknown]";
+}
+
+void SymbolResolver::load_kallsyms() {
+    kallsyms_loaded_ = true;
+    std::ifstream in("/proc/kallsyms");
+    std::string line;
+    while (std::getline(in, line)) {
+        char* end;
+        uint64_t addr = strtoull(line.c_str(), &end, 16);
+        // "<addr> <type> <name>[\t[module]]": text symbols only
+        if (addr == 0 || end[0] != ' ' || end[1] == '\0' || !strchr("tTwW", end[1]) || end[2] != ' ') continue;
+        std::string name = end + 3;
+        size_t tab = name.find('\t');
+        if (tab != std::string::npos) name.erase(tab);
+        kallsyms_.emplace_back(addr, name);
+    }
+    std::sort(kallsyms_.begin(), kallsyms_.end());
+}
+
+std::string SymbolResolver::resolve_kernel(uint64_t ip) {
+    if (!kallsyms_loaded_) load_kallsyms();
+    auto it = std::upper_bound(kallsyms_.begin(), kallsyms_.end(), std::make_pair(ip, std::string()));
+    // Addresses hidden (kptr_restrict) leave the table empty
+    if (it == kallsyms_.begin()) return "[kernel]_[k]";
+    return std::prev(it)->second + "_[k]"; // "_[k]": kernel frame, colored as such by flamegraph.pl
+}
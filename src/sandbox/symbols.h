@@ -0,0 +1,73 @@
+// neoshell/src/sandbox/symbols.h
+#ifndef NSI_SANDBOX_SYMBOLS_H
+#define NSI_SANDBOX_SYMBOLS_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+
+// Address -> function name, for `nsi-sandbox profile`.
+//
+// Addresses are resolved the way the process sees its files: mappings come
+// from /proc/<pid>/maps and the files are opened through /proc/<pid>/root,
+// so a container's binaries resolve without being installed on the host.
+// ELF function symbols come from .symtab, or .dynsym for stripped files.
+//
+// Code without a file behind it (JIT) is looked up in the process's perf
+// map, /tmp/perf-<pid>.map in its own root and PID namespace, as written by
+// `node --perf-basic-prof` and other JIT runtimes.
+//
+// Kernel addresses resolve through /proc/kallsyms when it shows addresses.
+
+class SymbolResolver {
+public:
+    SymbolResolver();
+    ~SymbolResolver();
+
+    // Takes a snapshot of pid's mappings and loads the symbols of its
+    // executable files. Call while the process is alive. False if it is gone.
+    bool add_process(int pid);
+    bool has_process(int pid) const { return procs_.count(pid) != 0; }
+
+    // Function name, "[file]" when the file has no symbol for it, or "[unknown]".
+    // caller: ip is a return address (every frame but the innermost), so the
+    // call instruction is just before it.
+    std::string resolve(int pid, uint64_t ip, bool caller);
+    std::string resolve_kernel(uint64_t ip);
+
+private:
+    struct ElfFile;
+    struct Mapping {
+        uint64_t start, end, offset;
+        std::string path;   // As the process sees it; empty for anonymous memory
+        ElfFile* elf;       // nullptr if not an ELF file we could read
+    };
+    struct JitSymbol {
+        uint64_t start, size;
+        std::string name;
+    };
+    struct Process {
+        std::vector<Mapping> maps; // Sorted by start
+        int nspid = -1;            // PID in its own namespace (names its perf map)
+        bool perfmap_loaded = false;
+        std::vector<JitSymbol> jit;
+    };
+
+    // Reads the function symbols of a mapped 64-bit ELF image. Every offset
+    // is checked against size: the file comes from the container.
+    static bool parse_elf(const unsigned char* p, size_t size, ElfFile& elf);
+    ElfFile* load_elf(int pid, const std::string& path);
+    void load_perfmap(int pid, Process& proc);
+    void load_kallsyms();
+
+    std::map<int, Process> procs_;
+    std::map<std::pair<dev_t, ino_t>, std::unique_ptr<ElfFile>> files_;
+    bool kallsyms_loaded_ = false;
+    std::vector<std::pair<uint64_t, std::string>> kallsyms_; // Sorted by address
+};
+
+#endif // NSI_SANDBOX_SYMBOLS_H
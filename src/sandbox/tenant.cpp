@@ -0,0 +1,68 @@
+// neoshell/src/sandbox/tenant.cpp
+#include "tenant.h"
+#include "holder.h"
+#include "utils.h"
+
+#include <climits>
+#include <unistd.h>
+#include <fcntl.h>        // For open
+#include <sched.h>        // For unshare, setns, CLONE_NEWUSER
+
+static const HolderKind TENANT = {"tenants", "tenant", "holder", "nsi-tenant"};
+
+int tenant_inherited_fd(const std::string& tenant) {
+    if (tenant.compare(0, 8, "/dev/fd/") != 0 || tenant.size() == 8) return -1;
+    char* end;
+    long n = strtol(tenant.c_str() + 8, &end, 10);
+    return *end == '\0' && n >= 0 && n <= INT_MAX ? (int)n : -1;
+}
+
+void tenant_join(const std::string& tenant) {
+    int fd = tenant_inherited_fd(tenant);
+    int pid = -1;
+    if (fd == -1) {
+        // The holder's namespace is opened before its start time is checked,
+        // so a PID reused in between cannot hand us a stranger's namespace
+        unsigned long long started = 0, now_started = 0;
+        errno = 0;
+        if (holder_state(TENANT, tenant, pid, started)) {
+            fd = open(("/proc/" + std::to_string(pid) + "/ns/user").c_str(), O_RDONLY | O_CLOEXEC);
+        }
+        if (fd == -1 || !proc_start_ticks(pid, now_started) || now_started != started) {
+            errno = 0;
+            die(("No running tenant named " + tenant + " (create it with: nsi-sandbox tenant create " + tenant + ")").c_str());
+        }
+    }
+    errno = 0;
+    if (setns(fd, CLONE_NEWUSER) == -1) die(("setns into the user namespace of tenant " + tenant + " failed").c_str());
+    close(fd); // An inherited one too: the app has no use for it
+    if (pid == -1) {
+        log_msg(("-> Joined the user namespace on " + tenant + ".").c_str());
+    } else {
+        log_msg(("-> Joined the user namespace of tenant " + tenant + " (holder PID " + std::to_string(pid) + ").").c_str());
+    }
+}
+
+// The holder process's setup: creates the user namespace, mapped like a container's.
+static void tenant_holder() {
+    uid_t host_uid = getuid();
+    gid_t host_gid = getgid();
+    errno = 0;
+    if (unshare(CLONE_NEWUSER) == -1) die("unshare CLONE_NEWUSER failed");
+    setup_user_namespace_mappings(host_uid, host_gid);
+}
+
+int tenant_main(int argc, char* argv[]) {
+    std::string cmd = argc > 1 ? argv[1] : "";
+    if (cmd == "ls" && argc == 2) return holder_ls(TENANT);
+    if ((cmd == "create" || cmd == "rm") && argc == 3) {
+        std::string name = argv[2];
+        if (!holder_valid_name(name)) {
+            fprintf(stderr, "Invalid tenant name '%s' (letters, digits, '_', '.', '-'; at most 63)\n", name.c_str());
+            return EXIT_FAILURE;
+        }
+        return cmd == "create" ? holder_create(TENANT, name, tenant_holder) : holder_rm(TENANT, name);
+    }
+    fprintf(stderr, "Usage: nsi-sandbox tenant create <name> | rm <name> | ls\n");
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,39 @@
+// neoshell/src/sandbox/tenant.h
+#ifndef NSI_SANDBOX_TENANT_H
+#define NSI_SANDBOX_TENANT_H
+
+#include <string>
+
+// Tenants: one long-lived user namespace shared by many containers
+// (`nsi-sandbox tenant`).
+//
+// `tenant create <name>` starts a small holder process that creates a user
+// namespace, mapped like a container's, and then only holds it open.
+// Containers started with `--tenant <name>` join it with setns() in Stage 1
+// instead of creating and mapping a user namespace of their own: every
+// other namespace is still new per container. The launch skips writing
+// setgroups, uid_map and gid_map, and all of the tenant's containers have
+// the same identity, so files they leave in shared caches and volumes keep
+// owners they all agree on.
+//
+// A launcher that starts many containers can open the namespace once
+// (/proc/<holder>/ns/user, PID from `tenant ls`) and pass
+// `--tenant /dev/fd/<n>`: the join is then a single setns() on the
+// inherited descriptor, which nsi-sandbox closes before the app starts.
+// A descriptor cannot go into a launch plan (plan.h); a name can.
+//
+// The holder is a named holder process (holder.h), found through
+// <runtime_dir>/tenants/<name>, as pods are. Removing a tenant ends the holder;
+// containers still running in the namespace keep it alive until they exit.
+
+// The descriptor n of a `--tenant /dev/fd/<n>`, -1 for a tenant name.
+int tenant_inherited_fd(const std::string& tenant);
+
+// Joins the tenant's user namespace, given by name or as /dev/fd/<n>.
+// Must run before any thread exists. Dies if the tenant is not running.
+void tenant_join(const std::string& tenant);
+
+// `nsi-sandbox tenant create|rm|ls`
+int tenant_main(int argc, char* argv[]);
+
+#endif // NSI_SANDBOX_TENANT_H
@@ -0,0 +1,169 @@
+// neoshell/src/sandbox/utils.cpp
+#include "utils.h"
+
+#include <unistd.h> // For read, pread, close
+#include <fcntl.h>  // For openat
+#include <sched.h>  // For setns
+#include <sys/stat.h> // For mkdir
+
+static int g_log_fd = STDERR_FILENO;
+
+void log_init() {
+    const char* env = getenv("NSI_LOG_FD");
+    if (!env) return;
+    char* end;
+    long fd = strtol(env, &end, 10);
+    // Moved out of the way of the descriptors the app gets (fd 3.. for
+    // --listen), and closed at its execve
+    int moved = *env && *end == '\0' && fd > STDERR_FILENO && fd < 1024 ? fcntl(fd, F_DUPFD_CLOEXEC, 64) : -1;
+    if (moved != -1) {
+        close(fd);
+        g_log_fd = moved;
+    }
+    unsetenv("NSI_LOG_FD");
+}
+
+int log_fd() {
+    return g_log_fd;
+}
+
+void die(const char* msg) {
+    int saved_errno = errno; // Save errno immediately
+    if (saved_errno != 0) { // Only print strerror if errno was set by a syscall
+         dprintf(g_log_fd, "[nsi-sandbox] FATAL ERROR: %s: %s (errno %d)\n", msg, strerror(saved_errno), saved_errno);
+    } else {
+         dprintf(g_log_fd, "[nsi-sandbox] FATAL ERROR: %s\n", msg); // No syscall error to add
+    }
+    exit(EXIT_FAILURE);
+}
+
+void log_msg(const char* msg) {
+    dprintf(g_log_fd, "[nsi-sandbox] %s\n", msg);
+}
+
+bool pread_all(int fd, std::string& out) {
+    out.clear();
+    char buf[4096];
+    off_t off = 0;
+    for (;;) {
+        ssize_t n = pread(fd, buf, sizeof(buf), off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (n == 0) break;
+        out.append(buf, n);
+        off += n;
+    }
+    return true;
+}
+
+bool read_file_at(int dirfd, const char* name, std::string& out) {
+    int fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return false;
+    bool ok = pread_all(fd, out);
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return ok;
+}
+
+int container_pid(const std::string& cgroup_id) {
+    std::string procs;
+    if (!read_file_at(AT_FDCWD, (container_cgroup_path(cgroup_id) + "/cgroup.procs").c_str(), procs)) return -1;
+    int pid = atoi(procs.c_str());
+    return pid > 0 ? pid : -1;
+}
+
+bool join_ns(int pid, const char* name, int nstype) {
+    std::string path = "/proc/" + std::to_string(pid) + "/ns/" + name;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return false;
+    int rc = setns(fd, nstype);
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return rc == 0;
+}
+
+bool enter_netns(int pid) {
+    if (join_ns(pid, "net", CLONE_NEWNET)) return true;
+    if (errno != EPERM) return false;
+    return join_ns(pid, "user", CLONE_NEWUSER) && join_ns(pid, "net", CLONE_NEWNET);
+}
+
+// Writes UID/GID maps for rootless operation.
+// Maps the current host user/group to root (0) inside the container.
+// WARNING: This is sensitive to kernel configuration and permissions.
+void setup_user_namespace_mappings(uid_t host_uid, gid_t host_gid) {
+    log_msg("Setting up user namespace mappings (simplified)...");
+    int fd = -1;
+
+    // --- Deny setgroups ---
+    // REQUIRED for writing gid_map as an unprivileged user in the *parent* namespace
+    // trying to map groups in the *child* namespace. Must happen *before* writing gid_map.
+    errno = 0;
+    fd = open("/proc/self/setgroups", O_WRONLY);
+    if (fd >= 0) {
+        if (write(fd, "deny", 4) == -1) {
+            // Non-fatal warning if this fails (depends on kernel config)
+             log_msg(("Warning: Failed to write 'deny' to /proc/self/setgroups: " + std::string(strerror(errno))).c_str());
+        }
+        close(fd);
+    } else {
+         // Non-fatal warning if file doesn't exist or can't be opened
+         log_msg(("Warning: Could not open /proc/self/setgroups: " + std::string(strerror(errno))).c_str());
+    }
+
+    // --- Write UID Map ---
+    // Format: container_uid host_uid range
+    char uid_map_buf[100];
+    snprintf(uid_map_buf, sizeof(uid_map_buf), "0 %d 1", host_uid);
+    errno = 0;
+    fd = open("/proc/self/uid_map", O_WRONLY);
+    if (fd == -1) die("open /proc/self/uid_map");
+    if (write(fd, uid_map_buf, strlen(uid_map_buf)) == -1) die("write /proc/self/uid_map");
+    close(fd);
+    log_msg("-> UID map written");
+
+    // --- Write GID Map ---
+    // Format: container_gid host_gid range
+    char gid_map_buf[100];
+    snprintf(gid_map_buf, sizeof(gid_map_buf), "0 %d 1", host_gid);
+    errno = 0;
+    fd = open("/proc/self/gid_map", O_WRONLY);
+    if (fd == -1) die("open /proc/self/gid_map");
+    if (write(fd, gid_map_buf, strlen(gid_map_buf)) == -1) die("write /proc/self/gid_map");
+    close(fd);
+    log_msg("-> GID map written");
+}
+
+bool proc_start_ticks(int pid, unsigned long long& ticks, int proc_fd) {
+    std::string stat;
+    std::string path = (proc_fd == -1 ? "/proc/" : "") + std::to_string(pid) + "/stat";
+    if (!read_file_at(proc_fd == -1 ? AT_FDCWD : proc_fd, path.c_str(), stat)) return false;
+    size_t p = stat.rfind(')'); // comm may contain spaces
+    if (p == std::string::npos) return false;
+    const char* field = stat.c_str() + p + 2; // Field 3, state
+    for (int i = 3; i < 22; ++i) {
+        field = strchr(field, ' ');
+        if (!field) return false;
+        ++field;
+    }
+    ticks = strtoull(field, nullptr, 10);
+    return true;
+}
+
+std::string runtime_dir() {
+    const char* xdg = getenv("XDG_RUNTIME_DIR");
+    std::string dir = xdg && *xdg ? std::string(xdg) + "/neoshell" : "/tmp/neoshell-" + std::to_string(getuid());
+    mkdir(dir.c_str(), 0700); // EEXIST is fine; callers report real failures when they use it
+    // ...but only if it is our own private directory: in /tmp anyone could
+    // have created it first, and would then see (or plant) our state
+    struct stat st;
+    if (lstat(dir.c_str(), &st) == 0 && (!S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 07777) != 0700)) {
+        errno = 0;
+        die(("Runtime directory " + dir + " is not a directory of ours with mode 0700; remove it or set XDG_RUNTIME_DIR").c_str());
+    }
+    return dir;
+}
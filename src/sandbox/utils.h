@@ -9,5 +9,55 @@
 #include <cstdlib> // For exit
 #include <cstring> // For strerror
 #include <errno.h> // For errno
+#include <sys/types.h> // For uid_t, gid_t
 
-#endif // NSI_SANDBOX_UTILS_H
\ No newline at end of file
+// --- Basic Error Handling (utils.cpp) ---
+// Prints msg (plus strerror(errno) if errno is set) and exits with failure.
+void die(const char* msg);
+// Log messages to stderr to avoid interfering with container stdout
+void log_msg(const char* msg);
+// Where die() and log_msg() write: stderr, or the descriptor named by
+// $NSI_LOG_FD. A launcher that records the app's stderr passes one so the
+// sandbox's own lines stay apart from the app's. Call first thing in main().
+void log_init();
+int log_fd();
+
+// --- Cgroup Paths ---
+// All neoshell containers live under this parent in the unified hierarchy.
+#define NSI_CGROUP_ROOT "/sys/fs/cgroup/neoshell"
+
+inline std::string container_cgroup_path(const std::string& cgroup_id) {
+    return std::string(NSI_CGROUP_ROOT) + "/" + cgroup_id;
+}
+
+// --- Running Containers (utils.cpp) ---
+// A process of a running container, from its cgroup.procs (host PID). -1 if none.
+int container_pid(const std::string& cgroup_id);
+// Joins one namespace of pid, e.g. join_ns(pid, "net", CLONE_NEWNET). False on error.
+bool join_ns(int pid, const char* name, int nstype);
+// Joins pid's network namespace, entering its user namespace first when we
+// are not privileged over the netns (rootless containers). False on error.
+bool enter_netns(int pid);
+// Start time of pid in clock ticks since boot (/proc/<pid>/stat field 22):
+// tells a process apart from a later one that reuses its PID. proc_fd: an
+// open /proc to use instead of the path.
+bool proc_start_ticks(int pid, unsigned long long& ticks, int proc_fd = -1);
+
+// --- User Namespace (utils.cpp) ---
+// Writes UID/GID maps for rootless operation, right after unshare(CLONE_NEWUSER):
+// the host user/group becomes root (0) inside. Takes the host IDs from the
+// caller: getuid() in the new, still unmapped namespace is the overflow ID.
+void setup_user_namespace_mappings(uid_t host_uid, gid_t host_gid);
+
+// --- Runtime State (utils.cpp) ---
+// Per-user directory for runtime state ($XDG_RUNTIME_DIR/neoshell, else
+// /tmp/neoshell-<uid>), created on first use.
+std::string runtime_dir();
+
+// --- Small File Helpers (utils.cpp) ---
+// Reads a whole (small) file relative to dirfd into out. Returns false on error (errno set).
+bool read_file_at(int dirfd, const char* name, std::string& out);
+// Re-reads an already open file from offset 0 (works for /proc and cgroup files).
+bool pread_all(int fd, std::string& out);
+
+#endif // NSI_SANDBOX_UTILS_H
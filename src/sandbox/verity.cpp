@@ -0,0 +1,167 @@
+// neoshell/src/sandbox/verity.cpp
+#include "verity.h"
+#include "utils.h"
+
+#include <fstream>
+#include <set>
+#include <utility>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fsverity.h>
+
+// Parameters must match the digests computed by `nsi build` (build.js).
+static const unsigned VERITY_BLOCK_SIZE = 4096;
+static const unsigned VERITY_DIGEST_SIZE = 32; // SHA-256
+
+static std::string to_hex(const unsigned char* p, size_t n) {
+    static const char digits[] = "0123456789abcdef";
+    std::string s(n * 2, '0');
+    for (size_t i = 0; i < n; ++i) {
+        s[2 * i] = digits[p[i] >> 4];
+        s[2 * i + 1] = digits[p[i] & 0xf];
+    }
+    return s;
+}
+
+static bool is_unsupported(int err) {
+    // EOPNOTSUPP: fs lacks the feature; ENOTTY: fs doesn't know the ioctl at all
+    return err == EOPNOTSUPP || err == ENOTTY;
+}
+
+// Enables fs-verity on an open file. Already-sealed files are fine.
+static bool enable_verity(int fd) {
+    struct fsverity_enable_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.version = 1;
+    arg.hash_algorithm = FS_VERITY_HASH_ALG_SHA256;
+    arg.block_size = VERITY_BLOCK_SIZE;
+    if (ioctl(fd, FS_IOC_ENABLE_VERITY, &arg) == -1 && errno != EEXIST) return false;
+    return true;
+}
+
+// Asks the kernel for the file's fs-verity digest (no data is read).
+static bool measure_verity(int fd, std::string& hex) {
+    // struct fsverity_digest ends in a flexible array; give it room for any algorithm
+    alignas(struct fsverity_digest) unsigned char buf[sizeof(struct fsverity_digest) + 64];
+    struct fsverity_digest* d = reinterpret_cast<struct fsverity_digest*>(buf);
+    d->digest_size = 64;
+    if (ioctl(fd, FS_IOC_MEASURE_VERITY, d) == -1) return false;
+    if (d->digest_algorithm != FS_VERITY_HASH_ALG_SHA256 || d->digest_size != VERITY_DIGEST_SIZE) {
+        errno = EINVAL;
+        return false;
+    }
+    hex = to_hex(d->digest, d->digest_size);
+    return true;
+}
+
+// Files of the image: manifest paths, and their inodes (hard links in the
+// image are separate paths to one sealed inode)
+struct Listed {
+    std::set<std::string> paths;
+    std::set<std::pair<dev_t, ino_t>> inodes;
+};
+
+// Counts regular files under dir_fd (rel is its path) that the manifest
+// does not list: added to a kept tree after it was sealed, they would be
+// launched unverified.
+static size_t count_unlisted(int dir_fd, const std::string& rel, const Listed& listed) {
+    DIR* d = fdopendir(dir_fd);
+    if (!d) {
+        close(dir_fd);
+        log_msg(("Verity: cannot list " + (rel.empty() ? "/" : rel) + ": " + std::string(strerror(errno))).c_str());
+        return 1;
+    }
+    size_t unlisted = 0;
+    while (struct dirent* e = readdir(d)) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        std::string path = rel.empty() ? e->d_name : rel + "/" + e->d_name;
+        struct stat st;
+        if (fstatat(dirfd(d), e->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+            log_msg(("Verity: cannot stat " + path + ": " + std::string(strerror(errno))).c_str());
+            ++unlisted;
+        } else if (S_ISDIR(st.st_mode)) {
+            int sub = openat(dirfd(d), e->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            unlisted += sub == -1 ? 1 : count_unlisted(sub, path, listed);
+        } else if (S_ISREG(st.st_mode) && !listed.paths.count(path) &&
+                   !listed.inodes.count(std::make_pair(st.st_dev, st.st_ino))) {
+            log_msg(("Verity: " + path + " is not part of the image").c_str());
+            ++unlisted;
+        }
+    }
+    closedir(d);
+    return unlisted;
+}
+
+int verity_main(int argc, char* argv[]) {
+    if (argc != 4 || (strcmp(argv[1], "seal") != 0 && strcmp(argv[1], "check") != 0)) {
+        fprintf(stderr, "Usage: nsi-sandbox verity seal|check <rootfs> <manifest>\n");
+        return EXIT_FAILURE;
+    }
+    const bool seal = strcmp(argv[1], "seal") == 0;
+    const std::string rootfs = argv[2];
+
+    std::ifstream manifest(argv[3]);
+    if (!manifest) die(("Could not open verity manifest: " + std::string(argv[3])).c_str());
+
+    errno = 0;
+    int root_fd = open(rootfs.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd == -1) die(("open rootfs failed: " + rootfs).c_str());
+
+    size_t checked = 0, failed = 0;
+    Listed listed;
+    std::string line;
+    while (std::getline(manifest, line)) {
+        size_t sp = line.find(' ');
+        if (line.empty() || sp == std::string::npos) continue;
+        const std::string expected = line.substr(0, sp);
+        const std::string rel = line.substr(sp + 1);
+        listed.paths.insert(rel);
+
+        // O_NOFOLLOW: a symlink swapped in for a listed file must not pass
+        errno = 0;
+        int fd = openat(root_fd, rel.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd == -1) {
+            log_msg(("Verity: cannot open " + rel + ": " + std::string(strerror(errno))).c_str());
+            ++failed;
+            continue;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0) listed.inodes.insert(std::make_pair(st.st_dev, st.st_ino));
+        std::string actual;
+        errno = 0;
+        bool ok = (!seal || enable_verity(fd)) && measure_verity(fd, actual);
+        int saved_errno = errno;
+        close(fd);
+
+        if (!ok) {
+            if (is_unsupported(saved_errno) || (seal && saved_errno == EINVAL && checked + failed == 0)) {
+                // Checked on the first file; a filesystem either supports it or not
+                log_msg(("Verity: not supported on " + rootfs + ": " + std::string(strerror(saved_errno))).c_str());
+                close(root_fd);
+                return NSI_VERITY_EXIT_UNSUPPORTED;
+            }
+            log_msg(("Verity: " + rel + (saved_errno == ENODATA ? ": not sealed" : ": " + std::string(strerror(saved_errno)))).c_str());
+            ++failed;
+            continue;
+        }
+        if (actual != expected) {
+            log_msg(("Verity: digest mismatch for " + rel).c_str());
+            ++failed;
+            continue;
+        }
+        ++checked;
+    }
+    // A sealed tree is complete too: nothing was added next to its files
+    if (!seal) {
+        int dir_fd = openat(root_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        failed += dir_fd == -1 ? 1 : count_unlisted(dir_fd, "", listed);
+    }
+    close(root_fd);
+
+    log_msg(("Verity: " + std::to_string(checked) + " files " + (seal ? "sealed" : "verified") +
+             (failed ? ", " + std::to_string(failed) + " FAILED" : "")).c_str());
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,26 @@
+// neoshell/src/sandbox/verity.h
+#ifndef NSI_SANDBOX_VERITY_H
+#define NSI_SANDBOX_VERITY_H
+
+// `nsi-sandbox verity seal|check <rootfs> <manifest>`
+//
+// Works on an extracted image that is kept for reuse. The manifest lists one
+// regular file per line as "<sha256 fs-verity digest hex> <relative path>",
+// exactly as recorded by `nsi build`.
+//
+//   seal:  enables fs-verity on every listed file (idempotent), then checks
+//          the kernel-measured digest against the manifest.
+//   check: only measures; every file must already be sealed and match, and
+//          the tree must hold no regular file the manifest does not list.
+//
+// Once sealed, the kernel verifies each page against the Merkle tree when it
+// is read, so a cached rootfs can be launched without hashing it up front.
+//
+// Exit status: 0 all files match, 1 mismatch or error, 2 the filesystem does
+// not support fs-verity (caller should fall back to a full payload hash).
+
+#define NSI_VERITY_EXIT_UNSUPPORTED 2
+
+int verity_main(int argc, char* argv[]);
+
+#endif // NSI_SANDBOX_VERITY_H
@@ -0,0 +1,161 @@
+// neoshell/src/waiter/nsi-waiter.c
+// Resident waiter for one container.
+//
+// nsi-sandbox's parent process has nothing left to do after forking the
+// container except wait for it, so it execs this program in place (same
+// PID, same children). Linked statically against libc only, it keeps a
+// handful of pages resident instead of libstdc++, the parsed arguments and
+// the rest of nsi-sandbox's address space.
+//
+// Usage (internal): nsi-waiter [-s <state-fd>] <container-pid> [<helper-pid>...]
+// Helpers (log forwarder, metrics recorder, nsi-net, nsi-listen) finish
+// after the container and are waited for too. Exits with the container's status
+// (128 + signal if it was killed).
+//
+// With -s, the container's state file (see src/sandbox/state.h) is kept
+// mapped, with the descriptors it names; the exit status is stored in it
+// for `nsi-sandbox adopt`, in case our launcher is no longer there to
+// receive it.
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../sandbox/state.h"
+
+static void say(const char* a, long n, const char* b) {
+    char buf[160];
+    char num[24];
+    size_t len = 0;
+    int i = sizeof(num);
+    unsigned long v = n < 0 ? -(unsigned long)n : (unsigned long)n;
+    do {
+        num[--i] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    if (n < 0) num[--i] = '-';
+    const char* parts[] = {"[nsi-sandbox] ", a, NULL, b, "\n"};
+    for (int p = 0; p < 5; ++p) {
+        const char* s = parts[p] ? parts[p] : num + i;
+        size_t l = parts[p] ? strlen(s) : sizeof(num) - i;
+        if (len + l > sizeof(buf)) l = sizeof(buf) - len;
+        memcpy(buf + len, s, l);
+        len += l;
+    }
+    ssize_t rc = write(STDERR_FILENO, buf, len);
+    (void)rc;
+}
+
+static pid_t parse_pid(const char* s) {
+    char* end;
+    long v = strtol(s, &end, 10);
+    return (*s && !*end && v > 0) ? (pid_t)v : -1;
+}
+
+// Closes descriptors lo..hi. Kernels before 5.9 have no close_range: there
+// the open ones are looked up in /proc, or tried one by one without it.
+static void close_fds(unsigned int lo, unsigned int hi) {
+    if (syscall(SYS_close_range, lo, hi, 0U) == 0) return;
+    DIR* d = opendir("/proc/self/fd");
+    if (d) {
+        struct dirent* e;
+        while ((e = readdir(d)) != NULL) {
+            char* end;
+            long fd = strtol(e->d_name, &end, 10);
+            if (*end || end == e->d_name || fd == dirfd(d)) continue;
+            if (fd >= (long)lo && fd <= (long)hi) close((int)fd);
+        }
+        closedir(d);
+        return;
+    }
+    long max = sysconf(_SC_OPEN_MAX);
+    if (max < 0 || (unsigned long)max > (unsigned long)hi + 1) max = (long)hi + 1;
+    for (long fd = lo; fd < max; ++fd) close((int)fd);
+}
+
+// Closes every descriptor from 3 up except those in keep (ascending, -1 for none).
+static void close_others(const int* keep, int n) {
+    unsigned int next = 3;
+    for (int i = 0; i < n; ++i) {
+        if (keep[i] < (int)next) continue;
+        if ((unsigned int)keep[i] > next) close_fds(next, (unsigned int)keep[i] - 1);
+        next = keep[i] + 1;
+    }
+    close_fds(next, ~0U);
+}
+
+static void sort_fds(int* fds, int n) {
+    for (int i = 1; i < n; ++i) {
+        for (int j = i; j > 0 && fds[j - 1] > fds[j]; --j) {
+            int t = fds[j];
+            fds[j] = fds[j - 1];
+            fds[j - 1] = t;
+        }
+    }
+}
+
+static int wait_for(pid_t pid, int* status) {
+    int rc;
+    while ((rc = waitpid(pid, status, 0)) == -1 && errno == EINTR) {
+    }
+    return rc;
+}
+
+int main(int argc, char* argv[]) {
+    int state_fd = -1;
+    if (argc > 2 && strcmp(argv[1], "-s") == 0) {
+        state_fd = parse_pid(argv[2]);
+        argc -= 2;
+        argv += 2;
+    }
+    pid_t child = argc > 1 ? parse_pid(argv[1]) : -1;
+    int bad = child == -1;
+    for (int i = 2; i < argc; ++i) bad |= parse_pid(argv[i]) == -1;
+    if (bad) {
+        say("nsi-waiter: usage: nsi-waiter [-s <state-fd>] <container-pid> [<helper-pid>...], got ", argc - 1, " args");
+        return EXIT_FAILURE;
+    }
+    signal(SIGPIPE, SIG_IGN); // A launcher that is gone must not take the status with it
+
+    struct nsi_state* st = NULL;
+    if (state_fd != -1) {
+        void* map = mmap(NULL, sizeof(*st), PROT_READ | PROT_WRITE, MAP_SHARED, state_fd, 0);
+        if (map != MAP_FAILED && ((struct nsi_state*)map)->magic == NSI_STATE_MAGIC) st = map;
+    }
+    // Don't pin anything else nsi-sandbox left open (pipes, namespace fds)
+    int keep[4] = {-1, -1, -1, -1};
+    if (st) {
+        keep[0] = state_fd;
+        keep[1] = st->dir_fd;
+        keep[2] = st->out_fd;
+        keep[3] = st->err_fd;
+        sort_fds(keep, 4);
+    }
+    close_others(keep, 4);
+
+    int status;
+    if (wait_for(child, &status) == -1) {
+        say("Parent: waitpid failed, errno ", errno, "");
+        return EXIT_FAILURE;
+    }
+    int code = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+    if (st) {
+        __atomic_store_n(&st->exit_code, code, __ATOMIC_RELEASE);
+        // Without readers left the pipes break, and writers get EPIPE, not stuck
+        if (st->out_fd != -1) close(st->out_fd);
+        if (st->err_fd != -1 && st->err_fd != st->out_fd) close(st->err_fd);
+        // Our launcher gets the status from us; an orphan's waits for its adopter
+        if (getppid() == st->launcher_pid) unlinkat(st->dir_fd, st->id, 0);
+    }
+    say("Parent: Child exited with status ", code, "");
+    // Let the forwarder drain the last lines, and the recorder take its last
+    // sample, before we report the exit
+    for (int i = 2; i < argc; ++i) wait_for(parse_pid(argv[i]), &status);
+    return code;
+}
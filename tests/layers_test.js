@@ -0,0 +1,122 @@
+// neoshell/tests/layers_test.js
+// applyLayer (src/cli/utils/layers.js) on layer tars built in memory.
+//
+//   symlink_escape  Layer 1 makes "evil" a symlink out of the rootfs; layer
+//                   2 then has a directory, a file and a hard link under or
+//                   through it. Nothing may be created or linked outside,
+//                   and layerView (the fs-verity file list) must agree.
+//   plain           Nested directories and files of a normal layer.
+//   whiteout        A .wh. entry removes a lower layer's file.
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const { Readable } = require('stream');
+const tarStream = require('tar-stream');
+const { applyLayer, layerView } = require('../src/cli/utils/layers');
+
+let failures = 0;
+
+function check(cond, message) {
+    if (!cond) {
+        console.error(`FAIL ${message}`);
+        failures++;
+    }
+}
+
+// A layer tar of entries: { name, type, data?, linkname? }
+function layerTar(entries) {
+    return new Promise((resolve, reject) => {
+        const pack = tarStream.pack();
+        const chunks = [];
+        pack.on('data', (c) => chunks.push(c));
+        pack.on('end', () => resolve(Buffer.concat(chunks)));
+        pack.on('error', reject);
+        for (const { data, ...header } of entries) pack.entry({ mode: header.type === 'directory' ? 0o755 : 0o644, ...header }, data);
+        pack.finalize();
+    });
+}
+
+async function apply(root, entries) {
+    const tar = await layerTar(entries);
+    await applyLayer({ open: () => Readable.from([tar]), digest: null }, root);
+}
+
+async function symlinkEscape(tmp) {
+    const root = path.join(tmp, 'escape-root');
+    const outside = path.join(tmp, 'outside');
+    fs.mkdirSync(root);
+    fs.mkdirSync(outside);
+    fs.writeFileSync(path.join(outside, 'secret'), 'host file\n');
+
+    const layers = [
+        [{ name: 'evil', type: 'symlink', linkname: outside }],
+        [
+            { name: 'evil/.ssh/', type: 'directory' },
+            { name: 'evil/.ssh/authorized_keys', type: 'file', data: 'ssh-ed25519 AAAA\n' },
+            { name: 'evil/planted', type: 'file', data: 'x\n' },
+            { name: 'stolen', type: 'link', linkname: 'evil/secret' },
+        ],
+    ];
+    const view = layerView();
+    for (const entries of layers) {
+        await apply(root, entries);
+        await view.add(Readable.from([await layerTar(entries)]));
+    }
+    check(!fs.existsSync(path.join(outside, '.ssh')), 'symlink_escape: directory created outside the rootfs');
+    check(!fs.existsSync(path.join(outside, 'planted')), 'symlink_escape: file written outside the rootfs');
+    check(!fs.existsSync(path.join(root, 'stolen')), 'symlink_escape: hard link to a file outside the rootfs');
+    check(fs.readFileSync(path.join(outside, 'secret'), 'utf8') === 'host file\n', 'symlink_escape: file outside changed');
+    check(fs.lstatSync(path.join(root, 'evil')).isSymbolicLink(), 'symlink_escape: the symlink itself is kept');
+    check(Object.keys(view.files).length === 0, `symlink_escape: view lists ${Object.keys(view.files).join(', ')}`);
+    check([...view.entries.keys()].join() === 'evil', `symlink_escape: view has ${[...view.entries.keys()].join(', ')}`);
+}
+
+async function plain(tmp) {
+    const root = path.join(tmp, 'plain-root');
+    fs.mkdirSync(root);
+    await apply(root, [
+        { name: 'usr/', type: 'directory' },
+        { name: 'usr/lib/', type: 'directory' },
+        { name: 'usr/lib/libc.so', type: 'file', data: 'libc\n' },
+        { name: 'usr/lib/libc.so.6', type: 'symlink', linkname: 'libc.so' },
+        { name: 'usr/lib/hard', type: 'link', linkname: 'usr/lib/libc.so' },
+    ]);
+    check(fs.readFileSync(path.join(root, 'usr/lib/libc.so'), 'utf8') === 'libc\n', 'plain: file content');
+    check(fs.readlinkSync(path.join(root, 'usr/lib/libc.so.6')) === 'libc.so', 'plain: symlink target');
+    check(fs.statSync(path.join(root, 'usr/lib/hard')).ino === fs.statSync(path.join(root, 'usr/lib/libc.so')).ino, 'plain: hard link');
+}
+
+async function whiteout(tmp) {
+    const root = path.join(tmp, 'whiteout-root');
+    fs.mkdirSync(root);
+    await apply(root, [
+        { name: 'etc/', type: 'directory' },
+        { name: 'etc/a', type: 'file', data: 'a\n' },
+        { name: 'etc/b', type: 'file', data: 'b\n' },
+    ]);
+    await apply(root, [{ name: 'etc/.wh.a', type: 'file', data: '' }]);
+    check(!fs.existsSync(path.join(root, 'etc/a')), 'whiteout: file not removed');
+    check(fs.existsSync(path.join(root, 'etc/b')), 'whiteout: sibling removed');
+    check(!fs.existsSync(path.join(root, 'etc/.wh.a')), 'whiteout: marker extracted');
+}
+
+async function main() {
+    const tmp = fs.mkdtempSync(path.join(os.tmpdir(), 'nsi-layers-test-'));
+    try {
+        await symlinkEscape(tmp);
+        await plain(tmp);
+        await whiteout(tmp);
+    } finally {
+        fs.rmSync(tmp, { recursive: true, force: true });
+    }
+    if (failures) {
+        console.error(`${failures} check(s) failed`);
+        process.exit(1);
+    }
+    console.log('layers: ok');
+}
+
+main().catch((err) => {
+    console.error(err);
+    process.exit(1);
+});
@@ -0,0 +1,239 @@
+// neoshell/tests/netstack_test.cpp
+// nsi-net against a local service, without a tap device or namespaces.
+//
+// nsi-net only reads and writes whole Ethernet frames on the descriptor it
+// is handed, so one end of a SOCK_SEQPACKET socketpair can stand in for the
+// tap: this test plays the container on the other end.
+//
+//   retransmit_limit  Many connections to a 127.0.0.1 listener (10.0.2.2)
+//                     whose SYN-ACKs are never acknowledged, so their timers
+//                     fire in the same ticks until MAX_RETRIES: each must end
+//                     in one RST to the container, and nsi-net must still
+//                     answer afterwards. (~45s: the retransmit backoff.)
+#include "netstack.h"
+#include "utils.h"
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+#include <netinet/if_ether.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+static const uint32_t GUEST_ADDR = 0x0a000264;   // 10.0.2.100
+static const uint32_t GATEWAY_ADDR = 0x0a000202; // 10.0.2.2: the host's loopback
+static const uint8_t GUEST_MAC[ETH_ALEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x64};
+static const int CONNECTIONS = 32;
+static const int MAX_RETRIES = 8;                // As in netstack.cpp
+static const int TIMEOUT_S = 90;
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                   \
+    do {                                                   \
+        if (!(cond)) {                                     \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__);                  \
+            fputc('\n', stderr);                           \
+            ++failures;                                    \
+        }                                                  \
+    } while (0)
+
+// The fake container: its end of the "tap", and nsi-net behind it
+struct Wire {
+    NetStack ns;
+    int tap = -1;
+    pid_t watched = -1;
+};
+
+static void send_fd(int sock, int fd) {
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    memset(cbuf, 0, sizeof(cbuf));
+    char byte = 'T';
+    struct iovec iov = {&byte, 1};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    if (sendmsg(sock, &msg, MSG_NOSIGNAL) != 1) die("handing the fake tap to nsi-net failed");
+}
+
+// Starts nsi-net as netstack_attach() would, with a socketpair for the tap.
+static void wire_up(Wire& w) {
+    netstack_start(w.ns);
+    int sv[2];
+    errno = 0;
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sv) == -1) die("socketpair failed");
+    send_fd(w.ns.sock, sv[1]);
+    close(sv[1]);
+    w.tap = sv[0];
+    // nsi-net runs until this process exits
+    w.watched = fork();
+    if (w.watched == 0) {
+        pause();
+        _exit(EXIT_SUCCESS);
+    }
+    netstack_watch(w.ns, w.watched);
+}
+
+static void wire_down(Wire& w) {
+    kill(w.watched, SIGKILL);
+    waitpid(w.watched, NULL, 0);
+    int status = 0;
+    waitpid(w.ns.pid, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0, "nsi-net ended with status 0x%x", status);
+    close(w.tap);
+}
+
+// Ethernet + IPv4 headers; returns where the L4 header goes. nsi-net does
+// not verify checksums, so none are filled in.
+static uint8_t* guest_frame(uint8_t* frame, uint8_t proto, uint32_t dst, size_t l4_len) {
+    struct ether_header* eth = reinterpret_cast<struct ether_header*>(frame);
+    memset(eth->ether_dhost, 0xff, ETH_ALEN);
+    memcpy(eth->ether_shost, GUEST_MAC, ETH_ALEN);
+    eth->ether_type = htons(ETHERTYPE_IP);
+    struct iphdr* ip = reinterpret_cast<struct iphdr*>(frame + ETH_HLEN);
+    memset(ip, 0, sizeof(*ip));
+    ip->version = 4;
+    ip->ihl = sizeof(*ip) / 4;
+    ip->ttl = 64;
+    ip->protocol = proto;
+    ip->tot_len = htons(sizeof(*ip) + l4_len);
+    ip->saddr = htonl(GUEST_ADDR);
+    ip->daddr = htonl(dst);
+    return frame + ETH_HLEN + sizeof(*ip);
+}
+
+static void send_syn(Wire& w, uint16_t sport, uint16_t dport) {
+    uint8_t frame[ETH_HLEN + sizeof(struct iphdr) + sizeof(struct tcphdr)];
+    struct tcphdr* th = reinterpret_cast<struct tcphdr*>(guest_frame(frame, IPPROTO_TCP, GATEWAY_ADDR, sizeof(struct tcphdr)));
+    memset(th, 0, sizeof(*th));
+    th->th_sport = htons(sport);
+    th->th_dport = htons(dport);
+    th->th_seq = htonl(1000);
+    th->th_off = sizeof(*th) / 4;
+    th->th_flags = TH_SYN;
+    th->th_win = htons(65535);
+    if (write(w.tap, frame, sizeof(frame)) != (ssize_t)sizeof(frame)) die("writing a SYN to nsi-net failed");
+}
+
+// Asks for the gateway's MAC; true once nsi-net answers.
+static bool arp_answered(Wire& w) {
+    uint8_t frame[ETH_HLEN + sizeof(struct ether_arp)];
+    struct ether_header* eth = reinterpret_cast<struct ether_header*>(frame);
+    memset(eth->ether_dhost, 0xff, ETH_ALEN);
+    memcpy(eth->ether_shost, GUEST_MAC, ETH_ALEN);
+    eth->ether_type = htons(ETHERTYPE_ARP);
+    struct ether_arp* req = reinterpret_cast<struct ether_arp*>(frame + ETH_HLEN);
+    memset(req, 0, sizeof(*req));
+    req->ea_hdr.ar_hrd = htons(ARPHRD_ETHER);
+    req->ea_hdr.ar_pro = htons(ETHERTYPE_IP);
+    req->ea_hdr.ar_hln = ETH_ALEN;
+    req->ea_hdr.ar_pln = 4;
+    req->ea_hdr.ar_op = htons(ARPOP_REQUEST);
+    uint32_t spa = htonl(GUEST_ADDR), tpa = htonl(GATEWAY_ADDR);
+    memcpy(req->arp_sha, GUEST_MAC, ETH_ALEN);
+    memcpy(req->arp_spa, &spa, 4);
+    memcpy(req->arp_tpa, &tpa, 4);
+    if (write(w.tap, frame, sizeof(frame)) != (ssize_t)sizeof(frame)) return false;
+
+    uint8_t reply[2048];
+    for (int i = 0; i < 20; ++i) {
+        struct pollfd pfd = {w.tap, POLLIN, 0};
+        if (poll(&pfd, 1, 100) != 1) continue;
+        ssize_t n = read(w.tap, reply, sizeof(reply));
+        if (n >= (ssize_t)sizeof(frame) &&
+            ntohs(reinterpret_cast<struct ether_header*>(reply)->ether_type) == ETHERTYPE_ARP &&
+            ntohs(reinterpret_cast<struct ether_arp*>(reply + ETH_HLEN)->ea_hdr.ar_op) == ARPOP_REPLY) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Per connection (container port): what nsi-net sent it
+struct Seen {
+    int syn_acks = 0;
+    int resets = 0;
+};
+
+static void retransmit_limit() {
+    // The local service: connects complete in its backlog, nobody accepts
+    int srv = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    errno = 0;
+    if (srv == -1 || bind(srv, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1 ||
+        listen(srv, CONNECTIONS * 2) == -1 || getsockname(srv, reinterpret_cast<struct sockaddr*>(&addr), &len) == -1) {
+        die("listening on 127.0.0.1 failed");
+    }
+    uint16_t port = ntohs(addr.sin_port);
+
+    Wire w;
+    wire_up(w);
+    std::map<uint16_t, Seen> seen;
+    for (int i = 0; i < CONNECTIONS; ++i) {
+        uint16_t sport = 40000 + i;
+        seen[sport] = Seen();
+        send_syn(w, sport, port);
+    }
+
+    // Never acknowledge: read until every connection was reset (or we give up)
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(TIMEOUT_S);
+    int reset = 0;
+    uint8_t frame[ETH_HLEN + 65536];
+    while (reset < CONNECTIONS && std::chrono::steady_clock::now() < deadline) {
+        struct pollfd pfd = {w.tap, POLLIN, 0};
+        if (poll(&pfd, 1, 1000) != 1) continue;
+        ssize_t n = read(w.tap, frame, sizeof(frame));
+        if (n < (ssize_t)(ETH_HLEN + sizeof(struct iphdr) + sizeof(struct tcphdr))) continue;
+        const struct iphdr* ip = reinterpret_cast<const struct iphdr*>(frame + ETH_HLEN);
+        if (ip->protocol != IPPROTO_TCP) continue;
+        const struct tcphdr* th = reinterpret_cast<const struct tcphdr*>(frame + ETH_HLEN + ip->ihl * 4);
+        auto it = seen.find(ntohs(th->th_dport));
+        CHECK(it != seen.end(), "segment for unknown port %u", ntohs(th->th_dport));
+        if (it == seen.end()) continue;
+        if ((th->th_flags & (TH_SYN | TH_ACK)) == (TH_SYN | TH_ACK)) ++it->second.syn_acks;
+        if (th->th_flags & TH_RST) {
+            if (it->second.resets++ == 0) ++reset;
+        }
+    }
+
+    CHECK(reset == CONNECTIONS, "%d of %d connections reset within %ds", reset, CONNECTIONS, TIMEOUT_S);
+    for (const auto& [sport, s] : seen) {
+        CHECK(s.resets == 1, "port %u: %d resets", sport, s.resets);
+        CHECK(s.syn_acks == MAX_RETRIES + 1, "port %u: %d SYN-ACKs (first + %d retransmits expected)",
+              sport, s.syn_acks, MAX_RETRIES);
+    }
+    CHECK(arp_answered(w), "nsi-net stopped answering after the resets");
+    wire_down(w);
+    close(srv);
+}
+
+int main() {
+    signal(SIGPIPE, SIG_IGN);
+    retransmit_limit();
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("netstack: ok\n");
+    return EXIT_SUCCESS;
+}